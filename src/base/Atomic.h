@@ -0,0 +1,86 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_BASE_ATOMIC_H_
+#define QSFS_BASE_ATOMIC_H_
+
+#include "boost/noncopyable.hpp"
+
+namespace QS {
+
+namespace Threading {
+
+// Scalar value accessed by multiple threads without a lock
+//
+// T should be an integral type (or bool, or a pointer) no larger than a word.
+// Loads acquire and stores release, so a value published by a thread is
+// seen with everything written before it. There are no atomics in boost 1.49,
+// the gcc builtins are used instead.
+template <typename T>
+class Atomic : private boost::noncopyable {
+ public:
+  explicit Atomic(T value = T()) : m_value(value) {}
+
+ public:
+  T Load() const { return __atomic_load_n(&m_value, __ATOMIC_ACQUIRE); }
+
+  void Store(T value) { __atomic_store_n(&m_value, value, __ATOMIC_RELEASE); }
+
+  // Add delta to value
+  //
+  // @param  : delta
+  // @return : value after the addition
+  T Add(T delta) {
+    return __atomic_add_fetch(&m_value, delta, __ATOMIC_ACQ_REL);
+  }
+
+  // Subtract delta from value
+  //
+  // @param  : delta
+  // @return : value after the subtraction
+  T Sub(T delta) {
+    return __atomic_sub_fetch(&m_value, delta, __ATOMIC_ACQ_REL);
+  }
+
+  // Store desired value if the value is still the expected one
+  //
+  // @param  : expected value, desired value
+  // @return : whether the value is stored
+  bool CompareAndSwap(T expected, T desired) {
+    return __atomic_compare_exchange_n(&m_value, &expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  }
+
+  operator T() const { return Load(); }
+
+  Atomic &operator=(T value) {
+    Store(value);
+    return *this;
+  }
+
+  T operator+=(T delta) { return Add(delta); }
+  T operator-=(T delta) { return Sub(delta); }
+  T operator++() { return Add(1); }
+
+ private:
+  T m_value;
+};
+
+}  // namespace Threading
+}  // namespace QS
+
+#endif  // QSFS_BASE_ATOMIC_H_
@@ -0,0 +1,202 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include "base/Crc32c.h"
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+#include <string.h>  // for memcpy
+
+// The crc32 instruction is enabled per function, so the rest of qsfs is still
+// built for the baseline cpu and runs where SSE4.2 is not supported.
+#if defined(__x86_64__) &&                                      \
+    (defined(__clang__) ||                                      \
+     (defined(__GNUC__) &&                                      \
+      (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define QSFS_CRC32C_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+namespace QS {
+
+namespace Crc32c {
+
+namespace {
+
+// Castagnoli polynomial in reversed bit order
+const uint32_t kPoly = 0x82f63b78;
+
+// Bytes of each of the three streams computed in parallel by the crc32
+// instruction, whose latency is three cycles while one can be issued per cycle
+const size_t kStripeSize = 1024;
+
+// --------------------------------------------------------------------------
+// Multiply a and b modulo the polynomial, in reversed bit order
+uint32_t MultiplyModPoly(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) {
+        break;
+      }
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ kPoly : b >> 1;
+  }
+  return p;
+}
+
+// --------------------------------------------------------------------------
+// Return x^(8 * len) modulo the polynomial, in reversed bit order
+uint32_t ShiftFactor(size_t len) {
+  uint32_t p = 1u << 31;      // x^0
+  uint32_t power = 1u << 23;  // x^8
+  while (len > 0) {
+    if (len & 1) {
+      p = MultiplyModPoly(power, p);
+    }
+    power = MultiplyModPoly(power, power);
+    len >>= 1;
+  }
+  return p;
+}
+
+// Tables to compute the checksum
+//
+// The byte table is for the table driven implementation. The shift tables
+// advance a crc register over a stripe or two stripes of zero bytes, they are
+// used to join the registers of the streams computed in parallel.
+struct Tables {
+  uint32_t m_byte[256];
+  uint32_t m_shift1[4][256];  // over one stripe
+  uint32_t m_shift2[4][256];  // over two stripes
+
+  Tables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int k = 0; k < 8; ++k) {
+        crc = crc & 1 ? (crc >> 1) ^ kPoly : crc >> 1;
+      }
+      m_byte[i] = crc;
+    }
+    uint32_t factor1 = ShiftFactor(kStripeSize);
+    uint32_t factor2 = ShiftFactor(2 * kStripeSize);
+    for (int j = 0; j < 4; ++j) {
+      for (uint32_t i = 0; i < 256; ++i) {
+        m_shift1[j][i] = MultiplyModPoly(factor1, i << (8 * j));
+        m_shift2[j][i] = MultiplyModPoly(factor2, i << (8 * j));
+      }
+    }
+  }
+};
+
+// --------------------------------------------------------------------------
+const Tables &GetTables() {
+  static const Tables tables;
+  return tables;
+}
+
+// --------------------------------------------------------------------------
+inline uint32_t Shift(const uint32_t table[4][256], uint32_t crc) {
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+         table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+// --------------------------------------------------------------------------
+// Extend the crc register, which is the checksum not inverted
+uint32_t ExtendSoftware(uint32_t crc, const unsigned char *p, size_t len) {
+  const uint32_t *table = GetTables().m_byte;
+  for (size_t i = 0; i < len; ++i) {
+    crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef QSFS_CRC32C_SSE42
+// --------------------------------------------------------------------------
+inline uint64_t Load64(const unsigned char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+// --------------------------------------------------------------------------
+// Extend the crc register, which is the checksum not inverted
+__attribute__((target("sse4.2"))) uint32_t ExtendHardware(
+    uint32_t crc, const unsigned char *p, size_t len) {
+  uint64_t crc0 = crc;
+  // Stripes of three streams, then join them into the first one
+  if (len >= 3 * kStripeSize) {
+    const Tables &tables = GetTables();
+    do {
+      uint64_t crc1 = 0;
+      uint64_t crc2 = 0;
+      for (size_t i = 0; i < kStripeSize; i += 8) {
+        crc0 = _mm_crc32_u64(crc0, Load64(p + i));
+        crc1 = _mm_crc32_u64(crc1, Load64(p + kStripeSize + i));
+        crc2 = _mm_crc32_u64(crc2, Load64(p + 2 * kStripeSize + i));
+      }
+      crc0 = Shift(tables.m_shift2, static_cast<uint32_t>(crc0)) ^
+             Shift(tables.m_shift1, static_cast<uint32_t>(crc1)) ^ crc2;
+      p += 3 * kStripeSize;
+      len -= 3 * kStripeSize;
+    } while (len >= 3 * kStripeSize);
+  }
+  for (; len >= 8; p += 8, len -= 8) {
+    crc0 = _mm_crc32_u64(crc0, Load64(p));
+  }
+  uint32_t crc32 = static_cast<uint32_t>(crc0);
+  for (; len > 0; ++p, --len) {
+    crc32 = _mm_crc32_u8(crc32, *p);
+  }
+  return crc32;
+}
+
+// --------------------------------------------------------------------------
+bool DetectHardware() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.2");
+}
+#endif  // QSFS_CRC32C_SSE42
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+uint32_t Extend(uint32_t crc, const char *buffer, size_t len) {
+  const unsigned char *p = reinterpret_cast<const unsigned char *>(buffer);
+#ifdef QSFS_CRC32C_SSE42
+  if (IsHardwareAccelerated()) {
+    return ~ExtendHardware(~crc, p, len);
+  }
+#endif
+  return ~ExtendSoftware(~crc, p, len);
+}
+
+// --------------------------------------------------------------------------
+bool IsHardwareAccelerated() {
+#ifdef QSFS_CRC32C_SSE42
+  static const bool supported = DetectHardware();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+}  // namespace Crc32c
+}  // namespace QS
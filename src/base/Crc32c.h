@@ -0,0 +1,49 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_BASE_CRC32C_H_
+#define QSFS_BASE_CRC32C_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+namespace QS {
+
+namespace Crc32c {
+
+// Extend the CRC32C (Castagnoli) checksum with more bytes
+//
+// @param  : checksum of the preceding bytes, buffer, len of bytes
+// @return : checksum of the preceding bytes followed by the buffer
+//
+// The SSE4.2 crc32 instruction is used when the cpu supports it, otherwise
+// a table driven implementation is used.
+uint32_t Extend(uint32_t crc, const char *buffer, size_t len);
+
+// Return the CRC32C checksum of the bytes
+inline uint32_t Value(const char *buffer, size_t len) {
+  return Extend(0, buffer, len);
+}
+
+// Whether the checksum is computed by the SSE4.2 crc32 instruction
+bool IsHardwareAccelerated();
+
+}  // namespace Crc32c
+}  // namespace QS
+
+
+#endif  // QSFS_BASE_CRC32C_H_
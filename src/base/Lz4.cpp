@@ -0,0 +1,252 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include "base/Lz4.h"
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+#include <string.h>  // for memcpy, memset
+
+namespace QS {
+
+namespace Lz4 {
+
+namespace {
+
+// Limits of the LZ4 block format
+const size_t kMinMatch = 4;        // min length of a match
+const size_t kLastLiterals = 5;    // last bytes of a block are literals
+const size_t kMatchFindLimit = 12;  // last match starts before the last bytes
+const size_t kMaxOffset = 65535;   // max distance of a match
+const unsigned kRunMask = 15;      // length of 15 continues in next bytes
+
+// Positions of the recent 4-byte sequences are kept in a table of 4096 slots,
+// which fits in the L1 cache
+const unsigned kHashLog = 12;
+
+// Bytes skipped is increased after every 64 failed searches, so the bytes which
+// do not compress are passed over quickly
+const unsigned kSkipTrigger = 6;
+
+// --------------------------------------------------------------------------
+uint32_t Load32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Load64(const char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// --------------------------------------------------------------------------
+uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+// --------------------------------------------------------------------------
+// Return the end of the match of the bytes at pos with the bytes at ref
+const char *MatchEnd(const char *pos, const char *ref, const char *limit) {
+  while (pos + 8 <= limit && Load64(pos) == Load64(ref)) {
+    pos += 8;
+    ref += 8;
+  }
+  while (pos < limit && *pos == *ref) {
+    ++pos;
+    ++ref;
+  }
+  return pos;
+}
+
+// --------------------------------------------------------------------------
+// Size of the bytes to encode a length beyond the 4 bits of token
+size_t LengthSize(size_t len) {
+  return len >= kRunMask ? (len - kRunMask) / 255 + 1 : 0;
+}
+
+// --------------------------------------------------------------------------
+char *PutLength(char *op, size_t len) {
+  for (len -= kRunMask; len >= 255; len -= 255) {
+    *op++ = static_cast<char>(255);
+  }
+  *op++ = static_cast<char>(len);
+  return op;
+}
+
+// --------------------------------------------------------------------------
+// Put a sequence of literals followed by a match, or the last literals if
+// match length is zero
+char *PutSequence(char *op, const char *literals, size_t litLen,
+                  size_t offset, size_t matchLen) {
+  unsigned char *token = reinterpret_cast<unsigned char *>(op++);
+  *token = static_cast<unsigned char>(
+      (litLen >= kRunMask ? kRunMask : litLen) << 4);
+  if (litLen >= kRunMask) {
+    op = PutLength(op, litLen);
+  }
+  if (litLen > 0) {
+    memcpy(op, literals, litLen);  // literals may be null if there are none
+    op += litLen;
+  }
+  if (matchLen == 0) {
+    return op;
+  }
+  *op++ = static_cast<char>(offset & 0xff);
+  *op++ = static_cast<char>(offset >> 8);
+  matchLen -= kMinMatch;
+  *token |= static_cast<unsigned char>(matchLen >= kRunMask ? kRunMask
+                                                            : matchLen);
+  if (matchLen >= kRunMask) {
+    op = PutLength(op, matchLen);
+  }
+  return op;
+}
+
+// --------------------------------------------------------------------------
+// Read a length beyond the 4 bits of token
+bool GetLength(const unsigned char **ip, const unsigned char *end,
+               size_t *len) {
+  unsigned char b = 255;
+  while (b == 255) {
+    if (*ip >= end) {
+      return false;
+    }
+    b = *(*ip)++;
+    *len += b;
+  }
+  return true;
+}
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+size_t CompressBound(size_t len) { return len + len / 255 + 16; }
+
+// --------------------------------------------------------------------------
+size_t Compress(const char *source, size_t len, char *dest, size_t capacity) {
+  const char *ip = source;
+  const char *anchor = source;  // start of the literals not put yet
+  const char *end = source + len;
+  char *op = dest;
+  const char *opEnd = dest + capacity;
+
+  if (len > kMatchFindLimit) {
+    uint32_t table[1 << kHashLog];
+    memset(table, 0, sizeof(table));
+    const char *matchLimit = end - kLastLiterals;
+    const char *findLimit = end - kMatchFindLimit;
+    unsigned misses = 0;
+    table[Hash(Load32(ip))] = 0;
+    ++ip;
+    while (ip <= findLimit) {
+      uint32_t sequence = Load32(ip);
+      uint32_t h = Hash(sequence);
+      const char *ref = source + table[h];
+      table[h] = static_cast<uint32_t>(ip - source);
+      if (ref >= ip || static_cast<size_t>(ip - ref) > kMaxOffset ||
+          Load32(ref) != sequence) {
+        ip += 1 + (misses++ >> kSkipTrigger);
+        continue;
+      }
+      misses = 0;
+      // Extend the match backward over the literals
+      while (ip > anchor && ref > source && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+      const char *matchEnd =
+          MatchEnd(ip + kMinMatch, ref + kMinMatch, matchLimit);
+      size_t litLen = static_cast<size_t>(ip - anchor);
+      size_t matchLen = static_cast<size_t>(matchEnd - ip);
+      if (static_cast<size_t>(opEnd - op) <
+          1 + LengthSize(litLen) + litLen + 2 + LengthSize(matchLen - 4)) {
+        return 0;
+      }
+      op = PutSequence(op, anchor, litLen, static_cast<size_t>(ip - ref),
+                       matchLen);
+      ip = anchor = matchEnd;
+      if (ip <= findLimit) {
+        // Index a position inside the match, which finds repeats sooner
+        table[Hash(Load32(ip - 2))] = static_cast<uint32_t>(ip - 2 - source);
+      }
+    }
+  }
+
+  size_t litLen = static_cast<size_t>(end - anchor);
+  if (static_cast<size_t>(opEnd - op) < 1 + LengthSize(litLen) + litLen) {
+    return 0;
+  }
+  op = PutSequence(op, anchor, litLen, 0, 0);
+  return static_cast<size_t>(op - dest);
+}
+
+// --------------------------------------------------------------------------
+bool Decompress(const char *source, size_t len, char *dest, size_t size) {
+  const unsigned char *ip = reinterpret_cast<const unsigned char *>(source);
+  const unsigned char *end = ip + len;
+  char *op = dest;
+  char *opEnd = dest + size;
+  while (ip < end) {
+    unsigned token = *ip++;
+    size_t litLen = token >> 4;
+    if (litLen == kRunMask && !GetLength(&ip, end, &litLen)) {
+      return false;
+    }
+    if (litLen > static_cast<size_t>(end - ip) ||
+        litLen > static_cast<size_t>(opEnd - op)) {
+      return false;
+    }
+    memcpy(op, ip, litLen);
+    op += litLen;
+    ip += litLen;
+    if (ip == end) {
+      break;  // last sequence has no match
+    }
+
+    if (end - ip < 2) {
+      return false;
+    }
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t matchLen = token & kRunMask;
+    if (matchLen == kRunMask && !GetLength(&ip, end, &matchLen)) {
+      return false;
+    }
+    matchLen += kMinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(op - dest) ||
+        matchLen > static_cast<size_t>(opEnd - op)) {
+      return false;
+    }
+    const char *ref = op - offset;
+    if (offset >= matchLen) {
+      memcpy(op, ref, matchLen);
+      op += matchLen;
+    } else {
+      // Overlapped match repeats the last offset bytes
+      for (size_t i = 0; i < matchLen; ++i) {
+        *op++ = *ref++;
+      }
+    }
+  }
+  return op == opEnd;
+}
+
+}  // namespace Lz4
+}  // namespace QS
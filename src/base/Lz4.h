@@ -0,0 +1,50 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_BASE_LZ4_H_
+#define QSFS_BASE_LZ4_H_
+
+#include <stddef.h>  // for size_t
+
+namespace QS {
+
+namespace Lz4 {
+
+// Return the max size of the compressed bytes of len bytes
+size_t CompressBound(size_t len);
+
+// Compress the bytes into LZ4 block format
+//
+// @param  : source buffer, len of bytes, destination buffer, its capacity
+// @return : size of the compressed bytes, zero if they exceed the capacity
+//
+// A capacity smaller than CompressBound(len) could be given to give up early
+// on the bytes which do not compress well.
+size_t Compress(const char *source, size_t len, char *dest, size_t capacity);
+
+// Decompress a LZ4 block
+//
+// @param  : source buffer, len of compressed bytes, destination buffer, size
+//           of the decompressed bytes
+// @return : true if the block is valid and decompressed to exactly size bytes
+bool Decompress(const char *source, size_t len, char *dest, size_t size);
+
+}  // namespace Lz4
+}  // namespace QS
+
+
+#endif  // QSFS_BASE_LZ4_H_
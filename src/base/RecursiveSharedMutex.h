@@ -0,0 +1,134 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_BASE_RECURSIVESHAREDMUTEX_H_
+#define QSFS_BASE_RECURSIVESHAREDMUTEX_H_
+
+#include <pthread.h>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "base/Atomic.h"
+
+namespace QS {
+
+namespace Threading {
+
+// Reader-writer mutex whose exclusive owner could lock it again
+//
+// Exclusive locks are recursive as boost::recursive_mutex, and the owner of
+// the exclusive lock could take shared locks as well, which count as its
+// exclusive lock, so a writer could call the readers guarded by shared locks.
+//
+// A shared lock costs a compare-and-swap when there is no writer, readers
+// only wait on the mutex while a writer holds or waits for the lock. Unlike
+// boost::shared_mutex, the readers do not serialize on an internal mutex.
+// Writers are preferred, new readers wait once a writer is waiting.
+//
+// NOTICE: a shared lock is not recursive, a thread holding a shared lock
+// should neither lock it shared again, which blocks if a writer is waiting,
+// nor lock it exclusively, which blocks forever.
+//
+// Both lock_guard and shared_lock of boost could guard it.
+class RecursiveSharedMutex : private boost::noncopyable {
+ public:
+  RecursiveSharedMutex() : m_state(0), m_owner(0), m_depth(0) {}
+
+ public:
+  void lock() {
+    if (OwnedByThisThread()) {
+      ++m_depth;
+      return;
+    }
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_state.Load() & kWriter) {
+      m_cond.wait(lock);  // wait for other writer
+    }
+    m_state.Add(kWriter);
+    while (m_state.Load() != kWriter) {
+      m_cond.wait(lock);  // wait for readers to leave
+    }
+    m_owner.Store(pthread_self());
+    m_depth = 1;
+  }
+
+  void unlock() {
+    if (--m_depth > 0) {
+      return;
+    }
+    m_owner.Store(0);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_state.Sub(kWriter);
+    m_cond.notify_all();
+  }
+
+  void lock_shared() {
+    if (OwnedByThisThread()) {
+      ++m_depth;
+      return;
+    }
+    while (true) {
+      unsigned state = m_state.Load();
+      if (!(state & kWriter)) {
+        if (m_state.CompareAndSwap(state, state + 1)) {
+          return;
+        }
+        continue;
+      }
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while (m_state.Load() & kWriter) {
+        m_cond.wait(lock);
+      }
+    }
+  }
+
+  void unlock_shared() {
+    if (OwnedByThisThread()) {
+      --m_depth;
+      return;
+    }
+    if (m_state.Sub(1) == kWriter) {
+      // the last reader wakes up the waiting writer
+      boost::lock_guard<boost::mutex> lock(m_mutex);
+      m_cond.notify_all();
+    }
+  }
+
+ private:
+  // Only the owner itself could see its own id stored in owner, so no lock is
+  // needed to tell whether this thread holds the exclusive lock.
+  bool OwnedByThisThread() const {
+    return pthread_equal(m_owner.Load(), pthread_self()) != 0;
+  }
+
+ private:
+  static const unsigned kWriter = 1u << 31;
+
+  Atomic<unsigned> m_state;  // writer bit and number of readers
+  boost::mutex m_mutex;      // guard waiting of writers and blocked readers
+  boost::condition_variable m_cond;
+  Atomic<pthread_t> m_owner;  // thread holding exclusive lock, zero if none
+  unsigned m_depth;           // times the owner locks, guarded by exclusive
+};
+
+}  // namespace Threading
+}  // namespace QS
+
+#endif  // QSFS_BASE_RECURSIVESHAREDMUTEX_H_
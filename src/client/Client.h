@@ -148,6 +148,17 @@ class Client : private boost::noncopyable {
       uint64_t contentLength,
       boost::shared_ptr<std::iostream> buffer) = 0;
 
+  // Upload multipart by copying a range of an existing object
+  //
+  // @param  : file path, upload id, part number, source file path, range
+  // @return : ClientError
+  //
+  // The part is copied by server without transferring its content, range is
+  // in the format of "bytes=start_offset-stop_offset".
+  virtual ClientError<QSError::Value> UploadMultipartCopy(
+      const std::string &filePath, const std::string &uploadId, int partNumber,
+      const std::string &sourcePath, const std::string &range) = 0;
+
   // Complete multipart upload
   //
   // @param  : file path, upload id, sorted part ids
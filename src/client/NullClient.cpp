@@ -85,6 +85,12 @@ ClientError<QSError::Value> NullClient::UploadMultipart(
   return GoodState();
 }
 
+ClientError<QSError::Value> NullClient::UploadMultipartCopy(
+    const string &filePath, const string &uploadId, int partNumber,
+    const string &sourcePath, const string &range) {
+  return GoodState();
+}
+
 ClientError<QSError::Value> NullClient::CompleteMultipartUpload(
     const string &filePath, const string &uploadId,
     const std::vector<int> &sortedPartIds) {
@@ -67,6 +67,10 @@ class NullClient : public Client {
       const std::string &filePath, const std::string &uploadId, int partNumber,
       uint64_t contentLength, boost::shared_ptr<std::iostream> buffer);
 
+  ClientError<QSError::Value> UploadMultipartCopy(
+      const std::string &filePath, const std::string &uploadId, int partNumber,
+      const std::string &sourcePath, const std::string &range);
+
   ClientError<QSError::Value> SymLink(const std::string &filePath,
                                       const std::string &linkPath);
 
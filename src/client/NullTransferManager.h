@@ -52,7 +52,8 @@ class NullTransferManager : public TransferManager {
 
   boost::shared_ptr<TransferHandle> UploadFile(
       const std::string &filePath, uint64_t fileSize, time_t fileMTimeSince,
-      const boost::shared_ptr<QS::Data::Cache> &cache, bool async = false) {
+      const boost::shared_ptr<QS::Data::Cache> &cache,
+      const QS::Data::ContentRangeDeque &dirtyRanges, bool async = false) {
     return boost::shared_ptr<TransferHandle>();
   }
 
@@ -62,6 +63,21 @@ class NullTransferManager : public TransferManager {
     return boost::shared_ptr<TransferHandle>();
   }
 
+  bool UploadStreamPart(const std::string &filePath,
+                        const std::string &uploadId, uint16_t partId,
+                        off_t offset, size_t size,
+                        const boost::shared_ptr<QS::Data::Cache> &cache) {
+    return false;
+  }
+
+  boost::shared_ptr<TransferHandle> UploadStreamedFile(
+      const std::string &filePath, uint64_t fileSize, time_t fileMTimeSince,
+      const boost::shared_ptr<QS::Data::Cache> &cache,
+      const QS::Data::ContentRangeDeque &dirtyRanges,
+      const std::string &uploadId, uint64_t streamedSize, bool async = false) {
+    return boost::shared_ptr<TransferHandle>();
+  }
+
   void AbortMultipartUpload(const boost::shared_ptr<TransferHandle> &handle) {}
 };
 
@@ -460,6 +460,27 @@ ClientError<QSError::Value> QSClient::UploadMultipart(
   }
 }
 
+// --------------------------------------------------------------------------
+ClientError<QSError::Value> QSClient::UploadMultipartCopy(
+    const string &filePath, const string &uploadId, int partNumber,
+    const string &sourcePath, const string &range) {
+  UploadMultipartInput input;
+  input.SetUploadID(uploadId);
+  input.SetPartNumber(partNumber);
+  input.SetContentLength(0);  // no body, the content is copied by server
+  input.SetXQSCopySource(BuildXQSSourceString(sourcePath));
+  input.SetXQSCopyRange(range);
+
+  UploadMultipartOutcome outcome =
+      GetQSClientImpl()->UploadMultipart(filePath, &input);
+
+  if (outcome.IsSuccess()) {
+    return ClientError<QSError::Value>(QSError::GOOD, false);
+  } else {
+    return outcome.GetError();
+  }
+}
+
 // --------------------------------------------------------------------------
 ClientError<QSError::Value> QSClient::CompleteMultipartUpload(
     const string &filePath, const string &uploadId,
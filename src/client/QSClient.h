@@ -137,6 +137,14 @@ class QSClient : public Client {
       const std::string &filePath, const std::string &uploadId, int partNumber,
       uint64_t contentLength, boost::shared_ptr<std::iostream> buffer);
 
+  // Upload multipart by copying a range of an existing object
+  //
+  // @param  : file path, upload id, part number, source file path, range
+  // @return : ClientError
+  ClientError<QSError::Value> UploadMultipartCopy(
+      const std::string &filePath, const std::string &uploadId, int partNumber,
+      const std::string &sourcePath, const std::string &range);
+
   // Complete multipart upload
   //
   // @param  : file path, upload id, sorted part ids
@@ -28,6 +28,7 @@
 
 #include "boost/bind.hpp"
 #include "boost/exception/to_string.hpp"
+#include "boost/foreach.hpp"
 #include "boost/make_shared.hpp"
 #include "boost/shared_ptr.hpp"
 #include "boost/tuple/tuple.hpp"
@@ -43,6 +44,7 @@
 #include "data/DirectoryTree.h"
 #include "data/IOStream.h"
 #include "data/Node.h"
+#include "data/Page.h"
 #include "data/ResourceManager.h"
 #include "data/StreamBuf.h"
 
@@ -56,14 +58,18 @@ using boost::shared_ptr;
 using boost::to_string;
 using QS::Client::Utils::BuildRequestRange;
 using QS::Data::Buffer;
+using QS::Data::ByteVector;
 using QS::Data::Cache;
 using QS::Data::ContentRangeDeque;
+using QS::Data::ContentSlice;
+using QS::Data::ContentSliceDeque;
+using QS::Data::CopySlices;
 using QS::Data::DirectoryTree;
+using QS::Data::IntersectContentRanges;
 using QS::Data::IOStream;
 using QS::Data::Node;
 using QS::Data::ResourceManager;
 using QS::Data::StreamBuf;
-using QS::Configure::Default::GetUploadMultipartMinPartSize;
 using QS::Configure::Default::GetUploadMultipartThresholdSize;
 using std::iostream;
 using std::make_pair;
@@ -211,11 +217,13 @@ struct ReceivedHandlerMultipleUpload {
       Error(GetMessageForQSError(err));
     }
 
-    // release part buffer back to resouce manager
-    stream->seekg(0, std::ios_base::beg);
-    StreamBuf *partStreamBuf = dynamic_cast<StreamBuf *>(stream->rdbuf());
-    if (partStreamBuf) {
-      bufferManager->Release(partStreamBuf->ReleaseBuffer());
+    // release part buffer back to resouce manager, a copied part has none
+    if (stream) {
+      stream->seekg(0, std::ios_base::beg);
+      StreamBuf *partStreamBuf = dynamic_cast<StreamBuf *>(stream->rdbuf());
+      if (partStreamBuf) {
+        bufferManager->Release(partStreamBuf->ReleaseBuffer());
+      }
     }
 
     // update status
@@ -291,10 +299,12 @@ shared_ptr<TransferHandle> QSTransferManager::RetryDownload(
 // --------------------------------------------------------------------------
 shared_ptr<TransferHandle> QSTransferManager::UploadFile(
     const string &filePath, uint64_t fileSize, time_t fileMtimeSince,
-    const shared_ptr<Cache> &cache, bool async) {
+    const shared_ptr<Cache> &cache, const ContentRangeDeque &dirtyRanges,
+    bool async) {
   string bucket = ClientConfiguration::Instance().GetBucket();
   shared_ptr<TransferHandle> handle = make_shared<TransferHandle>(
       bucket, filePath, 0, fileSize, TransferDirection::Upload);
+  handle->SetDirtyRanges(dirtyRanges);
   if (!cache) {
     DebugError("Null Cache input");
     return handle;
@@ -322,7 +332,7 @@ shared_ptr<TransferHandle> QSTransferManager::RetryUpload(
 
   if (handle->GetStatus() == TransferStatus::Aborted) {
     return UploadFile(handle->GetObjectKey(), handle->GetBytesTotalSize(),
-                      fileMtimeSince, cache, async);
+                      fileMtimeSince, cache, handle->GetDirtyRanges(), async);
   } else {
     handle->UpdateStatus(TransferStatus::NotStarted);
     handle->Restart();
@@ -331,6 +341,94 @@ shared_ptr<TransferHandle> QSTransferManager::RetryUpload(
   }
 }
 
+// --------------------------------------------------------------------------
+bool QSTransferManager::UploadStreamPart(const string &filePath,
+                                         const string &uploadId,
+                                         uint16_t partId, off_t offset,
+                                         size_t size,
+                                         const shared_ptr<Cache> &cache) {
+  if (!cache || size > GetBufferSize()) {
+    DebugError("Invalid input to upload part [file:part:len=" + filePath +
+               ":" + to_string(partId) + ":" + to_string(size) + "]");
+    return false;
+  }
+  Buffer buffer = GetBufferManager()->Acquire();
+  if (!buffer) {
+    DebugWarning("Unable to acquire resource, stop upload");
+    return false;
+  }
+
+  // the part is written into cache already, no need to check its mtime
+  pair<size_t, ContentRangeDeque> res =
+      cache->Read(filePath, offset, size, &(*buffer)[0], 0);
+  bool success = res.first == size;
+  if (success) {
+    shared_ptr<IOStream> stream = make_shared<IOStream>(buffer, size);
+    ClientError<QSError::Value> err =
+        GetClient()->UploadMultipart(filePath, uploadId, partId, size, stream);
+    success = IsGoodQSError(err);
+    DebugErrorIf(!success, GetMessageForQSError(err));
+    stream->seekg(0, std::ios_base::beg);
+    StreamBuf *streamBuf = dynamic_cast<StreamBuf *>(stream->rdbuf());
+    if (streamBuf) {
+      buffer = streamBuf->ReleaseBuffer();
+    }
+  } else {
+    DebugError("Fail to read cache [file:offset:len:readsize=" + filePath +
+               ":" + to_string(offset) + ":" + to_string(size) + ":" +
+               to_string(res.first) + "], stop upload");
+  }
+  GetBufferManager()->Release(buffer);
+  return success;
+}
+
+// --------------------------------------------------------------------------
+shared_ptr<TransferHandle> QSTransferManager::UploadStreamedFile(
+    const string &filePath, uint64_t fileSize, time_t fileMtimeSince,
+    const shared_ptr<Cache> &cache, const ContentRangeDeque &dirtyRanges,
+    const string &uploadId, uint64_t streamedSize, bool async) {
+  string bucket = ClientConfiguration::Instance().GetBucket();
+  shared_ptr<TransferHandle> handle = make_shared<TransferHandle>(
+      bucket, filePath, 0, fileSize, TransferDirection::Upload);
+  handle->SetDirtyRanges(dirtyRanges);
+  if (!cache) {
+    DebugError("Null Cache input");
+    return handle;
+  }
+  handle->UpdateStatus(TransferStatus::InProgress);
+  handle->SetIsMultiPart(true);
+  handle->SetMultipartId(uploadId);
+
+  uint64_t partSize = GetBufferSize();
+  if (streamedSize > fileSize) {
+    streamedSize = 0;  // invalid input, send all parts again
+  }
+  // the parts are in the same size except the last one, send the last
+  // uploaded part again if nothing is left, as the upload is completed only
+  // by the parts sent here
+  uint64_t partCount = partSize > 0 ? streamedSize / partSize : 0;
+  if (partCount > 0 && partCount * partSize == fileSize) {
+    --partCount;
+  }
+  uint16_t partId = 0;
+  for (; partId < partCount; ++partId) {
+    // part id, best progress in bytes, part size, range begin
+    shared_ptr<Part> part = make_shared<Part>(partId + 1, 0, partSize,
+                                              partId * partSize);
+    part->OnDataTransferred(partSize, handle);
+    handle->ChangePartToCompleted(part);
+  }
+  uint64_t sentSize = partCount * partSize;
+  BOOST_FOREACH(const ContentRangeDeque::value_type &range,
+                 GetUploadPartRanges(fileSize - sentSize)) {
+    handle->AddQueuePart(make_shared<Part>(++partId, 0, range.second,
+                                           sentSize + range.first));
+  }
+
+  DoMultiPartUpload(handle, cache, fileMtimeSince, async);
+  return handle;
+}
+
 // --------------------------------------------------------------------------
 void QSTransferManager::AbortMultipartUpload(
     const shared_ptr<TransferHandle> &handle) {
@@ -509,28 +607,18 @@ bool QSTransferManager::PrepareUpload(
         return false;
       }
 
-      size_t partCount = static_cast<size_t>(
-          std::ceil(static_cast<long double>(totalTransferSize) /
-                    static_cast<long double>(bufferSize)));
-      size_t lastCuttingSize = totalTransferSize - (partCount - 1) * bufferSize;
-      bool needAverageLastTwoPart =
-          lastCuttingSize < GetUploadMultipartMinPartSize();
-
-      size_t count = needAverageLastTwoPart ? partCount - 1 : partCount;
-      for (size_t i = 1; i < count; ++i) {
-        // part id, best progress in bytes, part size, range begin
-        handle->AddQueuePart(make_shared<Part>(
-            i, 0, bufferSize,
-            handle->GetContentRangeBegin() + (i - 1) * bufferSize));
-      }
-
-      size_t sz = needAverageLastTwoPart ? (lastCuttingSize + bufferSize) / 2
-                                         : lastCuttingSize;
-      for (size_t i = count; i <= partCount; ++i) {
-        handle->AddQueuePart(make_shared<Part>(i, 0, sz,
-                                               handle->GetContentRangeBegin() +
-                                                   (count - 1) * bufferSize +
-                                                   (i - count) * sz));
+      // part id, best progress in bytes, part size, range begin
+      ContentRangeDeque ranges = GetUploadPartRanges(totalTransferSize);
+      const ContentRangeDeque &dirtyRanges = handle->GetDirtyRanges();
+      uint16_t partId = 0;
+      BOOST_FOREACH(const ContentRangeDeque::value_type &range, ranges) {
+        shared_ptr<Part> part = make_shared<Part>(
+            ++partId, 0, range.second,
+            handle->GetContentRangeBegin() + range.first);
+        // the part not changed is copied from the existing object
+        part->SetCopy(
+            !IntersectContentRanges(dirtyRanges, range.first, range.second));
+        handle->AddQueuePart(part);
       }
     } else {  // single upload
       handle->SetIsMultiPart(false);
@@ -550,11 +638,14 @@ void QSTransferManager::DoSinglePartUpload(
 
   const shared_ptr<Part> &part = queuedParts.begin()->second;
   uint64_t fileSize = handle->GetBytesTotalSize();
-  Buffer buf = Buffer(new vector<char>(fileSize));
   string objKey = handle->GetObjectKey();
-  pair<size_t, ContentRangeDeque> res =
-      cache->Read(objKey, 0, fileSize, &(*buf)[0], mtimeSince);
-  size_t readSize = res.first;
+  pair<ContentSliceDeque, ContentRangeDeque> res =
+      cache->ReadSlices(objKey, 0, fileSize, mtimeSince);
+  const ContentSliceDeque &slices = res.first;
+  size_t readSize = 0;
+  BOOST_FOREACH (const ContentSlice &slice, slices) {
+    readSize += slice.m_size;
+  }
   if (readSize != fileSize) {
     DebugError("Fail to read cache [file:offset:len:readsize=" + objKey +
                ":0:" + to_string(fileSize) + ":" + to_string(readSize) +
@@ -568,8 +659,17 @@ void QSTransferManager::DoSinglePartUpload(
     return;
   }
 
-  shared_ptr<IOStream> stream =
-      shared_ptr<IOStream>(new IOStream(buf, fileSize));
+  shared_ptr<IOStream> stream;
+  if (slices.size() == 1 && slices.front().m_start == 0) {
+    // upload from the cached buffer directly without copying
+    stream = make_shared<IOStream>(slices.front().m_buffer, fileSize);
+  } else {
+    Buffer buf = Buffer(new ByteVector(fileSize));
+    if (fileSize > 0) {
+      CopySlices(slices, 0, fileSize, &(*buf)[0]);
+    }
+    stream = shared_ptr<IOStream>(new IOStream(buf, fileSize));
+  }
   handle->AddPendingPart(part);
   ReceivedHandlerSingleUpload receivedHandler(handle, part, stream);
 
@@ -593,6 +693,24 @@ void QSTransferManager::DoMultiPartUpload(
   PartIdToPartMapIterator ipart = queuedParts.begin();
   for (; ipart != queuedParts.end() && handle->ShouldContinue(); ++ipart) {
     const shared_ptr<Part> &part = ipart->second;
+    if (part->IsCopy()) {
+      // copied by server, no content is read from cache
+      handle->AddPendingPart(part);
+      ReceivedHandlerMultipleUpload receivedHandler(
+          handle, part, shared_ptr<IOStream>(), GetBufferManager(),
+          GetClient());
+      if (async) {
+        GetExecutor()->SubmitAsync(
+            bind(boost::type<void>(), receivedHandler, _1),
+            bind(boost::type<ClientError<QSError::Value> >(),
+                 &QSTransferManager::MultipleUploadCopyWrapper, this, _1, _2),
+            handle, part);
+      } else {
+        receivedHandler(MultipleUploadCopyWrapper(handle, part));
+      }
+      continue;
+    }
+
     Buffer buffer = GetBufferManager()->Acquire();
     if (!buffer) {
       DebugWarning("Unable to acquire resource, stop upload");
@@ -705,5 +823,14 @@ ClientError<QSError::Value> QSTransferManager::MultipleUploadWrapper(
       part->GetSize(), stream);
 }
 
+// --------------------------------------------------------------------------
+ClientError<QSError::Value> QSTransferManager::MultipleUploadCopyWrapper(
+    const shared_ptr<TransferHandle> &handle, const shared_ptr<Part> &part) {
+  return GetClient()->UploadMultipartCopy(
+      handle->GetObjectKey(), handle->GetMultiPartId(), part->GetPartId(),
+      handle->GetObjectKey(),
+      BuildRequestRange(part->GetRangeBegin(), part->GetSize()));
+}
+
 }  // namespace Client
 }  // namespace QS
@@ -63,11 +63,12 @@ class QSTransferManager : public TransferManager {
 
   // Upload a file
   //
-  // @param  : file path, file size
+  // @param  : file path, file size, mtime, cache, dirty ranges of file
   // @return : transfer handle
   boost::shared_ptr<TransferHandle> UploadFile(
       const std::string &filePath, uint64_t fileSize, time_t fileMtimeSince,
-      const boost::shared_ptr<QS::Data::Cache> &cache, bool async = false);
+      const boost::shared_ptr<QS::Data::Cache> &cache,
+      const QS::Data::ContentRangeDeque &dirtyRanges, bool async = false);
 
   // Retry a failed upload
   //
@@ -77,6 +78,26 @@ class QSTransferManager : public TransferManager {
       const boost::shared_ptr<TransferHandle> &handle, time_t fileMtimeSince,
       const boost::shared_ptr<QS::Data::Cache> &cache, bool async = false);
 
+  // Upload a part of a file while the file is written
+  //
+  // @param  : file path, upload id, part id, part start, part size, cache
+  // @return : bool
+  bool UploadStreamPart(const std::string &filePath,
+                        const std::string &uploadId, uint16_t partId,
+                        off_t offset, size_t size,
+                        const boost::shared_ptr<QS::Data::Cache> &cache);
+
+  // Upload a file whose leading parts are uploaded while it is written
+  //
+  // @param  : file path, file size, mtime, cache, dirty ranges of file,
+  //           upload id, size of the uploaded parts
+  // @return : transfer handle
+  boost::shared_ptr<TransferHandle> UploadStreamedFile(
+      const std::string &filePath, uint64_t fileSize, time_t fileMtimeSince,
+      const boost::shared_ptr<QS::Data::Cache> &cache,
+      const QS::Data::ContentRangeDeque &dirtyRanges,
+      const std::string &uploadId, uint64_t streamedSize, bool async = false);
+
   // Abort a multipart upload
   //
   // @param  : tranfer handle to abort
@@ -126,6 +147,10 @@ class QSTransferManager : public TransferManager {
       const boost::shared_ptr<TransferHandle> &handle,
       const boost::shared_ptr<Part> &part,
       const boost::shared_ptr<QS::Data::IOStream> &stream);
+
+  ClientError<QSError::Value> MultipleUploadCopyWrapper(
+      const boost::shared_ptr<TransferHandle> &handle,
+      const boost::shared_ptr<Part> &part);
 };
 
 }  // namespace Client
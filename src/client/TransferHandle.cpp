@@ -72,6 +72,7 @@ Part::Part(uint16_t partId, size_t bestProgressInBytes, size_t sizeInBytes,
       m_bestProgress(bestProgressInBytes),
       m_size(sizeInBytes),
       m_rangeBegin(rangeBegin),
+      m_copy(false),
       m_downloadPartStream() {}
 
 // --------------------------------------------------------------------------
@@ -80,7 +81,8 @@ string Part::ToString() const {
          ", current progress(bytes): " + to_string(m_currentProgress) +
          ", best progress(bytes): " + to_string(m_bestProgress) +
          ", size(bytes): " + to_string(m_size) +
-         ", range begin: " + to_string(m_rangeBegin) + "]";
+         ", range begin: " + to_string(m_rangeBegin) +
+         ", copy: " + (m_copy ? "true" : "false") + "]";
 }
 
 // --------------------------------------------------------------------------
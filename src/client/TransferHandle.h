@@ -32,6 +32,7 @@
 #include "boost/thread/recursive_mutex.hpp"
 
 #include "client/QSError.h"
+#include "data/Page.h"
 
 namespace QS {
 
@@ -60,6 +61,7 @@ class Part {
   size_t GetBestProgress() const { return m_bestProgress; }
   size_t GetSize() const { return m_size; }
   size_t GetRangeBegin() const { return m_rangeBegin; }
+  bool IsCopy() const { return m_copy; }
 
   boost::shared_ptr<std::iostream> GetDownloadPartStream() const {
     return boost::atomic_load(&m_downloadPartStream);
@@ -76,6 +78,7 @@ class Part {
   }
   void SetSize(size_t sizeInBytes) { m_size = sizeInBytes; }
   void SetRangeBegin(size_t rangeBegin) { m_rangeBegin = rangeBegin; }
+  void SetCopy(bool copy) { m_copy = copy; }
 
   void SetDownloadPartStream(
       boost::shared_ptr<std::iostream> downloadPartStream) {
@@ -89,6 +92,7 @@ class Part {
   size_t m_bestProgress;     // in bytes
   size_t m_size;             // in bytes
   size_t m_rangeBegin;
+  bool m_copy;  // upload part by copying the range of the existing object
 
   // Notice: use atomic functions every time you touch the variable
   boost::shared_ptr<std::iostream> m_downloadPartStream;
@@ -169,6 +173,10 @@ class TransferHandle : private boost::noncopyable {
     return m_metadata;
   }
 
+  const QS::Data::ContentRangeDeque &GetDirtyRanges() const {
+    return m_dirtyRanges;
+  }
+
   const ClientError<QSError::Value> &GetError() const { return m_error; }
 
  public:
@@ -233,6 +241,10 @@ class TransferHandle : private boost::noncopyable {
     m_metadata = metadata;
   }
 
+  void SetDirtyRanges(const QS::Data::ContentRangeDeque &ranges) {
+    m_dirtyRanges = ranges;
+  }
+
   void SetError(const ClientError<QSError::Value> &error) { m_error = error; }
 
   // Internal use only
@@ -280,6 +292,9 @@ class TransferHandle : private boost::noncopyable {
   // In case of an upload, this is the metadata that was placed on the object.
   // In case of a download, this is the object metadata from the GET operation.
   std::map<std::string, std::string> m_metadata;
+  // In case of an upload, these are the ranges changed since the object was
+  // uploaded, the parts without them are copied from the existing object.
+  QS::Data::ContentRangeDeque m_dirtyRanges;
 
   ClientError<QSError::Value> m_error;
 
@@ -31,6 +31,7 @@
 #include "base/ThreadPool.h"
 #include "base/ThreadPoolInitializer.h"
 #include "client/NullClient.h"
+#include "configure/Default.h"
 #include "data/ResourceManager.h"
 
 namespace QS {
@@ -39,9 +40,16 @@ namespace Client {
 
 using boost::make_shared;
 using boost::shared_ptr;
+using QS::Configure::Default::GetUploadMultipartMinPartSize;
+using QS::Configure::Default::GetUploadMultipartThresholdSize;
+using QS::Data::AddContentRange;
+using QS::Data::ByteVector;
+using QS::Data::ContentRangeDeque;
+using QS::Data::IntersectContentRanges;
 using QS::Data::Resource;
 using QS::Data::ResourceManager;
 using QS::Threading::ThreadPool;
+using std::make_pair;
 using std::vector;
 
 boost::once_flag initOnceFlag = BOOST_ONCE_INIT;
@@ -83,6 +91,54 @@ size_t TransferManager::GetBufferCount() const {
                              static_cast<long double>(GetBufferSize())));
 }
 
+// --------------------------------------------------------------------------
+ContentRangeDeque TransferManager::GetUploadPartRanges(
+    uint64_t fileSize) const {
+  ContentRangeDeque ranges;
+  uint64_t bufferSize = GetBufferSize();
+  if (bufferSize == 0 || fileSize < GetUploadMultipartThresholdSize()) {
+    ranges.push_back(make_pair(0, static_cast<size_t>(fileSize)));
+    return ranges;
+  }
+
+  uint64_t partCount = (fileSize + bufferSize - 1) / bufferSize;
+  uint64_t lastCuttingSize = fileSize - (partCount - 1) * bufferSize;
+  // average the last two parts if the last one is too small
+  bool needAverageLastTwoPart =
+      partCount > 1 && lastCuttingSize < GetUploadMultipartMinPartSize();
+  uint64_t count = needAverageLastTwoPart ? partCount - 2 : partCount - 1;
+  for (uint64_t i = 0; i < count; ++i) {
+    ranges.push_back(make_pair(static_cast<off_t>(i * bufferSize),
+                               static_cast<size_t>(bufferSize)));
+  }
+  uint64_t begin = count * bufferSize;
+  if (needAverageLastTwoPart) {
+    uint64_t sz = (lastCuttingSize + bufferSize) / 2;
+    ranges.push_back(
+        make_pair(static_cast<off_t>(begin), static_cast<size_t>(sz)));
+    begin += sz;
+  }
+  ranges.push_back(make_pair(static_cast<off_t>(begin),
+                             static_cast<size_t>(fileSize - begin)));
+  return ranges;
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque TransferManager::GetUploadRanges(
+    uint64_t fileSize, const ContentRangeDeque &dirtyRanges) const {
+  ContentRangeDeque partRanges = GetUploadPartRanges(fileSize);
+  if (fileSize < GetUploadMultipartThresholdSize()) {
+    return partRanges;  // a single upload could not copy any range
+  }
+  ContentRangeDeque ranges;
+  BOOST_FOREACH(const ContentRangeDeque::value_type &range, partRanges) {
+    if (IntersectContentRanges(dirtyRanges, range.first, range.second)) {
+      AddContentRange(&ranges, range.first, range.second);
+    }
+  }
+  return ranges;
+}
+
 // --------------------------------------------------------------------------
 void TransferManager::SetClient(const shared_ptr<Client> &client) {
   assert(client);
@@ -103,7 +159,7 @@ void TransferManager::InitializeResources() {
     return;
   }
   for (uint64_t i = 0; i < GetBufferMaxHeapSize(); i += GetBufferSize()) {
-    m_bufferManager->PutResource(Resource(new vector<char>(GetBufferSize())));
+    m_bufferManager->PutResource(Resource(new ByteVector(GetBufferSize())));
   }
 }
 
@@ -28,6 +28,7 @@
 
 #include "base/Size.h"
 #include "client/ClientConfiguration.h"
+#include "data/Page.h"
 #include "data/ResourceManager.h"
 
 namespace QS {
@@ -103,11 +104,16 @@ class TransferManager : private boost::noncopyable {
 
   // Upload a file
   //
-  // @param  : file path, file size
+  // @param  : file path, file size, mtime, cache, dirty ranges of file
   // @return : transfer handle
+  //
+  // For a multipart upload, the parts without any dirty range are copied from
+  // the existing object by server, only the other parts are read from cache
+  // and sent.
   virtual boost::shared_ptr<TransferHandle> UploadFile(
       const std::string &filePath, uint64_t fileSize, time_t fileMTimeSince,
-      const boost::shared_ptr<QS::Data::Cache> &cache, bool async = false) = 0;
+      const boost::shared_ptr<QS::Data::Cache> &cache,
+      const QS::Data::ContentRangeDeque &dirtyRanges, bool async = false) = 0;
 
   // Retry a failed upload
   //
@@ -117,6 +123,33 @@ class TransferManager : private boost::noncopyable {
       const boost::shared_ptr<TransferHandle> &handle, time_t fileMTimeSince,
       const boost::shared_ptr<QS::Data::Cache> &cache, bool async = false) = 0;
 
+  // Upload a part of a file while the file is written
+  //
+  // @param  : file path, upload id, part id, part start, part size, cache
+  // @return : bool
+  //
+  // The part is read from cache and sent synchronously, the multipart upload
+  // is completed by UploadStreamedFile later.
+  virtual bool UploadStreamPart(
+      const std::string &filePath, const std::string &uploadId,
+      uint16_t partId, off_t offset, size_t size,
+      const boost::shared_ptr<QS::Data::Cache> &cache) = 0;
+
+  // Upload a file whose leading parts are uploaded while it is written
+  //
+  // @param  : file path, file size, mtime, cache, dirty ranges of file,
+  //           upload id, size of the uploaded parts
+  // @return : transfer handle
+  //
+  // The parts uploaded by UploadStreamPart are kept in the multipart upload,
+  // only the rest of the file is read from cache and sent.
+  virtual boost::shared_ptr<TransferHandle> UploadStreamedFile(
+      const std::string &filePath, uint64_t fileSize, time_t fileMTimeSince,
+      const boost::shared_ptr<QS::Data::Cache> &cache,
+      const QS::Data::ContentRangeDeque &dirtyRanges,
+      const std::string &uploadId, uint64_t streamedSize,
+      bool async = false) = 0;
+
   // Abort a multipart upload
   //
   // @param  : tranfer handle to abort
@@ -139,6 +172,25 @@ class TransferManager : private boost::noncopyable {
   }
   size_t GetBufferCount() const;
 
+  // Return ranges of the parts to upload a file
+  //
+  // @param  : file size
+  // @return : a list of {part start, part size} sorted by start
+  //
+  // A file smaller than the multipart threshold is uploaded in one part.
+  QS::Data::ContentRangeDeque GetUploadPartRanges(uint64_t fileSize) const;
+
+  // Return ranges of a file to send when uploading it
+  //
+  // @param  : file size, dirty ranges of file
+  // @return : a list of {range start, range size} sorted by start
+  //
+  // These are the parts intersecting with the dirty ranges, the other parts
+  // are copied from the existing object. The whole file is sent if it is
+  // uploaded in one part.
+  QS::Data::ContentRangeDeque GetUploadRanges(
+      uint64_t fileSize, const QS::Data::ContentRangeDeque &dirtyRanges) const;
+
  protected:
   const boost::shared_ptr<Client> &GetClient() const { return m_client; }
   const boost::shared_ptr<QS::Threading::ThreadPool> &GetExecutor() const {
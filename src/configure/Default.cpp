@@ -42,6 +42,7 @@ static const char* const QSFS_DEFAULT_LOG_DIR = "/tmp/qsfs_log/";
 static const char* const QSFS_DEFAULT_LOGLEVEL_NAME = "WARN";
 static const char* const QSFS_DEFAULT_HOST = "qingstor.com";
 static const char* const QSFS_DEFAULT_PROTOCOL = "https";
+static const char* const QSFS_DEFAULT_CACHE_POLICY = "lru";
 static const char* const QSFS_DEFAULT_ZONE = "pek3a";
 static const char* const MIME_FILE_DEFAULT = "/etc/mime.types";
 static uint16_t const QSFS_DEFAULT_TRANSACTION_RETRIES = 3;
@@ -72,6 +73,7 @@ uint16_t GetDefaultPort(const string& protocolName) {
 
 string GetDefaultProtocolName() { return QSFS_DEFAULT_PROTOCOL; }
 string GetDefaultZone() { return QSFS_DEFAULT_ZONE; }
+string GetDefaultCachePolicyName() { return QSFS_DEFAULT_CACHE_POLICY; }
 
 vector<string> GetMimeFiles() {
   vector<string> mimes;
@@ -104,6 +106,56 @@ uint64_t GetMaxCacheSize() {
   return QS::Size::MB200;  // default value
 }
 
+size_t GetDefaultCacheShards() {
+  return 16;  // default value
+}
+
+size_t GetMaxCacheShards() {
+  return 1024;
+}
+
+size_t GetDefaultCacheBlockSize() {
+  return 0;  // default not use block store
+}
+
+size_t GetDefaultMaxPageSize() {
+  // same as transfer buffer size, so a merged page is not larger than a
+  // downloaded page
+  return QS::Size::MB10;
+}
+
+uint64_t GetDefaultMaxDiskCacheSize() {
+  return 0;  // default only limited by free disk space
+}
+
+uint64_t GetDefaultMaxMemorySize() {
+  return 0;  // default only limited by the size of each cache
+}
+
+uint64_t GetDefaultMaxDirtySize() {
+  return QS::Size::MB200;
+}
+
+time_t GetDefaultDirtyExpireTime() {
+  return 30;  // in seconds
+}
+
+size_t GetDefaultWarmUpJobs() {
+  return 4;
+}
+
+uint64_t GetDefaultPinQuota() {
+  return 0;  // default only warm up the cache
+}
+
+uint64_t GetDefaultMaxReadahead() {
+  return QS::Size::MB20;
+}
+
+uint64_t GetDefaultMaxRangeGap() {
+  return QS::Size::MB1;
+}
+
 size_t GetMaxStatCount() {
   return QS::Size::K20;  // default value
 }
@@ -19,6 +19,7 @@
 
 #include <stddef.h>
 #include <stdint.h>  // for fixed width integer types
+#include <time.h>
 
 #include <sys/types.h>  // for blkcnt_t
 
@@ -41,6 +42,7 @@ std::string GetDefaultHostName();
 uint16_t GetDefaultPort(const std::string& protocolName);
 std::string GetDefaultProtocolName();
 std::string GetDefaultZone();
+std::string GetDefaultCachePolicyName();  // File data cache eviction policy
 std::vector<std::string> GetMimeFiles();
 
 uint16_t GetPathMaxLen();
@@ -55,6 +57,18 @@ uint16_t GetFragmentSize();
 blkcnt_t GetBlocks(off_t size);  // Number of 512B blocks allocated
 
 uint64_t GetMaxCacheSize();         // File data cache size in bytes
+size_t GetDefaultCacheShards();     // File data cache shard count
+size_t GetMaxCacheShards();         // Upper bound of cache shard count
+size_t GetDefaultCacheBlockSize();  // File data block size, 0 to use pages
+size_t GetDefaultMaxPageSize();     // File data merged page size, 0 no merge
+uint64_t GetDefaultMaxDiskCacheSize();  // File data disk size, 0 no limit
+uint64_t GetDefaultMaxMemorySize();  // Memory budget of all caches, 0 no limit
+uint64_t GetDefaultMaxDirtySize();   // Dirty bytes of write-back, 0 no limit
+time_t GetDefaultDirtyExpireTime();  // Age of dirty files in seconds
+size_t GetDefaultWarmUpJobs();       // Parallel downloads of cache warm-up
+uint64_t GetDefaultPinQuota();       // Bytes pinned by warm-up, 0 not to pin
+uint64_t GetDefaultMaxReadahead();   // Readahead window in bytes, 0 disabled
+uint64_t GetDefaultMaxRangeGap();    // Cached gap fetched in a GET, 0 disabled
 size_t GetMaxStatCount();           // File meta data cache max count
 uint16_t GetMaxListObjectsCount();  // max count for list operation
 
@@ -35,12 +35,24 @@ namespace Configure {
 
 using boost::to_string;
 using QS::Configure::Default::GetClientDefaultPoolSize;
+using QS::Configure::Default::GetDefaultCacheBlockSize;
+using QS::Configure::Default::GetDefaultCachePolicyName;
+using QS::Configure::Default::GetDefaultCacheShards;
 using QS::Configure::Default::GetDefaultCredentialsFile;
 using QS::Configure::Default::GetDefaultDiskCacheDirectory;
 using QS::Configure::Default::GetDefaultDirMode;
 using QS::Configure::Default::GetDefaultFileMode;
 using QS::Configure::Default::GetDefaultLogDirectory;
 using QS::Configure::Default::GetDefaultLogLevelName;
+using QS::Configure::Default::GetDefaultDirtyExpireTime;
+using QS::Configure::Default::GetDefaultMaxDirtySize;
+using QS::Configure::Default::GetDefaultMaxRangeGap;
+using QS::Configure::Default::GetDefaultMaxReadahead;
+using QS::Configure::Default::GetDefaultPinQuota;
+using QS::Configure::Default::GetDefaultWarmUpJobs;
+using QS::Configure::Default::GetDefaultMaxDiskCacheSize;
+using QS::Configure::Default::GetDefaultMaxMemorySize;
+using QS::Configure::Default::GetDefaultMaxPageSize;
 using QS::Configure::Default::GetDefaultHostName;
 using QS::Configure::Default::GetDefaultTransactionRetries;
 using QS::Configure::Default::GetDefaultPort;
@@ -74,7 +86,28 @@ Options::Options()
       m_retries(GetDefaultTransactionRetries()),
       m_requestTimeOut(GetDefaultTransactionTimeDuration()),
       m_maxCacheSizeInMB(GetMaxCacheSize() / QS::Size::MB1),
+      m_cacheShards(GetDefaultCacheShards()),
+      m_cacheBlockSizeInKB(GetDefaultCacheBlockSize() / QS::Size::KB1),
+      m_maxPageSizeInMB(GetDefaultMaxPageSize() / QS::Size::MB1),
+      m_maxDiskCacheSizeInMB(GetDefaultMaxDiskCacheSize() / QS::Size::MB1),
+      m_cachePolicy(GetDefaultCachePolicyName()),
+      m_maxMemoryInMB(GetDefaultMaxMemorySize() / QS::Size::MB1),
       m_diskCacheDir(GetDefaultDiskCacheDirectory()),
+      m_persistDiskCache(false),
+      m_compressCache(false),
+      m_hugePages(false),
+      m_dedupCache(false),
+      m_writeBack(false),
+      m_streamUpload(false),
+      m_maxDirtySizeInMB(GetDefaultMaxDirtySize() / QS::Size::MB1),
+      m_dirtyExpireInSec(GetDefaultDirtyExpireTime()),
+      m_journalDir(),
+      m_warmUpManifest(),
+      m_warmUpJobs(GetDefaultWarmUpJobs()),
+      m_pinQuotaInMB(GetDefaultPinQuota() / QS::Size::MB1),
+      m_maxReadaheadInMB(GetDefaultMaxReadahead() / QS::Size::MB1),
+      m_maxRangeGapInKB(GetDefaultMaxRangeGap() / QS::Size::KB1),
+      m_prefetchPaths(),
       m_maxStatCountInK(GetMaxStatCount() / QS::Size::K1),
       m_maxListCount(GetMaxListObjectsCount()),
       m_statExpireInMin(-1),  // default disable state expire
@@ -140,7 +173,23 @@ ostream &operator<<(ostream &os, const Options &opts) {
          << "[retries: " << to_string(opts.m_retries) << "] "
          << "[req timeout(ms): " << to_string(opts.m_requestTimeOut) << "] "
          << "[max cache(MB): " << to_string(opts.m_maxCacheSizeInMB) << "] "
+         << "[cache shards: " << to_string(opts.m_cacheShards) << "] "
+         << "[block size(KB): " << to_string(opts.m_cacheBlockSizeInKB) << "] "
+         << "[max page(MB): " << to_string(opts.m_maxPageSizeInMB) << "] "
+         << "[max disk cache(MB): " << to_string(opts.m_maxDiskCacheSizeInMB)
+         << "] "
+         << "[cache policy: " << opts.m_cachePolicy << "] "
+         << "[max memory(MB): " << to_string(opts.m_maxMemoryInMB) << "] "
          << "[disk cache dir: " << opts.m_diskCacheDir << "] "
+         << "[max dirty(MB): " << to_string(opts.m_maxDirtySizeInMB) << "] "
+         << "[dirty expire(sec): " << to_string(opts.m_dirtyExpireInSec) << "] "
+         << "[journal dir: " << opts.m_journalDir << "] "
+         << "[warm-up manifest: " << opts.m_warmUpManifest << "] "
+         << "[warm-up jobs: " << to_string(opts.m_warmUpJobs) << "] "
+         << "[pin quota(MB): " << to_string(opts.m_pinQuotaInMB) << "] "
+         << "[max readahead(MB): " << to_string(opts.m_maxReadaheadInMB) << "] "
+         << "[max range gap(KB): " << to_string(opts.m_maxRangeGapInKB) << "] "
+         << "[prefetch paths: " << opts.m_prefetchPaths << "] "
          << "[max stat(K): " << to_string(opts.m_maxStatCountInK) << "] "
          << "[max list: " << to_string(opts.m_maxListCount) << "] "
          << "[stat expire(min): " << to_string(opts.m_statExpireInMin) << "] "
@@ -154,6 +203,12 @@ ostream &operator<<(ostream &os, const Options &opts) {
          << std::boolalpha
          << "[enable content md5: " << opts.m_enableContentMD5 << "] "
          << "[clear logdir: " << opts.m_clearLogDir << "] "
+         << "[persist disk cache: " << opts.m_persistDiskCache << "] "
+         << "[compress cache: " << opts.m_compressCache << "] "
+         << "[huge pages: " << opts.m_hugePages << "] "
+         << "[dedup cache: " << opts.m_dedupCache << "] "
+         << "[write back: " << opts.m_writeBack << "] "
+         << "[stream upload: " << opts.m_streamUpload << "] "
          << "[foreground: " << opts.m_foreground << "] "
          << "[FUSE single thread: " << opts.m_singleThread << "] "
          << "[qsfs single thread: " << opts.m_qsfsSingleThread << "] "
@@ -18,6 +18,7 @@
 #define QSFS_CONFIGURE_OPTIONS_H_
 
 #include <stdint.h>  // for uint16_t
+#include <time.h>
 
 #include <sys/stat.h>
 
@@ -70,6 +71,12 @@ class Options : public Singleton<Options> {
   uint16_t GetRetries() const { return m_retries; }
   uint32_t GetRequestTimeOut() const { return m_requestTimeOut; }
   uint32_t GetMaxCacheSizeInMB() const { return m_maxCacheSizeInMB; }
+  uint16_t GetCacheShards() const { return m_cacheShards; }
+  uint32_t GetCacheBlockSizeInKB() const { return m_cacheBlockSizeInKB; }
+  uint32_t GetMaxPageSizeInMB() const { return m_maxPageSizeInMB; }
+  uint32_t GetMaxDiskCacheSizeInMB() const { return m_maxDiskCacheSizeInMB; }
+  const std::string &GetCachePolicy() const { return m_cachePolicy; }
+  uint32_t GetMaxMemoryInMB() const { return m_maxMemoryInMB; }
   const std::string &GetDiskCacheDirectory() const { return m_diskCacheDir; }
   uint32_t GetMaxStatCountInK() const { return m_maxStatCountInK; }
   int32_t GetMaxListCount() const { return m_maxListCount; }
@@ -83,6 +90,23 @@ class Options : public Singleton<Options> {
   const std::string &GetProtocol() const { return m_protocol; }
   uint16_t GetPort() const { return m_port; }
   const std::string &GetAdditionalAgent() const { return m_additionalAgent; }
+  bool IsPersistDiskCache() const { return m_persistDiskCache; }
+  bool IsCompressCache() const { return m_compressCache; }
+  bool IsHugePages() const { return m_hugePages; }
+  bool IsDedupCache() const { return m_dedupCache; }
+  bool IsWriteBack() const { return m_writeBack; }
+  bool IsStreamUpload() const { return m_streamUpload; }
+  uint32_t GetMaxDirtySizeInMB() const { return m_maxDirtySizeInMB; }
+  time_t GetDirtyExpireInSec() const { return m_dirtyExpireInSec; }
+  const std::string &GetJournalDirectory() const { return m_journalDir; }
+  bool IsJournal() const { return !m_journalDir.empty(); }
+  const std::string &GetWarmUpManifest() const { return m_warmUpManifest; }
+  bool IsWarmUp() const { return !m_warmUpManifest.empty(); }
+  uint32_t GetWarmUpJobs() const { return m_warmUpJobs; }
+  uint32_t GetPinQuotaInMB() const { return m_pinQuotaInMB; }
+  uint32_t GetMaxReadaheadInMB() const { return m_maxReadaheadInMB; }
+  uint32_t GetMaxRangeGapInKB() const { return m_maxRangeGapInKB; }
+  const std::string &GetPrefetchPaths() const { return m_prefetchPaths; }
   bool IsEnableContentMD5() const { return m_enableContentMD5; }
   bool IsClearLogDir() const { return m_clearLogDir; }
   bool IsForeground() const { return m_foreground; }
@@ -122,7 +146,34 @@ class Options : public Singleton<Options> {
   void SetRetries(unsigned retries) { m_retries = retries; }
   void SetRequestTimeOut(uint32_t timeout) { m_requestTimeOut = timeout; }
   void SetMaxCacheSizeInMB(uint32_t maxcache) { m_maxCacheSizeInMB = maxcache; }
+  void SetCacheShards(unsigned shards) { m_cacheShards = shards; }
+  void SetCacheBlockSizeInKB(uint32_t blocksize) {
+    m_cacheBlockSizeInKB = blocksize;
+  }
+  void SetMaxPageSizeInMB(uint32_t pagesize) { m_maxPageSizeInMB = pagesize; }
+  void SetMaxDiskCacheSizeInMB(uint32_t maxdiskcache) {
+    m_maxDiskCacheSizeInMB = maxdiskcache;
+  }
+  void SetCachePolicy(const char *policy) { m_cachePolicy = policy; }
+  void SetMaxMemoryInMB(uint32_t maxmemory) { m_maxMemoryInMB = maxmemory; }
   void SetDiskCacheDirectory(const char *diskdir) { m_diskCacheDir = diskdir; }
+  void SetPersistDiskCache(bool persist) { m_persistDiskCache = persist; }
+  void SetCompressCache(bool compress) { m_compressCache = compress; }
+  void SetHugePages(bool hugePages) { m_hugePages = hugePages; }
+  void SetDedupCache(bool dedup) { m_dedupCache = dedup; }
+  void SetWriteBack(bool writeBack) { m_writeBack = writeBack; }
+  void SetStreamUpload(bool streamUpload) { m_streamUpload = streamUpload; }
+  void SetMaxDirtySizeInMB(uint32_t maxdirty) { m_maxDirtySizeInMB = maxdirty; }
+  void SetDirtyExpireInSec(time_t expire) { m_dirtyExpireInSec = expire; }
+  void SetJournalDirectory(const char *dir) { m_journalDir = dir; }
+  void SetWarmUpManifest(const char *manifest) { m_warmUpManifest = manifest; }
+  void SetWarmUpJobs(uint32_t jobs) { m_warmUpJobs = jobs; }
+  void SetPinQuotaInMB(uint32_t quota) { m_pinQuotaInMB = quota; }
+  void SetMaxReadaheadInMB(uint32_t readahead) {
+    m_maxReadaheadInMB = readahead;
+  }
+  void SetMaxRangeGapInKB(uint32_t gap) { m_maxRangeGapInKB = gap; }
+  void SetPrefetchPaths(const char *paths) { m_prefetchPaths = paths; }
   void SetMaxStatCountInK(uint32_t maxstat) { m_maxStatCountInK = maxstat; }
   void SetMaxListCount(int32_t maxlist) { m_maxListCount = maxlist; }
   void SetStatExpireInMin(int32_t expire) { m_statExpireInMin = expire; }
@@ -172,7 +223,28 @@ class Options : public Singleton<Options> {
   uint16_t m_retries;         // transaction retries
   uint32_t m_requestTimeOut;  // in milliseconds
   uint32_t m_maxCacheSizeInMB;
+  uint16_t m_cacheShards;  // count of independently locked cache shards
+  uint32_t m_cacheBlockSizeInKB;  // zero to store file data in pages
+  uint32_t m_maxPageSizeInMB;     // zero not to merge successive pages
+  uint32_t m_maxDiskCacheSizeInMB;  // zero only limited by free disk space
+  std::string m_cachePolicy;        // lru, 2q, arc or tinylfu
+  uint32_t m_maxMemoryInMB;         // memory budget, zero means no limit
   std::string m_diskCacheDir;
+  bool m_persistDiskCache;  // keep disk cache across remount
+  bool m_compressCache;     // compress cold pages in memory
+  bool m_hugePages;         // back page buffers with huge pages
+  bool m_dedupCache;        // share cached pages of the same object content
+  bool m_writeBack;             // upload dirty files by background flusher
+  bool m_streamUpload;          // upload parts of files while written
+  uint32_t m_maxDirtySizeInMB;  // writers block beyond it, zero no limit
+  time_t m_dirtyExpireInSec;    // age of dirty file to be flushed
+  std::string m_journalDir;     // empty not to journal local changes
+  std::string m_warmUpManifest;  // empty not to warm up cache
+  uint32_t m_warmUpJobs;         // parallel downloads of warm-up
+  uint32_t m_pinQuotaInMB;       // zero not to pin warmed up files
+  uint32_t m_maxReadaheadInMB;   // zero not to read ahead
+  uint32_t m_maxRangeGapInKB;    // zero not to download cached gaps
+  std::string m_prefetchPaths;   // paths downloaded in full at open
   uint32_t m_maxStatCountInK;
   int32_t m_maxListCount;        // negative value will list all files for ls
   int32_t m_statExpireInMin;     //  negative value will disable state expire
@@ -0,0 +1,689 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/BlockStore.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/exception/to_string.hpp"
+#include "boost/make_shared.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/tuple/tuple.hpp"
+
+#include "base/LogMacros.h"
+#include "base/StringUtils.h"
+#include "data/DiskFile.h"
+#include "data/MemoryBudget.h"
+#include "data/SlabAllocator.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::make_shared;
+using boost::make_tuple;
+using boost::shared_ptr;
+using boost::to_string;
+using boost::tuple;
+using QS::StringUtils::FormatPath;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+// --------------------------------------------------------------------------
+BlockStore::BlockStore(size_t blockSize)
+    : m_blockSize(1),
+      m_shift(0),
+      m_validSize(0),
+      m_memorySize(0),
+      m_diskSize(0),
+      m_accessTick(0) {
+  assert(blockSize > 0);
+  while (m_blockSize < blockSize) {
+    m_blockSize <<= 1;
+    ++m_shift;
+  }
+  DebugWarningIf(m_blockSize != blockSize,
+                 "Block size " + to_string(blockSize) +
+                     " is not power of two, use " + to_string(m_blockSize));
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::GetNumBlocks() const {
+  size_t num = 0;
+  for (vector<Block>::const_iterator it = m_blocks.begin();
+       it != m_blocks.end(); ++it) {
+    if (it->m_data || it->m_onDisk) {
+      ++num;
+    }
+  }
+  return num;
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::GetMemoryUsage() const {
+  // The vector of a block in memory is allocated along with its shared count,
+  // and its buffer is carved from a slab separately
+  size_t numMemoryBlocks = m_memorySize / m_blockSize;
+  size_t blockOverhead = SharedCountSize() + sizeof(ByteVector) +
+                         SlabPool::Instance().GetChunkSize(m_blockSize) -
+                         m_blockSize;
+  return HeapSize(sizeof(BlockStore)) +
+         HeapSize(m_blocks.capacity() * sizeof(Block)) +
+         m_blocks.size() * EmptyDequeSize() +
+         HeapSize(m_fullBlocks.capacity() / 8) + m_memorySize +
+         numMemoryBlocks * blockOverhead;
+}
+
+// --------------------------------------------------------------------------
+bool BlockStore::HasData(off_t start, size_t size) const {
+  if (size == 0) {
+    return true;
+  }
+  off_t stop = start + static_cast<off_t>(size);
+  size_t first = static_cast<size_t>(start >> m_shift);
+  size_t last = static_cast<size_t>((stop - 1) >> m_shift);
+  if (last >= m_blocks.size()) {
+    return false;
+  }
+  for (size_t i = first; i <= last; ++i) {
+    if (m_fullBlocks[i]) {
+      continue;
+    }
+    off_t s = std::max(start, BlockOffset(i)) - BlockOffset(i);
+    off_t e = std::min(stop, BlockOffset(i + 1)) - BlockOffset(i);
+    bool found = false;
+    const ContentRangeDeque &ranges = m_blocks[i].m_validRanges;
+    for (ContentRangeDeque::const_iterator it = ranges.begin();
+         it != ranges.end(); ++it) {
+      if (it->first <= s && e <= it->first + static_cast<off_t>(it->second)) {
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque BlockStore::GetUnloadedRanges(off_t start,
+                                                size_t size) const {
+  ContentRangeDeque unloaded;
+  if (size == 0) {
+    return unloaded;
+  }
+  off_t stop = start + static_cast<off_t>(size);
+  size_t first = static_cast<size_t>(start >> m_shift);
+  size_t last = static_cast<size_t>((stop - 1) >> m_shift);
+  for (size_t i = first; i <= last; ++i) {
+    off_t blockOff = BlockOffset(i);
+    off_t s = std::max(start, blockOff);
+    off_t e = std::min(stop, BlockOffset(i + 1));
+    ContentRangeDeque ranges = GetValidRanges(i);
+    ContentRangeDeque::const_iterator it = ranges.begin();
+    for (; s < e; ++it) {
+      off_t gapStop = e;
+      off_t next = e;
+      if (it != ranges.end()) {
+        off_t rStart = blockOff + it->first;
+        off_t rStop = rStart + static_cast<off_t>(it->second);
+        if (rStop <= s) {
+          continue;
+        }
+        gapStop = std::min(e, rStart);
+        next = std::min(e, rStop);
+      }
+      if (gapStop > s) {
+        // merge with the previous range if adjacent
+        if (!unloaded.empty() && unloaded.back().first + static_cast<off_t>(
+                                     unloaded.back().second) == s) {
+          unloaded.back().second += static_cast<size_t>(gapStop - s);
+        } else {
+          unloaded.push_back(make_pair(s, static_cast<size_t>(gapStop - s)));
+        }
+      }
+      s = std::max(s, next);
+      if (it == ranges.end()) {
+        break;
+      }
+    }
+  }
+  return unloaded;
+}
+
+// --------------------------------------------------------------------------
+tuple<bool, size_t, size_t> BlockStore::Write(
+    off_t offset, size_t len, const char *buffer,
+    const shared_ptr<DiskFile> &diskFile) {
+  size_t addedMemSize = 0;
+  size_t addedValidSize = 0;
+  size_t pos = 0;
+  while (pos < len) {
+    off_t off = offset + static_cast<off_t>(pos);
+    size_t index = static_cast<size_t>(off >> m_shift);
+    size_t start = static_cast<size_t>(off - BlockOffset(index));
+    size_t sz = std::min(len - pos, m_blockSize - start);
+    tuple<bool, size_t, size_t> res =
+        WriteBlock(index, start, sz, buffer + pos, diskFile);
+    addedMemSize += boost::get<1>(res);
+    addedValidSize += boost::get<2>(res);
+    if (!boost::get<0>(res)) {
+      DebugError("Fail to write block " + to_string(index) + " [offset:size=" +
+                 to_string(off) + ":" + to_string(sz) + "]");
+      return make_tuple(false, addedMemSize, addedValidSize);
+    }
+    pos += sz;
+  }
+  return make_tuple(true, addedMemSize, addedValidSize);
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::Read(off_t offset, size_t len, char *buffer,
+                        const shared_ptr<DiskFile> &diskFile) const {
+  if (len == 0 || m_blocks.empty()) {
+    return 0;
+  }
+  size_t readSize = 0;
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = static_cast<size_t>(offset >> m_shift);
+  size_t last = std::min(static_cast<size_t>((stop - 1) >> m_shift),
+                         m_blocks.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    off_t blockOff = BlockOffset(i);
+    off_t s = std::max(offset, blockOff) - blockOff;
+    off_t e = std::min(stop, BlockOffset(i + 1)) - blockOff;
+    ContentRangeDeque ranges = GetValidRanges(i);
+    for (ContentRangeDeque::const_iterator it = ranges.begin();
+         it != ranges.end(); ++it) {
+      off_t rs = std::max(s, it->first);
+      off_t re = std::min(e, it->first + static_cast<off_t>(it->second));
+      if (rs >= re) {
+        continue;
+      }
+      size_t sz = static_cast<size_t>(re - rs);
+      if (ReadBlock(i, static_cast<size_t>(rs), sz,
+                    buffer + (blockOff + rs - offset), diskFile)) {
+        readSize += sz;
+      }
+    }
+  }
+  return readSize;
+}
+
+// --------------------------------------------------------------------------
+ContentSliceDeque BlockStore::ReadSlices(
+    off_t offset, size_t len, const shared_ptr<DiskFile> &diskFile) const {
+  ContentSliceDeque slices;
+  if (len == 0 || m_blocks.empty()) {
+    return slices;
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = static_cast<size_t>(offset >> m_shift);
+  size_t last = std::min(static_cast<size_t>((stop - 1) >> m_shift),
+                         m_blocks.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    off_t blockOff = BlockOffset(i);
+    off_t s = std::max(offset, blockOff) - blockOff;
+    off_t e = std::min(stop, BlockOffset(i + 1)) - blockOff;
+    ContentRangeDeque ranges = GetValidRanges(i);
+    for (ContentRangeDeque::const_iterator it = ranges.begin();
+         it != ranges.end(); ++it) {
+      off_t rs = std::max(s, it->first);
+      off_t re = std::min(e, it->first + static_cast<off_t>(it->second));
+      if (rs >= re) {
+        continue;
+      }
+      size_t sz = static_cast<size_t>(re - rs);
+      const Block &block = m_blocks[i];
+      if (block.m_data) {
+        slices.push_back(ContentSlice(blockOff + rs, sz, block.m_data,
+                                      static_cast<size_t>(rs)));
+      } else {
+        Buffer buf(new ByteVector(sz));
+        if (ReadBlock(i, static_cast<size_t>(rs), sz, &(*buf)[0], diskFile)) {
+          slices.push_back(
+              ContentSlice(blockOff + rs, sz, buf, 0, ContentTier::Disk));
+        }
+      }
+    }
+  }
+  return slices;
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque BlockStore::GetLoadedRanges() const {
+  ContentRangeDeque loaded;
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    off_t blockOff = BlockOffset(i);
+    ContentRangeDeque ranges = GetValidRanges(i);
+    for (ContentRangeDeque::const_iterator it = ranges.begin();
+         it != ranges.end(); ++it) {
+      off_t start = blockOff + it->first;
+      // merge with the previous range if adjacent
+      if (!loaded.empty() &&
+          loaded.back().first + static_cast<off_t>(loaded.back().second) ==
+              start) {
+        loaded.back().second += it->second;
+      } else {
+        loaded.push_back(make_pair(start, it->second));
+      }
+    }
+  }
+  return loaded;
+}
+
+// --------------------------------------------------------------------------
+void BlockStore::Touch(off_t offset, size_t len) {
+  if (len == 0 || m_blocks.empty()) {
+    return;
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = static_cast<size_t>(offset >> m_shift);
+  size_t last = std::min(static_cast<size_t>((stop - 1) >> m_shift),
+                         m_blocks.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    Block &block = m_blocks[i];
+    block.m_lastAccess = ++m_accessTick;
+    if (block.m_onDisk) {
+      ++block.m_diskHits;
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+pair<bool, size_t> BlockStore::Demote(size_t size,
+                                      const shared_ptr<DiskFile> &diskFile) {
+  // Collect blocks in memory ordered by recency, the least recent first
+  vector<pair<uint64_t, size_t> > blocks;
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    if (m_blocks[i].m_data) {
+      blocks.push_back(make_pair(m_blocks[i].m_lastAccess, i));
+    }
+  }
+  std::sort(blocks.begin(), blocks.end());
+
+  size_t removedMemSize = 0;
+  for (size_t i = 0; i < blocks.size() && removedMemSize < size; ++i) {
+    if (!MoveBlockToDisk(blocks[i].second, diskFile)) {
+      return make_pair(false, removedMemSize);
+    }
+    removedMemSize += m_blockSize;
+  }
+  return make_pair(true, removedMemSize);
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::GetPromotableSize(off_t offset, size_t len,
+                                     unsigned minHits) const {
+  size_t size = 0;
+  if (len == 0 || m_blocks.empty()) {
+    return size;
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = static_cast<size_t>(offset >> m_shift);
+  size_t last = std::min(static_cast<size_t>((stop - 1) >> m_shift),
+                         m_blocks.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    const Block &block = m_blocks[i];
+    if (block.m_onDisk && block.m_diskHits >= minHits) {
+      size += m_blockSize;
+    }
+  }
+  return size;
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::Promote(off_t offset, size_t len, unsigned minHits,
+                           const shared_ptr<DiskFile> &diskFile) {
+  size_t addedMemSize = 0;
+  if (len == 0 || m_blocks.empty() || !diskFile) {
+    return addedMemSize;
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = static_cast<size_t>(offset >> m_shift);
+  size_t last = std::min(static_cast<size_t>((stop - 1) >> m_shift),
+                         m_blocks.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    Block &block = m_blocks[i];
+    if (!block.m_onDisk || block.m_diskHits < minHits) {
+      continue;
+    }
+    Buffer data = make_shared<ByteVector>(m_blockSize);
+    ContentRangeDeque ranges = GetValidRanges(i);
+    bool success = true;
+    for (ContentRangeDeque::const_iterator it = ranges.begin();
+         it != ranges.end(); ++it) {
+      if (!ReadBlock(i, it->first, it->second, &(*data)[it->first],
+                     diskFile)) {
+        success = false;
+        break;
+      }
+    }
+    if (!success) {
+      DebugWarning("Fail to promote block " + to_string(i));
+      continue;
+    }
+    // The bytes left in disk file are overwritten when the block is put to
+    // disk file again
+    block.m_data = data;
+    block.m_onDisk = false;
+    block.m_diskHits = 0;
+    m_diskSize -= m_blockSize;
+    m_memorySize += m_blockSize;
+    addedMemSize += m_blockSize;
+  }
+  return addedMemSize;
+}
+
+// --------------------------------------------------------------------------
+pair<size_t, size_t> BlockStore::Evict(size_t size, bool onDisk,
+                                       const shared_ptr<DiskFile> &diskFile,
+                                       const ContentRangeDeque &dirtyRanges) {
+  // Collect blocks of the tier ordered by recency, the least recent first
+  vector<pair<uint64_t, size_t> > blocks;
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    const Block &block = m_blocks[i];
+    if ((onDisk ? block.m_onDisk : static_cast<bool>(block.m_data)) &&
+        !IntersectContentRanges(dirtyRanges, BlockOffset(i), m_blockSize)) {
+      blocks.push_back(make_pair(block.m_lastAccess, i));
+    }
+  }
+  std::sort(blocks.begin(), blocks.end());
+
+  size_t removedSize = 0;
+  size_t removedMemSize = 0;
+  size_t removedValidSize = 0;
+  for (size_t i = 0; i < blocks.size() && removedSize < size; ++i) {
+    size_t index = blocks[i].second;
+    if (onDisk && diskFile) {
+      diskFile->Discard(BlockOffset(index), m_blockSize);
+    }
+    pair<size_t, size_t> res = ReleaseBlock(index);
+    removedMemSize += res.first;
+    removedValidSize += res.second;
+    removedSize += m_blockSize;
+  }
+  m_memorySize -= removedMemSize;
+  m_validSize -= removedValidSize;
+  return make_pair(removedSize, removedValidSize);
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::DropDiskBlocks() {
+  size_t removedValidSize = 0;
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    if (m_blocks[i].m_onDisk) {
+      removedValidSize += ReleaseBlock(i).second;
+    }
+  }
+  m_validSize -= removedValidSize;
+  return removedValidSize;
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::DropDiskRange(off_t offset, size_t len) {
+  if (len == 0 || m_blocks.empty()) {
+    return 0;
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = static_cast<size_t>(offset >> m_shift);
+  size_t last = std::min(static_cast<size_t>((stop - 1) >> m_shift),
+                         m_blocks.size() - 1);
+  size_t removedValidSize = 0;
+  for (size_t i = first; i <= last; ++i) {
+    if (m_blocks[i].m_onDisk) {
+      removedValidSize += ReleaseBlock(i).second;
+    }
+  }
+  m_validSize -= removedValidSize;
+  return removedValidSize;
+}
+
+// --------------------------------------------------------------------------
+pair<bool, size_t> BlockStore::Persist(
+    const shared_ptr<DiskFile> &diskFile) {
+  size_t removedMemSize = 0;
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    if (!m_blocks[i].m_data) {
+      continue;
+    }
+    if (!MoveBlockToDisk(i, diskFile)) {
+      return make_pair(false, removedMemSize);
+    }
+    removedMemSize += m_blockSize;
+  }
+  return make_pair(true, removedMemSize);
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::Restore(off_t offset, size_t len) {
+  size_t addedValidSize = 0;
+  size_t pos = 0;
+  while (pos < len) {
+    off_t off = offset + static_cast<off_t>(pos);
+    size_t index = static_cast<size_t>(off >> m_shift);
+    size_t start = static_cast<size_t>(off - BlockOffset(index));
+    size_t sz = std::min(len - pos, m_blockSize - start);
+    if (index >= m_blocks.size()) {
+      m_blocks.resize(index + 1);
+      m_fullBlocks.resize(index + 1, false);
+    }
+    Block &block = m_blocks[index];
+    if (!block.m_data) {
+      if (!block.m_onDisk) {
+        block.m_onDisk = true;
+        m_diskSize += m_blockSize;
+      }
+      addedValidSize += AddValidRange(index, start, sz);
+    }
+    pos += sz;
+  }
+  return addedValidSize;
+}
+
+// --------------------------------------------------------------------------
+pair<size_t, size_t> BlockStore::Truncate(size_t size) {
+  size_t removedMemSize = 0;
+  size_t removedValidSize = 0;
+  size_t numBlocks = (size + m_blockSize - 1) >> m_shift;  // blocks to keep
+  for (size_t i = numBlocks; i < m_blocks.size(); ++i) {
+    pair<size_t, size_t> res = ReleaseBlock(i);
+    removedMemSize += res.first;
+    removedValidSize += res.second;
+  }
+  if (numBlocks < m_blocks.size()) {
+    m_blocks.resize(numBlocks);
+    m_fullBlocks.resize(numBlocks);
+  }
+
+  // Discard the bytes after size in the last kept block
+  size_t last = numBlocks - 1;
+  if (numBlocks > 0 && numBlocks <= m_blocks.size() &&
+      size - static_cast<size_t>(BlockOffset(last)) < m_blockSize) {
+    size_t lastSize = size - static_cast<size_t>(BlockOffset(last));
+    Block &block = m_blocks[last];
+    ContentRangeDeque ranges = GetValidRanges(last);
+    ContentRangeDeque kept;
+    size_t keptSize = 0;
+    for (ContentRangeDeque::iterator it = ranges.begin(); it != ranges.end();
+         ++it) {
+      if (it->first >= static_cast<off_t>(lastSize)) {
+        break;
+      }
+      size_t sz = std::min(it->second, lastSize - it->first);
+      kept.push_back(make_pair(it->first, sz));
+      keptSize += sz;
+    }
+    removedValidSize += block.m_validSize - keptSize;
+    block.m_validSize = keptSize;
+    block.m_validRanges.swap(kept);
+    m_fullBlocks[last] = false;
+    if (keptSize == 0) {
+      pair<size_t, size_t> res = ReleaseBlock(last);
+      removedMemSize += res.first;
+    }
+  }
+
+  m_memorySize -= removedMemSize;
+  m_validSize -= removedValidSize;
+  return make_pair(removedMemSize, removedValidSize);
+}
+
+// --------------------------------------------------------------------------
+void BlockStore::Clear() {
+  m_blocks.clear();
+  m_fullBlocks.clear();
+  m_validSize = 0;
+  m_memorySize = 0;
+  m_diskSize = 0;
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque BlockStore::GetValidRanges(size_t index) const {
+  ContentRangeDeque ranges;
+  if (index >= m_blocks.size()) {
+    return ranges;
+  }
+  if (m_fullBlocks[index]) {
+    ranges.push_back(make_pair(0, m_blockSize));
+    return ranges;
+  }
+  return m_blocks[index].m_validRanges;
+}
+
+// --------------------------------------------------------------------------
+tuple<bool, size_t, size_t> BlockStore::WriteBlock(
+    size_t index, size_t start, size_t len, const char *buffer,
+    const shared_ptr<DiskFile> &diskFile) {
+  assert(start + len <= m_blockSize);
+  if (index >= m_blocks.size()) {
+    m_blocks.resize(index + 1);
+    m_fullBlocks.resize(index + 1, false);
+  }
+  Block &block = m_blocks[index];
+  size_t addedMemSize = 0;
+  if (!block.m_data && !block.m_onDisk) {
+    if (!diskFile) {
+      block.m_data = make_shared<ByteVector>(m_blockSize);
+      addedMemSize = m_blockSize;
+      m_memorySize += m_blockSize;
+    } else {
+      block.m_onDisk = true;
+      m_diskSize += m_blockSize;
+      // Preallocate the whole block, as it is likely to be filled later
+      diskFile->Allocate(BlockOffset(index), m_blockSize);
+    }
+  }
+  block.m_lastAccess = ++m_accessTick;
+
+  if (block.m_data) {
+    memcpy(&(*block.m_data)[start], buffer, len);
+  } else {
+    if (!diskFile->Write(BlockOffset(index) + start, len, buffer)) {
+      DebugError("Fail to write disk file " + FormatPath(diskFile->GetPath()));
+      return make_tuple(false, addedMemSize, 0);
+    }
+  }
+
+  return make_tuple(true, addedMemSize, AddValidRange(index, start, len));
+}
+
+// --------------------------------------------------------------------------
+size_t BlockStore::AddValidRange(size_t index, size_t start, size_t len) {
+  size_t addedValidSize = 0;
+  if (!m_fullBlocks[index]) {
+    Block &block = m_blocks[index];
+    addedValidSize = AddContentRange(&block.m_validRanges, start, len);
+    block.m_validSize += addedValidSize;
+    if (block.m_validSize == m_blockSize) {
+      m_fullBlocks[index] = true;
+      block.m_validRanges.clear();
+    }
+  }
+  m_validSize += addedValidSize;
+  return addedValidSize;
+}
+
+// --------------------------------------------------------------------------
+bool BlockStore::MoveBlockToDisk(size_t index,
+                                 const shared_ptr<DiskFile> &diskFile) {
+  Block &block = m_blocks[index];
+  assert(block.m_data);
+  ContentRangeDeque ranges = GetValidRanges(index);
+  for (ContentRangeDeque::const_iterator it = ranges.begin();
+       it != ranges.end(); ++it) {
+    if (!diskFile->Write(BlockOffset(index) + it->first, it->second,
+                         &(*block.m_data)[it->first])) {
+      DebugError("Fail to write disk file " + FormatPath(diskFile->GetPath()));
+      return false;
+    }
+  }
+  block.m_data.reset();
+  block.m_onDisk = true;
+  block.m_diskHits = 0;
+  m_memorySize -= m_blockSize;
+  m_diskSize += m_blockSize;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool BlockStore::ReadBlock(size_t index, size_t start, size_t len,
+                           char *buffer,
+                           const shared_ptr<DiskFile> &diskFile) const {
+  assert(start + len <= m_blockSize);
+  const Block &block = m_blocks[index];
+  if (block.m_data) {
+    memcpy(buffer, &(*block.m_data)[start], len);
+    return true;
+  } else if (block.m_onDisk && diskFile) {
+    bool success =
+        diskFile->Read(BlockOffset(index) + start, len, buffer) == len;
+    DebugErrorIf(!success,
+                 "Fail to read disk file " + FormatPath(diskFile->GetPath()));
+    return success;
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------
+pair<size_t, size_t> BlockStore::ReleaseBlock(size_t index) {
+  Block &block = m_blocks[index];
+  size_t memSize = block.m_data ? m_blockSize : 0;
+  size_t validSize = block.m_validSize;
+  if (block.m_onDisk) {
+    m_diskSize -= m_blockSize;
+  }
+  block.m_data.reset();
+  block.m_onDisk = false;
+  block.m_validSize = 0;
+  block.m_validRanges.clear();
+  block.m_diskHits = 0;
+  m_fullBlocks[index] = false;
+  return make_pair(memSize, validSize);
+}
+
+}  // namespace Data
+}  // namespace QS
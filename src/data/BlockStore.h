@@ -0,0 +1,285 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_DATA_BLOCKSTORE_H_
+#define QSFS_DATA_BLOCKSTORE_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint64_t
+
+#include <sys/types.h>  // for off_t
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/tuple/tuple.hpp"
+
+#include "data/Page.h"  // for ContentRangeDeque, ContentSliceDeque
+
+namespace QS {
+
+namespace Data {
+
+class DiskFile;
+
+// BlockStore stores file content in fixed size blocks
+//
+// +---------------------------------------------------+
+// | block 0 | block 1 | block 2 | ...                  |
+// +---------------------------------------------------+
+// ^         ^
+// 0         block size
+//
+// Block size is power of two, so the block containing a file offset is
+// m_blocks[offset >> m_shift]. A block is fully loaded when its bit in the
+// validity bitmap is set, otherwise the loaded bytes are recorded by a short
+// list of ranges in the block.
+//
+// A block is either stored in memory, or stored in the disk file at the same
+// offset of the file when in-memory cache is not available. The least recently
+// accessed blocks in memory could be demoted to disk file, and the blocks in
+// disk file which are accessed frequently could be promoted back to memory.
+// The least recently accessed blocks of either tier could also be evicted to
+// free space, without discarding the whole file.
+//
+// BlockStore is not thread safe, the owning File should guard it.
+class BlockStore : private boost::noncopyable {
+ public:
+  // @param  : block size which should be power of two
+  explicit BlockStore(size_t blockSize);
+
+  ~BlockStore() {}
+
+ public:
+  size_t GetBlockSize() const { return m_blockSize; }
+
+  // Return sum of the loaded bytes
+  size_t GetValidSize() const { return m_validSize; }
+
+  // Return sum of the size of blocks stored in memory
+  size_t GetMemorySize() const { return m_memorySize; }
+
+  // Return sum of the size of blocks stored in disk file
+  size_t GetDiskSize() const { return m_diskSize; }
+
+  // Return num of blocks containing data
+  size_t GetNumBlocks() const;
+
+  // Return memory held by the block store, including the buffers of blocks
+  size_t GetMemoryUsage() const;
+
+  // Whether the content range is loaded
+  //
+  // @param  : content range start, content range size
+  // @return : bool
+  bool HasData(off_t start, size_t size) const;
+
+  // Return the unloaded content ranges
+  //
+  // @param  : content range start, content range size
+  // @return : a list of pair {range start, range size}
+  ContentRangeDeque GetUnloadedRanges(off_t start, size_t size) const;
+
+  // Write a block of bytes
+  //
+  // @param  : file offset, len, buffer, disk file
+  // @return : {success, added size in memory, added loaded size}
+  //
+  // New blocks are stored in disk file if disk file is not null.
+  boost::tuple<bool, size_t, size_t> Write(
+      off_t offset, size_t len, const char *buffer,
+      const boost::shared_ptr<DiskFile> &diskFile);
+
+  // Read loaded bytes into buffer
+  //
+  // @param  : file offset, len, buffer, disk file
+  // @return : size of loaded bytes which have been read
+  //
+  // Byte at file offset 'off' is put to buffer[off - offset], bytes not
+  // loaded are left untouched.
+  size_t Read(off_t offset, size_t len, char *buffer,
+              const boost::shared_ptr<DiskFile> &diskFile) const;
+
+  // Return slices of loaded bytes
+  //
+  // @param  : file offset, len, disk file
+  // @return : slices sorted by offset
+  //
+  // Slices of blocks in memory share the block's buffer.
+  ContentSliceDeque ReadSlices(
+      off_t offset, size_t len,
+      const boost::shared_ptr<DiskFile> &diskFile) const;
+
+  // Return the loaded content ranges
+  //
+  // @param  : void
+  // @return : a list of pair {range start, range size} sorted by start
+  ContentRangeDeque GetLoadedRanges() const;
+
+  // Record an access to the blocks of the content range
+  //
+  // @param  : file offset, len
+  // @return : void
+  //
+  // This updates the recency of blocks, and counts the hits of blocks stored
+  // in disk file.
+  void Touch(off_t offset, size_t len);
+
+  // Move the least recently accessed blocks in memory into disk file
+  //
+  // @param  : size to remove from memory, disk file
+  // @return : {success, removed size in memory}
+  std::pair<bool, size_t> Demote(size_t size,
+                                 const boost::shared_ptr<DiskFile> &diskFile);
+
+  // Return sum of the size of blocks in disk file which could be promoted
+  //
+  // @param  : file offset, len, min hits
+  // @return : size
+  //
+  // A block in disk file of the content range is promotable if it has been
+  // accessed at least 'min hits' times since it is put to disk file.
+  size_t GetPromotableSize(off_t offset, size_t len, unsigned minHits) const;
+
+  // Move the promotable blocks of the content range back to memory
+  //
+  // @param  : file offset, len, min hits, disk file
+  // @return : added size in memory
+  size_t Promote(off_t offset, size_t len, unsigned minHits,
+                 const boost::shared_ptr<DiskFile> &diskFile);
+
+  // Remove the least recently accessed blocks of a tier
+  //
+  // @param  : size to remove, remove blocks in disk file or in memory,
+  //           disk file, dirty ranges
+  // @return : {removed size of the tier, removed loaded size}
+  //
+  // The disk space of the blocks removed from disk file is released. Blocks
+  // intersecting with the dirty ranges are kept, as the changes are not
+  // uploaded yet.
+  std::pair<size_t, size_t> Evict(size_t size, bool onDisk,
+                                  const boost::shared_ptr<DiskFile> &diskFile,
+                                  const ContentRangeDeque &dirtyRanges);
+
+  // Remove the blocks stored in disk file
+  //
+  // @param  : void
+  // @return : removed loaded size
+  size_t DropDiskBlocks();
+
+  // Remove the blocks stored in disk file which intersect with the range
+  //
+  // @param  : file offset, len
+  // @return : removed loaded size
+  size_t DropDiskRange(off_t offset, size_t len);
+
+  // Move the blocks stored in memory into disk file
+  //
+  // @param  : disk file
+  // @return : {success, removed size in memory}
+  std::pair<bool, size_t> Persist(
+      const boost::shared_ptr<DiskFile> &diskFile);
+
+  // Restore the bytes which are already stored in disk file
+  //
+  // @param  : file offset, len
+  // @return : added loaded size
+  //
+  // Blocks stored in memory are not touched, so their bytes are skipped.
+  size_t Restore(off_t offset, size_t len);
+
+  // Discard the bytes after the given size
+  //
+  // @param  : size
+  // @return : {removed size in memory, removed loaded size}
+  std::pair<size_t, size_t> Truncate(size_t size);
+
+  // Remove all blocks
+  void Clear();
+
+ private:
+  BlockStore()
+      : m_blockSize(0),
+        m_shift(0),
+        m_validSize(0),
+        m_memorySize(0),
+        m_diskSize(0),
+        m_accessTick(0) {}
+
+  struct Block {
+    Block() : m_onDisk(false), m_validSize(0), m_lastAccess(0), m_diskHits(0) {}
+
+    Buffer m_data;  // null if not in memory
+    bool m_onDisk;
+    size_t m_validSize;
+    uint64_t m_lastAccess;  // access tick when the block is accessed last time
+    unsigned m_diskHits;    // accesses since the block is put to disk file
+    // loaded ranges relative to block start, sorted and not overlapped,
+    // it is empty when the block is fully loaded
+    ContentRangeDeque m_validRanges;
+  };
+
+  // Return block start offset in file
+  off_t BlockOffset(size_t index) const {
+    return static_cast<off_t>(index) << m_shift;
+  }
+
+  // Return loaded ranges of block, relative to block start
+  ContentRangeDeque GetValidRanges(size_t index) const;
+
+  // Write into block, the range should be inside the block
+  // Return {success, added size in memory, added loaded size}
+  boost::tuple<bool, size_t, size_t> WriteBlock(
+      size_t index, size_t start, size_t len, const char *buffer,
+      const boost::shared_ptr<DiskFile> &diskFile);
+
+  // Mark range as loaded in block, the range should be inside the block
+  // Return added loaded size
+  size_t AddValidRange(size_t index, size_t start, size_t len);
+
+  // Write the loaded bytes of block in memory into disk file, and release
+  // the block's memory
+  bool MoveBlockToDisk(size_t index,
+                       const boost::shared_ptr<DiskFile> &diskFile);
+
+  // Read from block, the range should be inside the block
+  bool ReadBlock(size_t index, size_t start, size_t len, char *buffer,
+                 const boost::shared_ptr<DiskFile> &diskFile) const;
+
+  // Release block and return {removed size in memory, removed loaded size}
+  std::pair<size_t, size_t> ReleaseBlock(size_t index);
+
+ private:
+  size_t m_blockSize;
+  unsigned m_shift;  // log2 of block size
+
+  std::vector<Block> m_blocks;     // indexed by offset >> m_shift
+  std::vector<bool> m_fullBlocks;  // validity bitmap of blocks
+
+  size_t m_validSize;
+  size_t m_memorySize;
+  size_t m_diskSize;
+  uint64_t m_accessTick;  // increased at each access of blocks
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_BLOCKSTORE_H_
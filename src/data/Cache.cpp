@@ -20,7 +20,7 @@
 #include <string.h>
 
 #include <algorithm>
-#include <list>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -28,26 +28,39 @@
 #include "boost/exception/to_string.hpp"
 #include "boost/make_shared.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/recursive_mutex.hpp"
 #include "boost/tuple/tuple.hpp"
 
+#include "base/HashUtils.h"
 #include "base/LogMacros.h"
+#include "base/Size.h"
 #include "base/StringUtils.h"
 #include "base/TimeUtils.h"
 #include "base/Utils.h"
 #include "base/UtilsWithLog.h"
 #include "configure/Options.h"
+#include "data/CachePolicy.h"
 #include "data/File.h"
+#include "data/IOStream.h"
+#include "data/MemoryBudget.h"
 #include "data/Page.h"
+#include "data/StreamBuf.h"
 #include "data/StreamUtils.h"
 
 namespace QS {
 
 namespace Data {
 
+using boost::lock_guard;
 using boost::make_shared;
+using boost::mutex;
+using boost::recursive_mutex;
 using boost::shared_ptr;
 using boost::to_string;
 using boost::tuple;
+using boost::unique_lock;
 using QS::Data::StreamUtils::GetStreamSize;
 using QS::StringUtils::FormatPath;
 using QS::StringUtils::PointerAddress;
@@ -55,96 +68,297 @@ using QS::TimeUtils::SecondsToRFC822GMT;
 using QS::UtilsWithLog::CreateDirectoryIfNotExists;
 using QS::UtilsWithLog::IsSafeDiskSpace;
 using std::iostream;
-using std::list;
 using std::make_pair;
 using std::pair;
+using std::set;
 using std::string;
 using std::vector;
 
+namespace {
+
+// A file holding more than this fraction of the capacity of a tier (and not
+// less than the min size) is large, its least recently used ranges are evicted
+// before evicting any file.
+const uint64_t kLargeFileFraction = 8;
+const size_t kMinLargeFileSize = QS::Size::MB1;
+
+// Return the size above which a file is large in a tier of the capacity
+size_t GetLargeFileSize(uint64_t capacity) {
+  return std::max(static_cast<size_t>(capacity / kLargeFileFraction),
+                  kMinLargeFileSize);
+}
+
+// Return memory used by the entry of a file in cache, which is linked in cache
+// list, cache map and eviction policy
+size_t GetFileEntrySize(const string &fileId) {
+  return ListNodeSize(sizeof(FileIdToFilePair)) +
+         HashNodeSize(sizeof(FileIdToCacheListIteratorMap::value_type)) +
+         ListNodeSize(sizeof(string)) +
+         HashNodeSize(sizeof(string) + 4 * sizeof(void *)) +
+         4 * StringSize(fileId) + SharedCountSize();
+}
+
+// Choose the first candidate which is not open and is not fileUnfreeable.
+// If onDisk is true, the candidate should have more than minSize bytes in
+// disk file, otherwise if minSize is not zero, the candidate should have more
+// than minSize bytes in memory.
+class EvictVisitor : public CachePolicyVisitor {
+ public:
+  // A min size of zero visits the files to evict entirely, which skips the
+  // files with changes not uploaded. Otherwise it visits the files larger
+  // than min size to evict partially, except the excluded ones.
+  EvictVisitor(const FileIdToCacheListIteratorMap &map,
+               const string &fileUnfreeable, bool onDisk = false,
+               size_t minSize = 0, const set<string> *excluded = NULL)
+      : m_map(map),
+        m_fileUnfreeable(fileUnfreeable),
+        m_onDisk(onDisk),
+        m_minSize(minSize),
+        m_excluded(excluded) {}
+
+  bool Visit(const string &fileId) {
+    if (fileId == m_fileUnfreeable ||
+        (m_excluded != NULL && m_excluded->count(fileId) > 0)) {
+      return false;
+    }
+    CacheMapConstIterator it = m_map.find(fileId);
+    const shared_ptr<File> &file =
+        it == m_map.end() ? shared_ptr<File>() : it->second->second;
+    if (!file || file->IsOpen() || (m_minSize == 0 && file->IsDirty())) {
+      return false;
+    }
+    if (m_onDisk ? file->GetDiskSize() <= m_minSize
+                 : m_minSize > 0 && file->GetCachedSize() <= m_minSize) {
+      return false;
+    }
+    m_victim = fileId;
+    return true;
+  }
+
+  const string &GetVictim() const { return m_victim; }
+
+ private:
+  const FileIdToCacheListIteratorMap &m_map;
+  const string &m_fileUnfreeable;
+  bool m_onDisk;
+  size_t m_minSize;
+  const set<string> *m_excluded;
+  string m_victim;
+};
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+Cache::Cache(uint64_t capacity, size_t numShards, size_t blockSize,
+             size_t maxPageSize, uint64_t diskCapacity,
+             CachePolicyType::Value policy)
+    : m_size(0),
+      m_memoryUsage(0),
+      m_capacity(capacity),
+      m_diskSize(0),
+      m_diskCapacity(diskCapacity),
+      m_demoting(false),
+      m_pinnedSize(0),
+      m_pinQuota(0),
+      m_blockSize(blockSize),
+      m_maxPageSize(maxPageSize),
+      m_compression(false),
+      m_dedup(false),
+      m_policy(policy) {
+  if (numShards == 0) {
+    numShards = 1;
+  }
+  m_shards.reserve(numShards);
+  for (size_t i = 0; i < numShards; ++i) {
+    m_shards.push_back(make_shared<Shard>(policy));
+  }
+}
+
+// --------------------------------------------------------------------------
+Cache::~Cache() {
+  // Release the memory charged by the files left in cache
+  MemoryBudget::Instance().Subtract(MemoryUser::Cache, GetMemoryUsage());
+}
+
 // --------------------------------------------------------------------------
 bool Cache::HasFreeSpace(size_t size) const {
-  return GetSize() + size <= GetCapacity();
+  return GetSize() + size <= GetCapacity() &&
+         MemoryBudget::Instance().HasFreeSpace(size);
+}
+
+// --------------------------------------------------------------------------
+bool Cache::HasFreeDiskSpace(size_t size) const {
+  return m_diskCapacity == 0 || GetDiskSize() + size <= m_diskCapacity;
 }
 
 // --------------------------------------------------------------------------
 bool Cache::IsLastFileOpen() const {
-  if (m_cache.empty()) {
-    return false;
+  bool hasFile = false;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    const Shard &shard = *m_shards[i];
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    if (shard.m_cache.empty()) {
+      continue;
+    }
+    hasFile = true;
+    if (!shard.m_cache.back().second->IsOpen()) {
+      return false;
+    }
   }
-  return m_cache.back().second->IsOpen();
+  return hasFile;
 }
 
 // --------------------------------------------------------------------------
 bool Cache::HasFileData(const string &filePath, off_t start,
                         size_t size) const {
-  if (!HasFile(filePath)) {
+  shared_ptr<File> file = GetFile(filePath);
+  if (!file) {
     return false;
   }
   assert(size > 0);
   if (size == 0) {
     return true;
   }
-  CacheMapConstIterator it = m_map.find(filePath);
-  shared_ptr<File> &file = it->second->second;
   return file->HasData(start, size);
 }
 
 // --------------------------------------------------------------------------
 ContentRangeDeque Cache::GetUnloadedRanges(const string &filePath, off_t start,
                                            size_t size) const {
-  ContentRangeDeque ranges;
-  if (!HasFile(filePath)) {
+  shared_ptr<File> file = GetFile(filePath);
+  if (!file) {
+    ContentRangeDeque ranges;
     ranges.push_back(make_pair(start, size));
     return ranges;
   }
-  CacheMapConstIterator it = m_map.find(filePath);
-  assert(it != m_map.end());
-  shared_ptr<File> &file = it->second->second;
 
   return file->GetUnloadedRanges(start, size);
 }
 
+// --------------------------------------------------------------------------
+ContentRangeDeque Cache::GetDirtyRanges(const string &filePath) const {
+  shared_ptr<File> file = GetFile(filePath);
+  return file ? file->GetDirtyRanges() : ContentRangeDeque();
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque Cache::SnapshotDirtyRanges(const string &filePath,
+                                             uint64_t *snapshot) {
+  *snapshot = 0;
+  shared_ptr<File> file = GetFile(filePath);
+  return file ? file->SnapshotDirtyRanges(snapshot) : ContentRangeDeque();
+}
+
+// --------------------------------------------------------------------------
+size_t Cache::GetDirtySize(const string &filePath) const {
+  shared_ptr<File> file = GetFile(filePath);
+  return file ? file->GetDirtySize() : 0;
+}
+
 // --------------------------------------------------------------------------
 bool Cache::HasFile(const string &filePath) const {
-  return m_map.find(filePath) != m_map.end();
+  const Shard &shard = GetShard(filePath);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  return shard.m_map.find(filePath) != shard.m_map.end();
 }
 
 // --------------------------------------------------------------------------
-size_t Cache::GetNumFile() const { return m_map.size(); }
+size_t Cache::GetNumFile() const {
+  size_t numFile = 0;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    const Shard &shard = *m_shards[i];
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    numFile += shard.m_map.size();
+  }
+  return numFile;
+}
 
 // --------------------------------------------------------------------------
-time_t Cache::GetTime(const string &fileId) const {
-  CacheMapConstIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
-    shared_ptr<File> &file = it->second->second;
-    return file->GetTime();
-  } else {
-    return 0;
+vector<string> Cache::GetFileIds() const {
+  vector<string> fileIds;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    const Shard &shard = *m_shards[i];
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    for (CacheListConstIterator it = shard.m_cache.begin();
+         it != shard.m_cache.end(); ++it) {
+      fileIds.push_back(it->first);
+    }
   }
+  return fileIds;
 }
 
 // --------------------------------------------------------------------------
-uint64_t Cache::GetFileSize(const std::string &filePath) const {
-  CacheMapConstIterator it = m_map.find(filePath);
-  if (it != m_map.end()) {
-    shared_ptr<File> &file = it->second->second;
-    return file->GetSize();
-  } else {
-    return 0;
+uint64_t Cache::GetSize() const {
+  lock_guard<mutex> lock(m_sizeLock);
+  return m_size;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Cache::GetMemoryUsage() const {
+  lock_guard<mutex> lock(m_sizeLock);
+  return m_memoryUsage;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Cache::GetDiskSize() const {
+  lock_guard<mutex> lock(m_sizeLock);
+  return m_diskSize;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Cache::GetPinnedSize() const {
+  lock_guard<mutex> lock(m_sizeLock);
+  return m_pinnedSize;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Cache::GetPinQuota() const {
+  lock_guard<mutex> lock(m_sizeLock);
+  return m_pinQuota;
+}
+
+// --------------------------------------------------------------------------
+void Cache::SetPinQuota(uint64_t quota) {
+  lock_guard<mutex> lock(m_sizeLock);
+  m_pinQuota = quota;
+}
+
+// --------------------------------------------------------------------------
+CachePolicyStats Cache::GetPolicyStats() const {
+  CachePolicyStats stats;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    const Shard &shard = *m_shards[i];
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    stats += shard.m_stats;
   }
+  return stats;
+}
+
+// --------------------------------------------------------------------------
+time_t Cache::GetTime(const string &fileId) const {
+  shared_ptr<File> file = GetFile(fileId);
+  return file ? file->GetTime() : 0;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Cache::GetFileSize(const std::string &filePath) const {
+  shared_ptr<File> file = GetFile(filePath);
+  return file ? file->GetSize() : 0;
 }
 
 // --------------------------------------------------------------------------
 CacheListIterator Cache::Find(const string &filePath) {
-  CacheMapIterator it = m_map.find(filePath);
-  return it != m_map.end() ? it->second : m_cache.end();
+  Shard &shard = GetShard(filePath);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheMapIterator it = shard.m_map.find(filePath);
+  return it != shard.m_map.end() ? it->second : shard.m_cache.end();
 }
 
 // --------------------------------------------------------------------------
-CacheListIterator Cache::Begin() { return m_cache.begin(); }
+CacheListIterator Cache::Begin() { return m_shards[0]->m_cache.begin(); }
 
 // --------------------------------------------------------------------------
-CacheListIterator Cache::End() { return m_cache.end(); }
+CacheListIterator Cache::End() { return m_shards[0]->m_cache.end(); }
 
 // --------------------------------------------------------------------------
 pair<size_t, ContentRangeDeque> Cache::Read(const string &fileId, off_t offset,
@@ -165,86 +379,180 @@ pair<size_t, ContentRangeDeque> Cache::Read(const string &fileId, off_t offset,
     return make_pair(0, unloadedRanges);
   }
 
+  pair<ContentSliceDeque, ContentRangeDeque> outcome =
+      ReadSlices(fileId, offset, len, mtimeSince);
+  // Copy slices to buffer, only the holes are filled with zero
+  size_t readSize = CopySlices(outcome.first, offset, len, buffer);
+  return make_pair(readSize, outcome.second);
+}
+
+// --------------------------------------------------------------------------
+pair<ContentSliceDeque, ContentRangeDeque> Cache::ReadSlices(
+    const string &fileId, off_t offset, size_t len, time_t mtimeSince) {
+  ContentSliceDeque slices;
+  ContentRangeDeque unloadedRanges;
+  if (len == 0) {
+    return make_pair(slices, unloadedRanges);
+  }
+
+  bool validInput = !fileId.empty() && offset >= 0;
+  assert(validInput);
+  if (!validInput) {
+    DebugError("Try to read cache with invalid input " +
+               FormatPath(fileId) + ToStringLine(offset, len));
+    return make_pair(slices, unloadedRanges);
+  }
+
   DebugInfo("Read cache [offset:len=" + to_string(offset) + ":" +
             to_string(len) + "] " + FormatPath(fileId));
-  memset(buffer, 0, len);  // Clear input buffer.
-  size_t cachedSizeBegin = 0;
-  CacheListIterator pos = m_cache.begin();
-  CacheMapIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
-    pos = UnguardedMakeFileMostRecentlyUsed(it->second);
-    cachedSizeBegin = pos->second->GetCachedSize();
-  } else {
-    DebugInfo("File not exist in cache. Create new one" + fileId);
-    pos = UnguardedNewEmptyFile(fileId, mtimeSince);
-    unloadedRanges.push_back(make_pair(offset, len));
-    return make_pair(0, unloadedRanges);
+  Shard &shard = GetShard(fileId);
+  shared_ptr<File> file;
+  {
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    CacheMapIterator it = shard.m_map.find(fileId);
+    if (it != shard.m_map.end()) {
+      CacheListIterator pos =
+          UnguardedMakeFileMostRecentlyUsed(shard, it->second);
+      file = pos->second;
+      if (file->HasData(offset, len)) {
+        ++shard.m_stats.m_hits;
+      } else {
+        ++shard.m_stats.m_misses;
+      }
+    } else {
+      DebugInfo("File not exist in cache. Create new one" + fileId);
+      ++shard.m_stats.m_misses;
+      UnguardedNewEmptyFile(shard, fileId, mtimeSince);
+      unloadedRanges.push_back(make_pair(offset, len));
+      return make_pair(slices, unloadedRanges);
+    }
   }
 
-  assert(pos != m_cache.end());
-  shared_ptr<File> &file = pos->second;
+  // Read file without holding the shard lock, as file is guarded by itself.
+  // Reading adds no content to file, so the cache size is not changed.
+  assert(file);
   if (mtimeSince > file->GetTime()) {
     DebugWarning("File too old, read no bytes " + FormatPath(fileId) +
                  "[mtime:" + SecondsToRFC822GMT(mtimeSince) +
                  ", file time:" + SecondsToRFC822GMT(file->GetTime()) + "]");
   }
-  tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> outcome =
-      file->Read(offset, len, mtimeSince);
-  size_t readedFileSize = boost::get<0>(outcome);
-  list<shared_ptr<Page> > &pagelist = boost::get<1>(outcome);
-  unloadedRanges = boost::get<2>(outcome);
-  if (readedFileSize == 0 || pagelist.empty()) {
-    DebugWarning("Read no bytes from file [offset:len=" + to_string(offset) +
-                 ":" + to_string(len) + "] " + FormatPath(fileId));
-    return make_pair(0, unloadedRanges);
+  pair<ContentSliceDeque, ContentRangeDeque> outcome =
+      file->ReadSlices(offset, len, mtimeSince);
+  if (file->HasCorruptContent()) {
+    {
+      lock_guard<recursive_mutex> lock(shard.m_mutex);
+      CacheMapIterator it = shard.m_map.find(fileId);
+      if (it != shard.m_map.end() && it->second->second == file) {
+        size_t oldDiskSize = file->GetDiskSize();
+        file->DropCorruptContent();
+        UnguardedUpdateDiskSize(shard, oldDiskSize, file->GetDiskSize());
+        UnguardedUpdateMemoryUsage(fileId, *file);
+      }
+    }
+    // Read again, so the removed content is reported as unloaded
+    outcome = file->ReadSlices(offset, len, mtimeSince);
   }
+  if (!outcome.first.empty()) {
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    for (ContentSliceDeque::const_iterator slice = outcome.first.begin();
+         slice != outcome.first.end(); ++slice) {
+      if (slice->m_tier == ContentTier::Compressed) {
+        ++shard.m_stats.m_compressedHits;
+      } else if (slice->m_tier == ContentTier::Disk) {
+        ++shard.m_stats.m_diskHits;
+      } else {
+        ++shard.m_stats.m_memoryHits;
+      }
+    }
+  }
+  DebugWarningIf(outcome.first.empty(),
+                 "Read no bytes from file [offset:len=" + to_string(offset) +
+                     ":" + to_string(len) + "] " + FormatPath(fileId));
 
-  size_t addedCacheSize = file->GetCachedSize() - cachedSizeBegin;
-  if (addedCacheSize > 0) {
-    // Update cache status.
-    bool success = Free(addedCacheSize, fileId);
-    if (!success) {
-      DebugWarning("Cache is full. Unable to free added" +
-                   to_string(addedCacheSize) + " bytes when reading file " +
-                   FormatPath(fileId));
+  // Promote the content in disk file which is read frequently to memory, the
+  // slices already read are not affected.
+  size_t promotableSize = file->GetPromotableSize(offset, len);
+  if (promotableSize > 0) {
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    CacheMapIterator it = shard.m_map.find(fileId);
+    if (it != shard.m_map.end() && it->second->second == file) {
+      if (!HasFreeSpace(promotableSize)) {
+        Demote(promotableSize);
+      }
+      if (HasFreeSpace(promotableSize)) {
+        size_t oldDiskSize = file->GetDiskSize();
+        size_t promotedSize = file->Promote(offset, len);
+        UnguardedAddSize(shard, promotedSize);
+        UnguardedUpdateDiskSize(shard, oldDiskSize, file->GetDiskSize());
+        UnguardedUpdateMemoryUsage(fileId, *file);
+        DebugInfoIf(promotedSize > 0,
+                    "Promote " + to_string(promotedSize) +
+                        " bytes to memory " + FormatPath(fileId));
+      }
     }
-    m_size += addedCacheSize;
   }
+  return outcome;
+}
 
-  // Notice outcome pagelist could has more content than required
-  shared_ptr<Page> page = pagelist.front();  // copy instead use reference
-  pagelist.pop_front();
-  if (pagelist.empty()) {  // Only a single page.
-    size_t sz = std::min(len, readedFileSize);
-    return make_pair(page->Read(offset, sz, buffer), unloadedRanges);
-  } else {  // Have Multipule pages.
-    // read first page
-    size_t readSize = page->Read(static_cast<off_t>(offset), buffer);
-    page = pagelist.front();
-    pagelist.pop_front();
-    // read middle pages
-    while (!pagelist.empty()) {
-      readSize += page->Read(buffer + page->Offset() - offset);
-      page = pagelist.front();
-      pagelist.pop_front();
+// --------------------------------------------------------------------------
+size_t Cache::Compact(const string &fileId) {
+  // Compact file without holding the shard lock, as file is guarded by itself
+  // and the cache size is not changed.
+  shared_ptr<File> file = GetFile(fileId);
+  if (!file) {
+    return 0;
+  }
+  size_t numMerged = file->Compact();
+  if (numMerged > 0) {
+    // Merged pages hold new buffers, charge them if the file is still cached
+    Shard &shard = GetShard(fileId);
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    CacheMapIterator it = shard.m_map.find(fileId);
+    if (it != shard.m_map.end() && it->second->second == file) {
+      UnguardedUpdateMemoryUsage(fileId, *file);
     }
-    // read last page
-    size_t sz = std::min(readedFileSize - readSize, len - readSize);
-    readSize +=
-        page->Read(static_cast<size_t>(sz), buffer + page->Offset() - offset);
-    return make_pair(readSize, unloadedRanges);
   }
+  DebugInfoIf(numMerged > 0, "Merge " + to_string(numMerged) + " pages " +
+                                 FormatPath(fileId));
+  return numMerged;
+}
+
+// --------------------------------------------------------------------------
+bool Cache::NeedDemote() const {
+  lock_guard<mutex> lock(m_sizeLock);
+  // High watermark is 90% of capacity
+  return !m_demoting && m_size > m_capacity / 10 * 9;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Cache::DemoteColdPages() {
+  {
+    lock_guard<mutex> lock(m_sizeLock);
+    if (m_demoting) {
+      return 0;
+    }
+    m_demoting = true;
+  }
+  // Low watermark is 80% of capacity
+  uint64_t demotedSize = Demote(static_cast<size_t>(m_capacity / 5));
+  {
+    lock_guard<mutex> lock(m_sizeLock);
+    m_demoting = false;
+  }
+  return demotedSize;
 }
 
 // --------------------------------------------------------------------------
 bool Cache::Write(const string &fileId, off_t offset, size_t len,
                   const char *buffer, time_t mtime, bool open) {
   if (len == 0) {
-    CacheMapIterator it = m_map.find(fileId);
-    if (it != m_map.end()) {
-      UnguardedMakeFileMostRecentlyUsed(it->second);
+    Shard &shard = GetShard(fileId);
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    CacheMapIterator it = shard.m_map.find(fileId);
+    if (it != shard.m_map.end()) {
+      UnguardedMakeFileMostRecentlyUsed(shard, it->second);
     } else {
-      UnguardedNewEmptyFile(fileId, mtime);
+      UnguardedNewEmptyFile(shard, fileId, mtime);
     }
     return true;  // do nothing
   }
@@ -260,30 +568,44 @@ bool Cache::Write(const string &fileId, off_t offset, size_t len,
 
   DebugInfo("Write cache [offset:len=" + to_string(offset) + ":" +
             to_string(len) + "] " + FormatPath(fileId));
+  Shard &shard = GetShard(fileId);
+  // Hold the shard lock until the added size is recorded, so a concurrent
+  // eviction of the file will not mess up the byte accounting.
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
   pair<bool, shared_ptr<File> > res = PrepareWrite(fileId, len, mtime);
   bool success = res.first;
   if (success) {
     shared_ptr<File> &file = res.second;
     assert(file);
+    // Bytes from user make the file differ from the object it is loaded from
+    file->m_changedLocally = true;
+    UnguardedDropContentKey(shard, fileId);
+    size_t oldDiskSize = file->GetDiskSize();
     tuple<bool, size_t, size_t> res =
         file->Write(offset, len, buffer, mtime, open);
+    UnguardedPinFile(shard, fileId, open);
     success = boost::get<0>(res);
     if (success) {
-      m_size += boost::get<1>(res);  // added size in cache
+      UnguardedAddSize(shard, boost::get<1>(res));  // added size in cache
     }
+    UnguardedUpdateDiskSize(shard, oldDiskSize, file->GetDiskSize());
+    UnguardedUpdateMemoryUsage(fileId, *file);
   }
   return success;
 }
 
 // --------------------------------------------------------------------------
 bool Cache::Write(const string &fileId, off_t offset, size_t len,
-                  const shared_ptr<iostream> &stream, time_t mtime, bool open) {
+                  const shared_ptr<iostream> &stream, time_t mtime, bool open,
+                  bool unloadedOnly) {
   if (len == 0) {
-    CacheMapIterator it = m_map.find(fileId);
-    if (it != m_map.end()) {
-      UnguardedMakeFileMostRecentlyUsed(it->second);
+    Shard &shard = GetShard(fileId);
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    CacheMapIterator it = shard.m_map.find(fileId);
+    if (it != shard.m_map.end()) {
+      UnguardedMakeFileMostRecentlyUsed(shard, it->second);
     } else {
-      UnguardedNewEmptyFile(fileId, mtime);
+      UnguardedNewEmptyFile(shard, fileId, mtime);
     }
     return true;  // do nothing
   }
@@ -308,17 +630,24 @@ bool Cache::Write(const string &fileId, off_t offset, size_t len,
 
   DebugInfo("Write cache [offset:len=" + to_string(offset) + ":" +
             to_string(len) + "] " + FormatPath(fileId));
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
   pair<bool, shared_ptr<File> > res = PrepareWrite(fileId, len, mtime);
   bool success = res.first;
   if (success) {
     shared_ptr<File> &file = res.second;
     assert(file);
+    size_t oldDiskSize = file->GetDiskSize();
     tuple<bool, size_t, size_t> res =
-        file->Write(offset, len, stream, mtime, open);
+        unloadedOnly ? file->WriteUnloaded(offset, len, stream, mtime, open)
+                     : file->Write(offset, len, stream, mtime, open);
+    UnguardedPinFile(shard, fileId, open);
     success = boost::get<0>(res);
     if (success) {
-      m_size += boost::get<1>(res);  // added size in cache
+      UnguardedAddSize(shard, boost::get<1>(res));  // added size in cache
     }
+    UnguardedUpdateDiskSize(shard, oldDiskSize, file->GetDiskSize());
+    UnguardedUpdateMemoryUsage(fileId, *file);
   }
   return success;
 }
@@ -328,7 +657,10 @@ pair<bool, shared_ptr<File> > Cache::PrepareWrite(const string &fileId,
                                                    size_t len, time_t mtime) {
   bool availableFreeSpace = true;
   if (!HasFreeSpace(len)) {
-    availableFreeSpace = Free(len, fileId);
+    // Move cold content to disk files first, and only discard files from
+    // cache if the disk tier is not available
+    Demote(len);
+    availableFreeSpace = HasFreeSpace(len) || Free(len, fileId);
 
     if (!availableFreeSpace) {
       string diskfolder =
@@ -337,7 +669,7 @@ pair<bool, shared_ptr<File> > Cache::PrepareWrite(const string &fileId,
         Error("Unable to mkdir for folder " + FormatPath(diskfolder));
         return make_pair(false, shared_ptr<File>());
       }
-      if (!IsSafeDiskSpace(diskfolder, len)) {
+      if (!IsSafeDiskSpace(diskfolder, len) || !HasFreeDiskSpace(len)) {
         if (!FreeDiskCacheFiles(diskfolder, len, fileId)) {
           Error("No available free space (" + to_string(len) +
                 "bytes) for folder " + FormatPath(diskfolder));
@@ -347,13 +679,15 @@ pair<bool, shared_ptr<File> > Cache::PrepareWrite(const string &fileId,
     }
   }
 
-  CacheListIterator pos = m_cache.begin();
-  CacheMapIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
-    pos = UnguardedMakeFileMostRecentlyUsed(it->second);
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheListIterator pos = shard.m_cache.begin();
+  CacheMapIterator it = shard.m_map.find(fileId);
+  if (it != shard.m_map.end()) {
+    pos = UnguardedMakeFileMostRecentlyUsed(shard, it->second);
   } else {
-    pos = UnguardedNewEmptyFile(fileId, mtime);
-    assert(pos != m_cache.end());
+    pos = UnguardedNewEmptyFile(shard, fileId, mtime);
+    assert(pos != shard.m_cache.end());
   }
 
   shared_ptr<File> &file = pos->second;
@@ -376,31 +710,21 @@ bool Cache::Free(size_t size, const string &fileUnfreeable) {
     return true;
   }
 
-  assert(!m_cache.empty());
-  size_t freedSpace = 0;
-  size_t freedDiskSpace = 0;
+  uint64_t freedSpace = 0;
+  uint64_t freedDiskSpace = 0;
 
-  CacheList::reverse_iterator it = m_cache.rbegin();
-  // Discards the least recently used File first, which is put at back.
-  while (it != m_cache.rend() && !HasFreeSpace(size)) {
-    // Notice do NOT store a reference of the File supposed to be removed.
-    string fileId = it->first;
-    if (fileId != fileUnfreeable && it->second && !it->second->IsOpen()) {
-      size_t fileCacheSz = it->second->GetCachedSize();
-      freedSpace += fileCacheSz;
-      freedDiskSpace += it->second->GetSize() - fileCacheSz;
-      m_size -= fileCacheSz;
-      it->second->Clear();
-      m_cache.erase((++it).base());
-      m_map.erase(fileId);
-    } else {
-      if (!it->second) {
-        DebugInfo("file in cache is null " + FormatPath(fileId));
-        m_cache.erase((++it).base());
-        m_map.erase(fileId);
-      } else {
-        ++it;
-      }
+  // Balance the capacity among shards by always discarding the File chosen
+  // by eviction policy of the largest shard.
+  vector<bool> exhausted(m_shards.size(), false);
+  while (!HasFreeSpace(size)) {
+    size_t idx = GetLargestShardIndex(exhausted);
+    if (idx == m_shards.size()) {
+      break;  // no file could be freed
+    }
+    size_t needSize = GetNeedSize(size);
+    if (!EvictFile(*m_shards[idx], fileUnfreeable, needSize, &freedSpace,
+                   &freedDiskSpace)) {
+      exhausted[idx] = true;
     }
   }
 
@@ -415,64 +739,83 @@ bool Cache::Free(size_t size, const string &fileUnfreeable) {
   return HasFreeSpace(size);
 }
 
+// --------------------------------------------------------------------------
+uint64_t Cache::Demote(size_t size) {
+  uint64_t demotedSpace = 0;
+  if (size > GetCapacity() || HasFreeSpace(size)) {
+    return demotedSpace;
+  }
+
+  // Balance the capacity among shards by always demoting the least recently
+  // used File of the largest shard.
+  vector<bool> exhausted(m_shards.size(), false);
+  while (!HasFreeSpace(size)) {
+    size_t idx = GetLargestShardIndex(exhausted);
+    if (idx == m_shards.size()) {
+      break;  // no content could be demoted
+    }
+    if (!DemoteLeastRecentlyUsedFile(*m_shards[idx], GetNeedSize(size),
+                                     &demotedSpace)) {
+      exhausted[idx] = true;
+    }
+  }
+
+  DebugInfoIf(demotedSpace > 0, "Has demoted cache of " +
+                                    to_string(demotedSpace) +
+                                    " bytes to lower tiers");
+  return demotedSpace;
+}
+
 // --------------------------------------------------------------------------
 bool Cache::FreeDiskCacheFiles(const string &diskfolder, size_t size,
-                              const string &fileUnfreeable) {
+                               const string &fileUnfreeable) {
   assert(diskfolder ==
          QS::Configure::Options::Instance().GetDiskCacheDirectory());
   // diskfolder should be cache disk dir
-  if (IsSafeDiskSpace(diskfolder, size)) {
+  if (IsSafeDiskSpace(diskfolder, size) && HasFreeDiskSpace(size)) {
     return true;
   }
 
-  assert(!m_cache.empty());
-  size_t freedSpace = 0;
-  size_t freedDiskSpace = 0;
+  uint64_t freedDiskSpace = 0;
 
-  CacheList::reverse_iterator it = m_cache.rbegin();
-  // Discards the least recently used File first, which is put at back.
-  while (it != m_cache.rend() && !IsSafeDiskSpace(diskfolder, size)) {
-    // Notice do NOT store a reference of the File supposed to be removed.
-    string fileId = it->first;
-    if (fileId != fileUnfreeable && it->second && !it->second->IsOpen()) {
-      size_t fileCacheSz = it->second->GetCachedSize();
-      freedSpace += fileCacheSz;
-      freedDiskSpace += it->second->GetSize() - fileCacheSz;
-      m_size -= fileCacheSz;
-      it->second->Clear();
-      m_cache.erase((++it).base());
-      m_map.erase(fileId);
-    } else {
-      if (!it->second) {
-        DebugInfo("file in cache is null " + FormatPath(fileId));
-        m_cache.erase((++it).base());
-        m_map.erase(fileId);
-      } else {
-        ++it;
-      }
+  // Balance the disk capacity among shards by always discarding the disk
+  // content of the File chosen by eviction policy of the largest shard.
+  vector<bool> exhausted(m_shards.size(), false);
+  while (!IsSafeDiskSpace(diskfolder, size) || !HasFreeDiskSpace(size)) {
+    size_t idx = GetLargestShardIndex(exhausted, true);
+    if (idx == m_shards.size()) {
+      break;  // no file could be freed
+    }
+    size_t needSize =
+        HasFreeDiskSpace(size)
+            ? size
+            : static_cast<size_t>(GetDiskSize() + size - m_diskCapacity);
+    if (!EvictDiskContent(*m_shards[idx], fileUnfreeable, needSize,
+                          &freedDiskSpace)) {
+      exhausted[idx] = true;
     }
   }
 
-  if (freedSpace > 0) {
-    DebugInfo("Has freed cache of " + to_string(freedSpace) + " bytes");
-  }
   if (freedDiskSpace > 0) {
     DebugInfo(
         "Has freed disk file of " + to_string(freedDiskSpace) + " bytes" +
         FormatPath(QS::Configure::Options::Instance().GetDiskCacheDirectory()));
   }
-  return IsSafeDiskSpace(diskfolder, size);
+  return IsSafeDiskSpace(diskfolder, size) && HasFreeDiskSpace(size);
 }
 
 // --------------------------------------------------------------------------
 CacheListIterator Cache::Erase(const string &fileId) {
-  CacheMapIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheMapIterator it = shard.m_map.find(fileId);
+  if (it != shard.m_map.end()) {
     DebugInfo("Erase cache " + FormatPath(fileId));
-    return UnguardedErase(it);
+    return UnguardedErase(shard, it);
   } else {
     DebugInfo("File not exist, no remove " + FormatPath(fileId));
-    return m_cache.end();
+    UnguardedDropContentKey(shard, fileId);
+    return shard.m_cache.end();
   }
 }
 
@@ -483,33 +826,119 @@ void Cache::Rename(const string &oldFileId, const string &newFileId) {
     return;
   }
 
-  CacheMapIterator iter = m_map.find(newFileId);
-  if (iter != m_map.end()) {
+  size_t oldIdx = GetShardIndex(oldFileId);
+  size_t newIdx = GetShardIndex(newFileId);
+  Shard &oldShard = *m_shards[oldIdx];
+  Shard &newShard = *m_shards[newIdx];
+  // Lock the two shards in index order to avoid dead lock
+  lock_guard<recursive_mutex> lock1(
+      m_shards[std::min(oldIdx, newIdx)]->m_mutex);
+  lock_guard<recursive_mutex> lock2(
+      m_shards[std::max(oldIdx, newIdx)]->m_mutex);
+
+  CacheMapIterator iter = newShard.m_map.find(newFileId);
+  if (iter != newShard.m_map.end()) {
     DebugWarning("File exist, Just remove it from cache " +
                  FormatPath(newFileId));
-    UnguardedErase(iter);
+    UnguardedErase(newShard, iter);
   }
 
-  CacheMapIterator it = m_map.find(oldFileId);
-  if (it != m_map.end()) {
-    it->second->first = newFileId;
-    CacheListIterator pos = UnguardedMakeFileMostRecentlyUsed(it->second);
+  CacheMapIterator it = oldShard.m_map.find(oldFileId);
+  if (it != oldShard.m_map.end()) {
+    CacheListIterator pos = it->second;
+    pos->first = newFileId;
+    if (oldIdx == newIdx) {
+      newShard.m_policy->OnRename(oldFileId, newFileId);
+      pos = UnguardedMakeFileMostRecentlyUsed(newShard, pos);
+    } else {
+      oldShard.m_policy->OnErase(oldFileId, false);
+      newShard.m_policy->OnInsert(newFileId);
+      // Move the file to the front of the new shard, and its cached size too.
+      uint64_t fileCacheSz = pos->second->GetCachedSize();
+      uint64_t fileDiskSz = pos->second->GetDiskSize();
+      newShard.m_cache.splice(newShard.m_cache.begin(), oldShard.m_cache, pos);
+      pos = newShard.m_cache.begin();
+      oldShard.m_size -= fileCacheSz;
+      newShard.m_size += fileCacheSz;
+      oldShard.m_diskSize -= fileDiskSz;
+      newShard.m_diskSize += fileDiskSz;
+    }
+
+    // the pin by id stays with the old id
+    UnguardedPinFile(newShard, newFileId, pos->second->IsOpen());
 
-    pair<CacheMapIterator, bool> res = m_map.emplace(newFileId, pos);
+    // the content key moves with the file
+    UnguardedDropContentKey(newShard, newFileId);
+    FileIdToContentKeyMap::iterator key =
+        oldShard.m_contentKeys.find(oldFileId);
+    if (key != oldShard.m_contentKeys.end()) {
+      newShard.m_contentKeys[newFileId] = key->second;
+      {
+        lock_guard<mutex> lock(m_contentLock);
+        set<string> &fileIds = m_contentIndex[key->second];
+        fileIds.erase(oldFileId);
+        fileIds.insert(newFileId);
+      }
+      oldShard.m_contentKeys.erase(key);
+    }
+
+    pair<CacheMapIterator, bool> res = newShard.m_map.emplace(newFileId, pos);
     if (!res.second) {
       DebugWarning("Fail to rename " + FormatPath(oldFileId, newFileId));
     }
-    m_map.erase(it);
+    oldShard.m_map.erase(it);
+    UnguardedUpdateMemoryUsage(newFileId, *pos->second);
   } else {
     DebugInfo("File not exists, no rename " + FormatPath(oldFileId));
   }
 }
 
+// --------------------------------------------------------------------------
+pair<bool, ContentRangeDeque> Cache::Persist(const string &fileId) {
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheMapIterator it = shard.m_map.find(fileId);
+  if (it == shard.m_map.end()) {
+    DebugInfo("File not exists, no persist " + FormatPath(fileId));
+    return make_pair(false, ContentRangeDeque());
+  }
+  shared_ptr<File> &file = it->second->second;
+  size_t oldDiskSize = file->GetDiskSize();
+  pair<bool, size_t> res = file->Persist();
+  UnguardedSubtractSize(shard, res.second);  // removed size in cache
+  UnguardedUpdateDiskSize(shard, oldDiskSize, file->GetDiskSize());
+  UnguardedUpdateMemoryUsage(fileId, *file);
+  DebugErrorIf(!res.first, "Fail to persist file " + FormatPath(fileId));
+  return make_pair(res.first, file->GetLoadedRanges());
+}
+
+// --------------------------------------------------------------------------
+bool Cache::Restore(const string &fileId, time_t mtime,
+                    const ContentRangeDeque &ranges) {
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  if (shard.m_map.find(fileId) != shard.m_map.end()) {
+    DebugWarning("File exists, no restore " + FormatPath(fileId));
+    return false;
+  }
+  CacheListIterator pos = UnguardedNewEmptyFile(shard, fileId, mtime);
+  if (pos == shard.m_cache.end()) {
+    return false;
+  }
+  if (pos->second->Restore(ranges) == 0) {
+    DebugWarning("Fail to restore file " + FormatPath(fileId));
+    UnguardedErase(shard, shard.m_map.find(fileId));
+    return false;
+  }
+  UnguardedUpdateDiskSize(shard, 0, pos->second->GetDiskSize());
+  UnguardedUpdateMemoryUsage(fileId, *pos->second);
+  return true;
+}
+
 // --------------------------------------------------------------------------
 void Cache::SetTime(const string &fileId, time_t mtime) {
-  CacheMapIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
-    shared_ptr<File> &file = it->second->second;
+  shared_ptr<File> file = GetFile(fileId);
+  if (file) {
     if (mtime > file->GetTime()) {
       file->SetTime(mtime);
     }
@@ -518,12 +947,210 @@ void Cache::SetTime(const string &fileId, time_t mtime) {
   }
 }
 
+// --------------------------------------------------------------------------
+void Cache::SetContentKey(const string &fileId, const string &eTag,
+                          uint64_t size) {
+  if (!m_dedup || fileId.empty() || eTag.empty()) {
+    return;
+  }
+  string key = eTag + ":" + to_string(size);
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheMapIterator it = shard.m_map.find(fileId);
+  File *file = it != shard.m_map.end() ? it->second->second.get() : NULL;
+  if (file != NULL && file->m_changedLocally) {
+    return;
+  }
+  FileIdToContentKeyMap::iterator pos = shard.m_contentKeys.find(fileId);
+  if (pos != shard.m_contentKeys.end()) {
+    if (pos->second == key) {
+      return;
+    }
+    // The content loaded may come from the old object
+    DebugInfo("Object changed, stop sharing content " + FormatPath(fileId));
+    UnguardedDropContentKey(shard, fileId);
+    if (file != NULL) {
+      file->m_changedLocally = true;
+      return;
+    }
+  }
+  shard.m_contentKeys[fileId] = key;
+  lock_guard<mutex> contentLock(m_contentLock);
+  m_contentIndex[key].insert(fileId);
+}
+
+// --------------------------------------------------------------------------
+size_t Cache::ShareContent(const string &fileId, off_t offset, size_t len,
+                           time_t mtime, bool open) {
+  if (!m_dedup || m_blockSize > 0 || len == 0) {
+    return 0;
+  }
+
+  Shard &shard = GetShard(fileId);
+  string key;
+  {
+    lock_guard<recursive_mutex> lock(shard.m_mutex);
+    FileIdToContentKeyMap::const_iterator it =
+        shard.m_contentKeys.find(fileId);
+    if (it != shard.m_contentKeys.end()) {
+      key = it->second;
+    }
+  }
+  if (key.empty()) {
+    return 0;
+  }
+  vector<string> sources;
+  {
+    lock_guard<mutex> lock(m_contentLock);
+    ContentKeyToFileIdsMap::const_iterator it = m_contentIndex.find(key);
+    if (it != m_contentIndex.end()) {
+      for (set<string>::const_iterator id = it->second.begin();
+           id != it->second.end(); ++id) {
+        if (*id != fileId) {
+          sources.push_back(*id);
+        }
+      }
+    }
+  }
+
+  size_t sharedSize = 0;
+  for (vector<string>::const_iterator source = sources.begin();
+       source != sources.end(); ++source) {
+    ContentRangeDeque holes;
+    {
+      lock_guard<recursive_mutex> lock(shard.m_mutex);
+      holes = UnguardedGetHoles(shard, fileId, offset, len);
+    }
+    if (holes.empty()) {
+      break;
+    }
+    ContentSliceDeque slices;
+    {
+      Shard &sourceShard = GetShard(*source);
+      lock_guard<recursive_mutex> lock(sourceShard.m_mutex);
+      FileIdToContentKeyMap::const_iterator pos =
+          sourceShard.m_contentKeys.find(*source);
+      CacheMapIterator it = sourceShard.m_map.find(*source);
+      if (pos == sourceShard.m_contentKeys.end() || pos->second != key ||
+          it == sourceShard.m_map.end()) {
+        continue;
+      }
+      // Read under the shard lock, so no write to the file gets in between
+      File &file = *it->second->second;
+      for (ContentRangeDeque::const_iterator hole = holes.begin();
+           hole != holes.end(); ++hole) {
+        ContentSliceDeque res =
+            file.ReadSlices(hole->first, hole->second).first;
+        slices.insert(slices.end(), res.begin(), res.end());
+      }
+    }
+
+    for (ContentSliceDeque::const_iterator slice = slices.begin();
+         slice != slices.end(); ++slice) {
+      if (slice->m_size == 0 || !slice->m_buffer) {
+        continue;
+      }
+      Buffer buffer = slice->m_buffer;
+      if (slice->m_start != 0) {
+        buffer = Buffer(
+            new ByteVector(slice->Data(), slice->Data() + slice->m_size));
+      }
+      shared_ptr<IOStream> stream =
+          make_shared<IOStream>(buffer, slice->m_size);
+      // Check under the shard lock, so the range is not loaded meanwhile
+      lock_guard<recursive_mutex> lock(shard.m_mutex);
+      FileIdToContentKeyMap::const_iterator pos =
+          shard.m_contentKeys.find(fileId);
+      if (pos == shard.m_contentKeys.end() || pos->second != key) {
+        return sharedSize;  // changed meanwhile
+      }
+      ContentRangeDeque unloaded =
+          UnguardedGetHoles(shard, fileId, slice->m_offset, slice->m_size);
+      if (unloaded.size() != 1 || unloaded.front().second != slice->m_size) {
+        continue;
+      }
+      if (Write(fileId, slice->m_offset, slice->m_size, stream, mtime,
+                open)) {
+        sharedSize += slice->m_size;
+      }
+    }
+  }
+  DebugInfoIf(sharedSize > 0, "Share " + to_string(sharedSize) +
+                                  " bytes of cached content " +
+                                  FormatPath(fileId));
+  return sharedSize;
+}
+
+// --------------------------------------------------------------------------
+void Cache::CleanRanges(const string &fileId, const ContentRangeDeque &ranges,
+                        uint64_t snapshot) {
+  shared_ptr<File> file = GetFile(fileId);
+  if (file) {
+    file->CleanRanges(ranges, snapshot);
+  } else {
+    DebugInfo("File not exists, no clean ranges " + FormatPath(fileId));
+  }
+}
+
+// --------------------------------------------------------------------------
+bool Cache::Pin(const string &fileId, uint64_t size) {
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  FileIdToPinnedSizeMap::iterator it = shard.m_pinned.find(fileId);
+  uint64_t oldSize = it != shard.m_pinned.end() ? it->second : 0;
+  {
+    lock_guard<mutex> locker(m_sizeLock);
+    if (m_pinnedSize - oldSize + size > m_pinQuota) {
+      DebugInfo("Exceed pin quota, no pin " + FormatPath(fileId));
+      return false;
+    }
+    m_pinnedSize = m_pinnedSize - oldSize + size;
+  }
+  shard.m_pinned[fileId] = size;
+  UnguardedPinFile(shard, fileId, false);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+void Cache::Unpin(const string &fileId) {
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  FileIdToPinnedSizeMap::iterator it = shard.m_pinned.find(fileId);
+  if (it == shard.m_pinned.end()) {
+    return;
+  }
+  {
+    lock_guard<mutex> locker(m_sizeLock);
+    m_pinnedSize -= it->second;
+  }
+  shard.m_pinned.erase(it);
+  CacheMapIterator pos = shard.m_map.find(fileId);
+  bool open = pos != shard.m_map.end() && pos->second->second->IsOpen();
+  UnguardedPinFile(shard, fileId, open);
+}
+
+// --------------------------------------------------------------------------
+bool Cache::IsPinned(const string &fileId) const {
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  return shard.m_pinned.find(fileId) != shard.m_pinned.end();
+}
+
 // --------------------------------------------------------------------------
 void Cache::SetFileOpen(const std::string &fileId, bool open) {
-  CacheMapIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
-    shared_ptr<File> &file = it->second->second;
+  Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheMapIterator it = shard.m_map.find(fileId);
+  shared_ptr<File> file =
+      it != shard.m_map.end() ? it->second->second : shared_ptr<File>();
+  if (file) {
     file->SetOpen(open);
+    UnguardedPinFile(shard, fileId, open);
+    if (!open) {
+      // Release the descriptor of a closed file, so the number of opened
+      // descriptors is bounded by the number of opened files
+      file->CloseDiskFile();
+    }
   } else {
     DebugInfo("File not exists, no set open" + FormatPath(fileId));
   }
@@ -531,15 +1158,13 @@ void Cache::SetFileOpen(const std::string &fileId, bool open) {
 
 // --------------------------------------------------------------------------
 void Cache::Resize(const string &fileId, size_t newFileSize, time_t mtime) {
-  CacheMapIterator it = m_map.find(fileId);
-  if (it != m_map.end()) {
-    shared_ptr<File> &file = it->second->second;
+  shared_ptr<File> file = GetFile(fileId);
+  if (file) {
     size_t oldFileSize = file->GetSize();
-    size_t oldFileCacheSize = file->GetCachedSize();
     if (newFileSize == oldFileSize) {
       return;  // do nothing
     } else if (newFileSize > oldFileSize) {
-      // fill the hole
+      // fill the hole, cache size is updated by Write
       size_t holeSize = newFileSize - oldFileSize;
       vector<char> hole(holeSize);  // value initialization with '\0'
       DebugInfo("Fill hole [offset:len=" + to_string(oldFileSize) + ":" +
@@ -547,10 +1172,27 @@ void Cache::Resize(const string &fileId, size_t newFileSize, time_t mtime) {
       bool fileOpen = file->IsOpen();
       Write(fileId, oldFileSize, holeSize, &hole[0], mtime, fileOpen);
     } else {
+      Shard &shard = GetShard(fileId);
+      lock_guard<recursive_mutex> lock(shard.m_mutex);
+      size_t oldFileCacheSize = file->GetCachedSize();
+      size_t oldFileDiskSize = file->GetDiskSize();
       file->ResizeToSmallerSize(newFileSize);
       file->SetTime(mtime);
+      CacheMapIterator it = shard.m_map.find(fileId);
+      if (it != shard.m_map.end() && it->second->second == file) {
+        file->m_changedLocally = true;
+        UnguardedDropContentKey(shard, fileId);
+        // Decompressing the last page could grow the cache size
+        size_t fileCacheSize = file->GetCachedSize();
+        if (fileCacheSize > oldFileCacheSize) {
+          UnguardedAddSize(shard, fileCacheSize - oldFileCacheSize);
+        } else {
+          UnguardedSubtractSize(shard, oldFileCacheSize - fileCacheSize);
+        }
+        UnguardedUpdateDiskSize(shard, oldFileDiskSize, file->GetDiskSize());
+        UnguardedUpdateMemoryUsage(fileId, *file);
+      }
     }
-    m_size += file->GetCachedSize() - oldFileCacheSize;
 
     DebugInfoIf(file->GetSize() != newFileSize,
                 "Try to resize file from size " + to_string(oldFileSize) +
@@ -563,42 +1205,359 @@ void Cache::Resize(const string &fileId, size_t newFileSize, time_t mtime) {
 }
 
 // --------------------------------------------------------------------------
-CacheListIterator Cache::UnguardedNewEmptyFile(const string &fileId,
+Cache::Shard &Cache::GetShard(const string &fileId) const {
+  return *m_shards[GetShardIndex(fileId)];
+}
+
+// --------------------------------------------------------------------------
+size_t Cache::GetShardIndex(const string &fileId) const {
+  unsigned hash =
+      static_cast<unsigned>(QS::HashUtils::StringHash()(fileId));
+  return hash % m_shards.size();
+}
+
+// --------------------------------------------------------------------------
+shared_ptr<File> Cache::GetFile(const string &fileId) const {
+  const Shard &shard = GetShard(fileId);
+  lock_guard<recursive_mutex> lock(shard.m_mutex);
+  CacheMapConstIterator it = shard.m_map.find(fileId);
+  return it != shard.m_map.end() ? it->second->second : shared_ptr<File>();
+}
+
+// --------------------------------------------------------------------------
+size_t Cache::GetNeedSize(size_t size) const {
+  uint64_t usedSize = GetSize();
+  uint64_t needSize =
+      usedSize + size > GetCapacity() ? usedSize + size - GetCapacity() : 0;
+  return static_cast<size_t>(
+      std::max(needSize, MemoryBudget::Instance().GetShortage(size)));
+}
+
+// --------------------------------------------------------------------------
+void Cache::UnguardedAddSize(Shard &shard, uint64_t delta) {
+  shard.m_size += delta;
+  lock_guard<mutex> lock(m_sizeLock);
+  m_size += delta;
+}
+
+// --------------------------------------------------------------------------
+void Cache::UnguardedSubtractSize(Shard &shard, uint64_t delta) {
+  assert(shard.m_size >= delta);
+  shard.m_size -= delta;
+  lock_guard<mutex> lock(m_sizeLock);
+  m_size -= delta;
+}
+
+// --------------------------------------------------------------------------
+void Cache::UnguardedUpdateMemoryUsage(const string &fileId, File &file) {
+  size_t oldUsage = file.m_memoryCharge;
+  size_t newUsage = file.GetMemoryUsage() + GetFileEntrySize(fileId);
+  if (newUsage == oldUsage) {
+    return;
+  }
+  file.m_memoryCharge = newUsage;
+  {
+    lock_guard<mutex> lock(m_sizeLock);
+    m_memoryUsage = m_memoryUsage + newUsage - oldUsage;
+  }
+  MemoryBudget::Instance().Update(MemoryUser::Cache, oldUsage, newUsage);
+}
+
+// --------------------------------------------------------------------------
+void Cache::UnguardedDropContentKey(Shard &shard, const string &fileId) {
+  FileIdToContentKeyMap::iterator pos = shard.m_contentKeys.find(fileId);
+  if (pos == shard.m_contentKeys.end()) {
+    return;
+  }
+  {
+    lock_guard<mutex> lock(m_contentLock);
+    ContentKeyToFileIdsMap::iterator it = m_contentIndex.find(pos->second);
+    if (it != m_contentIndex.end()) {
+      it->second.erase(fileId);
+      if (it->second.empty()) {
+        m_contentIndex.erase(it);
+      }
+    }
+  }
+  shard.m_contentKeys.erase(pos);
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque Cache::UnguardedGetHoles(Shard &shard, const string &fileId,
+                                           off_t offset, size_t len) const {
+  ContentRangeDeque holes;
+  holes.push_back(make_pair(offset, len));
+  CacheMapConstIterator it = shard.m_map.find(fileId);
+  if (it != shard.m_map.end()) {
+    ContentRangeDeque loaded = it->second->second->GetLoadedRanges();
+    for (ContentRangeDeque::const_iterator range = loaded.begin();
+         range != loaded.end(); ++range) {
+      RemoveContentRange(&holes, range->first, range->second);
+    }
+  }
+  return holes;
+}
+
+// --------------------------------------------------------------------------
+void Cache::UnguardedUpdateDiskSize(Shard &shard, uint64_t oldSize,
+                                    uint64_t newSize) {
+  if (newSize == oldSize) {
+    return;
+  }
+  assert(shard.m_diskSize + newSize >= oldSize);
+  shard.m_diskSize = shard.m_diskSize + newSize - oldSize;
+  lock_guard<mutex> lock(m_sizeLock);
+  m_diskSize = m_diskSize + newSize - oldSize;
+}
+
+// --------------------------------------------------------------------------
+bool Cache::EvictFile(Shard &shard, const string &fileUnfreeable,
+                      size_t size, uint64_t *freedSpace,
+                      uint64_t *freedDiskSpace) {
+  unique_lock<recursive_mutex> lock(shard.m_mutex, boost::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;  // shard is busy
+  }
+  // Evict the least recently used ranges of a large file first, so it keeps
+  // its recently read ranges without pushing other files out of cache
+  size_t largeSize = GetLargeFileSize(GetCapacity());
+  set<string> dirtyFiles;  // large files with only dirty content to evict
+  while (true) {
+    EvictVisitor largeFileVisitor(shard.m_map, fileUnfreeable, false,
+                                  largeSize, &dirtyFiles);
+    shard.m_policy->VisitVictims(&largeFileVisitor);
+    if (largeFileVisitor.GetVictim().empty()) {
+      break;
+    }
+    CacheMapIterator it = shard.m_map.find(largeFileVisitor.GetVictim());
+    assert(it != shard.m_map.end());
+    const shared_ptr<File> &file = it->second->second;
+    size_t evictedSize = file->Evict(
+        std::min(size, file->GetCachedSize() - largeSize), false);
+    if (evictedSize == 0) {
+      dirtyFiles.insert(it->first);
+      continue;
+    }
+    UnguardedSubtractSize(shard, evictedSize);
+    UnguardedUpdateMemoryUsage(it->first, *file);
+    *freedSpace += evictedSize;
+    ++shard.m_stats.m_evictions;
+    return true;
+  }
+
+  EvictVisitor visitor(shard.m_map, fileUnfreeable);
+  shard.m_policy->VisitVictims(&visitor);
+  if (visitor.GetVictim().empty()) {
+    return false;
+  }
+  CacheMapIterator it = shard.m_map.find(visitor.GetVictim());
+  assert(it != shard.m_map.end());
+  const shared_ptr<File> &file = it->second->second;
+  *freedSpace += file->GetCachedSize();
+  *freedDiskSpace += file->GetDiskSize();
+  UnguardedErase(shard, it, true);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Cache::DemoteLeastRecentlyUsedFile(Shard &shard, size_t size,
+                                        uint64_t *demotedSpace) {
+  unique_lock<recursive_mutex> lock(shard.m_mutex, boost::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;  // shard is busy
+  }
+  string diskfolder =
+      QS::Configure::Options::Instance().GetDiskCacheDirectory();
+  CacheList::reverse_iterator it = shard.m_cache.rbegin();
+  // Demotes the least recently used File first, which is put at back.
+  for (; it != shard.m_cache.rend(); ++it) {
+    shared_ptr<File> file = it->second;
+    if (!file || file->GetCachedSize() == 0) {
+      continue;
+    }
+    string fileId = it->first;
+    if (m_compression) {
+      // Compress the cold pages first, which are kept in memory
+      size_t compressedSize = file->Compress(size);
+      if (compressedSize > 0) {
+        UnguardedSubtractSize(shard, compressedSize);
+        UnguardedUpdateMemoryUsage(fileId, *file);
+        *demotedSpace += compressedSize;
+        return true;
+      }
+    }
+    // Make room in disk tier for the demoted content
+    if (!IsSafeDiskSpace(diskfolder, size) || !HasFreeDiskSpace(size)) {
+      if (!FreeDiskCacheFiles(diskfolder, size, fileId)) {
+        DebugInfo("No available space in disk tier to demote cache");
+        return false;
+      }
+      // Freeing could erase the next file of list which the reverse iterator
+      // refers to, so locate the file again
+      it = CacheList::reverse_iterator(
+          ++CacheListIterator(shard.m_map.find(fileId)->second));
+    }
+    size_t oldDiskSize = file->GetDiskSize();
+    size_t demotedSize = file->Demote(size);
+    UnguardedSubtractSize(shard, demotedSize);
+    UnguardedUpdateDiskSize(shard, oldDiskSize, file->GetDiskSize());
+    UnguardedUpdateMemoryUsage(fileId, *file);
+    if (demotedSize > 0) {
+      *demotedSpace += demotedSize;
+      return true;
+    }
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------
+bool Cache::EvictDiskContent(Shard &shard, const string &fileUnfreeable,
+                             size_t size, uint64_t *freedDiskSpace) {
+  unique_lock<recursive_mutex> lock(shard.m_mutex, boost::try_to_lock);
+  if (!lock.owns_lock()) {
+    return false;  // shard is busy
+  }
+  // Evict the least recently used ranges of a large file first
+  if (m_diskCapacity > 0) {
+    size_t largeSize = GetLargeFileSize(m_diskCapacity);
+    set<string> dirtyFiles;  // large files with only dirty content to evict
+    while (true) {
+      EvictVisitor largeFileVisitor(shard.m_map, fileUnfreeable, true,
+                                    largeSize, &dirtyFiles);
+      shard.m_policy->VisitVictims(&largeFileVisitor);
+      if (largeFileVisitor.GetVictim().empty()) {
+        break;
+      }
+      CacheMapIterator it = shard.m_map.find(largeFileVisitor.GetVictim());
+      assert(it != shard.m_map.end());
+      const shared_ptr<File> &file = it->second->second;
+      size_t fileDiskSz = file->GetDiskSize();
+      size_t evictedSize =
+          file->Evict(std::min(size, fileDiskSz - largeSize), true);
+      if (evictedSize == 0) {
+        dirtyFiles.insert(it->first);
+        continue;
+      }
+      UnguardedUpdateDiskSize(shard, fileDiskSz, file->GetDiskSize());
+      UnguardedUpdateMemoryUsage(it->first, *file);
+      *freedDiskSpace += evictedSize;
+      ++shard.m_stats.m_evictions;
+      return true;
+    }
+  }
+
+  EvictVisitor visitor(shard.m_map, fileUnfreeable, true);
+  shard.m_policy->VisitVictims(&visitor);
+  if (visitor.GetVictim().empty()) {
+    return false;
+  }
+  CacheMapIterator it = shard.m_map.find(visitor.GetVictim());
+  assert(it != shard.m_map.end());
+  const shared_ptr<File> &file = it->second->second;
+  size_t fileDiskSz = file->GetDiskSize();
+  *freedDiskSpace += fileDiskSz;
+  if (file->GetCachedSize() == 0) {
+    // Nothing is left, evict the file so the policy knows it
+    UnguardedErase(shard, it, true);
+  } else {
+    file->DropDiskContent();
+    UnguardedUpdateDiskSize(shard, fileDiskSz, 0);
+    UnguardedUpdateMemoryUsage(it->first, *file);
+    ++shard.m_stats.m_evictions;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+size_t Cache::GetLargestShardIndex(const vector<bool> &excluded,
+                                   bool byDiskSize) const {
+  size_t largest = m_shards.size();
+  uint64_t largestSize = 0;
+  for (size_t i = 0; i < m_shards.size(); ++i) {
+    if (excluded[i]) {
+      continue;
+    }
+    const Shard &shard = *m_shards[i];
+    unique_lock<recursive_mutex> lock(shard.m_mutex, boost::try_to_lock);
+    if (!lock.owns_lock() || shard.m_cache.empty()) {
+      continue;
+    }
+    uint64_t size = byDiskSize ? shard.m_diskSize : shard.m_size;
+    if (largest == m_shards.size() || size > largestSize) {
+      largest = i;
+      largestSize = size;
+    }
+  }
+  return largest;
+}
+
+// --------------------------------------------------------------------------
+CacheListIterator Cache::UnguardedNewEmptyFile(Shard &shard,
+                                               const string &fileId,
                                                time_t mtime) {
-  m_cache.push_front(make_pair(
-      fileId, make_shared<File>(QS::Utils::GetBaseName(fileId), mtime)));
-  if (m_cache.begin()->first == fileId) {  // insert to cache sucessfully
-    pair<CacheMapIterator, bool> res = m_map.emplace(fileId, m_cache.begin());
+  shard.m_cache.push_front(make_pair(
+      fileId, make_shared<File>(QS::Utils::GetBaseName(fileId), mtime, 0,
+                                m_blockSize, m_maxPageSize)));
+  if (shard.m_cache.begin()->first == fileId) {  // insert to cache sucessfully
+    pair<CacheMapIterator, bool> res =
+        shard.m_map.emplace(fileId, shard.m_cache.begin());
     if (res.second) {
-      return m_cache.begin();
+      shard.m_policy->OnInsert(fileId);
+      if (shard.m_pinned.find(fileId) != shard.m_pinned.end()) {
+        shard.m_policy->OnPin(fileId);
+      }
+      UnguardedUpdateMemoryUsage(fileId, *shard.m_cache.begin()->second);
+      return shard.m_cache.begin();
     } else {
       DebugError("Fail to create empty file in cache " + FormatPath(fileId));
-      return m_cache.end();
+      return shard.m_cache.end();
     }
   } else {
     DebugError("Fail to create empty file in cache " + FormatPath(fileId));
-    return m_cache.end();
+    return shard.m_cache.end();
   }
 }
 
 // --------------------------------------------------------------------------
 CacheListIterator Cache::UnguardedErase(
-    FileIdToCacheListIteratorMap::iterator pos) {
+    Shard &shard, FileIdToCacheListIteratorMap::iterator pos, bool evicted) {
   CacheListIterator cachePos = pos->second;
+  shard.m_policy->OnErase(cachePos->first, evicted);
+  if (evicted) {
+    ++shard.m_stats.m_evictions;
+  }
   shared_ptr<File> &file = cachePos->second;
-  m_size -= file->GetCachedSize();
+  UnguardedDropContentKey(shard, cachePos->first);
+  UnguardedSubtractSize(shard, file->GetCachedSize());
+  UnguardedUpdateDiskSize(shard, file->GetDiskSize(), 0);
   file->Clear();
-  CacheListIterator next = m_cache.erase(cachePos);
-  m_map.erase(pos);
+  {
+    lock_guard<mutex> lock(m_sizeLock);
+    m_memoryUsage -= file->m_memoryCharge;
+  }
+  MemoryBudget::Instance().Subtract(MemoryUser::Cache, file->m_memoryCharge);
+  file->m_memoryCharge = 0;
+  CacheListIterator next = shard.m_cache.erase(cachePos);
+  shard.m_map.erase(pos);
   return next;
 }
 
+// --------------------------------------------------------------------------
+void Cache::UnguardedPinFile(Shard &shard, const string &fileId, bool open) {
+  if (open || shard.m_pinned.find(fileId) != shard.m_pinned.end()) {
+    shard.m_policy->OnPin(fileId);
+  } else {
+    shard.m_policy->OnUnpin(fileId);
+  }
+}
+
 // --------------------------------------------------------------------------
 CacheListIterator Cache::UnguardedMakeFileMostRecentlyUsed(
-    CacheListIterator pos) {
-  m_cache.splice(m_cache.begin(), m_cache, pos);
+    Shard &shard, CacheListIterator pos) {
+  shard.m_policy->OnAccess(pos->first);
+  shard.m_cache.splice(shard.m_cache.begin(), shard.m_cache, pos);
   // no iterators or references become invalidated, so no need to update m_map.
-  return m_cache.begin();
+  return shard.m_cache.begin();
 }
 
 }  // namespace Data
@@ -25,14 +25,20 @@
 
 #include <iostream>
 #include <list>
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "boost/noncopyable.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/recursive_mutex.hpp"
 #include "boost/unordered_map.hpp"
 
 #include "base/HashUtils.h"
+#include "data/CachePolicy.h"
 #include "data/File.h"
 #include "data/Page.h"
 
@@ -61,11 +67,62 @@ typedef boost::unordered_map<std::string, CacheListIterator,
 typedef FileIdToCacheListIteratorMap::iterator CacheMapIterator;
 typedef FileIdToCacheListIteratorMap::const_iterator CacheMapConstIterator;
 
+// Cache is split into a number of shards keyed by file id hash. Each shard
+// has its own lock, LRU list, map and byte accounting, so operations on files
+// in different shards could run in parallel. The capacity is shared by all
+// shards, and is balanced by freeing files from the largest shards first.
+//
+// Which file of a shard is freed first is decided by the eviction policy of
+// the shard, e.g. LRU, or 2Q, ARC and TinyLFU which keep the files accessed
+// repeatedly from being flushed by a scan over a large directory.
+// Open files are pinned in the eviction policy, so freeing cache only visits
+// the files which could be freed however many files are open. Files could
+// also be pinned by id, e.g. by a warm-up manifest, up to the pin quota.
+//
+// A large file is not freed as a whole, its least recently used ranges are
+// freed first until it holds no more than a fraction of the capacity.
+//
+// If block size is not zero, files are created with a block store of the
+// block size instead of pages.
+//
+// If max page size is not zero, successive pages of a file are merged into
+// pages up to max page size.
+//
+// Content is cached in two tiers, memory and disk files. When memory is full,
+// the least recently used pages (or blocks) of the least recently used files
+// are demoted to their disk files, and the pages in disk file which are read
+// frequently are promoted back to memory, so memory holds the hottest content.
+// The disk tier is bounded by disk capacity, and the content in disk files of
+// the files chosen by the eviction policy is dropped when it is full.
+//
+// If compression is enabled, the cold pages of a file are compressed in memory
+// before its pages are demoted to disk file, and a compressed page counts its
+// compressed size in cache. Compressed pages read frequently are decompressed
+// like the promoted pages.
+//
+// If dedup is enabled, files loaded from objects of the same ETag and size
+// share the buffers of their pages, so the same content is downloaded and held
+// in memory only once. A shared page is copied when it is written, and a file
+// changed locally never shares its content. The cache size and the memory
+// budget still count the shared content of each file.
+//
+// Memory used by the cache is charged to the global memory budget, including
+// the overhead of pages, blocks and the nodes linking files. The cache frees
+// space as if it is full once the budget is exhausted.
+//
+// Lock order: a thread never blocks on a shard lock while holding another one,
+// except in Rename which locks the two shards in index order. Freeing space
+// could happen while holding the lock of the shard to write, so it only try
+// to lock the other shards and skips the busy ones. The size lock and the
+// content lock are always the innermost ones, and never held together.
 class Cache : private boost::noncopyable {
  public:
-  explicit Cache(uint64_t capacity) : m_size(0), m_capacity(capacity) {}
+  explicit Cache(uint64_t capacity, size_t numShards = 1,
+                 size_t blockSize = 0, size_t maxPageSize = 0,
+                 uint64_t diskCapacity = 0,
+                 CachePolicyType::Value policy = CachePolicyType::LRU);
 
-  ~Cache() {}
+  ~Cache();
 
  public:
   // Has available free space
@@ -73,10 +130,19 @@ class Cache : private boost::noncopyable {
   // @param  : need size
   // @return : bool
   //
-  // If cache files' size plus needSize surpass MaxCacheSize,
-  // then there is no avaiable needSize space.
+  // If cache files' size plus needSize surpass MaxCacheSize, or the memory
+  // budget is exhausted, then there is no avaiable needSize space.
   bool HasFreeSpace(size_t needSize) const;  // size in byte
 
+  // Has available free space in disk tier
+  //
+  // @param  : need size
+  // @return : bool
+  //
+  // Always true if disk capacity is zero, as the disk tier is only limited by
+  // the free space of disk then.
+  bool HasFreeDiskSpace(size_t needSize) const;  // size in byte
+
   // Is the last file in cache open
   //
   // @param  : void
@@ -85,6 +151,8 @@ class Cache : private boost::noncopyable {
   // NOTES:
   // we put least recently used File at back and free the cache starting
   // from back, so IsLastFileOpen can be used as a condition when freeing cache.
+  // For a sharded cache, return true only if the last file of every non-empty
+  // shard is open.
   bool IsLastFileOpen() const;
 
   // Whether the file content existing
@@ -106,31 +174,103 @@ class Cache : private boost::noncopyable {
   ContentRangeDeque GetUnloadedRanges(const std::string &filePath, off_t start,
                                       size_t size) const;
 
+  // Return the ranges of a file written since it is loaded or last cleaned
+  //
+  // @param  : file path
+  // @return : a list of {range start, range size} sorted by start
+  //
+  // Empty if the file does not exist in cache, as nothing is written.
+  ContentRangeDeque GetDirtyRanges(const std::string &filePath) const;
+
+  // Return the dirty ranges of a file to upload and start to track rewrites
+  //
+  // @param  : file path, snapshot number to clean the ranges when uploaded
+  // @return : a list of {range start, range size} sorted by start
+  ContentRangeDeque SnapshotDirtyRanges(const std::string &filePath,
+                                        uint64_t *snapshot);
+
+  // Return total size of the ranges of a file written but not uploaded
+  //
+  // @param  : file path
+  // @return : zero if the file does not exist in cache
+  size_t GetDirtySize(const std::string &filePath) const;
+
   // Return the number of files in cache
   size_t GetNumFile() const;
 
+  // Return the ids of the files in cache
+  std::vector<std::string> GetFileIds() const;
+
   // Get cache size
-  uint64_t GetSize() const { return m_size; }
+  uint64_t GetSize() const;
 
   // Get cache Capacity
   uint64_t GetCapacity() const { return m_capacity; }
 
+  // Get memory used by cache, including the overhead of files and pages
+  uint64_t GetMemoryUsage() const;
+
+  // Get size of content stored in disk files
+  uint64_t GetDiskSize() const;
+
+  // Get disk tier capacity, zero if not limited
+  uint64_t GetDiskCapacity() const { return m_diskCapacity; }
+
+  // Get the bytes reserved by pinned files
+  uint64_t GetPinnedSize() const;
+
+  // Get pin quota, zero if files could not be pinned
+  uint64_t GetPinQuota() const;
+
+  // Set pin quota, the files pinned already are kept
+  void SetPinQuota(uint64_t quota);
+
+  // Whether cold pages are compressed before they are demoted
+  bool IsCompression() const { return m_compression; }
+
+  // Enable compression of cold pages, set before the cache is used
+  void SetCompression(bool compression) { m_compression = compression; }
+
+  // Whether files with the same object content share their cached pages
+  bool IsDedup() const { return m_dedup; }
+
+  // Enable deduplication of cached content, set before the cache is used
+  void SetDedup(bool dedup) { m_dedup = dedup; }
+
   // Get file mtime
   time_t GetTime(const std::string &fileId) const;
 
   // Get file size
   uint64_t GetFileSize(const std::string &filePath) const;
 
+  // Get number of shards
+  size_t GetNumShards() const { return m_shards.size(); }
+
+  // Get block size of files, zero if files use pages
+  size_t GetBlockSize() const { return m_blockSize; }
+
+  // Get max size of merged pages, zero if pages are not merged
+  size_t GetMaxPageSize() const { return m_maxPageSize; }
+
+  // Get eviction policy
+  CachePolicyType::Value GetPolicy() const { return m_policy; }
+
+  // Get counters of eviction policy summed over all shards
+  CachePolicyStats GetPolicyStats() const;
+
   // Find the file
   //
   // @param  : file path (absolute path)
   // @return : const iterator point to cache list
+  //
+  // NOTES: the iterators are not guarded by the shard lock, and they only
+  // refer to a global cache list when there is a single shard. For test only.
   CacheListIterator Find(const std::string &filePath);
 
-  // Begin of cache list
+  // Begin of cache list of the first shard
   CacheListIterator Begin();
 
-  // End of cache list
+  // End of cache list of the first shard
   CacheListIterator End();
 
   // Read file cache into a buffer
@@ -139,11 +279,54 @@ class Cache : private boost::noncopyable {
   // @return : {size of bytes have been writen to buffer, unloaded ranges}
   //
   // If not found fileId in cache, create it in cache and load its pages.
+  // Only the holes in buffer are filled with zero.
   std::pair<size_t, ContentRangeDeque> Read(const std::string &fileId,
                                             off_t offset, size_t len,
                                             char *buffer,
                                             time_t mtimeSince = 0);
 
+  // Read file cache as slices
+  //
+  // @param  : file path, offset, len, modified time since from
+  // @return : {slices sorted by offset, unloaded ranges}
+  //
+  // Slices pin the cached bytes without copying them, so the bytes stay valid
+  // even if the file is freed from cache. The ranges not covered by slices are
+  // holes. If not found fileId in cache, create it in cache.
+  // Content failing the checksum verification in disk file is removed from
+  // cache and reported as unloaded.
+  std::pair<ContentSliceDeque, ContentRangeDeque> ReadSlices(
+      const std::string &fileId, off_t offset, size_t len,
+      time_t mtimeSince = 0);
+
+  // Merge successive pages of a file into larger pages
+  //
+  // @param  : file id
+  // @return : number of pages merged
+  //
+  // This is used to compact a fragmented file in background, it does not
+  // change the cache size.
+  size_t Compact(const std::string &fileId);
+
+  // Whether cold content should be demoted in background
+  //
+  // @param  : void
+  // @return : bool
+  //
+  // Return true if memory usage is above the high watermark and there is no
+  // demotion ongoing.
+  bool NeedDemote() const;
+
+  // Demote cold content to disk files until memory usage is below the low
+  // watermark
+  //
+  // @param  : void
+  // @return : size of demoted content
+  //
+  // This is supposed to run in background, so a write seldom need to wait for
+  // demotion.
+  uint64_t DemoteColdPages();
+
  private:
   // Write a block of bytes into file cache
   //
@@ -161,10 +344,11 @@ class Cache : private boost::noncopyable {
   // @return : bool
   //
   // If File of fileId doesn't exist, create one.
-  // Stream will be moved to cache.
+  // Stream will be moved to cache. With unloaded only, the parts of the file
+  // loaded already are kept, so a download does not overwrite user writes.
   bool Write(const std::string &fileId, off_t offset, size_t len,
              const boost::shared_ptr<std::iostream> &stream, time_t mtime,
-             bool open = false);
+             bool open = false, bool unloadedOnly = false);
 
   // Prepare for Write
   //
@@ -180,17 +364,27 @@ class Cache : private boost::noncopyable {
   // @param  : size need to be freed, file should not be freed
   // @return : bool
   //
-  // Discard the least recently used File to make sure
+  // Discard the Files chosen by eviction policy to make sure
   // there will be number of size avaiable cache space.
   bool Free(size_t size, const std::string &fileUnfreeable);  // size in byte
 
-  // Remove disk files used to cache file content
+  // Demote cache content to disk files
+  //
+  // @param  : size need to be available in cache
+  // @return : size of demoted content
+  //
+  // Move the least recently used content of the least recently used Files
+  // into disk files, until there is number of size available cache space.
+  uint64_t Demote(size_t size);
+
+  // Remove content cached in disk files
   //
   // @param  : disk folder path, size need to be freed, file should not be freed
   // @return : bool
   //
-  // Discard the least recently used File which cache data in disk file to make
-  // sure there will be number of size avaiable disk free space in disk foler.
+  // Discard the disk content of the Files chosen by eviction policy to make
+  // sure there will be number of size avaiable space in disk tier and disk
+  // foler.
   bool FreeDiskCacheFiles(const std::string &diskfolder, size_t size,
                           const std::string &fileUnfreeable);
 
@@ -207,18 +401,84 @@ class Cache : private boost::noncopyable {
   // @return : void
   void Rename(const std::string &oldFileId, const std::string &newFileId);
 
+  // Move the content of a file into its disk file
+  //
+  // @param  : file id
+  // @return : {success, loaded content ranges}
+  //
+  // The disk file is kept after the file is removed from cache, so the file
+  // could be restored from it later.
+  std::pair<bool, ContentRangeDeque> Persist(const std::string &fileId);
+
+  // Restore a file from the content already stored in its disk file
+  //
+  // @param  : file id, mtime, content ranges stored in disk file
+  // @return : bool
+  //
+  // The file should not exist in cache. As the content is stored in disk file,
+  // cache size is not changed.
+  bool Restore(const std::string &fileId, time_t mtime,
+               const ContentRangeDeque &ranges);
+
   // Change file mtime
   //
   // @param  : file id, mtime
   // @return : void
   void SetTime(const std::string &fileId, time_t mtime);
 
+  // Record the object content a file is loaded from
+  //
+  // @param  : file id, ETag and size of the object
+  // @return : void
+  //
+  // The file need not be in cache yet, like a pin the key belongs to the file
+  // id, but it is dropped when the file is removed and moved when the file is
+  // renamed. Do nothing if dedup is disabled or the file is changed locally.
+  // A file whose object changes is not shared any more until it is removed.
+  void SetContentKey(const std::string &fileId, const std::string &eTag,
+                     uint64_t size);
+
+  // Load the unloaded ranges of a file from the files with the same content
+  //
+  // @param  : file id, offset, len, mtime, open state
+  // @return : size of the loaded bytes
+  //
+  // Pages of the other files are shared without copying them when possible.
+  // Files using block store are not shared, as blocks are written in place.
+  size_t ShareContent(const std::string &fileId, off_t offset, size_t len,
+                      time_t mtime, bool open = false);
+
   // Change file open state
   //
   // @param  : file id, open state
   // @return : void
   void SetFileOpen(const std::string &fileId, bool open);
 
+  // Pin a file so it is not evicted whether it is open or not
+  //
+  // @param  : file id, size to reserve in pin quota
+  // @return : false if the size exceeds the quota left
+  //
+  // The file need not be in cache yet, it is pinned once it is cached. The pin
+  // belongs to the file id, it is kept if the file is erased and not moved if
+  // the file is renamed. Pinning a pinned file updates its reserved size.
+  bool Pin(const std::string &fileId, uint64_t size);
+
+  // Unpin a file, it is an eviction candidate again once it is closed
+  void Unpin(const std::string &fileId);
+
+  // Whether a file is pinned by id
+  bool IsPinned(const std::string &fileId) const;
+
+  // Mark ranges of a file as clean, once they are uploaded
+  //
+  // @param  : file id, ranges sorted by start, snapshot number of the ranges
+  // @return : void
+  //
+  // The parts written since the snapshot are kept dirty.
+  void CleanRanges(const std::string &fileId, const ContentRangeDeque &ranges,
+                   uint64_t snapshot);
+
   // Resize a file
   //
   // @param  : file id, new file size, mtime
@@ -226,29 +486,165 @@ class Cache : private boost::noncopyable {
   void Resize(const std::string &fileId, size_t newSize, time_t mtime);
 
  private:
+  typedef boost::unordered_map<std::string, uint64_t, HashUtils::StringHash>
+      FileIdToPinnedSizeMap;
+  typedef boost::unordered_map<std::string, std::set<std::string>,
+                               HashUtils::StringHash>
+      ContentKeyToFileIdsMap;
+  typedef boost::unordered_map<std::string, std::string, HashUtils::StringHash>
+      FileIdToContentKeyMap;
+
+  struct Shard : private boost::noncopyable {
+    explicit Shard(CachePolicyType::Value policy)
+        : m_size(0), m_diskSize(0), m_policy(NewCachePolicy(policy)) {}
+
+    mutable boost::recursive_mutex m_mutex;
+
+    // Record sum of the cache files' size of this shard, not including disk
+    // file
+    uint64_t m_size;
+
+    // Record sum of the size of content in disk files of this shard
+    uint64_t m_diskSize;
+
+    // Most recently used File is put at front,
+    // Least recently used File is put at back.
+    CacheList m_cache;
+
+    FileIdToCacheListIteratorMap m_map;
+
+    // Decide which File to evict
+    boost::shared_ptr<CachePolicy> m_policy;
+    CachePolicyStats m_stats;
+
+    // Files pinned by id and their sizes reserved in pin quota
+    FileIdToPinnedSizeMap m_pinned;
+
+    // Keys of the object content files are loaded from, used by dedup
+    FileIdToContentKeyMap m_contentKeys;
+  };
+
+  // Get the shard which file id is hashed to
+  Shard &GetShard(const std::string &fileId) const;
+  size_t GetShardIndex(const std::string &fileId) const;
+
+  // Get the file in cache, null if not existing
+  boost::shared_ptr<File> GetFile(const std::string &fileId) const;
+
+  // Return size need to be freed so there is available space for size, which
+  // is the larger one of the excess over capacity and the memory budget
+  size_t GetNeedSize(size_t size) const;
+
+  // Update cache size with the delta of cached size of a file, the caller
+  // should hold the lock of the shard
+  void UnguardedAddSize(Shard &shard, uint64_t delta);
+  void UnguardedSubtractSize(Shard &shard, uint64_t delta);
+
+  // Charge the memory used by a file and its entry in cache to the memory
+  // budget, the caller should hold the lock of the shard
+  void UnguardedUpdateMemoryUsage(const std::string &fileId, File &file);
+
+  // Forget the content key of a file and remove it from the content index,
+  // the caller should hold the lock of the shard
+  void UnguardedDropContentKey(Shard &shard, const std::string &fileId);
+
+  // Return the ranges of {offset, len} not loaded in a file, the whole range
+  // if the file does not exist. The caller should hold the lock of the shard.
+  ContentRangeDeque UnguardedGetHoles(Shard &shard, const std::string &fileId,
+                                      off_t offset, size_t len) const;
+
+  // Update disk tier size with the change of a file's size in disk file, the
+  // caller should hold the lock of the shard
+  void UnguardedUpdateDiskSize(Shard &shard, uint64_t oldSize,
+                               uint64_t newSize);
+
+  // Discard the File of a shard chosen by the eviction policy which is not
+  // open and is not fileUnfreeable, the freed sizes are added to freedSpace
+  // and freedDiskSpace. If a large File holds more than a fraction of the
+  // capacity, only its least recently used ranges of the need size are
+  // discarded instead. Return false if there is no such file in the shard or
+  // the shard is locked by other thread.
+  bool EvictFile(Shard &shard, const std::string &fileUnfreeable,
+                 size_t size, uint64_t *freedSpace, uint64_t *freedDiskSpace);
+
+  // Demote the least recently used content of the least recently used File of
+  // a shard which has content in memory, the demoted size is added to
+  // demotedSpace. Return false if there is no such file in the shard, or the
+  // shard is locked by other thread, or there is no space in disk tier.
+  bool DemoteLeastRecentlyUsedFile(Shard &shard, size_t size,
+                                   uint64_t *demotedSpace);
+
+  // Discard the disk content of the File of a shard chosen by the eviction
+  // policy which is not open and is not fileUnfreeable, the freed size is
+  // added to freedDiskSpace. The File is removed if it has no content in
+  // memory. If a large File holds more than a fraction of the disk capacity,
+  // only its least recently used ranges of the need size are discarded
+  // instead. Return false if there is no such file in the shard or the shard
+  // is locked by other thread.
+  bool EvictDiskContent(Shard &shard, const std::string &fileUnfreeable,
+                        size_t size, uint64_t *freedDiskSpace);
+
+  // Return the index of the shard which has the largest cache size (or disk
+  // size) and is not excluded or busy, or return the number of shards if there
+  // is none.
+  size_t GetLargestShardIndex(const std::vector<bool> &excluded,
+                              bool byDiskSize = false) const;
+
   // Create an empty File with fileId in cache, without checking input.
   // If success return reference to insert file, else return m_cache.end().
-  CacheListIterator UnguardedNewEmptyFile(const std::string &fileId,
+  CacheListIterator UnguardedNewEmptyFile(Shard &shard,
+                                          const std::string &fileId,
                                           time_t mtime);
 
   // Erase the file denoted by pos, without checking input.
-  CacheListIterator UnguardedErase(FileIdToCacheListIteratorMap::iterator pos);
+  CacheListIterator UnguardedErase(Shard &shard,
+                                   FileIdToCacheListIteratorMap::iterator pos,
+                                   bool evicted = false);
+
+  // Pin an open file or a file pinned by id in the eviction policy so eviction
+  // skips it without visiting it, or unpin the others. The caller should hold
+  // the lock of the shard.
+  void UnguardedPinFile(Shard &shard, const std::string &fileId, bool open);
 
   // Move the file denoted by pos into the front of the cache,
   // without checking input.
-  CacheListIterator UnguardedMakeFileMostRecentlyUsed(CacheListIterator pos);
+  CacheListIterator UnguardedMakeFileMostRecentlyUsed(Shard &shard,
+                                                      CacheListIterator pos);
 
  private:
   // Record sum of the cache files' size, not including disk file
   uint64_t m_size;
+  mutable boost::mutex m_sizeLock;
+
+  // Record memory charged to memory budget, guarded by size lock
+  uint64_t m_memoryUsage;
 
   uint64_t m_capacity;  // in bytes
 
-  // Most recently used File is put at front,
-  // Least recently used File is put at back.
-  CacheList m_cache;
+  // Record sum of the size of content in disk files, guarded by size lock
+  uint64_t m_diskSize;
+  uint64_t m_diskCapacity;  // in bytes, zero if not limited
+  bool m_demoting;          // demotion ongoing, guarded by size lock
+
+  // Bytes reserved by pinned files and the quota, guarded by size lock
+  uint64_t m_pinnedSize;
+  uint64_t m_pinQuota;  // zero if files could not be pinned
+
+  size_t m_blockSize;  // block size of files, zero to use pages
+
+  size_t m_maxPageSize;  // max size of merged pages, zero not to merge
+
+  bool m_compression;  // compress cold pages before demoting them
+
+  bool m_dedup;  // share pages of files with the same object content
+
+  // Files having each content key, guarded by content lock
+  ContentKeyToFileIdsMap m_contentIndex;
+  mutable boost::mutex m_contentLock;
+
+  CachePolicyType::Value m_policy;  // eviction policy of shards
 
-  FileIdToCacheListIteratorMap m_map;
+  std::vector<boost::shared_ptr<Shard> > m_shards;
 
   friend class QS::Client::QSClient;
   friend class QS::FileSystem::Drive;
@@ -256,6 +652,9 @@ class Cache : private boost::noncopyable {
   friend struct QS::FileSystem::DownloadFileContentRangeCallback;
   friend struct QS::FileSystem::UploadFileCallback;
   friend class CacheTest;
+  friend class CacheBenchmark;
+  friend class CachePolicyBenchmark;
+  friend class FileReadBenchmark;
 };
 
 }  // namespace Data
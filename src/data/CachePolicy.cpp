@@ -0,0 +1,602 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/CachePolicy.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "boost/make_shared.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/unordered_map.hpp"
+
+#include "base/HashUtils.h"
+#include "base/StringUtils.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::make_shared;
+using boost::shared_ptr;
+using std::ostream;
+using std::string;
+using std::vector;
+
+namespace {
+
+typedef std::list<string> IdList;
+
+// Base of the policies which keep file ids in a number of queues, the most
+// recently put id is at front of a queue. The last queues are ghost queues,
+// which keep the ids of the files already evicted and are not counted as
+// resident files.
+//
+// A pinned id is moved to a separate list and remembers its queue, moving it
+// to another resident queue only changes the queue it goes back to when it is
+// unpinned, so the queues only hold the ids which could be evicted.
+class QueuedCachePolicy : public CachePolicy {
+ public:
+  QueuedCachePolicy(size_t numQueues, size_t numGhostQueues)
+      : m_queues(numQueues),
+        m_sizes(numQueues, 0),
+        m_numResidentQueues(numQueues - numGhostQueues),
+        m_numPinned(0) {
+    assert(numGhostQueues < numQueues);
+  }
+
+ public:
+  size_t GetSize() const {
+    size_t size = m_numPinned;
+    for (size_t i = 0; i < m_numResidentQueues; ++i) {
+      size += m_sizes[i];
+    }
+    return size;
+  }
+
+  void OnPin(const string &fileId) {
+    EntryMap::iterator it = m_entries.find(fileId);
+    if (it == m_entries.end() || it->second.m_pinned ||
+        it->second.m_queue >= m_numResidentQueues) {
+      return;
+    }
+    Entry &entry = it->second;
+    m_pinned.splice(m_pinned.begin(), m_queues[entry.m_queue], entry.m_pos);
+    --m_sizes[entry.m_queue];
+    ++m_numPinned;
+    entry.m_pinned = true;
+  }
+
+  // The unpinned id is put at front of its queue, as it is just used
+  void OnUnpin(const string &fileId) {
+    EntryMap::iterator it = m_entries.find(fileId);
+    if (it == m_entries.end() || !it->second.m_pinned) {
+      return;
+    }
+    Entry &entry = it->second;
+    m_queues[entry.m_queue].splice(m_queues[entry.m_queue].begin(), m_pinned,
+                                   entry.m_pos);
+    --m_numPinned;
+    ++m_sizes[entry.m_queue];
+    entry.m_pinned = false;
+  }
+
+  void OnRename(const string &oldFileId, const string &newFileId) {
+    EntryMap::iterator it = m_entries.find(oldFileId);
+    if (it == m_entries.end() || oldFileId == newFileId) {
+      return;
+    }
+    Remove(newFileId);
+    Entry entry = it->second;
+    m_entries.erase(it);
+    *entry.m_pos = newFileId;
+    m_entries.emplace(newFileId, entry);
+  }
+
+ protected:
+  static const int kNone = -1;
+
+  // Return the queue of the id, or kNone if not existing
+  int QueueOf(const string &fileId) const {
+    EntryMap::const_iterator it = m_entries.find(fileId);
+    return it == m_entries.end() ? kNone
+                                 : static_cast<int>(it->second.m_queue);
+  }
+
+  size_t QueueSize(size_t queue) const { return m_sizes[queue]; }
+
+  // Return the most recently put id of a non empty queue
+  const string &Front(size_t queue) const {
+    assert(m_sizes[queue] > 0);
+    return m_queues[queue].front();
+  }
+
+  // Return the least recently put id of a non empty queue
+  const string &Back(size_t queue) const {
+    assert(m_sizes[queue] > 0);
+    return m_queues[queue].back();
+  }
+
+  // Put a new id at front of the queue
+  void Push(const string &fileId, size_t queue) {
+    m_queues[queue].push_front(fileId);
+    ++m_sizes[queue];
+    m_entries.emplace(fileId, Entry(queue, m_queues[queue].begin()));
+  }
+
+  // Move an existing id to front of the queue, a pinned id is unpinned if
+  // the queue is a ghost queue
+  void Move(const string &fileId, size_t queue) {
+    EntryMap::iterator it = m_entries.find(fileId);
+    if (it == m_entries.end()) {
+      return;
+    }
+    Entry &entry = it->second;
+    if (entry.m_pinned && queue < m_numResidentQueues) {
+      entry.m_queue = queue;
+      return;
+    }
+    m_queues[queue].splice(m_queues[queue].begin(), ListOf(entry),
+                           entry.m_pos);
+    Unlinked(entry);
+    ++m_sizes[queue];
+    entry.m_queue = queue;
+    entry.m_pos = m_queues[queue].begin();
+  }
+
+  // Remove the id if existing
+  void Remove(const string &fileId) {
+    EntryMap::iterator it = m_entries.find(fileId);
+    if (it == m_entries.end()) {
+      return;
+    }
+    ListOf(it->second).erase(it->second.m_pos);
+    Unlinked(it->second);
+    m_entries.erase(it);
+  }
+
+  // Remove the least recently put ids until the queue has at most size ids
+  void Trim(size_t queue, size_t size) {
+    while (m_sizes[queue] > size) {
+      Remove(Back(queue));
+    }
+  }
+
+  // Visit the queue from the least recently put id, return true if the
+  // visitor stops
+  bool VisitQueue(size_t queue, CachePolicyVisitor *visitor) const {
+    for (IdList::const_reverse_iterator it = m_queues[queue].rbegin();
+         it != m_queues[queue].rend(); ++it) {
+      if (visitor->Visit(*it)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  struct Entry {
+    Entry(size_t queue, IdList::iterator pos)
+        : m_queue(queue), m_pos(pos), m_pinned(false) {}
+    size_t m_queue;  // for pinned id, the queue to put back when unpinned
+    IdList::iterator m_pos;
+    bool m_pinned;
+  };
+  typedef boost::unordered_map<string, Entry, HashUtils::StringHash> EntryMap;
+
+  // Return the list holding the id of entry
+  IdList &ListOf(const Entry &entry) {
+    return entry.m_pinned ? m_pinned : m_queues[entry.m_queue];
+  }
+
+  // Update the sizes after the id of entry is taken out of its list
+  void Unlinked(Entry &entry) {
+    if (entry.m_pinned) {
+      --m_numPinned;
+      entry.m_pinned = false;
+    } else {
+      --m_sizes[entry.m_queue];
+    }
+  }
+
+  vector<IdList> m_queues;
+  vector<size_t> m_sizes;  // std::list::size is linear in C++98
+  size_t m_numResidentQueues;
+  IdList m_pinned;  // pinned ids, which are not in any queue
+  size_t m_numPinned;
+  EntryMap m_entries;
+};
+
+// --------------------------------------------------------------------------
+// Least recently used
+class LRUPolicy : public QueuedCachePolicy {
+ public:
+  LRUPolicy() : QueuedCachePolicy(1, 0) {}
+
+  CachePolicyType::Value GetType() const { return CachePolicyType::LRU; }
+
+  void OnInsert(const string &fileId) {
+    if (QueueOf(fileId) == kNone) {
+      Push(fileId, 0);
+    } else {
+      Move(fileId, 0);
+    }
+  }
+
+  void OnAccess(const string &fileId) { Move(fileId, 0); }
+
+  void OnErase(const string &fileId, bool evicted) { Remove(fileId); }
+
+  void VisitVictims(CachePolicyVisitor *visitor) { VisitQueue(0, visitor); }
+};
+
+// --------------------------------------------------------------------------
+// 2Q, new files are put in a FIFO queue and only files accessed again after
+// being evicted from it are put in the main LRU queue, so a scan only flushes
+// the FIFO queue.
+class TwoQPolicy : public QueuedCachePolicy {
+ public:
+  TwoQPolicy() : QueuedCachePolicy(3, 1) {}
+
+  CachePolicyType::Value GetType() const { return CachePolicyType::TwoQ; }
+
+  void OnInsert(const string &fileId) {
+    int queue = QueueOf(fileId);
+    if (queue == kNone) {
+      Push(fileId, kIn);
+    } else if (queue == kOut) {
+      Move(fileId, kMain);
+    } else {
+      OnAccess(fileId);
+    }
+  }
+
+  // A file in FIFO queue stays as it is, as the accesses to a new file are
+  // usually correlated.
+  void OnAccess(const string &fileId) {
+    if (QueueOf(fileId) == kMain) {
+      Move(fileId, kMain);
+    }
+  }
+
+  void OnErase(const string &fileId, bool evicted) {
+    if (evicted && QueueOf(fileId) == kIn) {
+      Move(fileId, kOut);
+      Trim(kOut, std::max(GetSize() / 2, static_cast<size_t>(1)));
+    } else {
+      Remove(fileId);
+    }
+  }
+
+  // Evict from the FIFO queue if it exceeds a quarter of the files
+  void VisitVictims(CachePolicyVisitor *visitor) {
+    if (QueueSize(kIn) > std::max(GetSize() / 4, static_cast<size_t>(1))) {
+      VisitQueue(kIn, visitor) || VisitQueue(kMain, visitor);
+    } else {
+      VisitQueue(kMain, visitor) || VisitQueue(kIn, visitor);
+    }
+  }
+
+ private:
+  static const int kIn = 0;    // FIFO of new files
+  static const int kMain = 1;  // LRU of files accessed again
+  static const int kOut = 2;   // ghosts evicted from FIFO
+};
+
+// --------------------------------------------------------------------------
+// Adaptive replacement cache, which balances between the files seen once and
+// the files seen again by adapting the target size of the former with the
+// hits on the ghosts of evicted files.
+class ARCPolicy : public QueuedCachePolicy {
+ public:
+  ARCPolicy() : QueuedCachePolicy(4, 2), m_target(0) {}
+
+  CachePolicyType::Value GetType() const { return CachePolicyType::ARC; }
+
+  void OnInsert(const string &fileId) {
+    int queue = QueueOf(fileId);
+    if (queue == kNone) {
+      Push(fileId, kRecent);
+    } else if (queue == kRecentGhost) {
+      size_t delta = std::max(QueueSize(kFrequentGhost) /
+                                  QueueSize(kRecentGhost),
+                              static_cast<size_t>(1));
+      m_target = std::min(m_target + delta, GetSize() + 1);
+      Move(fileId, kFrequent);
+    } else if (queue == kFrequentGhost) {
+      size_t delta = std::max(QueueSize(kRecentGhost) /
+                                  QueueSize(kFrequentGhost),
+                              static_cast<size_t>(1));
+      m_target = m_target > delta ? m_target - delta : 0;
+      Move(fileId, kFrequent);
+    } else {
+      OnAccess(fileId);
+    }
+  }
+
+  void OnAccess(const string &fileId) {
+    int queue = QueueOf(fileId);
+    if (queue == kRecent || queue == kFrequent) {
+      Move(fileId, kFrequent);
+    }
+  }
+
+  void OnErase(const string &fileId, bool evicted) {
+    int queue = QueueOf(fileId);
+    if (evicted && (queue == kRecent || queue == kFrequent)) {
+      int ghost = queue == kRecent ? kRecentGhost : kFrequentGhost;
+      Move(fileId, ghost);
+      Trim(ghost, std::max(GetSize(), static_cast<size_t>(1)));
+    } else {
+      Remove(fileId);
+    }
+  }
+
+  void VisitVictims(CachePolicyVisitor *visitor) {
+    size_t recent = QueueSize(kRecent);
+    if (recent > 0 &&
+        (recent > std::min(m_target, GetSize()) || QueueSize(kFrequent) == 0)) {
+      VisitQueue(kRecent, visitor) || VisitQueue(kFrequent, visitor);
+    } else {
+      VisitQueue(kFrequent, visitor) || VisitQueue(kRecent, visitor);
+    }
+  }
+
+ private:
+  static const int kRecent = 0;         // files seen once
+  static const int kFrequent = 1;       // files seen again
+  static const int kRecentGhost = 2;    // ghosts evicted from kRecent
+  static const int kFrequentGhost = 3;  // ghosts evicted from kFrequent
+
+  size_t m_target;  // target number of files in kRecent
+};
+
+// --------------------------------------------------------------------------
+// Count-min sketch of the access frequency of files, with 4 bits counters
+// which are halved periodically so the history ages.
+class FrequencySketch {
+ public:
+  FrequencySketch() : m_mask(0), m_additions(0) { Resize(kMinWidth); }
+
+  // Grow the sketch to fit the number of files, the history is dropped
+  void EnsureCapacity(size_t numFiles) {
+    if (numFiles > m_mask + 1) {
+      size_t width = m_mask + 1;
+      while (width < numFiles) {
+        width <<= 1;
+      }
+      Resize(width);
+    }
+  }
+
+  void Increment(const string &fileId) {
+    uint32_t hash = Hash(fileId);
+    bool added = false;
+    for (size_t i = 0; i < kDepth; ++i) {
+      uint8_t &counter = m_table[Index(hash, i)];
+      if (counter < kMaxCount) {
+        ++counter;
+        added = true;
+      }
+    }
+    if (added && ++m_additions >= 10 * (m_mask + 1)) {
+      Age();
+    }
+  }
+
+  unsigned Frequency(const string &fileId) const {
+    uint32_t hash = Hash(fileId);
+    unsigned frequency = kMaxCount;
+    for (size_t i = 0; i < kDepth; ++i) {
+      frequency = std::min(frequency,
+                           static_cast<unsigned>(m_table[Index(hash, i)]));
+    }
+    return frequency;
+  }
+
+ private:
+  static const size_t kDepth = 4;
+  static const size_t kMinWidth = 64;
+  static const uint8_t kMaxCount = 15;
+
+  static uint32_t Mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6bU;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35U;
+    x ^= x >> 16;
+    return x;
+  }
+
+  static uint32_t Hash(const string &fileId) {
+    return Mix(static_cast<uint32_t>(HashUtils::StringHash()(fileId)));
+  }
+
+  size_t Index(uint32_t hash, size_t row) const {
+    static const uint32_t seeds[kDepth] = {0x97cb3127U, 0xbf58476dU,
+                                           0x94d049bbU, 0x2545f491U};
+    return row * (m_mask + 1) + (Mix(hash + seeds[row]) & m_mask);
+  }
+
+  void Resize(size_t width) {
+    m_mask = width - 1;
+    m_table.assign(kDepth * width, 0);
+    m_additions = 0;
+  }
+
+  void Age() {
+    for (size_t i = 0; i < m_table.size(); ++i) {
+      m_table[i] >>= 1;
+    }
+    m_additions /= 2;
+  }
+
+  vector<uint8_t> m_table;  // kDepth rows of counters
+  size_t m_mask;            // width of a row minus 1, width is power of two
+  size_t m_additions;       // additions since last aging
+};
+
+// --------------------------------------------------------------------------
+// Window TinyLFU, new files are put in a small LRU window, and the files
+// overflowing the window are put at front of the probation queue of the main
+// segmented LRU. When evicting, such a candidate is only kept if it is
+// accessed more frequently than the victim at back of the probation queue,
+// so the files of a scan are evicted before the files used frequently.
+class TinyLFUPolicy : public QueuedCachePolicy {
+ public:
+  TinyLFUPolicy() : QueuedCachePolicy(3, 0) {}
+
+  CachePolicyType::Value GetType() const { return CachePolicyType::TinyLFU; }
+
+  void OnInsert(const string &fileId) {
+    if (QueueOf(fileId) != kNone) {
+      OnAccess(fileId);
+      return;
+    }
+    m_sketch.EnsureCapacity(GetSize() + 1);
+    m_sketch.Increment(fileId);
+    Push(fileId, kWindow);
+    // Window holds 1% of the files
+    size_t maxWindow = std::max(GetSize() / 100, static_cast<size_t>(1));
+    while (QueueSize(kWindow) > maxWindow) {
+      Move(Back(kWindow), kProbation);
+    }
+  }
+
+  void OnAccess(const string &fileId) {
+    int queue = QueueOf(fileId);
+    if (queue == kNone) {
+      return;
+    }
+    m_sketch.Increment(fileId);
+    if (queue == kWindow) {
+      Move(fileId, kWindow);
+      return;
+    }
+    Move(fileId, kProtected);
+    // Protected queue holds at most 80% of the main queue
+    size_t maxProtected = std::max(
+        (QueueSize(kProbation) + QueueSize(kProtected)) * 4 / 5,
+        static_cast<size_t>(1));
+    while (QueueSize(kProtected) > maxProtected) {
+      Move(Back(kProtected), kProbation);
+    }
+  }
+
+  void OnErase(const string &fileId, bool evicted) { Remove(fileId); }
+
+  void VisitVictims(CachePolicyVisitor *visitor) {
+    if (QueueSize(kProbation) > 1) {
+      const string &candidate = Front(kProbation);
+      if (m_sketch.Frequency(candidate) <=
+              m_sketch.Frequency(Back(kProbation)) &&
+          visitor->Visit(candidate)) {
+        return;  // candidate is not admitted
+      }
+    }
+    VisitQueue(kProbation, visitor) || VisitQueue(kProtected, visitor) ||
+        VisitQueue(kWindow, visitor);
+  }
+
+ private:
+  static const int kWindow = 0;
+  static const int kProbation = 1;
+  static const int kProtected = 2;
+
+  FrequencySketch m_sketch;
+};
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+string GetCachePolicyName(CachePolicyType::Value policy) {
+  string name;
+  switch (policy) {
+    case CachePolicyType::LRU:
+      name = "lru";
+      break;
+    case CachePolicyType::TwoQ:
+      name = "2q";
+      break;
+    case CachePolicyType::ARC:
+      name = "arc";
+      break;
+    case CachePolicyType::TinyLFU:
+      name = "tinylfu";
+      break;
+    default:
+      break;
+  }
+  return name;
+}
+
+// --------------------------------------------------------------------------
+CachePolicyType::Value GetCachePolicyByName(const string &name) {
+  CachePolicyType::Value policy = CachePolicyType::LRU;
+  string name_lowercase = QS::StringUtils::ToLower(name);
+  if (name_lowercase == "2q") {
+    policy = CachePolicyType::TwoQ;
+  } else if (name_lowercase == "arc") {
+    policy = CachePolicyType::ARC;
+  } else if (name_lowercase == "tinylfu") {
+    policy = CachePolicyType::TinyLFU;
+  }
+  return policy;
+}
+
+// --------------------------------------------------------------------------
+CachePolicyStats &CachePolicyStats::operator+=(const CachePolicyStats &stats) {
+  m_hits += stats.m_hits;
+  m_misses += stats.m_misses;
+  m_evictions += stats.m_evictions;
+  m_memoryHits += stats.m_memoryHits;
+  m_compressedHits += stats.m_compressedHits;
+  m_diskHits += stats.m_diskHits;
+  return *this;
+}
+
+// --------------------------------------------------------------------------
+ostream &operator<<(ostream &os, const CachePolicyStats &stats) {
+  return os << "[hits: " << stats.m_hits << "] "
+            << "[misses: " << stats.m_misses << "] "
+            << "[evictions: " << stats.m_evictions << "] "
+            << "[memory hits: " << stats.m_memoryHits << "] "
+            << "[compressed hits: " << stats.m_compressedHits << "] "
+            << "[disk hits: " << stats.m_diskHits << "]";
+}
+
+// --------------------------------------------------------------------------
+shared_ptr<CachePolicy> NewCachePolicy(CachePolicyType::Value policy) {
+  switch (policy) {
+    case CachePolicyType::TwoQ:
+      return make_shared<TwoQPolicy>();
+    case CachePolicyType::ARC:
+      return make_shared<ARCPolicy>();
+    case CachePolicyType::TinyLFU:
+      return make_shared<TinyLFUPolicy>();
+    default:
+      return make_shared<LRUPolicy>();
+  }
+}
+
+}  // namespace Data
+}  // namespace QS
@@ -0,0 +1,147 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_CACHEPOLICY_H_
+#define QSFS_DATA_CACHEPOLICY_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+
+#include "boost/noncopyable.hpp"
+#include "boost/shared_ptr.hpp"
+
+namespace QS {
+
+namespace Data {
+
+struct CachePolicyType {
+  enum Value { LRU = 0, TwoQ = 1, ARC = 2, TinyLFU = 3 };
+};
+
+// Get cache policy name
+//
+// @param  : cache policy enumeration
+// @return : cache policy name
+std::string GetCachePolicyName(CachePolicyType::Value policy);
+
+// Get cache policy
+//
+// @param  : cache policy name
+// @return : cache policy enumeration
+//
+// Return LRU if name not belongs to {lru, 2q, arc, tinylfu}
+CachePolicyType::Value GetCachePolicyByName(const std::string &name);
+
+// Counters of a cache policy, used to compare the policies
+struct CachePolicyStats {
+  CachePolicyStats()
+      : m_hits(0),
+        m_misses(0),
+        m_evictions(0),
+        m_memoryHits(0),
+        m_compressedHits(0),
+        m_diskHits(0) {}
+
+  CachePolicyStats &operator+=(const CachePolicyStats &stats);
+
+  uint64_t m_hits;       // reads with all content in cache
+  uint64_t m_misses;     // reads with content not in cache
+  uint64_t m_evictions;  // files or ranges evicted to free space
+
+  // Pages or blocks read from each tier
+  uint64_t m_memoryHits;
+  uint64_t m_compressedHits;
+  uint64_t m_diskHits;
+};
+
+std::ostream &operator<<(std::ostream &os, const CachePolicyStats &stats);
+
+// Visitor of the eviction candidates of a cache policy
+class CachePolicyVisitor {
+ public:
+  virtual ~CachePolicyVisitor() {}
+
+  // Visit a candidate
+  //
+  // @param  : file id
+  // @return : true to stop visiting
+  virtual bool Visit(const std::string &fileId) = 0;
+};
+
+// Eviction policy of the files of a cache
+//
+// A policy only orders the ids of the files in cache, it is told when a file
+// is inserted, accessed or erased, and offers the files to evict in order of
+// preference. An open file is pinned, it keeps its place in the policy but is
+// not offered. A policy is not thread safe, it is guarded by the owner.
+class CachePolicy : private boost::noncopyable {
+ public:
+  virtual ~CachePolicy() {}
+
+ public:
+  // Get policy type
+  virtual CachePolicyType::Value GetType() const = 0;
+
+  // Get number of files resident in cache
+  virtual size_t GetSize() const = 0;
+
+  // A file is put into cache
+  virtual void OnInsert(const std::string &fileId) = 0;
+
+  // A file in cache is accessed
+  virtual void OnAccess(const std::string &fileId) = 0;
+
+  // A file is removed from cache
+  //
+  // @param  : file id, whether the file is evicted to free space
+  // @return : void
+  virtual void OnErase(const std::string &fileId, bool evicted) = 0;
+
+  // A file in cache is renamed
+  virtual void OnRename(const std::string &oldFileId,
+                        const std::string &newFileId) = 0;
+
+  // A file in cache is opened, it is not an eviction candidate until unpinned
+  virtual void OnPin(const std::string &fileId) = 0;
+
+  // A file in cache is closed, it is an eviction candidate again
+  virtual void OnUnpin(const std::string &fileId) = 0;
+
+  // Visit the files in cache in order of eviction preference
+  //
+  // @param  : visitor
+  // @return : void
+  //
+  // Pinned files are not visited, so the cost of visiting does not grow with
+  // the number of open files.
+  // The visitor should not change the policy while visiting, as the policy
+  // could reorder the files before visiting, e.g. to admit a new file.
+  virtual void VisitVictims(CachePolicyVisitor *visitor) = 0;
+};
+
+// Create a cache policy
+//
+// @param  : cache policy enumeration
+// @return : cache policy
+boost::shared_ptr<CachePolicy> NewCachePolicy(CachePolicyType::Value policy);
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_CACHEPOLICY_H_
@@ -38,6 +38,7 @@
 #include "base/TimeUtils.h"
 #include "base/Utils.h"
 #include "data/FileMetaData.h"
+#include "data/MemoryBudget.h"
 #include "data/Node.h"
 
 namespace QS {
@@ -61,6 +62,17 @@ using std::vector;
 
 static const char *const ROOT_PATH = "/";
 
+namespace {
+
+// Return memory used by a node, which is linked in node map and the children
+// map of its parent, not including the file paths
+size_t GetNodeSize() {
+  return SharedCountSize() + sizeof(Node) +
+         2 * HashNodeSize(sizeof(FilePathToNodeUnorderedMap::value_type));
+}
+
+}  // namespace
+
 // --------------------------------------------------------------------------
 shared_ptr<Node> DirectoryTree::GetRoot() const {
   lock_guard<recursive_mutex> lock(m_mutex);
@@ -117,6 +129,12 @@ ChildrenMultiMapConstIterator DirectoryTree::CEndParentToChildrenMap() const {
   return m_parentToChildrenMap.cend();
 }
 
+// --------------------------------------------------------------------------
+uint64_t DirectoryTree::GetMemoryUsage() const {
+  lock_guard<recursive_mutex> lock(m_mutex);
+  return m_memoryUsage;
+}
+
 // --------------------------------------------------------------------------
 shared_ptr<Node> DirectoryTree::Grow(const shared_ptr<FileMetaData> &fileMeta) {
   lock_guard<recursive_mutex> lock(m_mutex);
@@ -150,6 +168,7 @@ shared_ptr<Node> DirectoryTree::Grow(const shared_ptr<FileMetaData> &fileMeta) {
       DebugError("Fail to add node " + FormatPath(filePath));
       return shared_ptr<Node>();
     }
+    m_pathSize += StringSize(filePath);
 
     // hook up with parent
     assert(!dirName.empty());
@@ -185,6 +204,7 @@ shared_ptr<Node> DirectoryTree::Grow(const shared_ptr<FileMetaData> &fileMeta) {
       DebugError("Fail to add node " + FormatPath(filePath));
       return shared_ptr<Node>();
     }
+    UpdateMemoryUsageNoLock();
   }
   // m_currentNode = node;
 
@@ -276,6 +296,7 @@ shared_ptr<Node> DirectoryTree::UpdateDirectory(
     node = Grow(BuildDefaultDirectoryMeta(path));
     Grow(newChildrenMetas);
   }
+  UpdateMemoryUsageNoLock();
 
   // m_currentNode = node;
   return node;
@@ -318,8 +339,12 @@ shared_ptr<Node> DirectoryTree::Rename(const string &oldFilePath,
     if (!res.second) {
       DebugWarning("Fail to rename node " +
                    FormatPath(oldFilePath, newFilePath));
+    } else {
+      m_pathSize += StringSize(newFilePath);
+    }
+    if (m_map.erase(oldFilePath) > 0) {
+      m_pathSize -= StringSize(oldFilePath);
     }
-    m_map.erase(oldFilePath);
     if (node->IsDirectory()) {
       bool fail = false;
       vector<weak_ptr<Node> > childs = FindChildren(oldFilePath);
@@ -335,6 +360,7 @@ shared_ptr<Node> DirectoryTree::Rename(const string &oldFilePath,
       }
       m_parentToChildrenMap.erase(oldFilePath);
     }
+    UpdateMemoryUsageNoLock();
     // m_currentNode = node;
   } else {
     DebugWarning("Node not exist " + FormatPath(oldFilePath));
@@ -365,7 +391,9 @@ void DirectoryTree::Remove(const string &path) {
     // to the node now.
     parent->Remove(path);
   }
-  m_map.erase(path);
+  if (m_map.erase(path) > 0) {
+    m_pathSize -= StringSize(path);
+  }
   string nodeDir = node->MyDirName();
   for (ChildrenMultiMapIterator it = m_parentToChildrenMap.begin();
        it != m_parentToChildrenMap.end();) {
@@ -386,6 +414,7 @@ void DirectoryTree::Remove(const string &path) {
 
   if (!node->IsDirectory()) {
     // Do not need to reset, destructor will be invoked at end
+    UpdateMemoryUsageNoLock();
     return;
   }
 
@@ -400,7 +429,9 @@ void DirectoryTree::Remove(const string &path) {
     deleteNodes.pop();
 
     string path_ = node_->GetFilePath();
-    m_map.erase(path_);
+    if (m_map.erase(path_) > 0) {
+      m_pathSize -= StringSize(path_);
+    }
     m_parentToChildrenMap.erase(path_);
 
     if (node->IsDirectory()) {
@@ -410,16 +441,40 @@ void DirectoryTree::Remove(const string &path) {
       }
     }
   }
+  UpdateMemoryUsageNoLock();
 }
 
 // --------------------------------------------------------------------------
-DirectoryTree::DirectoryTree(time_t mtime, uid_t uid, gid_t gid, mode_t mode) {
+void DirectoryTree::UpdateMemoryUsageNoLock() {
+  // The keys of parent to children map are the file paths of directories,
+  // which are counted at the average size of file paths
+  size_t avgPathSize = m_map.empty() ? 0 : m_pathSize / m_map.size();
+  uint64_t usage =
+      m_map.size() * GetNodeSize() + 2 * m_pathSize +
+      m_parentToChildrenMap.size() *
+          (HashNodeSize(sizeof(ParentFilePathToChildrenMultiMap::value_type)) +
+           avgPathSize);
+  MemoryBudget::Instance().Update(MemoryUser::DirectoryTree, m_memoryUsage,
+                                  usage);
+  m_memoryUsage = usage;
+}
+
+// --------------------------------------------------------------------------
+DirectoryTree::DirectoryTree(time_t mtime, uid_t uid, gid_t gid, mode_t mode)
+    : m_pathSize(0), m_memoryUsage(0) {
   lock_guard<recursive_mutex> lock(m_mutex);
   m_root = make_shared<Node>(
       Entry(ROOT_PATH, 0, mtime, mtime, uid, gid, mode, FileType::Directory));
   // m_currentNode = m_root;
   m_root->SetFileOpen(true);  // always keep root open
   m_map.emplace(ROOT_PATH, m_root);
+  UpdateMemoryUsageNoLock();
+}
+
+// --------------------------------------------------------------------------
+DirectoryTree::~DirectoryTree() {
+  m_map.clear();
+  MemoryBudget::Instance().Subtract(MemoryUser::DirectoryTree, m_memoryUsage);
 }
 
 }  // namespace Data
@@ -17,6 +17,7 @@
 #ifndef QSFS_DATA_DIRECTORYTREE_H_
 #define QSFS_DATA_DIRECTORYTREE_H_
 
+#include <stdint.h>
 #include <time.h>
 
 #include <unistd.h>
@@ -67,12 +68,14 @@ typedef ParentFilePathToChildrenMultiMap::const_iterator
 
 /**
  * Representation of the filesystem's directory tree.
+ *
+ * Memory used by nodes is reported to the global memory budget.
  */
 class DirectoryTree : private boost::noncopyable {
  public:
   DirectoryTree(time_t mtime, uid_t uid, gid_t gid, mode_t mode);
 
-  ~DirectoryTree() { m_map.clear(); }
+  ~DirectoryTree();
 
  public:
   // Get root
@@ -108,6 +111,9 @@ class DirectoryTree : private boost::noncopyable {
   // Const iterator point to end of the parent to children map
   ChildrenMultiMapConstIterator CEndParentToChildrenMap() const;
 
+  // Return memory used by nodes, including the maps linking them
+  uint64_t GetMemoryUsage() const;
+
  private:
   // Grow the directory tree
   //
@@ -150,7 +156,10 @@ class DirectoryTree : private boost::noncopyable {
   void Remove(const std::string &path);
 
  private:
-  DirectoryTree() {}
+  DirectoryTree() : m_pathSize(0), m_memoryUsage(0) {}
+
+  // Update the memory reported to memory budget, internal use only
+  void UpdateMemoryUsageNoLock();
 
   boost::shared_ptr<Node> m_root;
   // boost::shared_ptr<Node> m_currentNode;
@@ -164,6 +173,9 @@ class DirectoryTree : private boost::noncopyable {
   // So, the dirName to children map which will help to update these references.
   ParentFilePathToChildrenMultiMap m_parentToChildrenMap;
 
+  size_t m_pathSize;       // heap size of the file paths of node map
+  uint64_t m_memoryUsage;  // memory reported to memory budget
+
   friend class QS::Client::QSClient;
   friend class QS::Data::FileMetaDataManager;
   friend class QS::FileSystem::Drive;
@@ -0,0 +1,203 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include "data/DiskCacheIndex.h"
+
+#include <stdio.h>  // for rename
+#include <stdlib.h>  // for strtoll, strtoull
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/thread/locks.hpp"
+
+#include "base/LogMacros.h"
+#include "base/StringUtils.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using QS::StringUtils::FormatPath;
+using std::ifstream;
+using std::istringstream;
+using std::make_pair;
+using std::ofstream;
+using std::pair;
+using std::string;
+using std::vector;
+
+namespace {
+
+// First line of index file, update the version if the format is changed
+const char *const kIndexHeader = "qsfs-disk-cache-index 1";
+
+// Split a line by tab
+vector<string> SplitByTab(const string &line) {
+  vector<string> fields;
+  string field;
+  istringstream ss(line);
+  while (std::getline(ss, field, '\t')) {
+    fields.push_back(field);
+  }
+  if (!line.empty() && line[line.size() - 1] == '\t') {
+    fields.push_back(string());  // trailing empty field
+  }
+  return fields;
+}
+
+// Parse ranges in form of "offset:size,offset:size"
+bool ParseRanges(const string &str, ContentRangeDeque *ranges) {
+  string range;
+  istringstream ss(str);
+  while (std::getline(ss, range, ',')) {
+    size_t pos = range.find(':');
+    if (pos == string::npos) {
+      return false;
+    }
+    off_t offset = static_cast<off_t>(strtoll(range.c_str(), NULL, 10));
+    size_t size =
+        static_cast<size_t>(strtoull(range.c_str() + pos + 1, NULL, 10));
+    if (offset < 0) {
+      return false;
+    }
+    ranges->push_back(make_pair(offset, size));
+  }
+  return true;
+}
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+bool DiskCacheIndex::Load(const string &indexFile) {
+  ifstream file(indexFile.c_str());
+  if (!file.is_open()) {
+    DebugInfo("No disk cache index " + FormatPath(indexFile));
+    return false;
+  }
+  string line;
+  if (!std::getline(file, line) || line != kIndexHeader) {
+    DebugWarning("Unrecognized disk cache index " + FormatPath(indexFile));
+    return false;
+  }
+
+  lock_guard<mutex> lock(m_mutex);
+  while (std::getline(file, line)) {
+    vector<string> fields = SplitByTab(line);
+    DiskCacheRecord record;
+    if (fields.size() != 5 || fields[0].empty() ||
+        !ParseRanges(fields[4], &record.m_ranges)) {
+      DebugWarning("Skip invalid disk cache record [" + line + "]");
+      continue;
+    }
+    record.m_fileId = fields[0];
+    record.m_eTag = fields[1];
+    record.m_mtime = static_cast<time_t>(strtoll(fields[2].c_str(), NULL, 10));
+    record.m_fileSize = strtoull(fields[3].c_str(), NULL, 10);
+    m_records[record.m_fileId] = record;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool DiskCacheIndex::Save(const string &indexFile) const {
+  // Write to a temporary file and rename it, so a crash will not leave a
+  // truncated index.
+  string tmpFile = indexFile + ".tmp";
+  ofstream file(tmpFile.c_str(), std::ios_base::out | std::ios_base::trunc);
+  if (!file.is_open()) {
+    DebugError("Fail to open file " + FormatPath(tmpFile));
+    return false;
+  }
+
+  file << kIndexHeader << "\n";
+  {
+    lock_guard<mutex> lock(m_mutex);
+    for (FileIdToRecordMap::const_iterator it = m_records.begin();
+         it != m_records.end(); ++it) {
+      const DiskCacheRecord &record = it->second;
+      if (record.m_fileId.find_first_of("\t\n") != string::npos ||
+          record.m_eTag.find_first_of("\t\n") != string::npos) {
+        DebugWarning("Skip disk cache record " + FormatPath(record.m_fileId));
+        continue;
+      }
+      file << record.m_fileId << "\t" << record.m_eTag << "\t"
+           << static_cast<int64_t>(record.m_mtime) << "\t" << record.m_fileSize
+           << "\t";
+      for (ContentRangeDeque::const_iterator r = record.m_ranges.begin();
+           r != record.m_ranges.end(); ++r) {
+        file << (r == record.m_ranges.begin() ? "" : ",")
+             << static_cast<int64_t>(r->first) << ":" << r->second;
+      }
+      file << "\n";
+    }
+  }
+  file.close();
+  if (!file) {
+    DebugError("Fail to write file " + FormatPath(tmpFile));
+    return false;
+  }
+  if (rename(tmpFile.c_str(), indexFile.c_str()) != 0) {
+    DebugError("Fail to rename " + FormatPath(tmpFile, indexFile));
+    return false;
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+void DiskCacheIndex::Add(const DiskCacheRecord &record) {
+  lock_guard<mutex> lock(m_mutex);
+  m_records[record.m_fileId] = record;
+}
+
+// --------------------------------------------------------------------------
+pair<bool, DiskCacheRecord> DiskCacheIndex::Take(const string &fileId) {
+  lock_guard<mutex> lock(m_mutex);
+  FileIdToRecordMap::iterator it = m_records.find(fileId);
+  if (it == m_records.end()) {
+    return make_pair(false, DiskCacheRecord());
+  }
+  pair<bool, DiskCacheRecord> res = make_pair(true, it->second);
+  m_records.erase(it);
+  return res;
+}
+
+// --------------------------------------------------------------------------
+vector<DiskCacheRecord> DiskCacheIndex::GetRecords() const {
+  lock_guard<mutex> lock(m_mutex);
+  vector<DiskCacheRecord> records;
+  records.reserve(m_records.size());
+  for (FileIdToRecordMap::const_iterator it = m_records.begin();
+       it != m_records.end(); ++it) {
+    records.push_back(it->second);
+  }
+  return records;
+}
+
+// --------------------------------------------------------------------------
+size_t DiskCacheIndex::Size() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_records.size();
+}
+
+}  // namespace Data
+}  // namespace QS
@@ -0,0 +1,112 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_DATA_DISKCACHEINDEX_H_
+#define QSFS_DATA_DISKCACHEINDEX_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "data/Page.h"  // for ContentRangeDeque
+
+namespace QS {
+
+namespace Data {
+
+// Record of a file whose content is kept in disk cache
+struct DiskCacheRecord {
+  DiskCacheRecord() : m_mtime(0), m_fileSize(0) {}
+  DiskCacheRecord(const std::string &fileId, const std::string &eTag,
+                  time_t mtime, uint64_t fileSize,
+                  const ContentRangeDeque &ranges)
+      : m_fileId(fileId),
+        m_eTag(eTag),
+        m_mtime(mtime),
+        m_fileSize(fileSize),
+        m_ranges(ranges) {}
+
+  std::string m_fileId;
+  std::string m_eTag;        // etag of the object when content is cached
+  time_t m_mtime;
+  uint64_t m_fileSize;
+  ContentRangeDeque m_ranges;  // content ranges stored in disk file
+};
+
+// Index of the files kept in disk cache directory.
+//
+// The index is saved into the disk cache directory when unmount, and loaded
+// when mount again, so the cached content survives remount. A record is taken
+// out of the index when the file is first accessed, the caller should check
+// the record against the latest object meta before reuse the cached content.
+class DiskCacheIndex : private boost::noncopyable {
+ public:
+  DiskCacheIndex() {}
+
+  ~DiskCacheIndex() {}
+
+ public:
+  // Load records from index file
+  //
+  // @param  : index file path
+  // @return : bool
+  //
+  // Records of the index file are added to the existing ones.
+  bool Load(const std::string &indexFile);
+
+  // Save records into index file
+  //
+  // @param  : index file path
+  // @return : bool
+  bool Save(const std::string &indexFile) const;
+
+  // Add a record, the existing record of the same file is replaced
+  void Add(const DiskCacheRecord &record);
+
+  // Take out the record of a file
+  //
+  // @param  : file id
+  // @return : {true if record is found, record}
+  std::pair<bool, DiskCacheRecord> Take(const std::string &fileId);
+
+  // Return all records
+  std::vector<DiskCacheRecord> GetRecords() const;
+
+  // Return number of records
+  size_t Size() const;
+
+  // Whether there is no record
+  bool Empty() const { return Size() == 0; }
+
+ private:
+  typedef std::map<std::string, DiskCacheRecord> FileIdToRecordMap;
+
+  mutable boost::mutex m_mutex;
+  FileIdToRecordMap m_records;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_DISKCACHEINDEX_H_
@@ -0,0 +1,480 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/DiskFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>  // for strerror
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/exception/to_string.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/shared_mutex.hpp"
+
+#include "base/Crc32c.h"
+#include "base/LogMacros.h"
+#include "base/StringUtils.h"
+#include "base/Utils.h"
+#include "base/UtilsWithLog.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::shared_lock;
+using boost::shared_mutex;
+using boost::to_string;
+using boost::unique_lock;
+using QS::StringUtils::FormatPath;
+using QS::Utils::GetDirName;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+const size_t DiskFile::kChecksumChunkSize;
+
+namespace {
+
+// --------------------------------------------------------------------------
+string PostErrMsg(const string &path) {
+  return string(": ") + strerror(errno) + " " + FormatPath(path);
+}
+
+// --------------------------------------------------------------------------
+off_t ChunkOffset(size_t index) {
+  return static_cast<off_t>(index * DiskFile::kChecksumChunkSize);
+}
+
+// --------------------------------------------------------------------------
+size_t ChunkIndex(off_t offset) {
+  return static_cast<size_t>(offset) / DiskFile::kChecksumChunkSize;
+}
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+bool DiskFile::IsOpen() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_fd >= 0;
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::HasCorruptRanges() const {
+  shared_lock<shared_mutex> lock(m_checksumMutex);
+  return m_numCorrupt > 0;
+}
+
+// --------------------------------------------------------------------------
+vector<pair<off_t, size_t> > DiskFile::TakeCorruptRanges() {
+  unique_lock<shared_mutex> lock(m_checksumMutex);
+  vector<pair<off_t, size_t> > ranges;
+  for (size_t i = 0; i < m_checksums.size() && m_numCorrupt > 0; ++i) {
+    if (m_checksums[i].m_corrupt) {
+      ranges.push_back(make_pair(ChunkOffset(i), kChecksumChunkSize));
+      m_checksums[i] = ChunkChecksum();
+      --m_numCorrupt;
+    }
+  }
+  return ranges;
+}
+
+// --------------------------------------------------------------------------
+int DiskFile::Fd() {
+  lock_guard<mutex> lock(m_mutex);
+  if (m_fd >= 0) {
+    return m_fd;
+  }
+  if (m_path.empty()) {
+    DebugError("Empty disk file path");
+    return -1;
+  }
+  if (!QS::Utils::FileExists(m_path)) {
+    QS::UtilsWithLog::CreateDirectoryIfNotExists(GetDirName(m_path));
+  }
+  int flags = O_RDWR | O_CREAT;
+#ifdef O_CLOEXEC
+  flags |= O_CLOEXEC;
+#endif
+  m_fd = open(m_path.c_str(), flags, 0666);
+  if (m_fd < 0) {
+    DebugError("Fail to open file" + PostErrMsg(m_path));
+  } else {
+    DebugInfo("Open file " + FormatPath(m_path));
+  }
+  return m_fd;
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::Write(off_t offset, size_t len, const char *buffer) {
+  if (!m_checksum || len == 0) {
+    return UnguardedWrite(offset, len, buffer);
+  }
+
+  unique_lock<shared_mutex> lock(m_checksumMutex);
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = ChunkIndex(offset);
+  size_t last = ChunkIndex(stop - 1);
+  // Compute the checksums before writing, as the bytes of the chunks which
+  // are not overwritten are verified first
+  vector<ChunkChecksum> checksums(last - first + 1);
+  for (size_t i = first; i <= last; ++i) {
+    off_t start = std::max(offset, ChunkOffset(i));
+    off_t end = std::min(stop, ChunkOffset(i + 1));
+    ChunkChecksum &checksum = checksums[i - first];
+    if (i < m_checksums.size()) {
+      checksum = m_checksums[i];
+    }
+    UnguardedComputeChecksum(i, start, static_cast<size_t>(end - start),
+                             buffer + (start - offset), &checksum);
+  }
+
+  bool success = UnguardedWrite(offset, len, buffer);
+  if (m_checksums.size() <= last) {
+    m_checksums.resize(last + 1);
+  }
+  for (size_t i = first; i <= last; ++i) {
+    ChunkChecksum &checksum = m_checksums[i];
+    bool wasCorrupt = checksum.m_corrupt;
+    if (success) {
+      checksum = checksums[i - first];
+    } else if (!wasCorrupt) {
+      checksum = ChunkChecksum();  // bytes are unknown
+    }
+    if (checksum.m_corrupt != wasCorrupt) {
+      checksum.m_corrupt ? ++m_numCorrupt : --m_numCorrupt;
+    }
+  }
+  return success;
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::UnguardedWrite(off_t offset, size_t len, const char *buffer) {
+  int fd = Fd();
+  if (fd < 0) {
+    return false;
+  }
+  size_t written = 0;
+  while (written < len) {
+    ssize_t n = pwrite(fd, buffer + written, len - written,
+                       offset + static_cast<off_t>(written));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DebugError("Fail to write file at " + to_string(offset + written) +
+                 PostErrMsg(m_path));
+      return false;
+    }
+    written += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+// --------------------------------------------------------------------------
+size_t DiskFile::Read(off_t offset, size_t len, char *buffer) {
+  if (!m_checksum) {
+    return UnguardedRead(offset, len, buffer);
+  }
+
+  size_t readSize = 0;
+  size_t corrupt = 0;
+  {
+    shared_lock<shared_mutex> lock(m_checksumMutex);
+    readSize = UnguardedRead(offset, len, buffer);
+    if (readSize == 0) {
+      return readSize;
+    }
+    corrupt = UnguardedVerify(offset, readSize, buffer);
+    if (corrupt >= m_checksums.size()) {
+      return readSize;
+    }
+  }
+
+  // Record the corrupt chunk, a concurrent writer could have overwritten it,
+  // in which case the content is dropped and loaded again needlessly.
+  {
+    unique_lock<shared_mutex> lock(m_checksumMutex);
+    if (corrupt < m_checksums.size() && !m_checksums[corrupt].m_corrupt) {
+      m_checksums[corrupt].m_corrupt = true;
+      ++m_numCorrupt;
+    }
+  }
+  off_t chunkOff = ChunkOffset(corrupt);
+  return chunkOff > offset ? static_cast<size_t>(chunkOff - offset) : 0;
+}
+
+// --------------------------------------------------------------------------
+size_t DiskFile::UnguardedRead(off_t offset, size_t len, char *buffer) {
+  int fd = Fd();
+  if (fd < 0) {
+    return 0;
+  }
+  size_t readSize = 0;
+  while (readSize < len) {
+    ssize_t n = pread(fd, buffer + readSize, len - readSize,
+                      offset + static_cast<off_t>(readSize));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      DebugError("Fail to read file at " + to_string(offset + readSize) +
+                 PostErrMsg(m_path));
+      break;
+    }
+    if (n == 0) {
+      break;  // reach the end of file
+    }
+    readSize += static_cast<size_t>(n);
+  }
+  return readSize;
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::Allocate(off_t offset, size_t len) {
+  if (len == 0) {
+    return true;
+  }
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+  int fd = Fd();
+  if (fd < 0) {
+    return false;
+  }
+  int ret = 0;
+  do {
+    ret = fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, static_cast<off_t>(len));
+  } while (ret != 0 && errno == EINTR);
+  // File system not supporting it is not an error
+  return ret == 0 || errno == EOPNOTSUPP || errno == ENOSYS;
+#else
+  return true;
+#endif
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::Discard(off_t offset, size_t len) {
+  if (len == 0) {
+    return true;
+  }
+  unique_lock<shared_mutex> lock(m_checksumMutex, boost::defer_lock);
+  if (m_checksum) {
+    lock.lock();
+    UnguardedResetChecksums(offset, len);
+  }
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE) && \
+    defined(FALLOC_FL_KEEP_SIZE)
+  int fd = Fd();
+  if (fd < 0) {
+    return false;
+  }
+  int ret = 0;
+  do {
+    ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                    static_cast<off_t>(len));
+  } while (ret != 0 && errno == EINTR);
+  // File system not supporting it is not an error
+  return ret == 0 || errno == EOPNOTSUPP || errno == ENOSYS;
+#else
+  return true;
+#endif
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::Truncate(off_t size) {
+  int fd = Fd();
+  if (fd < 0) {
+    return false;
+  }
+  unique_lock<shared_mutex> lock(m_checksumMutex, boost::defer_lock);
+  if (m_checksum) {
+    lock.lock();
+    size_t numChunks = ChunkIndex(size + kChecksumChunkSize - 1);
+    for (size_t i = numChunks; i < m_checksums.size(); ++i) {
+      if (m_checksums[i].m_corrupt) {
+        --m_numCorrupt;
+      }
+    }
+    if (m_checksums.size() > numChunks) {
+      m_checksums.resize(numChunks);
+    }
+    UnguardedResetChecksums(size, 1);  // the chunk truncated partially
+  }
+  int ret = 0;
+  do {
+    ret = ftruncate(fd, size);
+  } while (ret != 0 && errno == EINTR);
+  DebugErrorIf(ret != 0, "Fail to truncate file" + PostErrMsg(m_path));
+  return ret == 0;
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::Sync() {
+  int fd = Fd();
+  if (fd < 0) {
+    return false;
+  }
+  int ret = 0;
+  do {
+#ifdef __APPLE__
+    ret = fsync(fd);  // no fdatasync
+#else
+    ret = fdatasync(fd);
+#endif
+  } while (ret != 0 && errno == EINTR);
+  DebugErrorIf(ret != 0, "Fail to sync file" + PostErrMsg(m_path));
+  return ret == 0;
+}
+
+// --------------------------------------------------------------------------
+void DiskFile::Close() {
+  lock_guard<mutex> lock(m_mutex);
+  if (m_fd >= 0) {
+    close(m_fd);
+    m_fd = -1;
+  }
+}
+
+// --------------------------------------------------------------------------
+bool DiskFile::Remove(bool logOn) {
+  Close();
+  {
+    unique_lock<shared_mutex> lock(m_checksumMutex);
+    m_checksums.clear();
+    m_numCorrupt = 0;
+  }
+  if (logOn) {
+    return QS::UtilsWithLog::RemoveFileIfExists(m_path);
+  } else {
+    return QS::Utils::RemoveFileIfExists(m_path);
+  }
+}
+
+// --------------------------------------------------------------------------
+void DiskFile::UnguardedComputeChecksum(size_t index, off_t offset,
+                                        size_t len, const char *buffer,
+                                        ChunkChecksum *checksum) {
+  off_t chunkOff = ChunkOffset(index);
+  off_t stop = offset + static_cast<off_t>(len);
+  off_t checksummedStop = chunkOff + static_cast<off_t>(checksum->m_size);
+  if (offset == chunkOff && stop >= checksummedStop) {
+    // All checksummed bytes are overwritten, including the corrupt ones
+    *checksum = ChunkChecksum();
+    checksum->m_crc = QS::Crc32c::Value(buffer, len);
+    checksum->m_size = static_cast<uint32_t>(len);
+    return;
+  }
+  if (checksum->m_corrupt) {
+    return;  // keep it corrupt until the owner takes it
+  }
+  if (checksum->m_size > 0 && offset == checksummedStop) {
+    // Append
+    checksum->m_crc = QS::Crc32c::Extend(checksum->m_crc, buffer, len);
+    checksum->m_size += static_cast<uint32_t>(len);
+    return;
+  }
+
+  // Checksum the chunk from its start to the end of the checksummed or the
+  // written bytes, whichever is larger. Bytes before the written ones out of
+  // the checksummed ones are read as they are, or as zeros if not exist.
+  size_t oldSize = checksum->m_size;
+  size_t newSize = std::max(oldSize, static_cast<size_t>(stop - chunkOff));
+  vector<char> chunk(newSize, 0);
+  size_t readSize = std::max(oldSize, static_cast<size_t>(offset - chunkOff));
+  if (UnguardedRead(chunkOff, readSize, &chunk[0]) < oldSize ||
+      QS::Crc32c::Value(&chunk[0], oldSize) != checksum->m_crc) {
+    Error("Checksum mismatch of disk file " + FormatPath(m_path) +
+          "[offset:size=" + to_string(chunkOff) + ":" + to_string(oldSize) +
+          "]");
+    checksum->m_corrupt = true;
+    return;
+  }
+  memcpy(&chunk[offset - chunkOff], buffer, len);
+  checksum->m_crc = QS::Crc32c::Value(&chunk[0], newSize);
+  checksum->m_size = static_cast<uint32_t>(newSize);
+}
+
+// --------------------------------------------------------------------------
+size_t DiskFile::UnguardedVerify(off_t offset, size_t len,
+                                 const char *buffer) {
+  if (len == 0 || m_checksums.empty()) {
+    return m_checksums.size();
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = ChunkIndex(offset);
+  size_t last = std::min(ChunkIndex(stop - 1), m_checksums.size() - 1);
+  vector<char> chunk;
+  for (size_t i = first; i <= last; ++i) {
+    const ChunkChecksum &checksum = m_checksums[i];
+    if (checksum.m_corrupt) {
+      return i;
+    }
+    off_t chunkOff = ChunkOffset(i);
+    off_t checksummedStop = chunkOff + static_cast<off_t>(checksum.m_size);
+    if (std::max(offset, chunkOff) >= std::min(stop, checksummedStop)) {
+      continue;  // no checksummed bytes are read
+    }
+    uint32_t crc = 0;
+    if (offset <= chunkOff && stop >= checksummedStop) {
+      crc = QS::Crc32c::Value(buffer + (chunkOff - offset), checksum.m_size);
+    } else {
+      // Read partially, verify the whole checksummed bytes
+      chunk.resize(checksum.m_size);
+      if (UnguardedRead(chunkOff, checksum.m_size, &chunk[0]) ==
+          checksum.m_size) {
+        crc = QS::Crc32c::Value(&chunk[0], checksum.m_size);
+      } else {
+        crc = ~checksum.m_crc;
+      }
+    }
+    if (crc != checksum.m_crc) {
+      Error("Checksum mismatch of disk file " + FormatPath(m_path) +
+            "[offset:size=" + to_string(chunkOff) + ":" +
+            to_string(checksum.m_size) + "]");
+      return i;
+    }
+  }
+  return m_checksums.size();
+}
+
+// --------------------------------------------------------------------------
+void DiskFile::UnguardedResetChecksums(off_t offset, size_t len) {
+  if (len == 0 || m_checksums.empty()) {
+    return;
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t first = ChunkIndex(offset);
+  size_t last = std::min(ChunkIndex(stop - 1), m_checksums.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    ChunkChecksum &checksum = m_checksums[i];
+    off_t checksummedStop =
+        ChunkOffset(i) + static_cast<off_t>(checksum.m_size);
+    if (!checksum.m_corrupt && offset < checksummedStop) {
+      checksum = ChunkChecksum();
+    }
+  }
+}
+
+}  // namespace Data
+}  // namespace QS
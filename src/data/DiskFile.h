@@ -0,0 +1,196 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_DISKFILE_H_
+#define QSFS_DATA_DISKFILE_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+#include <sys/types.h>  // for off_t
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/shared_mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+// Disk file storing the cached content of a File
+//
+// The file descriptor is opened at the first access and kept open until
+// Close, so the pages and blocks of a File share one descriptor and read or
+// write bytes at their file offset with pread/pwrite, without opening the
+// file and seeking it for each operation.
+//
+// With checksum enabled, a CRC32C is kept in memory for the bytes written in
+// each chunk of kChecksumChunkSize bytes, and the bytes read are verified, so
+// the corruption of the storage device is detected. A read stops before the
+// first chunk failing the verification, and the chunk is recorded as corrupt
+// until the owner takes it to drop the content and load it again. Bytes which
+// are already in the file when it is opened, e.g. restored at mount, have no
+// checksum and are not verified.
+// Notice: Close and Remove should not be called while reading or writing.
+class DiskFile : private boost::noncopyable {
+ public:
+  // Size of the chunk covered by a checksum, chunks are aligned to it
+  static const size_t kChecksumChunkSize = 16 * 1024;
+
+  // @param  : absolute file path, whether to checksum the bytes
+  explicit DiskFile(const std::string &path, bool checksum = false)
+      : m_path(path), m_fd(-1), m_checksum(checksum), m_numCorrupt(0) {}
+
+  ~DiskFile() { Close(); }
+
+ public:
+  // Return the absolute file path
+  const std::string &GetPath() const { return m_path; }
+
+  // Return if the descriptor is open
+  bool IsOpen() const;
+
+  // Return if the bytes are checksummed
+  bool UseChecksum() const { return m_checksum; }
+
+  // Whether any chunk fails the verification since last take
+  bool HasCorruptRanges() const;
+
+  // Take the chunks failing the verification
+  //
+  // @param  : void
+  // @return : ranges of {offset, size} of the corrupt chunks
+  //
+  // The chunks have no checksum afterwards, the owner should drop the content
+  // of them, which will be written again.
+  std::vector<std::pair<off_t, size_t> > TakeCorruptRanges();
+
+  // Write bytes into disk file
+  //
+  // @param  : file offset, len of bytes, buffer
+  // @return : bool
+  //
+  // The disk file and its directory are created if not exist.
+  bool Write(off_t offset, size_t len, const char *buffer);
+
+  // Read bytes from disk file
+  //
+  // @param  : file offset, len of bytes, buffer
+  // @return : size of read bytes
+  //
+  // Less than len bytes are read if reach the end of the disk file, or if a
+  // chunk fails the verification.
+  size_t Read(off_t offset, size_t len, char *buffer);
+
+  // Preallocate disk space for the range without changing the file size
+  //
+  // @param  : file offset, len of bytes
+  // @return : bool
+  //
+  // This is a hint to keep the disk file less fragmented, it does nothing on
+  // the platforms or file systems not supporting it.
+  bool Allocate(off_t offset, size_t len);
+
+  // Release the disk space of the range without changing the file size
+  //
+  // @param  : file offset, len of bytes
+  // @return : bool
+  //
+  // The range is read as zeros afterwards. It does nothing on the platforms
+  // or file systems not supporting it. The chunks of the range have no
+  // checksum afterwards.
+  bool Discard(off_t offset, size_t len);
+
+  // Truncate disk file to the size
+  //
+  // @param  : size
+  // @return : bool
+  bool Truncate(off_t size);
+
+  // Flush the written bytes of disk file to the storage device
+  //
+  // @param  : void
+  // @return : bool
+  bool Sync();
+
+  // Close the descriptor, it will be opened again at next access
+  void Close();
+
+  // Close the descriptor and remove the disk file
+  //
+  // @param  : log on
+  // @return : bool
+  bool Remove(bool logOn = true);
+
+ private:
+  DiskFile() : m_fd(-1), m_checksum(false), m_numCorrupt(0) {}
+
+  // Checksum of the bytes from the chunk start
+  struct ChunkChecksum {
+    ChunkChecksum() : m_crc(0), m_size(0), m_corrupt(false) {}
+
+    uint32_t m_crc;
+    uint32_t m_size;  // checksummed bytes, zero if no checksum
+    bool m_corrupt;   // fail the verification
+  };
+
+  // Return the descriptor, open it if not opened
+  int Fd();
+
+  // Write or read bytes without checksum
+  bool UnguardedWrite(off_t offset, size_t len, const char *buffer);
+  size_t UnguardedRead(off_t offset, size_t len, char *buffer);
+
+  // Compute the checksum of a chunk after writing bytes into it
+  //
+  // @param  : chunk index, offset, len of bytes inside the chunk, buffer,
+  //           checksum to update
+  // @return : void
+  //
+  // The bytes of the chunk not overwritten are read and verified first, the
+  // checksum is marked as corrupt if they fail the verification.
+  void UnguardedComputeChecksum(size_t index, off_t offset, size_t len,
+                                const char *buffer, ChunkChecksum *checksum);
+
+  // Verify the bytes read, return the index of the first corrupt chunk or
+  // the num of chunks if all are verified
+  size_t UnguardedVerify(off_t offset, size_t len, const char *buffer);
+
+  // Drop the checksums of the chunks inside the range
+  void UnguardedResetChecksums(off_t offset, size_t len);
+
+ private:
+  std::string m_path;  // absolute file path
+
+  mutable boost::mutex m_mutex;
+  int m_fd;  // file descriptor, -1 if not opened
+
+  bool m_checksum;
+  // Writers hold it exclusively and readers share it, so the bytes and the
+  // checksums of chunks are always consistent to readers
+  mutable boost::shared_mutex m_checksumMutex;
+  std::vector<ChunkChecksum> m_checksums;  // indexed by chunk
+  size_t m_numCorrupt;                     // corrupt chunks not taken
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_DISKFILE_H_
@@ -81,6 +81,7 @@ class Entry {
   FileType::Value GetFileType() const { return m_metaData.lock()->m_fileType; }
   mode_t GetFileMode() const { return m_metaData.lock()->m_fileMode; }
   time_t GetMTime() const { return m_metaData.lock()->m_mtime; }
+  const std::string &GetETag() const { return m_metaData.lock()->m_eTag; }
   time_t GetCachedTime() const { return m_metaData.lock()->m_cachedTime; }
   uid_t GetUID() const { return m_metaData.lock()->m_uid; }
   bool IsNeedUpload() const { return m_metaData.lock()->m_needUpload; }
@@ -18,6 +18,9 @@
 
 #include <assert.h>
 
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <iterator>
 #include <list>
 #include <string>
@@ -29,15 +32,17 @@
 #include "boost/scoped_ptr.hpp"
 #include "boost/shared_ptr.hpp"
 #include "boost/thread/locks.hpp"
-#include "boost/thread/recursive_mutex.hpp"
 #include "boost/tuple/tuple.hpp"
 
 #include "base/LogMacros.h"
+#include "base/RecursiveSharedMutex.h"
 #include "base/StringUtils.h"
 #include "base/Utils.h"
 #include "base/UtilsWithLog.h"
 #include "configure/Options.h"
-#include "data/IOStream.h"
+#include "data/DiskFile.h"
+#include "data/MemoryBudget.h"
+#include "data/StreamBuf.h"
 
 namespace QS {
 
@@ -46,12 +51,14 @@ namespace Data {
 using boost::lock_guard;
 using boost::make_shared;
 using boost::make_tuple;
-using boost::recursive_mutex;
 using boost::scoped_ptr;
+using boost::shared_lock;
 using boost::shared_ptr;
 using boost::to_string;
 using boost::tuple;
+using QS::StringUtils::FormatPath;
 using QS::StringUtils::PointerAddress;
+using QS::Threading::RecursiveSharedMutex;
 using std::iostream;
 using std::list;
 using std::make_pair;
@@ -76,22 +83,82 @@ string BuildDiskFilePath(const string &basename) {
 // --------------------------------------------------------------------------
 string PrintFileName(const string &file) { return "[file=" + file + "]"; }
 
+// Times content in disk file need to be read before moving back to memory,
+// so content read only once (e.g. a sequential scan) stays in disk file.
+const unsigned kPromoteDiskHits = 2;
+
+// Size of the content of a page in memory counted in cache
+size_t SizeInCache(const shared_ptr<Page> &page) {
+  return page->IsCompressed() ? page->GetCompressedSize() : page->Size();
+}
+
+// Size saved by a page in memory with compressed content
+size_t CompressionSaving(const shared_ptr<Page> &page) {
+  return page->IsCompressed() ? page->Size() - page->GetCompressedSize() : 0;
+}
+
+// Buffer backing a stream of at least len bytes, null if there is none
+Buffer StreamBuffer(const shared_ptr<iostream> &stream, size_t len) {
+  const StreamBuf *streamBuf = dynamic_cast<const StreamBuf *>(stream->rdbuf());
+  if (streamBuf != NULL && streamBuf->GetBuffer() &&
+      streamBuf->GetBuffer()->size() >= len) {
+    return streamBuf->GetBuffer();
+  }
+  return Buffer();
+}
+
+// Order pages by their last access
+struct LessAccessTick {
+  bool operator()(const pair<uint64_t, PageSetConstIterator> &lhs,
+                  const pair<uint64_t, PageSetConstIterator> &rhs) const {
+    return lhs.first < rhs.first;
+  }
+};
+
 }  // namespace
 
 // --------------------------------------------------------------------------
 File::~File() {
   // As pages using disk file will reference to the same disk file, so File
   // should manage the life cycle of the disk file.
-  RemoveDiskFileIfExists(false);  // log off
+  if (!m_keepDiskFile) {
+    RemoveDiskFileIfExists(false);  // log off
+  }
 }
 
 // --------------------------------------------------------------------------
 string File::AskDiskFilePath() const { return BuildDiskFilePath(m_baseName); }
 
+// --------------------------------------------------------------------------
+const shared_ptr<DiskFile> &File::AskDiskFile() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (!m_diskFile) {
+    m_diskFile = make_shared<DiskFile>(AskDiskFilePath(), true);
+  }
+  return m_diskFile;
+}
+
+// --------------------------------------------------------------------------
+void File::CloseDiskFile() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (m_diskFile) {
+    m_diskFile->Close();
+  }
+}
+
+// --------------------------------------------------------------------------
+size_t File::GetDiskSize() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  if (UseBlockStore()) {
+    return m_blockStore->GetDiskSize();
+  }
+  return m_size - m_cacheSize - m_compressionSaving;
+}
+
 // --------------------------------------------------------------------------
 pair<PageSetConstIterator, PageSetConstIterator>
 File::ConsecutivePageRangeAtFront() const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   if (m_pages.empty()) {
     return make_pair(m_pages.begin(), m_pages.begin());
   }
@@ -108,10 +175,13 @@ File::ConsecutivePageRangeAtFront() const {
 
 // --------------------------------------------------------------------------
 bool File::HasData(off_t start, size_t size) const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  if (UseBlockStore()) {
+    return m_blockStore->HasData(start, size);
+  }
   off_t stop = static_cast<off_t>(start + size);
   pair<PageSetConstIterator, PageSetConstIterator> range =
-      IntesectingRange(start, stop);
+      IntesectingRangeNoLock(start, stop);
   if (range.first == range.second) {
     if (range.first == m_pages.end()) {
       if (size == 0 && start <= static_cast<off_t>(m_size)) {
@@ -136,7 +206,10 @@ bool File::HasData(off_t start, size_t size) const {
 
 // --------------------------------------------------------------------------
 ContentRangeDeque File::GetUnloadedRanges(off_t start, size_t size) const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  if (UseBlockStore()) {
+    return m_blockStore->GetUnloadedRanges(start, size);
+  }
   ContentRangeDeque ranges;
   if (size == 0 || m_size == 0 || m_pages.empty()) {
     return ranges;
@@ -144,7 +217,7 @@ ContentRangeDeque File::GetUnloadedRanges(off_t start, size_t size) const {
 
   off_t stop = static_cast<off_t>(start + size);
   pair<PageSetConstIterator, PageSetConstIterator> range =
-      IntesectingRange(start, stop);
+      IntesectingRangeNoLock(start, stop);
 
   if (range.first == range.second) {
     return ranges;
@@ -173,24 +246,135 @@ ContentRangeDeque File::GetUnloadedRanges(off_t start, size_t size) const {
   return ranges;
 }
 
+// --------------------------------------------------------------------------
+ContentRangeDeque File::GetLoadedRanges() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  if (UseBlockStore()) {
+    return m_blockStore->GetLoadedRanges();
+  }
+  ContentRangeDeque ranges;
+  for (PageSetConstIterator it = m_pages.begin(); it != m_pages.end(); ++it) {
+    // merge with the previous range if adjacent
+    if (!ranges.empty() &&
+        ranges.back().first + static_cast<off_t>(ranges.back().second) ==
+            (*it)->Offset()) {
+      ranges.back().second += (*it)->Size();
+    } else {
+      ranges.push_back(make_pair((*it)->Offset(), (*it)->Size()));
+    }
+  }
+  return ranges;
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque File::GetDirtyRanges() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return m_dirtyRanges;
+}
+
+// --------------------------------------------------------------------------
+ContentRangeDeque File::SnapshotDirtyRanges(uint64_t *snapshot) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  m_rewrittenRanges.clear();
+  *snapshot = ++m_dirtySnapshot;
+  return m_dirtyRanges;
+}
+
+// --------------------------------------------------------------------------
+bool File::IsDirty() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return !m_dirtyRanges.empty();
+}
+
+// --------------------------------------------------------------------------
+size_t File::GetDirtySize() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return m_dirtySize;
+}
+
 // --------------------------------------------------------------------------
 PageSetConstIterator File::BeginPage() const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   return m_pages.begin();
 }
 
 // --------------------------------------------------------------------------
 PageSetConstIterator File::EndPage() const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   return m_pages.end();
 }
 
 // --------------------------------------------------------------------------
 size_t File::GetNumPages() const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   return m_pages.size();
 }
 
+// --------------------------------------------------------------------------
+size_t File::GetNumBlocks() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return UseBlockStore() ? m_blockStore->GetNumBlocks() : 0;
+}
+
+// --------------------------------------------------------------------------
+size_t File::GetMemoryUsage() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  size_t usage = sizeof(File) + StringSize(m_baseName) + EmptyDequeSize();
+  if (UseBlockStore()) {
+    return usage + m_blockStore->GetMemoryUsage();
+  }
+  // Each page is owned by a shared_ptr linked in a node of the page set
+  size_t pageOverhead =
+      TreeNodeSize(sizeof(shared_ptr<Page>)) + SharedCountSize();
+  for (PageSetConstIterator it = m_pages.begin(); it != m_pages.end(); ++it) {
+    usage += pageOverhead + (*it)->GetMemoryUsage();
+  }
+  return usage;
+}
+
+// --------------------------------------------------------------------------
+size_t File::Compact() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t numMerged = 0;
+  if (UseBlockStore() || m_maxPageSize == 0 || m_pages.size() < 2) {
+    return numMerged;
+  }
+
+  PageSetConstIterator cur = m_pages.begin();
+  while (cur != m_pages.end()) {
+    // Find the successive pages [cur, next) which could be merged together
+    size_t mergedSize = (*cur)->Size();
+    PageSetConstIterator prev = cur;
+    PageSetConstIterator next = cur;
+    while (++next != m_pages.end()) {
+      if ((*prev)->Next() != (*next)->Offset() ||
+          (*prev)->UseDiskFile() != (*next)->UseDiskFile() ||
+          (*prev)->IsCompressed() || (*next)->IsCompressed() ||
+          mergedSize + (*next)->Size() > m_maxPageSize) {
+        break;
+      }
+      mergedSize += (*next)->Size();
+      prev = next;
+    }
+
+    PageSetConstIterator it = cur;
+    ++it;
+    while (it != next) {
+      if (!(*cur)->Merge(**it, mergedSize)) {
+        DebugWarning("Fail to merge page " +
+                     ToStringLine((*it)->Offset(), (*it)->Size()) +
+                     PrintFileName(m_baseName));
+        break;
+      }
+      m_pages.erase(it++);
+      ++numMerged;
+    }
+    cur = it;
+  }
+
+  return numMerged;
+}
+
 // --------------------------------------------------------------------------
 tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> File::Read(
     off_t offset, size_t len, time_t mtimeSince) {
@@ -213,7 +397,8 @@ tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> File::Read(
   }
 
   {
-    lock_guard<recursive_mutex> lock(m_mutex);
+    // Pages are only collected and touched, so readers share the lock
+    shared_lock<RecursiveSharedMutex> lock(m_mutex);
 
     if (mtimeSince > 0) {
       // File is just created, update mtime.
@@ -233,7 +418,7 @@ tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> File::Read(
     }
 
     pair<PageSetConstIterator, PageSetConstIterator> range =
-        IntesectingRange(offset, offset + len);
+        IntesectingRangeNoLock(offset, offset + len);
     PageSetConstIterator it1 = range.first;
     PageSetConstIterator it2 = range.second;
     off_t offset_ = offset;
@@ -250,6 +435,7 @@ tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> File::Read(
         offset_ = page->m_offset;
         len_ -= lenNewPage;
       } else {  // Collect existing pages.
+        UnguardedTouchPage(page);
         if (len_ <= static_cast<size_t>(page->Next() - offset_)) {
           outcomePages.push_back(page);
           outcomeSize += page->m_size;
@@ -273,6 +459,79 @@ tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> File::Read(
   return make_tuple(outcomeSize, outcomePages, unloadedRanges);
 }
 
+// --------------------------------------------------------------------------
+pair<size_t, ContentRangeDeque> File::Read(off_t offset, size_t len,
+                                           char *buffer, time_t mtimeSince) {
+  assert(UseBlockStore());
+  ContentRangeDeque unloadedRanges;
+  if (len == 0 || !UseBlockStore()) {
+    unloadedRanges.push_back(make_pair(offset, len));
+    return make_pair(0, unloadedRanges);
+  }
+
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (mtimeSince > 0) {
+    // File is just created, update mtime.
+    if (m_mtime == 0) {
+      SetTime(mtimeSince);
+    } else if (mtimeSince > m_mtime) {
+      // Detected modification in the file
+      unloadedRanges.push_back(make_pair(offset, len));
+      return make_pair(0, unloadedRanges);
+    }
+  }
+
+  // Blocks could be stored in disk file even if new blocks are put in memory
+  size_t readSize = m_blockStore->Read(offset, len, buffer, m_diskFile);
+  m_blockStore->Touch(offset, len);
+  unloadedRanges = m_blockStore->GetUnloadedRanges(offset, len);
+  return make_pair(readSize, unloadedRanges);
+}
+
+// --------------------------------------------------------------------------
+pair<ContentSliceDeque, ContentRangeDeque> File::ReadSlices(off_t offset,
+                                                            size_t len,
+                                                            time_t mtimeSince) {
+  ContentSliceDeque slices;
+  if (UseBlockStore()) {
+    lock_guard<RecursiveSharedMutex> lock(m_mutex);
+    ContentRangeDeque unloadedRanges;
+    if (len == 0) {
+      unloadedRanges.push_back(make_pair(offset, len));
+      return make_pair(slices, unloadedRanges);
+    }
+    if (mtimeSince > 0) {
+      // File is just created, update mtime.
+      if (m_mtime == 0) {
+        SetTime(mtimeSince);
+      } else if (mtimeSince > m_mtime) {
+        // Detected modification in the file
+        unloadedRanges.push_back(make_pair(offset, len));
+        return make_pair(slices, unloadedRanges);
+      }
+    }
+    slices = m_blockStore->ReadSlices(offset, len, m_diskFile);
+    m_blockStore->Touch(offset, len);
+    unloadedRanges = m_blockStore->GetUnloadedRanges(offset, len);
+    return make_pair(slices, unloadedRanges);
+  }
+
+  tuple<size_t, list<shared_ptr<Page> >, ContentRangeDeque> outcome =
+      Read(offset, len, mtimeSince);
+  const list<shared_ptr<Page> > &pages = boost::get<1>(outcome);
+  // Notice outcome pages could has more content than required, and pages
+  // could grow by merging after they are collected, so each page slices the
+  // part intersecting with the asked range under its own lock.
+  for (list<shared_ptr<Page> >::const_iterator it = pages.begin();
+       it != pages.end(); ++it) {
+    ContentSlice slice = (*it)->Slice(offset, len);
+    if (slice.m_size > 0) {
+      slices.push_back(slice);
+    }
+  }
+  return make_pair(slices, boost::get<2>(outcome));
+}
+
 // --------------------------------------------------------------------------
 tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
                                         const char *buffer, time_t mtime,
@@ -286,11 +545,22 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
   //   return false;
   // }
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
 
   SetOpen(open);
+  if (len > 0) {
+    m_dirtySize += AddContentRange(&m_dirtyRanges, offset, len);
+    if (m_dirtySnapshot > 0) {
+      AddContentRange(&m_rewrittenRanges, offset, len);
+    }
+  }
+  if (UseBlockStore()) {
+    return UnguardedWriteBlocks(offset, len, buffer, mtime);
+  }
+
   size_t addedSizeInCache = 0;
   size_t addedSize = 0;
+
   // If pages is empty.
   if (m_pages.empty()) {
     tuple<PageSetConstIterator, bool, size_t, size_t> res =
@@ -308,7 +578,7 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
 
   bool success = true;
   pair<PageSetConstIterator, PageSetConstIterator> range =
-      IntesectingRange(offset, offset + len);
+      IntesectingRangeNoLock(offset, offset + len);
   PageSetConstIterator it1 = range.first;
   PageSetConstIterator it2 = range.second;
   off_t offset_ = offset;
@@ -338,6 +608,7 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
       if (len_ <= static_cast<size_t>(page->Next() - offset_)) {
         if (mtime >= m_mtime) {
           SetTime(mtime);
+          addedSizeInCache += UnguardedDecompressPage(page);
           // refresh parital content of page
           return make_tuple(page->Refresh(offset_, len_, buffer + start_),
                             addedSizeInCache, addedSize);
@@ -347,6 +618,7 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
         }
       } else {
         if (mtime >= m_mtime) {
+          addedSizeInCache += UnguardedDecompressPage(page);
           // refresh entire page
           bool refresh = page->Refresh(buffer + start_);
           if (!refresh) {
@@ -387,8 +659,15 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
 tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
                                         const shared_ptr<iostream> &stream,
                                         time_t mtime, bool open) {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   SetOpen(open);
+  if (UseBlockStore()) {
+    scoped_ptr<vector<char> > buf(new vector<char>(len));
+    stream->seekg(0, std::ios_base::beg);
+    stream->read(&(*buf)[0], len);
+    return UnguardedWriteBlocks(offset, len, &(*buf)[0], mtime);
+  }
+
   if (m_pages.empty()) {
     tuple<PageSetConstIterator, bool, size_t, size_t> res =
         UnguardedAddPage(offset, len, stream);
@@ -398,7 +677,7 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
     return make_tuple(boost::get<1>(res), boost::get<2>(res),
                       boost::get<3>(res));
   } else {
-    PageSetConstIterator it = LowerBoundPage(offset);
+    PageSetConstIterator it = LowerBoundPageNoLock(offset);
     const shared_ptr<Page> &page = *it;
     if (it == m_pages.end()) {
       tuple<PageSetConstIterator, bool, size_t, size_t> res =
@@ -408,7 +687,8 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
       }
       return make_tuple(boost::get<1>(res), boost::get<2>(res),
                         boost::get<3>(res));
-    } else if (page->Offset() == offset && page->Size() == len) {
+    } else if (page->Offset() == offset && page->Size() == len &&
+               !page->UseDiskFile() && !page->IsCompressed()) {
       if (mtime >= m_mtime) {
         // replace old stream
         page->SetStream(stream);
@@ -425,6 +705,135 @@ tuple<bool, size_t, size_t> File::Write(off_t offset, size_t len,
   }
 }
 
+// --------------------------------------------------------------------------
+tuple<bool, size_t, size_t> File::WriteUnloaded(
+    off_t offset, size_t len, const shared_ptr<iostream> &stream,
+    time_t mtime, bool open) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  ContentRangeDeque holes;
+  if (len > 0) {
+    holes.push_back(make_pair(offset, len));
+  }
+  off_t stop = offset + static_cast<off_t>(len);
+  ContentRangeDeque loaded = GetLoadedRanges();
+  for (ContentRangeDeque::const_iterator it = loaded.begin();
+       it != loaded.end() && it->first < stop; ++it) {
+    RemoveContentRange(&holes, it->first, it->second);
+  }
+  if (holes.size() == 1 && holes.front().second == len) {
+    return Write(offset, len, stream, mtime, open);  // nothing is loaded
+  }
+
+  SetOpen(open);
+  bool success = true;
+  size_t addedSizeInCache = 0;
+  size_t addedSize = 0;
+  vector<char> buf;
+  for (ContentRangeDeque::const_iterator it = holes.begin();
+       it != holes.end(); ++it) {
+    buf.resize(it->second);
+    stream->seekg(it->first - offset, std::ios_base::beg);
+    stream->read(&buf[0], it->second);
+    tuple<bool, size_t, size_t> res;
+    if (UseBlockStore()) {
+      res = UnguardedWriteBlocks(it->first, it->second, &buf[0], mtime);
+    } else {
+      // a hole overlaps no page, so it is added as a new page
+      tuple<PageSetConstIterator, bool, size_t, size_t> added =
+          UnguardedAddPage(it->first, it->second, &buf[0]);
+      res = make_tuple(boost::get<1>(added), boost::get<2>(added),
+                       boost::get<3>(added));
+      if (boost::get<1>(added) && mtime > m_mtime) {
+        SetTime(mtime);
+      }
+    }
+    success = boost::get<0>(res) && success;
+    addedSizeInCache += boost::get<1>(res);
+    addedSize += boost::get<2>(res);
+  }
+  return make_tuple(success, addedSizeInCache, addedSize);
+}
+
+// --------------------------------------------------------------------------
+pair<bool, size_t> File::Persist() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  const shared_ptr<DiskFile> &diskFile = AskDiskFile();
+  size_t removedCacheSize = 0;
+  bool success = true;
+  if (UseBlockStore()) {
+    pair<bool, size_t> res = m_blockStore->Persist(diskFile);
+    success = res.first;
+    removedCacheSize = res.second;
+  } else {
+    PageSetConstIterator it = m_pages.begin();
+    while (it != m_pages.end()) {
+      const shared_ptr<Page> &page = *it;
+      if (page->UseDiskFile()) {
+        ++it;
+        continue;
+      }
+      size_t sizeInCache = SizeInCache(page);
+      size_t saving = CompressionSaving(page);
+      if (!page->MoveToDiskFile(diskFile)) {
+        DebugError("Fail to persist page " +
+                   ToStringLine(page->Offset(), page->Size()) +
+                   PrintFileName(m_baseName));
+        success = false;
+        break;
+      }
+      removedCacheSize += sizeInCache;
+      m_compressionSaving -= saving;
+      ++it;
+    }
+  }
+
+  m_cacheSize -= removedCacheSize;
+  if (m_size > 0) {
+    SetUseDiskFile(true);
+  }
+  m_keepDiskFile = success;
+  return make_pair(success, removedCacheSize);
+}
+
+// --------------------------------------------------------------------------
+size_t File::Restore(const ContentRangeDeque &ranges) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (m_size > 0) {
+    DebugWarning("Unable to restore a file with content" +
+                 PrintFileName(m_baseName));
+    return 0;
+  }
+  const shared_ptr<DiskFile> &diskFile = AskDiskFile();
+  struct stat st;
+  if (stat(diskFile->GetPath().c_str(), &st) != 0) {
+    DebugWarning("Disk file not exists " + FormatPath(diskFile->GetPath()));
+    return 0;
+  }
+  size_t addedSize = 0;
+  for (ContentRangeDeque::const_iterator it = ranges.begin();
+       it != ranges.end(); ++it) {
+    // ranges beyond the disk file are lost
+    if (it->second == 0 ||
+        it->first + static_cast<off_t>(it->second) > st.st_size) {
+      continue;
+    }
+    if (UseBlockStore()) {
+      addedSize += m_blockStore->Restore(it->first, it->second);
+    } else {
+      pair<PageSetConstIterator, bool> res =
+          m_pages.insert(make_shared<Page>(it->first, it->second, diskFile));
+      if (res.second) {
+        addedSize += it->second;
+      }
+    }
+  }
+  if (addedSize > 0) {
+    SetUseDiskFile(true);
+    m_size += addedSize;
+  }
+  return addedSize;
+}
+
 // --------------------------------------------------------------------------
 void File::ResizeToSmallerSize(size_t smallerSize) {
   size_t curSize = GetSize();
@@ -440,19 +849,38 @@ void File::ResizeToSmallerSize(size_t smallerSize) {
   }
 
   {
-    lock_guard<recursive_mutex> lock(m_mutex);
+    lock_guard<RecursiveSharedMutex> lock(m_mutex);
+    // the bytes after the new size are gone, nothing to upload for them
+    if (!m_dirtyRanges.empty()) {
+      off_t dirtyStop = m_dirtyRanges.back().first +
+                        static_cast<off_t>(m_dirtyRanges.back().second);
+      if (dirtyStop > static_cast<off_t>(smallerSize)) {
+        m_dirtySize -=
+            RemoveContentRange(&m_dirtyRanges, smallerSize,
+                               static_cast<size_t>(dirtyStop - smallerSize));
+      }
+    }
+
+    if (UseBlockStore()) {
+      pair<size_t, size_t> removed = m_blockStore->Truncate(smallerSize);
+      m_cacheSize -= removed.first;
+      m_size -= removed.second;
+      return;
+    }
 
     while (!m_pages.empty() && smallerSize < m_size) {
       PageSetConstIterator lastPage = --m_pages.end();
       size_t lastPageSize = (*lastPage)->Size();
       if (smallerSize + lastPageSize <= m_size) {
         if (!(*lastPage)->UseDiskFile()) {
-          m_cacheSize -= lastPageSize;
+          m_cacheSize -= SizeInCache(*lastPage);
+          m_compressionSaving -= CompressionSaving(*lastPage);
         }
         m_size -= lastPageSize;
         m_pages.erase(lastPage);
       } else {
         size_t newSize = lastPageSize - (m_size - smallerSize);
+        UnguardedDecompressPage(*lastPage);
         // Do a lazy remove for last page.
         (*lastPage)->ResizeToSmallerSize(newSize);
         if (!(*lastPage)->UseDiskFile()) {
@@ -465,10 +893,305 @@ void File::ResizeToSmallerSize(size_t smallerSize) {
   }
 }
 
+// --------------------------------------------------------------------------
+void File::CleanRanges(const ContentRangeDeque &ranges, uint64_t snapshot) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (snapshot != m_dirtySnapshot) {
+    return;  // the writes between the snapshots are not tracked
+  }
+  // a write merged into a dirty range during the upload may not be uploaded
+  ContentRangeDeque cleaned = ranges;
+  for (ContentRangeDeque::const_iterator it = m_rewrittenRanges.begin();
+       it != m_rewrittenRanges.end() && !cleaned.empty(); ++it) {
+    RemoveContentRange(&cleaned, it->first, it->second);
+  }
+  for (ContentRangeDeque::const_iterator it = cleaned.begin();
+       it != cleaned.end() && !m_dirtyRanges.empty(); ++it) {
+    m_dirtySize -= RemoveContentRange(&m_dirtyRanges, it->first, it->second);
+  }
+}
+
+// --------------------------------------------------------------------------
+size_t File::Demote(size_t size) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t removedCacheSize = 0;
+  if (size == 0 || m_cacheSize == 0) {
+    return removedCacheSize;
+  }
+  const shared_ptr<DiskFile> &diskFile = AskDiskFile();
+  if (UseBlockStore()) {
+    pair<bool, size_t> res = m_blockStore->Demote(size, diskFile);
+    DebugErrorIf(!res.first, "Fail to demote blocks" +
+                                 PrintFileName(m_baseName));
+    removedCacheSize = res.second;
+  } else {
+    // Collect pages in memory ordered by recency, the least recent first
+    vector<pair<uint64_t, shared_ptr<Page> > > pages;
+    for (PageSetConstIterator it = m_pages.begin(); it != m_pages.end();
+         ++it) {
+      if (!(*it)->UseDiskFile()) {
+        pages.push_back(make_pair((*it)->m_lastAccess.Load(), *it));
+      }
+    }
+    std::sort(pages.begin(), pages.end());
+    for (size_t i = 0; i < pages.size() && removedCacheSize < size; ++i) {
+      const shared_ptr<Page> &page = pages[i].second;
+      size_t sizeInCache = SizeInCache(page);
+      size_t saving = CompressionSaving(page);
+      if (!page->MoveToDiskFile(diskFile)) {
+        DebugError("Fail to demote page " +
+                   ToStringLine(page->Offset(), page->Size()) +
+                   PrintFileName(m_baseName));
+        break;
+      }
+      removedCacheSize += sizeInCache;
+      m_compressionSaving -= saving;
+    }
+  }
+  m_cacheSize -= removedCacheSize;
+  return removedCacheSize;
+}
+
+// --------------------------------------------------------------------------
+size_t File::Compress(size_t size) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t removedCacheSize = 0;
+  if (size == 0 || m_cacheSize == 0 || UseBlockStore()) {
+    return removedCacheSize;
+  }
+  // Collect uncompressed pages in memory, the least recent first
+  vector<pair<uint64_t, shared_ptr<Page> > > pages;
+  for (PageSetConstIterator it = m_pages.begin(); it != m_pages.end(); ++it) {
+    if (!(*it)->UseDiskFile() && !(*it)->IsCompressed()) {
+      pages.push_back(make_pair((*it)->m_lastAccess.Load(), *it));
+    }
+  }
+  std::sort(pages.begin(), pages.end());
+  for (size_t i = 0; i < pages.size() && removedCacheSize < size; ++i) {
+    const shared_ptr<Page> &page = pages[i].second;
+    if (page->Compress()) {
+      size_t saving = CompressionSaving(page);
+      removedCacheSize += saving;
+      m_compressionSaving += saving;
+    }
+  }
+  m_cacheSize -= removedCacheSize;
+  return removedCacheSize;
+}
+
+// --------------------------------------------------------------------------
+size_t File::GetPromotableSize(off_t offset, size_t len) const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  if (UseBlockStore()) {
+    return m_blockStore->GetPromotableSize(offset, len, kPromoteDiskHits);
+  }
+  size_t size = 0;
+  pair<PageSetConstIterator, PageSetConstIterator> range =
+      IntesectingRangeNoLock(offset, offset + len);
+  for (PageSetConstIterator it = range.first; it != range.second; ++it) {
+    if ((*it)->m_diskHits < kPromoteDiskHits) {
+      continue;
+    }
+    if ((*it)->UseDiskFile()) {
+      size += (*it)->Size();
+    } else {
+      size += CompressionSaving(*it);
+    }
+  }
+  return size;
+}
+
+// --------------------------------------------------------------------------
+size_t File::Promote(off_t offset, size_t len) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t addedCacheSize = 0;
+  size_t decompressedSize = 0;
+  if (UseBlockStore()) {
+    addedCacheSize =
+        m_blockStore->Promote(offset, len, kPromoteDiskHits, m_diskFile);
+  } else {
+    pair<PageSetConstIterator, PageSetConstIterator> range =
+        IntesectingRangeNoLock(offset, offset + len);
+    for (PageSetConstIterator it = range.first; it != range.second; ++it) {
+      const shared_ptr<Page> &page = *it;
+      if (page->m_diskHits < kPromoteDiskHits) {
+        continue;
+      }
+      if (page->IsCompressed()) {
+        decompressedSize += UnguardedDecompressPage(page);
+        continue;
+      }
+      if (!page->UseDiskFile()) {
+        continue;
+      }
+      if (!page->MoveToMemory()) {
+        DebugWarning("Fail to promote page " +
+                     ToStringLine(page->Offset(), page->Size()) +
+                     PrintFileName(m_baseName));
+        continue;
+      }
+      addedCacheSize += page->Size();
+    }
+  }
+  m_cacheSize += addedCacheSize;
+  return addedCacheSize + decompressedSize;
+}
+
+// --------------------------------------------------------------------------
+size_t File::DropDiskContent() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t removedSize = 0;
+  if (UseBlockStore()) {
+    removedSize = m_blockStore->DropDiskBlocks();
+  } else {
+    PageSetConstIterator it = m_pages.begin();
+    while (it != m_pages.end()) {
+      if ((*it)->UseDiskFile()) {
+        removedSize += (*it)->Size();
+        m_pages.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+  }
+  m_size -= removedSize;
+
+  // Nothing is left in disk file, new content is put in memory again
+  RemoveDiskFileIfExists(true);
+  m_diskFile.reset();
+  SetUseDiskFile(false);
+  m_keepDiskFile = false;
+  return removedSize;
+}
+
+// --------------------------------------------------------------------------
+bool File::HasCorruptContent() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return m_diskFile && m_diskFile->HasCorruptRanges();
+}
+
+// --------------------------------------------------------------------------
+size_t File::DropCorruptContent() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t removedSize = 0;
+  if (!m_diskFile) {
+    return removedSize;
+  }
+  vector<pair<off_t, size_t> > ranges = m_diskFile->TakeCorruptRanges();
+  for (vector<pair<off_t, size_t> >::const_iterator range = ranges.begin();
+       range != ranges.end(); ++range) {
+    if (UseBlockStore()) {
+      // Blocks are removed entirely
+      off_t blockSize = static_cast<off_t>(m_blockStore->GetBlockSize());
+      off_t start = range->first / blockSize * blockSize;
+      off_t stop = range->first + static_cast<off_t>(range->second);
+      stop = (stop + blockSize - 1) / blockSize * blockSize;
+      if (IntersectContentRanges(m_dirtyRanges, start,
+                                 static_cast<size_t>(stop - start))) {
+        Error("Unable to reload corrupt content with changes not uploaded " +
+              ToStringLine(range->first, range->second) +
+              PrintFileName(m_baseName));
+        continue;
+      }
+      size_t removed = m_blockStore->DropDiskRange(
+          start, static_cast<size_t>(stop - start));
+      removedSize += removed;
+      m_size -= removed;
+      continue;
+    }
+    pair<PageSetConstIterator, PageSetConstIterator> pages =
+        IntesectingRangeNoLock(
+            range->first, range->first + static_cast<off_t>(range->second));
+    PageSetConstIterator it = pages.first;
+    while (it != pages.second) {
+      const shared_ptr<Page> &page = *it;
+      if (!page->UseDiskFile()) {
+        ++it;
+      } else if (IntersectContentRanges(m_dirtyRanges, page->Offset(),
+                                        page->Size())) {
+        Error("Unable to reload corrupt content with changes not uploaded " +
+              ToStringLine(page->Offset(), page->Size()) +
+              PrintFileName(m_baseName));
+        ++it;
+      } else {
+        removedSize += page->Size();
+        m_size -= page->Size();
+        m_pages.erase(it++);
+      }
+    }
+  }
+  WarningIf(removedSize > 0, "Drop " + to_string(removedSize) +
+                                 " bytes of corrupt content in disk file" +
+                                 PrintFileName(m_baseName));
+  if (removedSize > 0 && GetDiskSize() == 0) {
+    DropDiskContent();  // remove the empty disk file
+  }
+  return removedSize;
+}
+
+// --------------------------------------------------------------------------
+size_t File::Evict(size_t size, bool onDisk) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  size_t removedSize = 0;
+  if (size == 0) {
+    return removedSize;
+  }
+  if (UseBlockStore()) {
+    pair<size_t, size_t> res =
+        m_blockStore->Evict(size, onDisk, m_diskFile, m_dirtyRanges);
+    removedSize = res.first;
+    m_size -= res.second;
+    if (!onDisk) {
+      m_cacheSize -= removedSize;
+    }
+  } else {
+    // Collect pages of the tier ordered by recency, the least recent first,
+    // pages with changes not uploaded are kept
+    vector<pair<uint64_t, PageSetConstIterator> > pages;
+    for (PageSetConstIterator it = m_pages.begin(); it != m_pages.end();
+         ++it) {
+      if ((*it)->UseDiskFile() == onDisk &&
+          !IntersectContentRanges(m_dirtyRanges, (*it)->Offset(),
+                                  (*it)->Size())) {
+        pages.push_back(make_pair((*it)->m_lastAccess.Load(), it));
+      }
+    }
+    std::stable_sort(pages.begin(), pages.end(), LessAccessTick());
+    size_t removedPageSize = 0;
+    for (size_t i = 0; i < pages.size() && removedSize < size; ++i) {
+      const shared_ptr<Page> &page = *pages[i].second;
+      size_t pageSize = page->Size();
+      if (onDisk) {
+        if (m_diskFile) {
+          m_diskFile->Discard(page->Offset(), pageSize);
+        }
+        removedSize += pageSize;
+      } else {
+        removedSize += SizeInCache(page);
+        m_compressionSaving -= CompressionSaving(page);
+      }
+      removedPageSize += pageSize;
+      m_pages.erase(pages[i].second);
+    }
+    m_size -= removedPageSize;
+    if (!onDisk) {
+      m_cacheSize -= removedSize;
+    }
+  }
+
+  if (onDisk && GetDiskSize() == 0) {
+    DropDiskContent();  // remove the empty disk file
+  }
+  return removedSize;
+}
+
 // --------------------------------------------------------------------------
 void File::RemoveDiskFileIfExists(bool logOn) const {
-  lock_guard<recursive_mutex> lock(m_mutex);
-  if (UseDiskFile()) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (m_diskFile) {
+    m_diskFile->Close();
+  }
+  if (m_diskFile || UseDiskFile()) {
     string diskFile = AskDiskFilePath();
     if (logOn) {
       if (QS::UtilsWithLog::FileExists(diskFile))
@@ -482,46 +1205,90 @@ void File::RemoveDiskFileIfExists(bool logOn) const {
 
 // --------------------------------------------------------------------------
 void File::Clear() {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   m_pages.clear();
+  if (UseBlockStore()) {
+    m_blockStore->Clear();
+  }
+  m_dirtyRanges.clear();
+  m_dirtySize = 0;
+  m_rewrittenRanges.clear();
   m_mtime = 0;
   m_size = 0;
   m_cacheSize = 0;
+  m_compressionSaving = 0;
   RemoveDiskFileIfExists(true);
+  m_diskFile.reset();
   m_useDiskFile = false;
+  m_keepDiskFile = false;
+}
+
+// --------------------------------------------------------------------------
+void File::UnguardedTouchPage(const shared_ptr<Page> &page) {
+  page->m_lastAccess = ++m_accessTick;
+  if (page->UseDiskFile() || page->IsCompressed()) {
+    ++page->m_diskHits;
+  }
+}
+
+// --------------------------------------------------------------------------
+size_t File::UnguardedDecompressPage(const shared_ptr<Page> &page) {
+  if (!page->IsCompressed()) {
+    return 0;
+  }
+  size_t saving = CompressionSaving(page);
+  if (!page->Decompress()) {
+    DebugError("Fail to decompress page " +
+               ToStringLine(page->Offset(), page->Size()) +
+               PrintFileName(m_baseName));
+    return 0;
+  }
+  m_compressionSaving -= saving;
+  m_cacheSize += saving;
+  return saving;
+}
+
+// --------------------------------------------------------------------------
+shared_ptr<Page> File::ProbePage(off_t offset) {
+  // no body stream, which is costly to construct at each look up
+  shared_ptr<Page> page(new Page());
+  page->m_offset = offset;
+  return page;
 }
 
 // --------------------------------------------------------------------------
 PageSetConstIterator File::LowerBoundPage(off_t offset) const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   return LowerBoundPageNoLock(offset);
 }
 
 // --------------------------------------------------------------------------
 PageSetConstIterator File::LowerBoundPageNoLock(off_t offset) const {
-  shared_ptr<Page> tmpPage =
-      make_shared<Page>(offset, 0, make_shared<IOStream>(0));
-  return m_pages.lower_bound(tmpPage);
+  return m_pages.lower_bound(ProbePage(offset));
 }
 
 // --------------------------------------------------------------------------
 PageSetConstIterator File::UpperBoundPage(off_t offset) const {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   return UpperBoundPageNoLock(offset);
 }
 
 // --------------------------------------------------------------------------
 PageSetConstIterator File::UpperBoundPageNoLock(off_t offset) const {
-  shared_ptr<Page> tmpPage =
-      make_shared<Page>(offset, 0, make_shared<IOStream>(0));
-  return m_pages.upper_bound(tmpPage);
+  return m_pages.upper_bound(ProbePage(offset));
 }
 
 // --------------------------------------------------------------------------
 pair<PageSetConstIterator, PageSetConstIterator> File::IntesectingRange(
     off_t off1, off_t off2) const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return IntesectingRangeNoLock(off1, off2);
+}
+
+// --------------------------------------------------------------------------
+pair<PageSetConstIterator, PageSetConstIterator>
+File::IntesectingRangeNoLock(off_t off1, off_t off2) const {
   assert(off1 <= off2);
-  lock_guard<recursive_mutex> lock(m_mutex);
   PageSetConstIterator it1 = LowerBoundPageNoLock(off1);
   PageSetConstIterator it2 = LowerBoundPageNoLock(off2);
   // Move backward it1 to pointing to the page which maybe intersect with
@@ -536,27 +1303,79 @@ pair<PageSetConstIterator, PageSetConstIterator> File::IntesectingRange(
 
 // --------------------------------------------------------------------------
 const shared_ptr<Page> &File::Front() {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   assert(!m_pages.empty());
   return *(m_pages.begin());
 }
 
 // --------------------------------------------------------------------------
 const shared_ptr<Page> &File::Back() {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
   assert(!m_pages.empty());
   return *(m_pages.rbegin());
 }
 
+// --------------------------------------------------------------------------
+tuple<bool, size_t, size_t> File::UnguardedWriteBlocks(off_t offset,
+                                                       size_t len,
+                                                       const char *buffer,
+                                                       time_t mtime) {
+  shared_ptr<DiskFile> diskFile =
+      UseDiskFile() ? AskDiskFile() : shared_ptr<DiskFile>();
+  tuple<bool, size_t, size_t> res =
+      m_blockStore->Write(offset, len, buffer, diskFile);
+  m_cacheSize += boost::get<1>(res);
+  m_size += boost::get<2>(res);
+  if (boost::get<0>(res) && mtime > m_mtime) {
+    SetTime(mtime);
+  }
+  return res;
+}
+
+// --------------------------------------------------------------------------
+PageSetConstIterator File::UnguardedMergeablePage(off_t offset,
+                                                  size_t len) const {
+  if (m_maxPageSize == 0 || m_pages.empty()) {
+    return m_pages.end();
+  }
+  PageSetConstIterator it = LowerBoundPageNoLock(offset);
+  if (it == m_pages.begin()) {
+    return m_pages.end();
+  }
+  --it;
+  const shared_ptr<Page> &page = *it;
+  if (page->Next() == offset && page->UseDiskFile() == UseDiskFile() &&
+      !page->IsCompressed() && page->Size() + len <= m_maxPageSize) {
+    return it;
+  }
+  return m_pages.end();
+}
+
+// --------------------------------------------------------------------------
+size_t File::PageCapacity(size_t size) const {
+  // Double the capacity to make the appending of small writes cheap, but never
+  // reserve more than max page size.
+  return std::min(2 * size, m_maxPageSize);
+}
+
 // --------------------------------------------------------------------------
 tuple<PageSetConstIterator, bool, size_t, size_t> File::UnguardedAddPage(
     off_t offset, size_t len, const char *buffer) {
   pair<PageSetConstIterator, bool> res;
   size_t addedSize = 0;
   size_t addedSizeInCache = 0;
-  if (UseDiskFile()) {
+  PageSetConstIterator prev = UnguardedMergeablePage(offset, len);
+  if (prev != m_pages.end()) {
+    res.first = prev;
+    res.second =
+        (*prev)->Append(len, buffer, PageCapacity((*prev)->Size() + len));
+    if (res.second && !UseDiskFile()) {
+      addedSizeInCache = len;
+      m_cacheSize += len;
+    }
+  } else if (UseDiskFile()) {
     res = m_pages.insert(
-        make_shared<Page>(offset, len, buffer, AskDiskFilePath()));
+        make_shared<Page>(offset, len, buffer, AskDiskFile()));
     // do not count size of data stored in disk file
   } else {
     res = m_pages.insert(shared_ptr<Page>(new Page(offset, len, buffer)));
@@ -566,6 +1385,7 @@ tuple<PageSetConstIterator, bool, size_t, size_t> File::UnguardedAddPage(
     }
   }
   if (res.second) {
+    (*res.first)->m_lastAccess = ++m_accessTick;
     addedSize = len;
     m_size += len;
   } else {
@@ -582,17 +1402,31 @@ tuple<PageSetConstIterator, bool, size_t, size_t> File::UnguardedAddPage(
   pair<PageSetConstIterator, bool> res;
   size_t addedSize = 0;
   size_t addedSizeInCache = 0;
-  if (UseDiskFile()) {
+  PageSetConstIterator prev = UnguardedMergeablePage(offset, len);
+  if (prev != m_pages.end()) {
+    res.first = prev;
+    res.second =
+        (*prev)->Append(len, stream, PageCapacity((*prev)->Size() + len));
+    if (res.second && !UseDiskFile()) {
+      addedSizeInCache = len;
+      m_cacheSize += len;
+    }
+  } else if (UseDiskFile()) {
     res = m_pages.insert(
-        make_shared<Page>(offset, len, stream, AskDiskFilePath()));
+        make_shared<Page>(offset, len, stream, AskDiskFile()));
   } else {
-    res = m_pages.insert(shared_ptr<Page>(new Page(offset, len, stream)));
+    // Share the buffer of a downloaded stream instead of copying it
+    Buffer buffer = len > 0 ? StreamBuffer(stream, len) : Buffer();
+    res = m_pages.insert(buffer
+                             ? shared_ptr<Page>(new Page(offset, len, buffer))
+                             : shared_ptr<Page>(new Page(offset, len, stream)));
     if (res.second) {
       addedSizeInCache = len;
       m_cacheSize += len;
     }
   }
   if (res.second) {
+    (*res.first)->m_lastAccess = ++m_accessTick;
     addedSize = len;
     m_size += len;
   } else {
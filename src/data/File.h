@@ -18,6 +18,7 @@
 #define QSFS_DATA_FILE_H_
 
 #include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint64_t
 #include <time.h>
 
 #include <deque>
@@ -27,60 +28,71 @@
 #include <utility>
 
 #include "boost/noncopyable.hpp"
+#include "boost/scoped_ptr.hpp"
 #include "boost/shared_ptr.hpp"
 #include "boost/thread/locks.hpp"
-#include "boost/thread/mutex.hpp"
-#include "boost/thread/recursive_mutex.hpp"
 #include "boost/tuple/tuple.hpp"
 
+#include "base/Atomic.h"
+#include "base/RecursiveSharedMutex.h"
+#include "data/BlockStore.h"
 #include "data/Page.h"
 
 namespace QS {
 
 namespace Data {
 class Cache;
-
-// Range represented by a pair of {offset, size}
-typedef std::deque<std::pair<off_t, size_t> > ContentRangeDeque;
+class DiskFile;
 
 class File : private boost::noncopyable {
  public:
-  explicit File(const std::string &baseName, time_t mtime, size_t size = 0)
+  // Construct File
+  //
+  // @param  : base name, mtime, size, block size, max page size
+  // @return :
+  //
+  // If block size is not zero, file content is stored in fixed size blocks
+  // instead of pages.
+  // If max page size is not zero, a new page successive to a existing page is
+  // merged into it as long as the merged page is not larger than max page size.
+  explicit File(const std::string &baseName, time_t mtime, size_t size = 0,
+                size_t blockSize = 0, size_t maxPageSize = 0)
       : m_baseName(baseName),
         m_mtime(mtime),
         m_size(size),
         m_cacheSize(size),
         m_useDiskFile(false),
-        m_open(false) {}
+        m_open(false),
+        m_keepDiskFile(false),
+        m_accessTick(0),
+        m_maxPageSize(maxPageSize),
+        m_dirtySize(0),
+        m_dirtySnapshot(0),
+        m_compressionSaving(0),
+        m_blockStore(blockSize > 0 ? new BlockStore(blockSize) : NULL),
+        m_memoryCharge(0),
+        m_changedLocally(false) {}
 
   ~File();
 
  public:
   std::string GetBaseName() const { return m_baseName; }
-  size_t GetSize() const {
-    boost::lock_guard<boost::mutex> locker(m_sizeLock);
-    return m_size;
-  }
-  size_t GetCachedSize() const {
-    boost::lock_guard<boost::mutex> locker(m_cacheSizeLock);
-    return m_cacheSize;
-  }
-  time_t GetTime() const {
-    boost::lock_guard<boost::mutex> locker(m_mtimeLock);
-    return m_mtime;
-  }
-  bool UseDiskFile() const {
-    boost::lock_guard<boost::mutex> locker(m_useDiskFileLock);
-    return m_useDiskFile;
-  }
-  bool IsOpen() const {
-    boost::lock_guard<boost::mutex> locker(m_openLock);
-    return m_open;
-  }
+  size_t GetSize() const { return m_size; }
+  size_t GetCachedSize() const { return m_cacheSize; }
+  time_t GetTime() const { return m_mtime; }
+  bool UseDiskFile() const { return m_useDiskFile; }
+  bool IsOpen() const { return m_open; }
+  bool UseBlockStore() const { return m_blockStore.get() != NULL; }
+
+  // Return sum of the size of content stored in disk file
+  size_t GetDiskSize() const;
 
   // return disk file path
   std::string AskDiskFilePath() const;
 
+  // Close the descriptor of disk file, it is opened again at next access
+  void CloseDiskFile();
+
   // Return a pair of iterators pointing to the range of consecutive pages
   // at the front of cache list
   //
@@ -102,6 +114,32 @@ class File : private boost::noncopyable {
   // @return : a list of pair {range start, range size}
   ContentRangeDeque GetUnloadedRanges(off_t start, size_t size) const;
 
+  // Return the loaded content ranges
+  //
+  // @param  : void
+  // @return : a list of pair {range start, range size} sorted by start
+  ContentRangeDeque GetLoadedRanges() const;
+
+  // Return the ranges written since the file is loaded or last cleaned
+  //
+  // @param  : void
+  // @return : a list of pair {range start, range size} sorted by start
+  //
+  // Bytes outside of the dirty ranges are the same as the uploaded object.
+  ContentRangeDeque GetDirtyRanges() const;
+
+  // Return the dirty ranges to upload and start to track the rewrites
+  //
+  // @param  : snapshot number to clean the ranges once they are uploaded
+  // @return : a list of pair {range start, range size} sorted by start
+  ContentRangeDeque SnapshotDirtyRanges(uint64_t *snapshot);
+
+  // Whether any range is written since the file is loaded or last cleaned
+  bool IsDirty() const;
+
+  // Return total size of the dirty ranges
+  size_t GetDirtySize() const;
+
   // Return begin pos of pages
   PageSetConstIterator BeginPage() const;
 
@@ -111,6 +149,25 @@ class File : private boost::noncopyable {
   // Return num of pages
   size_t GetNumPages() const;
 
+  // Return num of blocks containing data, for file using block store
+  size_t GetNumBlocks() const;
+
+  // Return memory held by the file, including its pages or blocks and the
+  // nodes linking them
+  size_t GetMemoryUsage() const;
+
+  // Return max size of a merged page, zero if pages are not merged
+  size_t GetMaxPageSize() const { return m_maxPageSize; }
+
+  // Merge successive pages into larger pages
+  //
+  // @param  : void
+  // @return : number of pages merged into their previous pages
+  //
+  // Merged page is not larger than max page size. This is used to compact
+  // the pages of a fragmented file.
+  size_t Compact();
+
  private:
   // Read from the cache (file pages)
   //
@@ -127,6 +184,26 @@ class File : private boost::noncopyable {
   boost::tuple<size_t, std::list<boost::shared_ptr<Page> >, ContentRangeDeque>
   Read(off_t offset, size_t len, time_t mtimeSince = 0);
 
+  // Read from the block store into buffer
+  //
+  // @param  : file offset, len of bytes, buffer, modified time since from
+  // @return : a pair of {read size, unloaded ranges}
+  //
+  // For file using block store only. The bytes not loaded are left untouched
+  // in buffer.
+  std::pair<size_t, ContentRangeDeque> Read(off_t offset, size_t len,
+                                            char *buffer, time_t mtimeSince);
+
+  // Read slices of the loaded content
+  //
+  // @param  : file offset, len of bytes, modified time since from
+  // @return : a pair of {slices sorted by offset, unloaded ranges}
+  //
+  // Slices only cover the range {offset, len}. Slices of the content stored in
+  // memory share the buffer of pages or blocks without copying.
+  std::pair<ContentSliceDeque, ContentRangeDeque> ReadSlices(
+      off_t offset, size_t len, time_t mtimeSince = 0);
+
   // Write a block of bytes into pages
   //
   // @param  : file offset, len, buffer, modification time
@@ -134,6 +211,7 @@ class File : private boost::noncopyable {
   //
   // From pointer of buffer, number of len bytes will be writen.
   // The owning file's offset is set with 'offset'.
+  // The written range is recorded as dirty, as the bytes come from user.
   boost::tuple<bool, size_t, size_t> Write(off_t offset, size_t len,
                                            const char *buffer, time_t mtime,
                                            bool open = false);
@@ -145,13 +223,127 @@ class File : private boost::noncopyable {
   //
   // The stream will be moved to the pages.
   // The owning file's offset is set with 'offset'.
+  // The written range is not dirty, as the stream is downloaded content.
   boost::tuple<bool, size_t, size_t> Write(
       off_t offset, size_t len, const boost::shared_ptr<std::iostream> &stream,
       time_t mtime, bool open = false);
 
+  // Write stream into the parts of its range not loaded
+  //
+  // @param  : file offset, len of stream, stream, modification time
+  // @return : {success, added size in cache, added size}
+  //
+  // The loaded parts are kept, as they could be written by user since the
+  // stream was requested. The written parts are not dirty.
+  boost::tuple<bool, size_t, size_t> WriteUnloaded(
+      off_t offset, size_t len, const boost::shared_ptr<std::iostream> &stream,
+      time_t mtime, bool open = false);
+
+  // Move the content stored in memory into disk file
+  //
+  // @param  : void
+  // @return : {success, removed size in cache}
+  //
+  // The disk file is kept when the file is destroyed, so the content could be
+  // restored by a new file with the same base name.
+  std::pair<bool, size_t> Persist();
+
+  // Restore the content which is already stored in disk file
+  //
+  // @param  : content ranges stored in disk file
+  // @return : added size
+  //
+  // This is only done for a file without any content.
+  size_t Restore(const ContentRangeDeque &ranges);
+
   // Resize the total pages' size to a smaller size.
   void ResizeToSmallerSize(size_t smallerSize);
 
+  // Mark the ranges as clean, once they are uploaded
+  //
+  // @param  : ranges sorted by start, snapshot number the ranges are taken at
+  // @return : void
+  //
+  // The parts written since the snapshot are kept dirty, as they may not be
+  // in the uploaded content. Nothing is cleaned if a newer snapshot is taken,
+  // the upload of which cleans the ranges instead.
+  void CleanRanges(const ContentRangeDeque &ranges, uint64_t snapshot);
+
+  // Move the least recently accessed content in memory into disk file
+  //
+  // @param  : size to remove from cache
+  // @return : removed size in cache
+  //
+  // Pages (or blocks) in memory are moved in order of their last access, until
+  // the removed size reaches 'size' or there is nothing left in memory.
+  size_t Demote(size_t size);
+
+  // Compress the least recently accessed pages in memory
+  //
+  // @param  : size to remove from cache
+  // @return : removed size in cache
+  //
+  // Pages in memory are compressed in order of their last access, until the
+  // removed size reaches 'size' or there is nothing left to compress. A
+  // compressed page counts the size of its compressed bytes in cache. Blocks
+  // are not compressed.
+  size_t Compress(size_t size);
+
+  // Return size of the content in disk file which could be moved back to memory
+  //
+  // @param  : file offset, len of bytes
+  // @return : size
+  //
+  // Pages (or blocks) of the range in disk file are promotable once they have
+  // been read several times since they are moved into disk file. So are the
+  // compressed pages, whose size saved by compression is counted.
+  size_t GetPromotableSize(off_t offset, size_t len) const;
+
+  // Move the promotable content of the range back to memory
+  //
+  // @param  : file offset, len of bytes
+  // @return : added size in cache
+  //
+  // Promotable compressed pages of the range are decompressed.
+  size_t Promote(off_t offset, size_t len);
+
+  // Remove the content stored in disk file
+  //
+  // @param  : void
+  // @return : removed size
+  //
+  // Content in memory is kept. The disk file is removed if there is no content
+  // stored in it any more.
+  size_t DropDiskContent();
+
+  // Whether any content in disk file fails the checksum verification
+  bool HasCorruptContent() const;
+
+  // Remove the content in disk file failing the checksum verification
+  //
+  // @param  : void
+  // @return : removed size
+  //
+  // Pages (or blocks) overlapping the corrupt chunks of disk file are removed,
+  // so they are reported as unloaded and downloaded again. Content with
+  // changes not uploaded yet can not be downloaded again, it is kept.
+  size_t DropCorruptContent();
+
+  // Remove the least recently accessed content of a tier
+  //
+  // @param  : size to remove, remove content in disk file or in memory
+  // @return : removed size of the tier
+  //
+  // Pages (or blocks) of the tier are removed in order of their last access,
+  // until the removed size reaches 'size' or there is nothing left in the
+  // tier, so the recently read ranges of a large file are kept in cache.
+  // Content with changes not uploaded is never removed.
+  size_t Evict(size_t size, bool onDisk);
+
+  // Return disk file shared by the pages or blocks, create it if not exist
+  // internal use only
+  const boost::shared_ptr<DiskFile> &AskDiskFile();
+
   // Remove disk file
   void RemoveDiskFileIfExists(bool logOn = true) const;
 
@@ -159,22 +351,21 @@ class File : private boost::noncopyable {
   void Clear();
 
   // Set modification time
-  void SetTime(time_t mtime) {
-    boost::lock_guard<boost::mutex> locker(m_mtimeLock);
-    m_mtime = mtime;
-  }
+  void SetTime(time_t mtime) { m_mtime = mtime; }
 
   // Set flag to use disk file
-  void SetUseDiskFile(bool useDiskFile) {
-    boost::lock_guard<boost::mutex> locker(m_useDiskFileLock);
-    m_useDiskFile = useDiskFile;
-  }
+  void SetUseDiskFile(bool useDiskFile) { m_useDiskFile = useDiskFile; }
 
   // Set file open state
-  void SetOpen(bool open) {
-    boost::lock_guard<boost::mutex> locker(m_openLock);
-    m_open = open;
-  }
+  void SetOpen(bool open) { m_open = open; }
+
+  // Record an access to page
+  // internal use only
+  void UnguardedTouchPage(const boost::shared_ptr<Page> &page);
+
+  // Decompress a page, return added size in cache
+  // internal use only
+  size_t UnguardedDecompressPage(const boost::shared_ptr<Page> &page);
 
   // Returns an iterator pointing to the first Page that is not ahead of offset.
   // If no such Page is found, a past-the-end iterator is returned.
@@ -196,6 +387,9 @@ class File : private boost::noncopyable {
   // Notice: this is a half-closed half open range [page1, page2)
   std::pair<PageSetConstIterator, PageSetConstIterator> IntesectingRange(
       off_t off1, off_t off2) const;
+  // internal use only
+  std::pair<PageSetConstIterator, PageSetConstIterator>
+  IntesectingRangeNoLock(off_t off1, off_t off2) const;
 
   // Return the first key in the page set.
   const boost::shared_ptr<Page> &Front();
@@ -211,27 +405,68 @@ class File : private boost::noncopyable {
   boost::tuple<PageSetConstIterator, bool, size_t, size_t> UnguardedAddPage(
       off_t offset, size_t len, const boost::shared_ptr<std::iostream> &stream);
 
- private:
-  std::string m_baseName;  // file base name
-
-  mutable boost::mutex m_mtimeLock;
-  time_t m_mtime;  // time of last modification
+  // Write a block of character into the block store without checking input.
+  // Return {success, added size in cache, added size}
+  // internal use only
+  boost::tuple<bool, size_t, size_t> UnguardedWriteBlocks(off_t offset,
+                                                          size_t len,
+                                                          const char *buffer,
+                                                          time_t mtime);
 
-  mutable boost::mutex m_sizeLock;
-  size_t m_size;   // record sum of all pages' size
+  // Return the page which a new page of {offset, len} could be merged into,
+  // or a past-the-end iterator if there is no such page.
+  // internal use only
+  PageSetConstIterator UnguardedMergeablePage(off_t offset, size_t len) const;
 
-  mutable boost::mutex m_cacheSizeLock;
-  size_t m_cacheSize;  // record sum of all pages' size
-                       // stored in cache not including disk file
+  // Return the capacity to reserve for a page growing to size
+  // internal use only
+  size_t PageCapacity(size_t size) const;
 
-  mutable boost::mutex m_useDiskFileLock;
-  bool m_useDiskFile;  // use disk file when no free cache space
+ private:
+  // Return an empty page to look up the pages by offset
+  static boost::shared_ptr<Page> ProbePage(off_t offset);
 
-  mutable boost::mutex m_openLock;
-  bool m_open;         // file open/close state
+ private:
+  std::string m_baseName;  // file base name
 
-  mutable boost::recursive_mutex m_mutex;
+  // The attributes are read without lock. Except the ones with setters, they
+  // are changed under the exclusive lock of the file.
+  QS::Threading::Atomic<time_t> m_mtime;  // time of last modification
+  QS::Threading::Atomic<size_t> m_size;   // record sum of all pages' size
+  QS::Threading::Atomic<size_t> m_cacheSize;  // record sum of all pages' size
+                       // stored in cache not including disk file, a
+                       // compressed page counts its compressed size
+  QS::Threading::Atomic<bool> m_useDiskFile;  // use disk file when no free
+                                              // cache space
+  QS::Threading::Atomic<bool> m_open;  // file open/close state
+
+  // Pages are read under shared lock and changed under exclusive lock, so
+  // parallel readers of a file do not wait for each other.
+  mutable QS::Threading::RecursiveSharedMutex m_mutex;
+  bool m_keepDiskFile;  // keep disk file when destroyed
+  boost::shared_ptr<DiskFile> m_diskFile;  // null before disk file is used
+  QS::Threading::Atomic<uint64_t> m_accessTick;  // increased at each access
+                                                 // of pages
   PageSet m_pages;              // a set of pages suppose to be successive
+  size_t m_maxPageSize;         // max size of merged page, zero not to merge
+  ContentRangeDeque m_dirtyRanges;  // ranges written but not uploaded
+  size_t m_dirtySize;               // total size of dirty ranges
+  uint64_t m_dirtySnapshot;         // number of the last snapshot, zero if
+                                    // never taken
+  ContentRangeDeque m_rewrittenRanges;  // ranges written since last snapshot
+  size_t m_compressionSaving;       // size saved by the compressed pages
+
+  // fixed size blocks used instead of pages if not null
+  boost::scoped_ptr<BlockStore> m_blockStore;
+
+  // memory charged to memory budget by the owning cache, guarded by the lock
+  // of the cache shard
+  size_t m_memoryCharge;
+
+  // whether the file is written or resized since it is created, which stops
+  // it from sharing content with other files, guarded by the lock of the
+  // cache shard
+  bool m_changedLocally;
 
   friend class Cache;
   friend class FileTest;
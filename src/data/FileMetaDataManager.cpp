@@ -30,6 +30,7 @@
 #include "base/StringUtils.h"
 #include "base/Utils.h"
 #include "data/DirectoryTree.h"
+#include "data/MemoryBudget.h"
 #include "configure/Options.h"
 
 namespace QS {
@@ -46,6 +47,20 @@ using QS::Utils::IsRootDirectory;
 using std::pair;
 using std::string;
 
+namespace {
+
+// Return memory used by the meta data of a file and the nodes linking it.
+// Mime type and etag are counted as short strings which are not stored inside
+// the string object, so the size only depends on file path.
+size_t GetEntrySize(const string &filePath) {
+  return ListNodeSize(sizeof(FileIdToMetaDataPair)) +
+         HashNodeSize(sizeof(FileIdToMetaDataListIteratorMap::value_type)) +
+         SharedCountSize() + HeapSize(sizeof(FileMetaData)) +
+         3 * StringSize(filePath) + 2 * HeapSize(4 * sizeof(void *));
+}
+
+}  // namespace
+
 // --------------------------------------------------------------------------
 MetaDataListConstIterator FileMetaDataManager::Get(
     const string &filePath) const {
@@ -96,10 +111,16 @@ bool FileMetaDataManager::Has(const string &filePath) const {
   return this->Get(filePath) != m_metaDatas.end();
 }
 
+// --------------------------------------------------------------------------
+uint64_t FileMetaDataManager::GetMemoryUsage() const {
+  lock_guard<recursive_mutex> lock(m_mutex);
+  return m_memoryUsage;
+}
+
 // --------------------------------------------------------------------------
 bool FileMetaDataManager::HasFreeSpace(size_t needCount) const {
   lock_guard<recursive_mutex> lock(m_mutex);
-  return m_metaDatas.size() + needCount <= GetMaxCount();
+  return HasFreeSpaceNoLock(needCount);
 }
 
 // --------------------------------------------------------------------------
@@ -110,7 +131,8 @@ MetaDataListIterator FileMetaDataManager::AddNoLock(
   if (it == m_map.end()) {  // not exist in manager
     if (!HasFreeSpaceNoLock(1)) {
       bool success = FreeNoLock(1, filePath);
-      if (!success) {
+      // Enlarging max count does not help if memory budget is exhausted
+      if (!success && m_metaDatas.size() + 1 > m_maxCount) {
         m_maxCount += static_cast<size_t>(m_maxCount / 5);
         Warning("Enlarge max stat to " + to_string(m_maxCount));
       }
@@ -120,6 +142,7 @@ MetaDataListIterator FileMetaDataManager::AddNoLock(
       pair<FileIdToMetaDataMapIterator, bool> res =
           m_map.emplace(filePath, m_metaDatas.begin());
       if(res.second) {
+        AddMemoryUsageNoLock(filePath);
         return m_metaDatas.begin();
       } else {
         DebugWarning("Fail to add file "+ FormatPath(filePath));
@@ -162,6 +185,7 @@ MetaDataListIterator FileMetaDataManager::Erase(const string &filePath) {
   MetaDataListIterator next = m_metaDatas.end();
   FileIdToMetaDataMapIterator it = m_map.find(filePath);
   if (it != m_map.end()) {
+    SubtractMemoryUsageNoLock(filePath);
     next = m_metaDatas.erase(it->second);
     m_map.erase(it);
   } else {
@@ -175,6 +199,8 @@ void FileMetaDataManager::Clear() {
   lock_guard<recursive_mutex> lock(m_mutex);
   m_map.clear();
   m_metaDatas.clear();
+  MemoryBudget::Instance().Subtract(MemoryUser::FileMetaData, m_memoryUsage);
+  m_memoryUsage = 0;
 }
 
 // --------------------------------------------------------------------------
@@ -205,6 +231,8 @@ void FileMetaDataManager::Rename(const string &oldFilePath,
       DebugWarning("Fail to rename " + FormatPath(oldFilePath, newFilePath));
     }
     m_map.erase(it);
+    SubtractMemoryUsageNoLock(oldFilePath);
+    AddMemoryUsageNoLock(newFilePath);
   } else {
     DebugWarning("File not exist, no rename " + FormatPath(oldFilePath));
   }
@@ -226,7 +254,24 @@ MetaDataListIterator FileMetaDataManager::UnguardedMakeMetaDataMostRecentlyUsed(
 
 // --------------------------------------------------------------------------
 bool FileMetaDataManager::HasFreeSpaceNoLock(size_t needCount) const {
-  return m_metaDatas.size() + needCount <= GetMaxCount();
+  return m_metaDatas.size() + needCount <= GetMaxCount() &&
+         MemoryBudget::Instance().HasFreeSpace(needCount *
+                                               GetEntrySize(string()));
+}
+
+// --------------------------------------------------------------------------
+void FileMetaDataManager::AddMemoryUsageNoLock(const string &filePath) {
+  size_t size = GetEntrySize(filePath);
+  m_memoryUsage += size;
+  MemoryBudget::Instance().Add(MemoryUser::FileMetaData, size);
+}
+
+// --------------------------------------------------------------------------
+void FileMetaDataManager::SubtractMemoryUsageNoLock(const string &filePath) {
+  size_t size = GetEntrySize(filePath);
+  assert(m_memoryUsage >= size);
+  m_memoryUsage -= size;
+  MemoryBudget::Instance().Subtract(MemoryUser::FileMetaData, size);
 }
 
 // --------------------------------------------------------------------------
@@ -285,6 +330,7 @@ bool FileMetaDataManager::FreeNoLock(size_t needCount, string fileUnfreeable) {
     // so double checking before earsing file meta
     FileIdToMetaDataMapIterator p = m_map.find(fileId);
     if(p != m_map.end()) {
+      SubtractMemoryUsageNoLock(fileId);
       m_metaDatas.erase(p->second);
       m_map.erase(p);
     }
@@ -302,7 +348,7 @@ bool FileMetaDataManager::FreeNoLock(size_t needCount, string fileUnfreeable) {
 }
 
 // --------------------------------------------------------------------------
-FileMetaDataManager::FileMetaDataManager() {
+FileMetaDataManager::FileMetaDataManager() : m_memoryUsage(0) {
   m_maxCount = static_cast<size_t>(
       QS::Configure::Options::Instance().GetMaxStatCountInK() * QS::Size::K1);
   m_dirTree = NULL;
@@ -55,6 +55,8 @@ typedef boost::unordered_map<std::string, MetaDataListIterator,
     FileIdToMetaDataListIteratorMap;
 typedef FileIdToMetaDataListIteratorMap::iterator FileIdToMetaDataMapIterator;
 
+// Memory used by meta datas is charged to the global memory budget, and the
+// least recently used meta datas are freed once the budget is exhausted.
 class FileMetaDataManager : public Singleton<FileMetaDataManager> {
  public:
   ~FileMetaDataManager() {}
@@ -62,6 +64,9 @@ class FileMetaDataManager : public Singleton<FileMetaDataManager> {
  public:
   size_t GetMaxCount() const { return m_maxCount; }
 
+  // Return memory used by meta datas, including the nodes linking them
+  uint64_t GetMemoryUsage() const;
+
  public:
   // Get file meta data
   MetaDataListConstIterator Get(const std::string &filePath) const;
@@ -76,7 +81,8 @@ class FileMetaDataManager : public Singleton<FileMetaDataManager> {
   bool Has(const std::string &filePath) const;
 
   // If the meta data list size plus needCount surpass
-  // MaxFileMetaDataCount then there is no available space
+  // MaxFileMetaDataCount, or the memory budget is exhausted, then there is no
+  // available space
   bool HasFreeSpace(size_t needCount) const;
 
  private:
@@ -122,6 +128,8 @@ class FileMetaDataManager : public Singleton<FileMetaDataManager> {
   bool FreeNoLock(size_t needCount, const std::string fileUnfreeable);
   MetaDataListIterator AddNoLock(
       const boost::shared_ptr<FileMetaData> &fileMetaData);
+  void AddMemoryUsageNoLock(const std::string &filePath);
+  void SubtractMemoryUsageNoLock(const std::string &filePath);
 
  private:
   FileMetaDataManager();
@@ -131,6 +139,7 @@ class FileMetaDataManager : public Singleton<FileMetaDataManager> {
   MetaDataList m_metaDatas;
   FileIdToMetaDataListIteratorMap m_map;
   size_t m_maxCount;  // max count of meta datas
+  uint64_t m_memoryUsage;  // memory charged to memory budget
 
   mutable boost::recursive_mutex m_mutex;
 
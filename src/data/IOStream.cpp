@@ -16,17 +16,14 @@
 
 #include "data/IOStream.h"
 
-#include <vector>
-
 #include "data/StreamBuf.h"
 
 namespace QS {
 
 namespace Data {
-using std::vector;
 
 IOStream::IOStream(size_t bufSize)
-    : Base(new StreamBuf(Buffer(new vector<char>(bufSize)), bufSize)) {}
+    : Base(new StreamBuf(Buffer(new ByteVector(bufSize)), bufSize)) {}
 IOStream::IOStream(Buffer buf, size_t lengthToRead)
     : Base(new StreamBuf(buf, lengthToRead)) {}
 
@@ -0,0 +1,118 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/InFlightRanges.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "boost/foreach.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::unique_lock;
+using std::make_pair;
+using std::string;
+
+// --------------------------------------------------------------------------
+ContentRangeDeque InFlightRanges::Claim(const string &filePath, off_t offset,
+                                        size_t size) {
+  ContentRangeDeque claimed;
+  if (size == 0) {
+    return claimed;
+  }
+  off_t stop = offset + static_cast<off_t>(size);
+
+  lock_guard<mutex> lock(m_mutex);
+  ContentRangeDeque &ranges = m_ranges[filePath];
+  // collect the gaps between the ranges in flight
+  off_t cursor = offset;
+  for (ContentRangeDeque::const_iterator it = ranges.begin();
+       it != ranges.end() && it->first < stop; ++it) {
+    off_t rStop = it->first + static_cast<off_t>(it->second);
+    if (rStop <= cursor) {
+      continue;
+    }
+    if (it->first > cursor) {
+      claimed.push_back(
+          make_pair(cursor, static_cast<size_t>(it->first - cursor)));
+    }
+    cursor = rStop;
+  }
+  if (cursor < stop) {
+    claimed.push_back(make_pair(cursor, static_cast<size_t>(stop - cursor)));
+  }
+
+  BOOST_FOREACH (const ContentRangeDeque::value_type &range, claimed) {
+    AddContentRange(&ranges, range.first, range.second);
+  }
+  return claimed;
+}
+
+// --------------------------------------------------------------------------
+void InFlightRanges::Release(const string &filePath, off_t offset,
+                             size_t size) {
+  lock_guard<mutex> lock(m_mutex);
+  FileToRangesMap::iterator it = m_ranges.find(filePath);
+  if (it == m_ranges.end()) {
+    return;
+  }
+  RemoveContentRange(&it->second, offset, size);
+  if (it->second.empty()) {
+    m_ranges.erase(it);
+  }
+  m_releaseCond.notify_all();
+}
+
+// --------------------------------------------------------------------------
+void InFlightRanges::Wait(const string &filePath, off_t offset,
+                          size_t size) const {
+  unique_lock<mutex> lock(m_mutex);
+  while (UnguardedIsInFlight(filePath, offset, size)) {
+    m_releaseCond.wait(lock);
+  }
+}
+
+// --------------------------------------------------------------------------
+bool InFlightRanges::IsInFlight(const string &filePath, off_t offset,
+                                size_t size) const {
+  lock_guard<mutex> lock(m_mutex);
+  return UnguardedIsInFlight(filePath, offset, size);
+}
+
+// --------------------------------------------------------------------------
+size_t InFlightRanges::GetNumFiles() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_ranges.size();
+}
+
+// --------------------------------------------------------------------------
+bool InFlightRanges::UnguardedIsInFlight(const string &filePath, off_t offset,
+                                         size_t size) const {
+  FileToRangesMap::const_iterator it = m_ranges.find(filePath);
+  return it != m_ranges.end() &&
+         IntersectContentRanges(it->second, offset, size);
+}
+
+}  // namespace Data
+}  // namespace QS
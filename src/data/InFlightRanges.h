@@ -0,0 +1,94 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_INFLIGHTRANGES_H_
+#define QSFS_DATA_INFLIGHTRANGES_H_
+
+#include <stddef.h>  // for size_t
+
+#include <sys/types.h>  // for off_t
+
+#include <map>
+#include <string>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "data/Page.h"  // for ContentRangeDeque
+
+namespace QS {
+
+namespace Data {
+
+// Ranges of the files being downloaded
+//
+// A downloader claims a range before downloading it, and gets only the parts
+// of it which are not in flight yet. The parts claimed by others are waited
+// for instead of being downloaded again, so the concurrent reads of the same
+// content fetch each byte once.
+//
+// A claimed range must be released once its content is written into cache,
+// or its download fails, otherwise the waiters block forever.
+class InFlightRanges : private boost::noncopyable {
+ public:
+  InFlightRanges() {}
+
+  ~InFlightRanges() {}
+
+ public:
+  // Claim a range of a file to download
+  //
+  // @param  : file path, range start, range size
+  // @return : the parts of the range which are not in flight before, sorted
+  //           by start, the caller should download and then release them
+  ContentRangeDeque Claim(const std::string &filePath, off_t offset,
+                          size_t size);
+
+  // Release a range claimed before and wake up the waiters
+  //
+  // @param  : file path, range start, range size
+  // @return : void
+  //
+  // A part of a claimed range could be released alone.
+  void Release(const std::string &filePath, off_t offset, size_t size);
+
+  // Block until no part of a range is in flight
+  //
+  // @param  : file path, range start, range size
+  // @return : void
+  void Wait(const std::string &filePath, off_t offset, size_t size) const;
+
+  bool IsInFlight(const std::string &filePath, off_t offset,
+                  size_t size) const;
+  size_t GetNumFiles() const;
+
+ private:
+  bool UnguardedIsInFlight(const std::string &filePath, off_t offset,
+                           size_t size) const;
+
+ private:
+  typedef std::map<std::string, ContentRangeDeque> FileToRangesMap;
+
+  mutable boost::mutex m_mutex;
+  mutable boost::condition_variable m_releaseCond;  // wake up waiters
+  FileToRangesMap m_ranges;  // in flight ranges sorted by start
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_INFLIGHTRANGES_H_
@@ -0,0 +1,471 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/Journal.h"
+
+#include <stdlib.h>  // for strtoll, strtoull, strtoul
+#include <string.h>  // for strlen
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "boost/exception/to_string.hpp"
+#include "boost/thread/locks.hpp"
+
+#include "base/LogMacros.h"
+#include "base/StringUtils.h"
+#include "base/Utils.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::to_string;
+using QS::StringUtils::FormatPath;
+using QS::Utils::AppendPathDelim;
+using std::ifstream;
+using std::istringstream;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace {
+
+// First line of log file, update the version if the format is changed
+const char *const kLogHeader = "qsfs-journal 1\n";
+
+// Kinds of records, the first field of a record line
+const char kWrite = 'W';     // path, offset, size, data offset
+const char kTruncate = 'T';  // path, new size
+const char kRemove = 'D';    // path
+const char kCreate = 'C';    // path, mode
+const char kRename = 'R';    // path, new path
+const char kConfirm = 'K';   // sequence number of confirmed intent
+const char kCommit = 'U';    // path, last sequence number of upload
+
+// Split a line by tab
+vector<string> SplitByTab(const string &line) {
+  vector<string> fields;
+  string field;
+  istringstream ss(line);
+  while (std::getline(ss, field, '\t')) {
+    fields.push_back(field);
+  }
+  return fields;
+}
+
+// Whether the path could be stored in a record line
+bool IsValidPath(const string &path) {
+  return !path.empty() && path.find_first_of("\t\n") == string::npos;
+}
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+Journal::Journal(const string &dir)
+    : m_dir(AppendPathDelim(dir)),
+      m_log(m_dir + "journal"),
+      m_data(m_dir + "journal.data"),
+      m_logSize(0),
+      m_dataSize(0),
+      m_lastSeq(0),
+      m_needSync(false) {}
+
+// --------------------------------------------------------------------------
+bool Journal::Open() {
+  lock_guard<mutex> lock(m_mutex);
+  ifstream file(m_log.GetPath().c_str());
+  string line;
+  if (file.is_open() && std::getline(file, line) && !file.eof()) {
+    if (line + "\n" != kLogHeader) {
+      DebugError("Unrecognized journal " + FormatPath(m_log.GetPath()));
+      return false;
+    }
+    m_logSize = line.size() + 1;
+    // a record is only valid with its line end, the records after a torn
+    // line are dropped and overwritten by the next records
+    while (std::getline(file, line) && !file.eof()) {
+      if (!LoadRecord(line)) {
+        DebugWarning("Stop at invalid journal record [" + line + "]");
+        break;
+      }
+      m_logSize += line.size() + 1;
+    }
+  }
+  file.close();
+
+  if (m_logSize == 0) {
+    size_t len = strlen(kLogHeader);
+    if (!m_log.Write(0, len, kLogHeader)) {
+      return false;
+    }
+    m_logSize = len;
+  }
+  // drop the torn record if any
+  if (!m_log.Truncate(static_cast<off_t>(m_logSize))) {
+    return false;
+  }
+  if (!m_pendingOps.empty() || !m_pendingIntents.empty()) {
+    Info("Load journal [files:intents=" + to_string(m_pendingOps.size()) +
+         ":" + to_string(m_pendingIntents.size()) + "] " +
+         FormatPath(m_dir));
+  }
+  UnguardedResetIfEmpty();
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Journal::AppendWrite(const string &filePath, off_t offset, size_t len,
+                          const char *buffer) {
+  if (!IsValidPath(filePath)) {
+    DebugWarning("Not journal the write of " + FormatPath(filePath));
+    return false;
+  }
+  lock_guard<mutex> lock(m_mutex);
+  // the bytes go first, so a record never refers to missing bytes
+  if (!m_data.Write(m_dataSize, len, buffer)) {
+    return false;
+  }
+  JournalOp op;
+  op.m_type = JournalOpType::Write;
+  op.m_path = filePath;
+  op.m_offset = offset;
+  op.m_size = len;
+  op.m_dataOffset = m_dataSize;
+  ostringstream line;
+  line << filePath << "\t" << offset << "\t" << len << "\t" << m_dataSize;
+  if (!UnguardedAppend(op, kWrite, line.str())) {
+    return false;
+  }
+  m_dataSize += len;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Journal::AppendTruncate(const string &filePath, uint64_t newSize) {
+  if (!IsValidPath(filePath)) {
+    DebugWarning("Not journal the truncate of " + FormatPath(filePath));
+    return false;
+  }
+  lock_guard<mutex> lock(m_mutex);
+  JournalOp op;
+  op.m_type = JournalOpType::Truncate;
+  op.m_path = filePath;
+  op.m_size = newSize;
+  ostringstream line;
+  line << filePath << "\t" << newSize;
+  return UnguardedAppend(op, kTruncate, line.str());
+}
+
+// --------------------------------------------------------------------------
+bool Journal::AppendRemove(const string &filePath) {
+  lock_guard<mutex> lock(m_mutex);
+  if (m_pendingOps.find(filePath) == m_pendingOps.end()) {
+    return true;  // nothing to drop
+  }
+  JournalOp op;
+  op.m_path = filePath;
+  bool success = UnguardedAppend(op, kRemove, filePath);
+  UnguardedResetIfEmpty();
+  return success;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Journal::AppendCreate(const string &filePath, mode_t mode) {
+  if (!IsValidPath(filePath)) {
+    DebugWarning("Not journal the creation of " + FormatPath(filePath));
+    return 0;
+  }
+  lock_guard<mutex> lock(m_mutex);
+  JournalOp op;
+  op.m_type = JournalOpType::Create;
+  op.m_path = filePath;
+  op.m_mode = mode;
+  ostringstream line;
+  line << filePath << "\t" << std::oct << mode;
+  return UnguardedAppend(op, kCreate, line.str()) ? m_lastSeq : 0;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Journal::AppendRename(const string &filePath,
+                               const string &newFilePath) {
+  if (!IsValidPath(filePath) || !IsValidPath(newFilePath)) {
+    DebugWarning("Not journal the renaming of " +
+                 FormatPath(filePath, newFilePath));
+    return 0;
+  }
+  lock_guard<mutex> lock(m_mutex);
+  JournalOp op;
+  op.m_type = JournalOpType::Rename;
+  op.m_path = filePath;
+  op.m_newPath = newFilePath;
+  return UnguardedAppend(op, kRename, filePath + "\t" + newFilePath)
+             ? m_lastSeq
+             : 0;
+}
+
+// --------------------------------------------------------------------------
+void Journal::Confirm(uint64_t seq) {
+  lock_guard<mutex> lock(m_mutex);
+  if (m_pendingIntents.find(seq) == m_pendingIntents.end()) {
+    return;
+  }
+  JournalOp op;
+  op.m_size = seq;
+  UnguardedAppend(op, kConfirm, to_string(seq));
+  UnguardedResetIfEmpty();
+}
+
+// --------------------------------------------------------------------------
+void Journal::Commit(const string &filePath, uint64_t seq) {
+  lock_guard<mutex> lock(m_mutex);
+  FileToOpsMap::const_iterator it = m_pendingOps.find(filePath);
+  if (it == m_pendingOps.end() || it->second.front().m_seq > seq) {
+    return;  // nothing uploaded
+  }
+  JournalOp op;
+  op.m_path = filePath;
+  op.m_size = seq;
+  UnguardedAppend(op, kCommit, filePath + "\t" + to_string(seq));
+  UnguardedResetIfEmpty();
+}
+
+// --------------------------------------------------------------------------
+bool Journal::Sync() {
+  {
+    lock_guard<mutex> lock(m_mutex);
+    if (!m_needSync) {
+      return true;
+    }
+    m_needSync = false;
+  }
+  bool success = m_data.Sync() && m_log.Sync();
+  if (!success) {
+    lock_guard<mutex> lock(m_mutex);
+    m_needSync = true;
+  }
+  return success;
+}
+
+// --------------------------------------------------------------------------
+uint64_t Journal::GetLastSequence() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_lastSeq;
+}
+
+// --------------------------------------------------------------------------
+vector<JournalOp> Journal::GetPendingIntents() const {
+  lock_guard<mutex> lock(m_mutex);
+  vector<JournalOp> intents;
+  for (SeqToIntentMap::const_iterator it = m_pendingIntents.begin();
+       it != m_pendingIntents.end(); ++it) {
+    intents.push_back(it->second);
+  }
+  return intents;
+}
+
+// --------------------------------------------------------------------------
+vector<string> Journal::GetPendingFiles() const {
+  lock_guard<mutex> lock(m_mutex);
+  vector<string> files;
+  for (FileToOpsMap::const_iterator it = m_pendingOps.begin();
+       it != m_pendingOps.end(); ++it) {
+    files.push_back(it->first);
+  }
+  return files;
+}
+
+// --------------------------------------------------------------------------
+vector<JournalOp> Journal::GetPendingOps(const string &filePath) const {
+  lock_guard<mutex> lock(m_mutex);
+  FileToOpsMap::const_iterator it = m_pendingOps.find(filePath);
+  return it != m_pendingOps.end() ? it->second : vector<JournalOp>();
+}
+
+// --------------------------------------------------------------------------
+bool Journal::ReadData(const JournalOp &op, char *buffer) {
+  if (op.m_type != JournalOpType::Write) {
+    return false;
+  }
+  size_t len = static_cast<size_t>(op.m_size);
+  return m_data.Read(static_cast<off_t>(op.m_dataOffset), len, buffer) ==
+         len;
+}
+
+// --------------------------------------------------------------------------
+bool Journal::Empty() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_pendingOps.empty() && m_pendingIntents.empty();
+}
+
+// --------------------------------------------------------------------------
+bool Journal::LoadRecord(const string &line) {
+  vector<string> fields = SplitByTab(line);
+  if (fields.size() < 3 || fields[0].size() != 1) {
+    return false;
+  }
+  char kind = fields[0][0];
+  JournalOp op;
+  op.m_seq = strtoull(fields[1].c_str(), NULL, 10);
+  if (op.m_seq <= m_lastSeq) {
+    return false;  // out of order
+  }
+  switch (kind) {
+    case kWrite:
+      if (fields.size() != 6) {
+        return false;
+      }
+      op.m_type = JournalOpType::Write;
+      op.m_path = fields[2];
+      op.m_offset = static_cast<off_t>(strtoll(fields[3].c_str(), NULL, 10));
+      op.m_size = strtoull(fields[4].c_str(), NULL, 10);
+      op.m_dataOffset = strtoull(fields[5].c_str(), NULL, 10);
+      if (op.m_dataOffset + op.m_size > m_dataSize) {
+        m_dataSize = op.m_dataOffset + op.m_size;
+      }
+      break;
+    case kTruncate:
+      if (fields.size() != 4) {
+        return false;
+      }
+      op.m_type = JournalOpType::Truncate;
+      op.m_path = fields[2];
+      op.m_size = strtoull(fields[3].c_str(), NULL, 10);
+      break;
+    case kRemove:
+      op.m_path = fields[2];
+      break;
+    case kCreate:
+      if (fields.size() != 4) {
+        return false;
+      }
+      op.m_type = JournalOpType::Create;
+      op.m_path = fields[2];
+      op.m_mode = static_cast<mode_t>(strtoul(fields[3].c_str(), NULL, 8));
+      break;
+    case kRename:
+      if (fields.size() != 4) {
+        return false;
+      }
+      op.m_type = JournalOpType::Rename;
+      op.m_path = fields[2];
+      op.m_newPath = fields[3];
+      break;
+    case kConfirm:
+      op.m_size = strtoull(fields[2].c_str(), NULL, 10);
+      break;
+    case kCommit:
+      if (fields.size() != 4) {
+        return false;
+      }
+      op.m_path = fields[2];
+      op.m_size = strtoull(fields[3].c_str(), NULL, 10);
+      break;
+    default:
+      return false;
+  }
+  m_lastSeq = op.m_seq;
+  UnguardedApply(op, kind);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Journal::UnguardedAppend(const JournalOp &op, char kind,
+                              const string &line) {
+  JournalOp record = op;
+  record.m_seq = m_lastSeq + 1;
+  string str = string(1, kind) + "\t" + to_string(record.m_seq) + "\t" +
+               line + "\n";
+  if (!m_log.Write(static_cast<off_t>(m_logSize), str.size(), str.c_str())) {
+    return false;
+  }
+  m_logSize += str.size();
+  m_lastSeq = record.m_seq;
+  m_needSync = true;
+  UnguardedApply(record, kind);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+void Journal::UnguardedApply(const JournalOp &op, char kind) {
+  switch (kind) {
+    case kWrite:  // fall through
+    case kTruncate:
+      m_pendingOps[op.m_path].push_back(op);
+      break;
+    case kRemove:
+      m_pendingOps.erase(op.m_path);
+      break;
+    case kCreate:
+      m_pendingIntents[op.m_seq] = op;
+      break;
+    case kRename: {
+      m_pendingIntents[op.m_seq] = op;
+      // the target is replaced, so are its pending changes
+      FileToOpsMap::iterator it = m_pendingOps.find(op.m_path);
+      if (it != m_pendingOps.end()) {
+        m_pendingOps[op.m_newPath].swap(it->second);
+        m_pendingOps.erase(op.m_path);
+      } else {
+        m_pendingOps.erase(op.m_newPath);
+      }
+      break;
+    }
+    case kConfirm:
+      m_pendingIntents.erase(op.m_size);
+      break;
+    case kCommit: {
+      FileToOpsMap::iterator it = m_pendingOps.find(op.m_path);
+      if (it != m_pendingOps.end()) {
+        vector<JournalOp> &ops = it->second;
+        vector<JournalOp>::iterator keep = ops.begin();
+        while (keep != ops.end() && keep->m_seq <= op.m_size) {
+          ++keep;
+        }
+        ops.erase(ops.begin(), keep);
+        if (ops.empty()) {
+          m_pendingOps.erase(it);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// --------------------------------------------------------------------------
+void Journal::UnguardedResetIfEmpty() {
+  if (!m_pendingOps.empty() || !m_pendingIntents.empty()) {
+    return;
+  }
+  size_t headerSize = strlen(kLogHeader);
+  if (m_logSize == headerSize && m_dataSize == 0) {
+    return;
+  }
+  if (m_log.Truncate(static_cast<off_t>(headerSize)) &&
+      m_data.Truncate(0)) {
+    m_logSize = headerSize;
+    m_dataSize = 0;
+  }
+}
+
+}  // namespace Data
+}  // namespace QS
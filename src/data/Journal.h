@@ -0,0 +1,195 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_JOURNAL_H_
+#define QSFS_DATA_JOURNAL_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+#include <sys/types.h>  // for off_t, mode_t
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "data/DiskFile.h"
+
+namespace QS {
+
+namespace Data {
+
+struct JournalOpType {
+  enum Value {
+    Write,     // bytes written into a file
+    Truncate,  // file resized
+    Create,    // intent to create a file
+    Rename     // intent to rename a file
+  };
+};
+
+// Operation recorded in journal
+struct JournalOp {
+  JournalOp()
+      : m_type(JournalOpType::Write),
+        m_seq(0),
+        m_offset(0),
+        m_size(0),
+        m_dataOffset(0),
+        m_mode(0) {}
+
+  JournalOpType::Value m_type;
+  uint64_t m_seq;          // increasing sequence number of the record
+  std::string m_path;
+  std::string m_newPath;   // target path of rename
+  off_t m_offset;          // file offset of write
+  uint64_t m_size;         // size of write, or new file size of truncate
+  uint64_t m_dataOffset;   // offset of the written bytes in data file
+  mode_t m_mode;           // mode of created file
+};
+
+// Journal of the local changes not uploaded yet
+//
+// Written bytes and truncations are recorded per file until the file is
+// uploaded, and intents of the metadata operations (create, rename) are
+// recorded until the object storage confirms them. The records are appended
+// into a log file and the written bytes into a data file in the journal
+// directory, so they are replayed at next mount if qsfs crashes before the
+// changes are uploaded.
+//
+// The records reach the disk file at once, which survives a crash of qsfs.
+// Call Sync to make them survive a crash of the system as well.
+//
+// Both files are truncated whenever nothing is pending, a file which is
+// never clean keeps the journal growing until it is uploaded.
+class Journal : private boost::noncopyable {
+ public:
+  explicit Journal(const std::string &dir);
+
+  ~Journal() {}
+
+ public:
+  // Load the records left by last mount and open journal to append
+  //
+  // @param  : void
+  // @return : bool
+  bool Open();
+
+  // Record the bytes written into a file
+  //
+  // @param  : file path, file offset, len of bytes, buffer
+  // @return : bool
+  bool AppendWrite(const std::string &filePath, off_t offset, size_t len,
+                   const char *buffer);
+
+  // Record the resizing of a file
+  bool AppendTruncate(const std::string &filePath, uint64_t newSize);
+
+  // Record the removing of a file, whose pending changes are dropped
+  bool AppendRemove(const std::string &filePath);
+
+  // Record the intent to create a file
+  //
+  // @param  : file path, file mode
+  // @return : sequence number to confirm the intent, zero if fail
+  uint64_t AppendCreate(const std::string &filePath, mode_t mode);
+
+  // Record the intent to rename a file
+  //
+  // @param  : file path, new file path
+  // @return : sequence number to confirm the intent, zero if fail
+  //
+  // Pending changes of the file are moved to the new path.
+  uint64_t AppendRename(const std::string &filePath,
+                        const std::string &newFilePath);
+
+  // Confirm the intent is done by object storage
+  //
+  // @param  : sequence number of the intent
+  // @return : void
+  void Confirm(uint64_t seq);
+
+  // Commit the changes of a file which are uploaded
+  //
+  // @param  : file path, last sequence number when the upload starts
+  // @return : void
+  //
+  // Changes recorded after the upload starts are kept.
+  void Commit(const std::string &filePath, uint64_t seq);
+
+  // Flush the records to the storage device
+  bool Sync();
+
+  // Return sequence number of the last record
+  uint64_t GetLastSequence() const;
+
+  // Return the intents not confirmed, in the order they are recorded
+  std::vector<JournalOp> GetPendingIntents() const;
+
+  // Return the files with changes not uploaded
+  std::vector<std::string> GetPendingFiles() const;
+
+  // Return the changes of a file not uploaded, in the order they are recorded
+  std::vector<JournalOp> GetPendingOps(const std::string &filePath) const;
+
+  // Read the bytes of a write
+  //
+  // @param  : write operation, buffer of at least op.m_size bytes
+  // @return : bool
+  bool ReadData(const JournalOp &op, char *buffer);
+
+  // Whether nothing is pending
+  bool Empty() const;
+
+  const std::string &GetDirectory() const { return m_dir; }
+
+ private:
+  typedef std::map<std::string, std::vector<JournalOp> > FileToOpsMap;
+  typedef std::map<uint64_t, JournalOp> SeqToIntentMap;
+
+  // Parse a record line and apply it
+  bool LoadRecord(const std::string &line);
+
+  // Write a record line at the end of log file and apply it
+  bool UnguardedAppend(const JournalOp &op, char kind,
+                       const std::string &line);
+
+  // Apply a record to the pending changes
+  void UnguardedApply(const JournalOp &op, char kind);
+
+  // Truncate the files if nothing is pending
+  void UnguardedResetIfEmpty();
+
+ private:
+  std::string m_dir;
+  mutable boost::mutex m_mutex;
+  DiskFile m_log;       // records of operations
+  DiskFile m_data;      // written bytes
+  uint64_t m_logSize;   // offset to append next record
+  uint64_t m_dataSize;  // offset to append next written bytes
+  uint64_t m_lastSeq;
+  bool m_needSync;      // appended since last sync
+  FileToOpsMap m_pendingOps;
+  SeqToIntentMap m_pendingIntents;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_JOURNAL_H_
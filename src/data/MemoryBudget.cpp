@@ -0,0 +1,193 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/MemoryBudget.h"
+
+#include <assert.h>
+
+#include <iostream>
+#include <string>
+
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using std::ostream;
+using std::string;
+
+namespace {
+
+// Header of a heap allocation kept by malloc
+const size_t kMallocOverhead = 2 * sizeof(void *);
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+string GetMemoryUserName(MemoryUser::Value user) {
+  string name;
+  switch (user) {
+    case MemoryUser::Cache:
+      name = "cache";
+      break;
+    case MemoryUser::FileMetaData:
+      name = "file meta data";
+      break;
+    case MemoryUser::DirectoryTree:
+      name = "directory tree";
+      break;
+    case MemoryUser::TransferBuffer:
+      name = "transfer buffer";
+      break;
+    default:
+      break;
+  }
+  return name;
+}
+
+// --------------------------------------------------------------------------
+uint64_t MemoryBudget::GetBudget() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_budget;
+}
+
+// --------------------------------------------------------------------------
+void MemoryBudget::SetBudget(uint64_t budget) {
+  lock_guard<mutex> lock(m_mutex);
+  m_budget = budget;
+}
+
+// --------------------------------------------------------------------------
+uint64_t MemoryBudget::GetUsage() const {
+  lock_guard<mutex> lock(m_mutex);
+  return GetUsageNoLock();
+}
+
+// --------------------------------------------------------------------------
+uint64_t MemoryBudget::GetUsage(MemoryUser::Value user) const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_usages[user];
+}
+
+// --------------------------------------------------------------------------
+bool MemoryBudget::HasFreeSpace(uint64_t size) const {
+  return GetShortage(size) == 0;
+}
+
+// --------------------------------------------------------------------------
+uint64_t MemoryBudget::GetShortage(uint64_t size) const {
+  lock_guard<mutex> lock(m_mutex);
+  uint64_t usage = GetUsageNoLock();
+  if (m_budget == 0 || usage + size <= m_budget) {
+    return 0;
+  }
+  return usage + size - m_budget;
+}
+
+// --------------------------------------------------------------------------
+void MemoryBudget::Add(MemoryUser::Value user, uint64_t size) {
+  lock_guard<mutex> lock(m_mutex);
+  m_usages[user] += size;
+}
+
+// --------------------------------------------------------------------------
+void MemoryBudget::Subtract(MemoryUser::Value user, uint64_t size) {
+  lock_guard<mutex> lock(m_mutex);
+  assert(m_usages[user] >= size);
+  m_usages[user] = m_usages[user] > size ? m_usages[user] - size : 0;
+}
+
+// --------------------------------------------------------------------------
+void MemoryBudget::Update(MemoryUser::Value user, uint64_t oldSize,
+                          uint64_t newSize) {
+  if (newSize > oldSize) {
+    Add(user, newSize - oldSize);
+  } else if (newSize < oldSize) {
+    Subtract(user, oldSize - newSize);
+  }
+}
+
+// --------------------------------------------------------------------------
+MemoryBudget::MemoryBudget() : m_budget(0) {
+  for (int i = 0; i < MemoryUser::NumUsers; ++i) {
+    m_usages[i] = 0;
+  }
+}
+
+// --------------------------------------------------------------------------
+uint64_t MemoryBudget::GetUsageNoLock() const {
+  uint64_t usage = 0;
+  for (int i = 0; i < MemoryUser::NumUsers; ++i) {
+    usage += m_usages[i];
+  }
+  return usage;
+}
+
+// --------------------------------------------------------------------------
+ostream &operator<<(ostream &os, const MemoryBudget &budget) {
+  for (int i = 0; i < MemoryUser::NumUsers; ++i) {
+    MemoryUser::Value user = static_cast<MemoryUser::Value>(i);
+    os << "[" << GetMemoryUserName(user) << ": " << budget.GetUsage(user)
+       << "] ";
+  }
+  return os << "[total: " << budget.GetUsage() << "] "
+            << "[budget: " << budget.GetBudget() << "]";
+}
+
+// --------------------------------------------------------------------------
+size_t HeapSize(size_t size) { return size + kMallocOverhead; }
+
+// --------------------------------------------------------------------------
+size_t ListNodeSize(size_t valueSize) {
+  return HeapSize(2 * sizeof(void *) + valueSize);
+}
+
+// --------------------------------------------------------------------------
+size_t TreeNodeSize(size_t valueSize) {
+  // color, parent, left and right
+  return HeapSize(4 * sizeof(void *) + valueSize);
+}
+
+// --------------------------------------------------------------------------
+size_t HashNodeSize(size_t valueSize) {
+  // next pointer, and a bucket as the load factor is at most 1
+  return HeapSize(2 * sizeof(void *) + valueSize);
+}
+
+// --------------------------------------------------------------------------
+size_t EmptyDequeSize() {
+  // a map of 8 pointers and a chunk of 512 bytes as libstdc++ does
+  return HeapSize(8 * sizeof(void *)) + HeapSize(512);
+}
+
+// --------------------------------------------------------------------------
+size_t StringSize(const string &str) {
+  // Short strings are stored inside the string object by most libraries
+  return str.size() < sizeof(string) ? 0 : HeapSize(str.size() + 1);
+}
+
+// --------------------------------------------------------------------------
+size_t SharedCountSize() {
+  // vtable, use count, weak count, and the deleter or the object
+  return HeapSize(2 * sizeof(void *) + 2 * sizeof(long));
+}
+
+}  // namespace Data
+}  // namespace QS
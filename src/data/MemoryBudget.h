@@ -0,0 +1,142 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_MEMORYBUDGET_H_
+#define QSFS_DATA_MEMORYBUDGET_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+
+#include "boost/thread/mutex.hpp"
+
+#include "base/Singleton.hpp"
+
+namespace QS {
+
+namespace Data {
+
+// Subsystems holding memory
+struct MemoryUser {
+  enum Value {
+    Cache = 0,           // file content cache
+    FileMetaData = 1,    // file meta data manager
+    DirectoryTree = 2,   // directory tree nodes
+    TransferBuffer = 3,  // buffers of transfer manager
+    NumUsers = 4
+  };
+};
+
+// Get memory user name
+//
+// @param  : memory user enumeration
+// @return : memory user name
+std::string GetMemoryUserName(MemoryUser::Value user);
+
+// Memory budget shared by all subsystems
+//
+// Each subsystem adds the memory it allocates and subtracts the memory it
+// releases, including the overhead of its containers, so the usage is close
+// to the memory the process really holds. The caches which could release
+// memory (file content cache and file meta data) honour the budget by freeing
+// their least valuable content once the total usage reaches the budget.
+//
+// A budget of zero means no limit, the usage is still reported.
+class MemoryBudget : public Singleton<MemoryBudget> {
+ public:
+  ~MemoryBudget() {}
+
+ public:
+  // Return budget in bytes, zero means no limit
+  uint64_t GetBudget() const;
+
+  // Set budget in bytes, zero means no limit
+  void SetBudget(uint64_t budget);
+
+  // Return sum of the memory used by all subsystems
+  uint64_t GetUsage() const;
+
+  // Return memory used by the subsystem
+  uint64_t GetUsage(MemoryUser::Value user) const;
+
+  // Whether there is available budget for the size
+  //
+  // @param  : size in bytes
+  // @return : bool
+  bool HasFreeSpace(uint64_t size) const;
+
+  // Return size to release so there is available budget for the size
+  //
+  // @param  : size in bytes
+  // @return : zero if there is available budget or there is no limit
+  uint64_t GetShortage(uint64_t size) const;
+
+  // Add memory used by the subsystem
+  void Add(MemoryUser::Value user, uint64_t size);
+
+  // Subtract memory released by the subsystem
+  void Subtract(MemoryUser::Value user, uint64_t size);
+
+  // Update memory used by the subsystem from oldSize to newSize
+  void Update(MemoryUser::Value user, uint64_t oldSize, uint64_t newSize);
+
+ private:
+  MemoryBudget();
+
+  uint64_t GetUsageNoLock() const;
+
+  mutable boost::mutex m_mutex;
+  uint64_t m_budget;                        // zero means no limit
+  uint64_t m_usages[MemoryUser::NumUsers];  // indexed by memory user
+
+  friend class Singleton<MemoryBudget>;
+};
+
+// Print the usage of each subsystem, the total usage and the budget
+std::ostream &operator<<(std::ostream &os, const MemoryBudget &budget);
+
+// Estimated memory of the allocations of containers, which include the
+// pointers linking a node and the header of the heap allocation.
+//
+// Return size of a heap allocation of the given size
+size_t HeapSize(size_t size);
+
+// Return size of a node of std::list holding the value
+size_t ListNodeSize(size_t valueSize);
+
+// Return size of a node of std::set or std::map holding the value
+size_t TreeNodeSize(size_t valueSize);
+
+// Return size of a node of boost::unordered_map holding the value, including
+// its share of the bucket array
+size_t HashNodeSize(size_t valueSize);
+
+// Return size of the allocations of an empty std::deque
+size_t EmptyDequeSize();
+
+// Return size of the heap allocation holding the characters of a string copied
+// from str
+size_t StringSize(const std::string &str);
+
+// Return size of the control block of a shared_ptr
+size_t SharedCountSize();
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_MEMORYBUDGET_H_
@@ -125,6 +125,9 @@ class Node : private boost::noncopyable {
 
   mode_t GetFileMode() const { return m_entry ? m_entry.GetFileMode() : 0; }
   time_t GetMTime() const { return m_entry ? m_entry.GetMTime() : 0; }
+  std::string GetETag() const {
+    return m_entry ? m_entry.GetETag() : std::string();
+  }
   time_t GetCachedTime() const { return m_entry ? m_entry.GetCachedTime() : 0; }
   uid_t GetUID() const { return m_entry ? m_entry.GetUID() : -1; }
   bool IsNeedUpload() const { return m_entry ? m_entry.IsNeedUpload() : false; }
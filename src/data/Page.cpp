@@ -17,85 +17,81 @@
 #include "data/Page.h"
 
 #include <assert.h>
+#include <string.h>  // for memcpy, memset
 
-#include <fstream>
+#include <algorithm>
 #include <sstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "base/LogMacros.h"
+#include "base/Lz4.h"
+#include "base/RecursiveSharedMutex.h"
 #include "base/StringUtils.h"
 #include "base/Utils.h"
 #include "base/UtilsWithLog.h"
-#include "configure/Options.h"
+#include "data/DiskFile.h"
 #include "data/IOStream.h"
+#include "data/MemoryBudget.h"
+#include "data/SlabAllocator.h"
+#include "data/StreamBuf.h"
 #include "data/StreamUtils.h"
 
 #include "boost/exception/to_string.hpp"
 #include "boost/make_shared.hpp"
-#include "boost/noncopyable.hpp"
 #include "boost/shared_ptr.hpp"
 #include "boost/thread/locks.hpp"
-#include "boost/thread/recursive_mutex.hpp"
 
 namespace QS {
 
 namespace Data {
 
+using boost::allocate_shared;
 using boost::lock_guard;
-using boost::make_shared;
-using boost::recursive_mutex;
+using boost::shared_lock;
 using boost::shared_ptr;
 using boost::to_string;
+using QS::Data::Buffer;
 using QS::Data::IOStream;
+using QS::Data::StreamBuf;
 using QS::Data::StreamUtils::GetStreamSize;
 using QS::StringUtils::FormatPath;
 using QS::StringUtils::PointerAddress;
+using QS::Threading::RecursiveSharedMutex;
 using QS::Utils::GetDirName;
-using QS::UtilsWithLog::CreateDirectoryIfNotExists;
-using QS::UtilsWithLog::FileExists;
-using std::fstream;
 using std::iostream;
+using std::make_pair;
 using std::stringstream;
 using std::string;
+using std::vector;
 
 namespace {
 
-// RAII class to open file and close it in destructor
-class FileOpener : private boost::noncopyable {
- public:
-  explicit FileOpener(const shared_ptr<iostream> &body) {
-    m_file = dynamic_cast<fstream *>(body.get());
-  }
-
-  ~FileOpener() {
-    if (m_file != NULL && m_file->is_open()) {
-      m_file->flush();
-      m_file->close();
-    }
-  }
-
-  void DoOpen(const string &filename, std::ios_base::openmode mode) {
-    if (m_file != NULL && !filename.empty()) {
-      m_file->open(filename.c_str(), mode);
-      if (!m_file->is_open()) {
-        DebugError("Fail to open file " + FormatPath(filename));
-      }
-    } else {
-      DebugError("Invalid parameter");
-    }
-  }
+// Smaller pages are not compressed, as they save little
+const size_t kMinCompressSize = 4096;
 
- private:
-  FileOpener() : m_file(NULL) {}
+// --------------------------------------------------------------------------
+// Allocate a stream along with its shared count from the slab pool
+shared_ptr<IOStream> NewStream(size_t len) {
+  return allocate_shared<IOStream>(SlabAllocator<IOStream>(), len);
+}
 
-  fstream *m_file;
-};
+// --------------------------------------------------------------------------
+shared_ptr<IOStream> NewStream(const Buffer &buf, size_t len) {
+  return allocate_shared<IOStream>(SlabAllocator<IOStream>(), buf, len);
+}
 
 }  // namespace
 
 // --------------------------------------------------------------------------
 Page::Page(off_t offset, size_t len, const char *buffer)
-    : m_offset(offset), m_size(len), m_body(make_shared<IOStream>(len)) {
+    : m_offset(offset),
+      m_size(len),
+      m_body(NewStream(len)),
+      m_incompressible(false),
+      m_lastAccess(0),
+      m_diskHits(0) {
   bool isValidInput = offset >= 0 && len >= 0 && buffer != NULL;
   assert(isValidInput);
   if (!isValidInput) {
@@ -104,14 +100,20 @@ Page::Page(off_t offset, size_t len, const char *buffer)
     return;
   }
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   UnguardedPutToBody(offset, len, buffer);
 }
 
 // --------------------------------------------------------------------------
-Page::Page(off_t offset, size_t len, const char *buffer, const string &diskfile)
-    : m_offset(offset), m_size(len), m_diskFile(diskfile) {
-  bool isValidInput = offset >= 0 && len >= 0 && buffer != NULL;
+Page::Page(off_t offset, size_t len, const char *buffer,
+           const shared_ptr<DiskFile> &diskfile)
+    : m_offset(offset),
+      m_size(len),
+      m_diskFile(diskfile),
+      m_incompressible(false),
+      m_lastAccess(0),
+      m_diskHits(0) {
+  bool isValidInput = offset >= 0 && len >= 0 && buffer != NULL && diskfile;
   assert(isValidInput);
   if (!isValidInput) {
     DebugError("Try to new a page with invalid input " +
@@ -119,15 +121,40 @@ Page::Page(off_t offset, size_t len, const char *buffer, const string &diskfile)
     return;
   }
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   if (SetupDiskFile()) {
     UnguardedPutToBody(offset, len, buffer);
   }
 }
 
+// --------------------------------------------------------------------------
+Page::Page(off_t offset, size_t len, const shared_ptr<DiskFile> &diskfile)
+    : m_offset(offset),
+      m_size(len),
+      m_diskFile(diskfile),
+      m_incompressible(false),
+      m_lastAccess(0),
+      m_diskHits(0) {
+  bool isValidInput = offset >= 0 && len > 0 && diskfile;
+  assert(isValidInput);
+  if (!isValidInput) {
+    DebugError("Try to new a page with invalid input " +
+               ToStringLine(offset, len));
+    return;
+  }
+
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  SetupDiskFile();
+}
+
 // --------------------------------------------------------------------------
 Page::Page(off_t offset, size_t len, const shared_ptr<iostream> &instream)
-    : m_offset(offset), m_size(len), m_body(make_shared<IOStream>(len)) {
+    : m_offset(offset),
+      m_size(len),
+      m_body(NewStream(len)),
+      m_incompressible(false),
+      m_lastAccess(0),
+      m_diskHits(0) {
   bool isValidInput = offset >= 0 && len >= 0 && instream;
   assert(isValidInput);
   if (!isValidInput) {
@@ -136,15 +163,20 @@ Page::Page(off_t offset, size_t len, const shared_ptr<iostream> &instream)
     return;
   }
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   UnguardedPutToBody(offset, len, instream);
 }
 
 // --------------------------------------------------------------------------
 Page::Page(off_t offset, size_t len, const shared_ptr<iostream> &instream,
-           const string &diskfile)
-    : m_offset(offset), m_size(len), m_diskFile(diskfile) {
-  bool isValidInput = offset >= 0 && len > 0 && instream;
+           const shared_ptr<DiskFile> &diskfile)
+    : m_offset(offset),
+      m_size(len),
+      m_diskFile(diskfile),
+      m_incompressible(false),
+      m_lastAccess(0),
+      m_diskHits(0) {
+  bool isValidInput = offset >= 0 && len > 0 && instream && diskfile;
   assert(isValidInput);
   if (!isValidInput) {
     DebugError("Try to new a page with invalid input " +
@@ -152,42 +184,97 @@ Page::Page(off_t offset, size_t len, const shared_ptr<iostream> &instream,
     return;
   }
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   if (SetupDiskFile()) {
     UnguardedPutToBody(offset, len, instream);
   }
 }
 
+// --------------------------------------------------------------------------
+Page::Page(off_t offset, size_t len, const Buffer &buffer)
+    : m_offset(offset),
+      m_size(len),
+      m_incompressible(false),
+      m_lastAccess(0),
+      m_diskHits(0) {
+  bool isValidInput = offset >= 0 && buffer && buffer->size() >= len;
+  assert(isValidInput);
+  if (!isValidInput) {
+    DebugError("Try to new a page with invalid input " +
+               ToStringLine(offset, len));
+    return;
+  }
+
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  m_body = NewStream(buffer, len);
+}
+
+// --------------------------------------------------------------------------
+size_t Page::GetMemoryUsage() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  size_t usage = HeapSize(sizeof(Page));
+  if (m_compressed) {
+    return usage + SharedCountSize() + HeapSize(sizeof(ByteVector)) +
+           SlabPool::Instance().GetChunkSize(m_compressed->capacity());
+  }
+  if (m_diskFile || !m_body) {
+    return usage;
+  }
+  usage += SlabPool::Instance().GetChunkSize(SharedCountSize() +
+                                            sizeof(IOStream));
+  const StreamBuf *streamBuf = dynamic_cast<const StreamBuf *>(m_body->rdbuf());
+  if (streamBuf != NULL && streamBuf->GetBuffer()) {
+    usage += HeapSize(sizeof(StreamBuf)) + SharedCountSize() +
+             HeapSize(sizeof(ByteVector)) +
+             SlabPool::Instance().GetChunkSize(
+                 streamBuf->GetBuffer()->capacity());
+  } else {
+    usage += m_size;
+  }
+  return usage;
+}
+
 // --------------------------------------------------------------------------
 bool Page::UseDiskFile() {
-  lock_guard<recursive_mutex> lock(m_mutex);
-  return !m_diskFile.empty();
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return static_cast<bool>(m_diskFile);
 }
 
 // --------------------------------------------------------------------------
 bool Page::UseDiskFileNoLock() {
-  return !m_diskFile.empty();
+  return static_cast<bool>(m_diskFile);
+}
+
+// --------------------------------------------------------------------------
+bool Page::IsCompressed() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return static_cast<bool>(m_compressed);
+}
+
+// --------------------------------------------------------------------------
+size_t Page::GetCompressedSize() const {
+  shared_lock<RecursiveSharedMutex> lock(m_mutex);
+  return m_compressed ? m_compressed->size() : 0;
 }
 
 // --------------------------------------------------------------------------
 void Page::UnguardedPutToBody(off_t offset, size_t len, const char *buffer) {
-  if (!m_body) {
-    DebugError("null body stream " + ToStringLine(offset, len, buffer));
+  if (len == 0) {
     return;
   }
-  if(len ==0){
+  if (UseDiskFileNoLock()) {
+    if (!m_diskFile->Write(m_offset, len, buffer)) {
+      DebugError("Fail to write disk file " +
+                 FormatPath(m_diskFile->GetPath()) +
+                 ToStringLine(offset, len, buffer));
+    }
     return;
   }
-  FileOpener opener(m_body);
-  if (UseDiskFileNoLock()) {
-    // Notice: need to open in both output and input mode to avoid truncate file
-    // as open in out mode only will actually truncate file.
-    opener.DoOpen(m_diskFile, std::ios_base::binary | std::ios_base::ate |
-                  std::ios_base::in | std::ios_base::out);  // open for write
-    m_body->seekp(m_offset, std::ios_base::beg);
-  } else {
-    m_body->seekp(0, std::ios_base::beg);
+  if (!m_body) {
+    DebugError("null body stream " + ToStringLine(offset, len, buffer));
+    return;
   }
+  m_body->seekp(0, std::ios_base::beg);
   if (!m_body->good()) {
     DebugError("Fail to seek body " + ToStringLine(offset, len, buffer));
   } else {
@@ -212,14 +299,20 @@ void Page::UnguardedPutToBody(off_t offset, size_t len,
     m_size = instreamLen;
   }
 
-  FileOpener opener(m_body);
   if (UseDiskFileNoLock()) {
-    opener.DoOpen(m_diskFile, std::ios_base::binary | std::ios_base::ate |
-                  std::ios_base::in | std::ios_base::out);  // open for write
-    m_body->seekp(m_offset, std::ios_base::beg);
-  } else {
-    m_body->seekp(0, std::ios_base::beg);
+    vector<char> buf(len);
+    instream->seekg(0, std::ios_base::beg);
+    instream->read(&buf[0], len);
+    if (!instream->good()) {
+      DebugError("Fail to read stream " + ToStringLine(offset, len));
+    } else if (!m_diskFile->Write(m_offset, len, &buf[0])) {
+      DebugError("Fail to write disk file " +
+                 FormatPath(m_diskFile->GetPath()) + ToStringLine(offset, len));
+    }
+    return;
   }
+
+  m_body->seekp(0, std::ios_base::beg);
   if (!m_body->good()) {
     DebugError("Fail to seek body " + ToStringLine(offset, len));
   } else {
@@ -239,29 +332,25 @@ void Page::UnguardedPutToBody(off_t offset, size_t len,
 
 // --------------------------------------------------------------------------
 void Page::SetStream(const shared_ptr<iostream> &stream) {
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   m_body = stream;
+  m_compressed.reset();
+  m_incompressible = false;
 }
 
 // --------------------------------------------------------------------------
 bool Page::SetupDiskFile() {
-  lock_guard<recursive_mutex> lock(m_mutex);
-  CreateDirectoryIfNotExists(
-      QS::Configure::Options::Instance().GetDiskCacheDirectory());
-
-  std::ios_base::openmode mode = std::ios_base::binary | std::ios_base::ate |
-                                 std::ios_base::in | std::ios_base::out;
-  if (!FileExists(m_diskFile)) {
-    // Notice: set open mode with std::ios_base::out to create file in disk if
-    // it is not exist
-    mode = std::ios_base::binary | std::ios_base::out;
-  }
-  shared_ptr<fstream> file = make_shared<fstream>(m_diskFile.c_str(), mode);
-  if (file && file->is_open()) {
-    DebugInfo("Open file " + FormatPath(m_diskFile));
-  }
-  file->close();
-  m_body = file;
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (!m_diskFile) {
+    return false;
+  }
+  // The bytes are read and written with the descriptor of disk file
+  m_body.reset();
+  // Preallocate the page's range to keep the disk file less fragmented
+  bool allocated = m_diskFile->Allocate(m_offset, m_size);
+  DebugWarningIf(!allocated, "Fail to preallocate disk file " +
+                                 FormatPath(m_diskFile->GetPath()) +
+                                 ToStringLine(m_offset, m_size));
   return true;
 }
 
@@ -271,18 +360,20 @@ void Page::ResizeToSmallerSize(size_t smallerSize) {
   // 1. Change size to 'samllerSize'.
   // 2. Set output position indicator to 'samllerSize'.
   assert(0 <= smallerSize && smallerSize <= m_size);
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  // compressed bytes are only decompressed to the original size
+  if (!UnguardedDecompress()) {
+    return;
+  }
   m_size = smallerSize;
-  if (UseDiskFileNoLock()) {
-    m_body->seekp(m_offset + smallerSize, std::ios_base::beg);
-  } else {
+  if (!UseDiskFileNoLock()) {
     m_body->seekp(smallerSize, std::ios_base::beg);
   }
 }
 
 // --------------------------------------------------------------------------
 bool Page::Refresh(off_t offset, size_t len, const char *buffer,
-                   const string &diskfile) {
+                   const shared_ptr<DiskFile> &diskfile) {
   if (len == 0) {
     return true;  // do nothing
   }
@@ -295,71 +386,184 @@ bool Page::Refresh(off_t offset, size_t len, const char *buffer,
     return false;
   }
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   return UnguardedRefresh(offset, len, buffer, diskfile);
 }
 
 // --------------------------------------------------------------------------
 bool Page::UnguardedRefresh(off_t offset, size_t len, const char *buffer,
-                            const string &diskfile) {
-  size_t moreLen = offset + len - Next();
-  size_t dataLen = moreLen > 0 ? m_size + moreLen : m_size;
-  shared_ptr<IOStream> data = make_shared<IOStream>(dataLen);
-  {
-    FileOpener opener(m_body);
-    if (UseDiskFileNoLock()) {
-      opener.DoOpen(m_diskFile,
-                    std::ios_base::binary | std::ios_base::in);  // for read
-      m_body->seekg(offset, std::ios_base::beg);
-    } else {
-      m_body->seekg(0, std::ios_base::beg);
+                            const shared_ptr<DiskFile> &diskfile) {
+  off_t stop = offset + static_cast<off_t>(len);
+  size_t moreLen = stop > Next() ? static_cast<size_t>(stop - Next()) : 0;
+  if (!UnguardedDecompress()) {
+    return false;
+  }
+  m_incompressible = false;
+  if (UseDiskFileNoLock()) {
+    // Refresh content in place, the disk file grows as need
+    if (!m_diskFile->Write(offset, len, buffer)) {
+      DebugError("Fail to refresh page(" + ToStringLine(m_offset, m_size) +
+                 ") with input " + ToStringLine(offset, len, buffer));
+      return false;
     }
-    (*data) << m_body->rdbuf();
+    m_size += moreLen;
+    return true;
   }
 
-  data->seekp(offset - m_offset, std::ios_base::beg);
-  data->write(buffer, len);
+  if (moreLen == 0 && !diskfile && !UnguardedIsBodyShared()) {
+    // Refresh content in place, as the page need not to grow or to move to
+    // disk file, and no one else sees the buffer
+    m_body->seekp(offset - m_offset, std::ios_base::beg);
+    if (m_body->good()) {
+      m_body->write(buffer, len);
+    }
+    if (!m_body->good()) {
+      DebugError("Fail to refresh page(" + ToStringLine(m_offset, m_size) +
+                 ") with input " + ToStringLine(offset, len, buffer));
+      return false;
+    }
+    return true;
+  }
 
-  if (!data->good()) {
-    DebugError("Fail to refresh page(" + ToStringLine(m_offset, m_size) +
-               ") with input " + ToStringLine(offset, len, buffer));
+  size_t dataLen = m_size + moreLen;
+  Buffer data(new ByteVector(dataLen));
+  if (m_size > 0 && UnguardedRead(&(*data)[0]) != m_size) {
     return false;
   }
+  memcpy(&(*data)[offset - m_offset], buffer, len);
 
-  if (!diskfile.empty()) {
+  if (diskfile) {
     m_diskFile = diskfile;
+    m_size = dataLen;
     if (!SetupDiskFile()) {
-      DebugError("Unable to set up file " + FormatPath(m_diskFile));
+      DebugError("Unable to set up file " + FormatPath(diskfile->GetPath()));
       return false;
     }
+    UnguardedPutToBody(m_offset, dataLen, &(*data)[0]);
+    return true;
+  }
+
+  m_body = NewStream(data, dataLen);
+  m_size = dataLen;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Page::Append(size_t len, const char *buffer, size_t capacity) {
+  if (len == 0) {
+    return true;  // do nothing
+  }
+
+  bool isValidInput = buffer != NULL;
+  assert(isValidInput);
+  if (!isValidInput) {
+    DebugError("Try to append page(" + ToStringLine(m_offset, m_size) +
+               ") with invalid input " + ToStringLine(Next(), len, buffer));
+    return false;
+  }
+
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  return UnguardedAppend(len, buffer, capacity);
+}
+
+// --------------------------------------------------------------------------
+bool Page::Append(size_t len, const shared_ptr<iostream> &stream,
+                  size_t capacity) {
+  if (len == 0) {
+    return true;  // do nothing
+  }
+
+  bool isValidInput = stream && GetStreamSize(stream) >= len;
+  assert(isValidInput);
+  if (!isValidInput) {
+    DebugError("Try to append page(" + ToStringLine(m_offset, m_size) +
+               ") with invalid input " + ToStringLine(Next(), len));
+    return false;
+  }
+
+  vector<char> buf(len);
+  stream->seekg(0, std::ios_base::beg);
+  stream->read(&buf[0], len);
+  if (!stream->good()) {
+    DebugError("Fail to read stream " + ToStringLine(Next(), len));
+    return false;
+  }
+
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  return UnguardedAppend(len, &buf[0], capacity);
+}
+
+// --------------------------------------------------------------------------
+bool Page::Merge(Page &page, size_t capacity) {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lockPage(page.m_mutex);
+  bool isValidInput = page.m_offset == Next() &&
+                      page.UseDiskFileNoLock() == UseDiskFileNoLock() &&
+                      page.m_diskFile == m_diskFile;
+  assert(isValidInput);
+  if (!isValidInput) {
+    DebugError("Try to merge page(" + ToStringLine(m_offset, m_size) +
+               ") with page " + ToStringLine(page.m_offset, page.m_size));
+    return false;
+  }
+  if (page.m_size == 0) {
+    return true;  // do nothing
   }
 
-  FileOpener opener(m_body);
   if (UseDiskFileNoLock()) {
-    opener.DoOpen(m_diskFile, std::ios_base::binary | std::ios_base::ate |
-                  std::ios_base::in | std::ios_base::out);  // open for write
-    m_body->seekp(m_offset, std::ios_base::beg);
-    if (!m_body->good()) {
-      DebugError("Fail to seek page(" + ToStringLine(m_offset, m_size) +
-                 ") with input " + ToStringLine(offset, len, buffer));
-      return false;
-    }
-    data->seekg(0, std::ios_base::beg);
-    (*m_body) << data->rdbuf();  // put pages' all content into disk file
-  } else {
-    data->seekg(0, std::ios_base::beg);
-    m_body = data;
+    // Pages using disk file share the same disk file, the content is already
+    // stored at the right position.
+    m_size += page.m_size;
+    return true;
   }
-  if (moreLen > 0) {
-    m_size += moreLen;
+
+  vector<char> buf(page.m_size);
+  if (page.UnguardedRead(&buf[0]) != page.m_size) {
+    return false;
+  }
+  return UnguardedAppend(buf.size(), &buf[0], capacity);
+}
+
+// --------------------------------------------------------------------------
+bool Page::UnguardedAppend(size_t len, const char *buffer, size_t capacity) {
+  if (!UnguardedDecompress()) {
+    return false;
   }
-  if (m_body->good()) {
+  m_incompressible = false;
+  if (UseDiskFileNoLock()) {
+    if (!m_diskFile->Write(Next(), len, buffer)) {
+      DebugError("Fail to append page(" + ToStringLine(m_offset, m_size) +
+                 ") with input " + ToStringLine(Next(), len, buffer));
+      return false;
+    }
+    m_size += len;
     return true;
+  }
+
+  size_t newSize = m_size + len;
+  const StreamBuf *streamBuf =
+      m_body ? dynamic_cast<const StreamBuf *>(m_body->rdbuf()) : NULL;
+  Buffer buf;
+  if (streamBuf != NULL && streamBuf->GetBuffer() &&
+      streamBuf->GetBuffer()->capacity() >= newSize &&
+      !UnguardedIsBodyShared()) {
+    // Grow in place, this will not reallocate the buffer
+    buf = streamBuf->GetBuffer();
+    if (buf->size() < newSize) {
+      buf->resize(newSize);
+    }
   } else {
-    DebugError("Fail to refresh page(" + ToStringLine(m_offset, m_size) +
-               ") with input " + ToStringLine(offset, len, buffer));
-    return false;
+    buf = Buffer(new ByteVector());
+    buf->reserve(std::max(capacity, newSize));
+    buf->resize(newSize);
+    if (m_size > 0 && UnguardedRead(&(*buf)[0]) != m_size) {
+      return false;
+    }
   }
+  memcpy(&(*buf)[m_size], buffer, len);
+  m_body = NewStream(buf, newSize);
+  m_size = newSize;
+  return true;
 }
 
 // --------------------------------------------------------------------------
@@ -376,24 +580,34 @@ size_t Page::Read(off_t offset, size_t len, char *buffer) {
                "Try to read page (" + ToStringLine(m_offset, m_size) +
                ") with invalid input " + ToStringLine(offset, len, buffer));
 
-  lock_guard<recursive_mutex> lock(m_mutex);
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
   return UnguardedRead(offset, len, buffer);
 }
 
 // --------------------------------------------------------------------------
 size_t Page::UnguardedRead(off_t offset, size_t len, char *buffer) {
+  if (UseDiskFileNoLock()) {
+    if (m_diskFile->Read(offset, len, buffer) != len) {
+      DebugError("Fail to read page(" + ToStringLine(m_offset, m_size) +
+                 ") from disk file " + FormatPath(m_diskFile->GetPath()) +
+                 ToStringLine(offset, len, buffer));
+      return 0;
+    }
+    return len;
+  }
+  if (m_compressed) {
+    Buffer buf = UnguardedUncompress();
+    if (!buf) {
+      return 0;
+    }
+    memcpy(buffer, &(*buf)[offset - m_offset], len);
+    return len;
+  }
   if (!m_body) {
     DebugError("null body stream " + ToStringLine(offset, len, buffer));
     return 0;
   }
-  FileOpener opener(m_body);
-  if (UseDiskFileNoLock()) {
-    opener.DoOpen(m_diskFile,
-                  std::ios_base::binary | std::ios_base::in);  // open for read
-    m_body->seekg(offset, std::ios_base::beg);
-  } else {
-    m_body->seekg(offset - m_offset, std::ios_base::beg);
-  }
+  m_body->seekg(offset - m_offset, std::ios_base::beg);
   if (!m_body->good()) {
     DebugError("Fail to seek page(" + ToStringLine(m_offset, m_size) +
                ") with input " + ToStringLine(offset, len, buffer));
@@ -410,6 +624,286 @@ size_t Page::UnguardedRead(off_t offset, size_t len, char *buffer) {
   }
 }
 
+// --------------------------------------------------------------------------
+ContentSlice Page::Slice(off_t offset, size_t len) {
+  {
+    shared_lock<RecursiveSharedMutex> lock(m_mutex);
+    if (!UnguardedClampRange(&offset, &len)) {
+      return ContentSlice(offset, 0, Buffer(), 0);
+    }
+    size_t start = static_cast<size_t>(offset - m_offset);
+    if (!UseDiskFileNoLock() && m_body) {
+      const StreamBuf *streamBuf =
+          dynamic_cast<const StreamBuf *>(m_body->rdbuf());
+      if (streamBuf != NULL && streamBuf->GetBuffer() &&
+          streamBuf->GetBuffer()->size() >= start + len) {
+        return ContentSlice(offset, len, streamBuf->GetBuffer(), start);
+      }
+    }
+    if (m_compressed) {
+      // The slice owns the decompressed bytes, page is kept compressed
+      Buffer buf = UnguardedUncompress();
+      return ContentSlice(offset, buf ? len : 0, buf, start,
+                          ContentTier::Compressed);
+    }
+    if (UseDiskFileNoLock()) {
+      // Disk file is read by pread, which leaves no state to guard
+      Buffer buf(new ByteVector(len));
+      size_t readSize = len > 0 ? UnguardedRead(offset, len, &(*buf)[0]) : 0;
+      return ContentSlice(offset, readSize, buf, 0, ContentTier::Disk);
+    }
+  }
+
+  // Copy bytes for a stream not backed by a buffer, which is seeked to read,
+  // or for a page changed since the shared lock is released
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (!UnguardedClampRange(&offset, &len)) {
+    return ContentSlice(offset, 0, Buffer(), 0);
+  }
+  Buffer buf(new ByteVector(len));
+  size_t readSize = len > 0 ? UnguardedRead(offset, len, &(*buf)[0]) : 0;
+  return ContentSlice(offset, readSize, buf, 0,
+                      UseDiskFileNoLock() ? ContentTier::Disk
+                                          : ContentTier::Memory);
+}
+
+// --------------------------------------------------------------------------
+bool Page::UnguardedClampRange(off_t *offset, size_t *len) const {
+  off_t start = std::max(*offset, m_offset);
+  off_t stop = std::min(*offset + static_cast<off_t>(*len), Next());
+  if (start >= stop) {
+    return false;
+  }
+  *offset = start;
+  *len = static_cast<size_t>(stop - start);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Page::MoveToDiskFile(const shared_ptr<DiskFile> &diskfile) {
+  if (!diskfile) {
+    DebugError("Try to move page(" + ToStringLine(m_offset, m_size) +
+               ") to null disk file");
+    return false;
+  }
+
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (UseDiskFileNoLock()) {
+    return true;  // do nothing
+  }
+  vector<char> buf(m_size);
+  if (m_size > 0 && UnguardedRead(&buf[0]) != m_size) {
+    return false;
+  }
+  bool allocated = diskfile->Allocate(m_offset, m_size);
+  DebugWarningIf(!allocated, "Fail to preallocate disk file " +
+                                 FormatPath(diskfile->GetPath()) +
+                                 ToStringLine(m_offset, m_size));
+  if (m_size > 0 && !diskfile->Write(m_offset, m_size, &buf[0])) {
+    DebugError("Fail to move page(" + ToStringLine(m_offset, m_size) +
+               ") to disk file " + FormatPath(diskfile->GetPath()));
+    return false;
+  }
+  m_diskFile = diskfile;
+  m_body.reset();
+  m_compressed.reset();
+  m_diskHits = 0;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Page::MoveToMemory() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (!UseDiskFileNoLock()) {
+    return true;  // do nothing
+  }
+  Buffer buf(new ByteVector(m_size));
+  if (m_size > 0 && UnguardedRead(&(*buf)[0]) != m_size) {
+    return false;
+  }
+  m_body = NewStream(buf, m_size);
+  m_diskFile.reset();
+  m_diskHits = 0;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Page::Compress() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  if (UseDiskFileNoLock() || m_compressed || m_incompressible ||
+      m_size < kMinCompressSize) {
+    return false;
+  }
+  ContentSlice slice = Slice(m_offset, m_size);
+  if (slice.m_size != m_size) {
+    return false;
+  }
+  // Give up once the compressed bytes exceed seven eighths of the page
+  vector<char> buf(m_size - m_size / 8);
+  size_t compressedSize =
+      QS::Lz4::Compress(slice.Data(), m_size, &buf[0], buf.size());
+  if (compressedSize == 0) {
+    m_incompressible = true;
+    return false;
+  }
+  m_compressed = Buffer(
+      new ByteVector(buf.begin(), buf.begin() + compressedSize));
+  m_body.reset();
+  m_diskHits = 0;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Page::Decompress() {
+  lock_guard<RecursiveSharedMutex> lock(m_mutex);
+  return UnguardedDecompress();
+}
+
+// --------------------------------------------------------------------------
+Buffer Page::UnguardedUncompress() const {
+  Buffer buf(new ByteVector(m_size));
+  if (!QS::Lz4::Decompress(&(*m_compressed)[0], m_compressed->size(),
+                           m_size > 0 ? &(*buf)[0] : NULL, m_size)) {
+    DebugError("Fail to decompress page " + ToStringLine(m_offset, m_size));
+    return Buffer();
+  }
+  return buf;
+}
+
+// --------------------------------------------------------------------------
+bool Page::UnguardedDecompress() {
+  if (!m_compressed) {
+    return true;  // do nothing
+  }
+  Buffer buf = UnguardedUncompress();
+  if (!buf) {
+    return false;
+  }
+  m_body = NewStream(buf, m_size);
+  m_compressed.reset();
+  m_diskHits = 0;
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool Page::UnguardedIsBodyShared() const {
+  if (!m_body) {
+    return false;
+  }
+  if (!m_body.unique()) {
+    return true;
+  }
+  const StreamBuf *streamBuf = dynamic_cast<const StreamBuf *>(m_body->rdbuf());
+  return streamBuf != NULL && streamBuf->GetBuffer() &&
+         !streamBuf->GetBuffer().unique();
+}
+
+// --------------------------------------------------------------------------
+size_t CopySlices(const ContentSliceDeque &slices, off_t offset, size_t len,
+                  char *buffer) {
+  off_t stop = offset + static_cast<off_t>(len);
+  off_t pos = offset;
+  size_t copiedSize = 0;
+  for (ContentSliceDeque::const_iterator it = slices.begin();
+       it != slices.end(); ++it) {
+    off_t start = std::max(pos, it->m_offset);
+    off_t end = std::min(stop, it->m_offset + static_cast<off_t>(it->m_size));
+    if (start >= end) {
+      continue;
+    }
+    if (pos < start) {  // fill hole
+      memset(buffer + (pos - offset), 0, static_cast<size_t>(start - pos));
+    }
+    memcpy(buffer + (start - offset), it->Data() + (start - it->m_offset),
+           static_cast<size_t>(end - start));
+    copiedSize += static_cast<size_t>(end - start);
+    pos = end;
+  }
+  if (pos < stop) {
+    memset(buffer + (pos - offset), 0, static_cast<size_t>(stop - pos));
+  }
+  return copiedSize;
+}
+
+// --------------------------------------------------------------------------
+size_t AddContentRange(ContentRangeDeque *ranges, off_t start, size_t len) {
+  off_t stop = start + static_cast<off_t>(len);
+  off_t mergedStart = start;
+  off_t mergedStop = stop;
+  size_t coveredSize = 0;
+  ContentRangeDeque merged;
+  bool inserted = false;
+  for (ContentRangeDeque::iterator it = ranges->begin(); it != ranges->end();
+       ++it) {
+    off_t rStart = it->first;
+    off_t rStop = it->first + static_cast<off_t>(it->second);
+    if (rStop < start) {
+      merged.push_back(*it);
+    } else if (rStart > stop) {
+      if (!inserted) {
+        merged.push_back(make_pair(
+            mergedStart, static_cast<size_t>(mergedStop - mergedStart)));
+        inserted = true;
+      }
+      merged.push_back(*it);
+    } else {  // overlapped or adjacent
+      off_t interStart = std::max(start, rStart);
+      off_t interStop = std::min(stop, rStop);
+      if (interStop > interStart) {
+        coveredSize += static_cast<size_t>(interStop - interStart);
+      }
+      mergedStart = std::min(mergedStart, rStart);
+      mergedStop = std::max(mergedStop, rStop);
+    }
+  }
+  if (!inserted) {
+    merged.push_back(
+        make_pair(mergedStart, static_cast<size_t>(mergedStop - mergedStart)));
+  }
+  ranges->swap(merged);
+  return len - coveredSize;
+}
+
+// --------------------------------------------------------------------------
+size_t RemoveContentRange(ContentRangeDeque *ranges, off_t start, size_t len) {
+  off_t stop = start + static_cast<off_t>(len);
+  size_t removedSize = 0;
+  ContentRangeDeque kept;
+  for (ContentRangeDeque::iterator it = ranges->begin(); it != ranges->end();
+       ++it) {
+    off_t rStart = it->first;
+    off_t rStop = it->first + static_cast<off_t>(it->second);
+    if (rStop <= start || rStart >= stop) {
+      kept.push_back(*it);
+      continue;
+    }
+    // keep the parts of the range outside of the removed range
+    if (rStart < start) {
+      kept.push_back(make_pair(rStart, static_cast<size_t>(start - rStart)));
+    }
+    if (rStop > stop) {
+      kept.push_back(make_pair(stop, static_cast<size_t>(rStop - stop)));
+    }
+    removedSize += static_cast<size_t>(std::min(stop, rStop) -
+                                       std::max(start, rStart));
+  }
+  ranges->swap(kept);
+  return removedSize;
+}
+
+// --------------------------------------------------------------------------
+bool IntersectContentRanges(const ContentRangeDeque &ranges, off_t start,
+                            size_t len) {
+  off_t stop = start + static_cast<off_t>(len);
+  for (ContentRangeDeque::const_iterator it = ranges.begin();
+       it != ranges.end() && it->first < stop; ++it) {
+    if (it->first + static_cast<off_t>(it->second) > start) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // --------------------------------------------------------------------------
 string ToStringLine(off_t offset, size_t len, const char *buffer) {
   return "[offset:size:buffer=" + to_string(offset) + ":" + to_string(len) +
@@ -18,22 +18,93 @@
 #define QSFS_DATA_PAGE_H_
 
 #include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint64_t
 
 #include <sys/types.h>  // for off_t
 
+#include <deque>
 #include <iostream>
 #include <set>
 #include <string>
+#include <utility>
 
 #include "boost/shared_ptr.hpp"
-#include "boost/thread/recursive_mutex.hpp"
+
+#include "base/Atomic.h"
+#include "base/RecursiveSharedMutex.h"
+#include "data/StreamBuf.h"  // for Buffer
 
 namespace QS {
 
 namespace Data {
 
+class DiskFile;
 class File;
 
+// Range represented by a pair of {offset, size}
+typedef std::deque<std::pair<off_t, size_t> > ContentRangeDeque;
+
+// Add range into the ranges sorted by start
+//
+// @param  : sorted ranges, range start, range size
+// @return : size not covered by the ranges before
+//
+// The range is merged with the overlapped or adjacent ranges.
+size_t AddContentRange(ContentRangeDeque *ranges, off_t start, size_t len);
+
+// Remove range from the ranges sorted by start
+//
+// @param  : sorted ranges, range start, range size
+// @return : size removed from the ranges
+size_t RemoveContentRange(ContentRangeDeque *ranges, off_t start, size_t len);
+
+// Whether any of the ranges sorted by start intersects with the range
+//
+// @param  : sorted ranges, range start, range size
+// @return : bool
+bool IntersectContentRanges(const ContentRangeDeque &ranges, off_t start,
+                            size_t len);
+
+// Tier storing the content of a page or a block
+struct ContentTier {
+  enum Value {
+    Memory,      // bytes in memory
+    Compressed,  // compressed bytes in memory
+    Disk         // bytes in disk file
+  };
+};
+
+// Slice of file content
+//
+// A slice shares the buffer of a page or a block stored in memory, and keeps
+// the buffer alive as long as the slice exists, so the bytes are not copied.
+// For content stored in disk file, the bytes are read into a buffer owned by
+// the slice.
+// A page is copied on write while its buffer is shared, but a later write to
+// a block could be seen by the slice.
+struct ContentSlice {
+  ContentSlice()
+      : m_offset(0), m_size(0), m_start(0), m_tier(ContentTier::Memory) {}
+  ContentSlice(off_t offset, size_t size, const Buffer &buffer, size_t start,
+               ContentTier::Value tier = ContentTier::Memory)
+      : m_offset(offset),
+        m_size(size),
+        m_buffer(buffer),
+        m_start(start),
+        m_tier(tier) {}
+
+  // Return pointer to the first byte of the slice
+  const char *Data() const { return m_buffer ? &(*m_buffer)[m_start] : NULL; }
+
+  off_t m_offset;   // offset from the begin of owning File
+  size_t m_size;    // size of bytes the slice contains
+  Buffer m_buffer;  // buffer holding the bytes
+  size_t m_start;   // position of the first byte in buffer
+  ContentTier::Value m_tier;  // tier the bytes are read from
+};
+
+typedef std::deque<ContentSlice> ContentSliceDeque;
+
 class Page {
  private:
   // Page attributes
@@ -58,21 +129,40 @@ class Page {
   size_t m_size;   // size of bytes this page contains
 
   // NOTICE: body stream should be QS::Data::IOStream which associated with
-  // QS::Data::StreamBuf when not use disk file; otherwise body stream is a
-  // fstream assoicated to a disk file.
-  // With the asssoicated stream buf or disk file, the body stream support to
-  // be read/write for multiple times, but keep in mind following things:
-  // 1) always seek to the right postion before to read/write body stream;
-  // 2) if use disk file, always use RAII FileOpener to open it for read/write
+  // QS::Data::StreamBuf when not use disk file; otherwise body stream is null
+  // and the bytes are stored in disk file at the page's file offset.
+  // With the asssoicated stream buf, the body stream support to be read/write
+  // for multiple times, but always seek to the right postion before to
+  // read/write body stream.
   boost::shared_ptr<std::iostream> m_body;  // stream storing the bytes
 
-  std::string m_diskFile;  // disk file is used when in-memory cache is not
-                           // available, it is an absolute file path
+  // disk file is used when in-memory cache is not available, it is shared by
+  // all the pages of the owning File
+  boost::shared_ptr<DiskFile> m_diskFile;
+
+  // bytes compressed in LZ4 block format when the page is cold, body stream is
+  // null then and the bytes are decompressed at each access
+  Buffer m_compressed;
+  bool m_incompressible;  // compressed before but saved too little
 
-  mutable boost::recursive_mutex m_mutex;
+  // access tick of the owning File when the page is accessed last time, and
+  // times the page is accessed since it is put to disk file or compressed,
+  // they are set by the owning File to choose the cold pages to move to disk
+  // file and the hot pages to move back to memory, they are set under the
+  // shared lock of the owning File
+  QS::Threading::Atomic<uint64_t> m_lastAccess;
+  QS::Threading::Atomic<unsigned> m_diskHits;
+
+  // Content is sliced under shared lock, changed under exclusive lock
+  mutable QS::Threading::RecursiveSharedMutex m_mutex;
 
  private:
-  Page() : m_offset(0), m_size(0) {}
+  Page()
+      : m_offset(0),
+        m_size(0),
+        m_incompressible(false),
+        m_lastAccess(0),
+        m_diskHits(0) {}
 
  public:
   // Construct Page from a block of bytes
@@ -89,7 +179,13 @@ class Page {
   // @param  : file offset, len, buffer, disk file path
   // @return :
   Page(off_t offset, size_t len, const char *buffer,
-       const std::string &diskfile);
+       const boost::shared_ptr<DiskFile> &diskfile);
+
+  // Construct Page from the bytes already stored in disk file
+  //
+  // @param  : file offset, len of bytes, disk file
+  // @return :
+  Page(off_t offset, size_t len, const boost::shared_ptr<DiskFile> &diskfile);
 
   // Construct Page from a stream
   //
@@ -106,7 +202,16 @@ class Page {
   // @param  : file offset, len of bytes, stream, disk file
   // @return :
   Page(off_t offset, size_t len, const boost::shared_ptr<std::iostream> &stream,
-       const std::string &diskfile);
+       const boost::shared_ptr<DiskFile> &diskfile);
+
+  // Construct Page sharing a buffer
+  //
+  // @param  : file offset, len of bytes, buffer
+  // @return :
+  //
+  // The first len bytes of buffer are the content, they are not copied until
+  // the page is written while the buffer is still shared.
+  Page(off_t offset, size_t len, const Buffer &buffer);
 
  public:
   ~Page() {}
@@ -123,6 +228,9 @@ class Page {
   // Return the offset
   off_t Offset() const { return m_offset; }
 
+  // Return memory held by the page, including the buffer of body
+  size_t GetMemoryUsage() const;
+
   // Return body
   const boost::shared_ptr<std::iostream> &GetBody() const { return m_body; }
 
@@ -130,6 +238,12 @@ class Page {
   bool UseDiskFile();
   bool UseDiskFileNoLock();
 
+  // Return if page content is compressed in memory
+  bool IsCompressed() const;
+
+  // Return size of the compressed bytes, zero if page is not compressed
+  size_t GetCompressedSize() const;
+
   // Refresh the page's partial content
   //
   // @param  : file offset, len of bytes to update, buffer, disk file
@@ -139,7 +253,8 @@ class Page {
   // is larger than page's size and using disk file, then all page's data
   // will be put to disk file.
   bool Refresh(off_t offset, size_t len, const char *buffer,
-               const std::string &diskfile = std::string());
+               const boost::shared_ptr<DiskFile> &diskfile =
+                   boost::shared_ptr<DiskFile>());
 
   // Refresh the page's entire content with bytes from buffer,
   // without checking.
@@ -150,6 +265,32 @@ class Page {
   // @return : bool
   bool Refresh(const char *buffer) { return Refresh(m_offset, m_size, buffer); }
 
+  // Append bytes to the end of the page
+  //
+  // @param  : len of bytes, buffer, capacity
+  // @return : bool
+  //
+  // The page grows by len bytes. A page stored in memory reserves room for
+  // capacity bytes when its buffer need to grow, so the successive appends
+  // could be done without copying the page's content again.
+  bool Append(size_t len, const char *buffer, size_t capacity = 0);
+
+  // Append bytes from stream to the end of the page
+  //
+  // @param  : len of bytes, stream, capacity
+  // @return : bool
+  bool Append(size_t len, const boost::shared_ptr<std::iostream> &stream,
+              size_t capacity = 0);
+
+  // Merge the successive page into this page
+  //
+  // @param  : page, capacity
+  // @return : bool
+  //
+  // The page to merge should start at Next() and use the same storage
+  // (memory or disk file) as this page.
+  bool Merge(Page &page, size_t capacity = 0);
+
   // Read the page's content
   //
   // @param  : file offset, len of bytes to read, buffer
@@ -168,29 +309,89 @@ class Page {
   // Read the page's entire content to buffer.
   size_t Read(char *buffer) { return Read(m_offset, m_size, buffer); }
 
+  // Return a slice of the page's content
+  //
+  // @param  : file offset, len of bytes
+  // @return : slice of the part of the range within the page, which is empty
+  //           if the range does not intersect with the page
+  //
+  // The range is clamped under the page lock, as the page could grow by
+  // merging once the file lock is released. For a page stored in memory, the slice shares the page's buffer.
+  // Pages are sliced in parallel unless the bytes are copied from a stream not
+  // backed by a buffer.
+  ContentSlice Slice(off_t offset, size_t len);
+
+  // Move the page's content from memory to disk file
+  //
+  // @param  : disk file
+  // @return : bool
+  //
+  // The bytes are written to disk file at the page's file offset, and the
+  // body stream is released.
+  bool MoveToDiskFile(const boost::shared_ptr<DiskFile> &diskfile);
+
+  // Move the page's content from disk file back to memory
+  //
+  // @param  : void
+  // @return : bool
+  //
+  // The bytes stay in disk file, which will be overwritten or removed by the
+  // owning File.
+  bool MoveToMemory();
+
+  // Compress the page's content stored in memory
+  //
+  // @param  : void
+  // @return : true if the page is compressed
+  //
+  // Content saving less than an eighth of its size is kept uncompressed, and
+  // it is not tried again until the page is written.
+  bool Compress();
+
+  // Decompress the page's content back to body stream
+  //
+  // @param  : void
+  // @return : bool
+  bool Decompress();
+
  private:
   // Set stream
   void SetStream(const boost::shared_ptr<std::iostream> &stream);
 
-  // Setup disk file on disk
-  // - open the disk file
-  // - set stream to fstream assocating with disk file
+  // Setup disk file
+  // - reset body stream as bytes are stored in disk file
+  // - preallocate the page's range in disk file
   bool SetupDiskFile();
 
   // Do a lazy resize for page.
   void ResizeToSmallerSize(size_t smallerSize);
 
+  // Return the decompressed content of a compressed page, null if fail
+  Buffer UnguardedUncompress() const;
+
+  // Decompress the page's content back to body stream, if it is compressed
+  bool UnguardedDecompress();
+
+  // Whether the buffer of body is shared with others, e.g. slices or pages
+  // of other files, so it should be copied before writing
+  bool UnguardedIsBodyShared() const;
+
   // Put data to body
   // For internal use only
   void UnguardedPutToBody(off_t offset, size_t len, const char *buffer);
   void UnguardedPutToBody(off_t offset, size_t len,
                           const boost::shared_ptr<std::iostream> &stream);
 
+  // Append bytes to the end of the page without checking.
+  // For internal use only.
+  bool UnguardedAppend(size_t len, const char *buffer, size_t capacity);
+
   // Refreseh the page's partial content without checking.
   // Starting from file offset, len of bytes will be updated.
   // For internal use only.
   bool UnguardedRefresh(off_t offset, size_t len, const char *buffer,
-                        const std::string &diskfile = std::string());
+                        const boost::shared_ptr<DiskFile> &diskfile =
+                            boost::shared_ptr<DiskFile>());
 
   // Refresh the page's partial content without checking.
   // Starting from file offset, all the page's remaining size will be updated.
@@ -211,6 +412,10 @@ class Page {
   // For internal use only.
   size_t UnguardedRead(off_t offset, size_t len, char *buffer);
 
+  // Clamp the range to the page
+  // Return false if the range does not intersect with the page.
+  bool UnguardedClampRange(off_t *offset, size_t *len) const;
+
   // Read the page's partial content without checking
   // Starting from file offset, all the page's remaining size will be read.
   // For internal use only.
@@ -244,6 +449,16 @@ struct PageCmp {
 typedef std::set<boost::shared_ptr<Page>, PageCmp> PageSet;
 typedef PageSet::const_iterator PageSetConstIterator;
 
+// Copy slices into buffer
+//
+// @param  : slices sorted by offset, offset, len, buffer
+// @return : size of bytes copied from slices
+//
+// Byte at file offset 'off' is put to buffer[off - offset], the holes not
+// covered by slices are filled with zero.
+size_t CopySlices(const ContentSliceDeque &slices, off_t offset, size_t len,
+                  char *buffer);
+
 std::string ToStringLine(const std::string &fileId, off_t offset, size_t len,
                          const char *buffer);
 std::string ToStringLine(off_t offset, size_t len, const char *buffer);
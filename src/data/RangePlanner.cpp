@@ -0,0 +1,83 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/RangePlanner.h"
+
+#include <utility>
+#include <vector>
+
+#include "boost/foreach.hpp"
+
+namespace QS {
+
+namespace Data {
+
+using std::vector;
+
+// --------------------------------------------------------------------------
+vector<RangeRequest> RangePlanner::Plan(const ContentRangeDeque &ranges) const {
+  vector<RangeRequest> requests;
+  BOOST_FOREACH (const ContentRangeDeque::value_type &range, ranges) {
+    off_t offset = range.first;
+    off_t stop = range.first + static_cast<off_t>(range.second);
+    while (offset < stop) {
+      off_t cut = stop;
+      bool merged = false;
+      if (!requests.empty()) {
+        RangeRequest &last = requests.back();
+        off_t lastStop = last.m_offset + static_cast<off_t>(last.m_size);
+        off_t limit = m_partSize > 0
+                          ? last.m_offset + static_cast<off_t>(m_partSize)
+                          : stop;
+        if (offset >= lastStop &&
+            static_cast<size_t>(offset - lastStop) <= m_maxGap &&
+            offset < limit) {
+          if (stop > limit) {
+            cut = NextBoundary(last.m_offset);  // no further than limit
+          }
+          if (cut > offset) {
+            last.m_size = static_cast<size_t>(cut - last.m_offset);
+            last.m_ranges.push_back(
+                std::make_pair(offset, static_cast<size_t>(cut - offset)));
+            merged = true;
+          }
+        }
+      }
+      if (!merged) {
+        // a range fitting in a request is not split even if it crosses a
+        // part boundary, which saves a request
+        cut = stop;
+        if (m_partSize > 0 && static_cast<size_t>(stop - offset) > m_partSize) {
+          cut = NextBoundary(offset);
+        }
+        RangeRequest request(offset, static_cast<size_t>(cut - offset));
+        request.m_ranges.push_back(std::make_pair(offset, request.m_size));
+        requests.push_back(request);
+      }
+      offset = cut;
+    }
+  }
+  return requests;
+}
+
+// --------------------------------------------------------------------------
+off_t RangePlanner::NextBoundary(off_t offset) const {
+  off_t partSize = static_cast<off_t>(m_partSize);
+  return (offset / partSize + 1) * partSize;
+}
+
+}  // namespace Data
+}  // namespace QS
@@ -0,0 +1,79 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_RANGEPLANNER_H_
+#define QSFS_DATA_RANGEPLANNER_H_
+
+#include <stddef.h>  // for size_t
+
+#include <sys/types.h>  // for off_t
+
+#include <vector>
+
+#include "data/Page.h"  // for ContentRangeDeque
+
+namespace QS {
+
+namespace Data {
+
+// A request to download, covering the wanted ranges and the gaps in between
+struct RangeRequest {
+  off_t m_offset;
+  size_t m_size;
+  ContentRangeDeque m_ranges;  // wanted ranges, sorted by start
+
+  RangeRequest(off_t offset, size_t size) : m_offset(offset), m_size(size) {}
+};
+
+// Planner of the requests to download the ranges of a file
+//
+// A range is followed by the next one in the same request if the gap
+// between them is no larger than the max gap, as the gap costs less to
+// download than the latency of another request. A request is no larger
+// than the part size, and a range which does not fit in a request is split
+// at part boundaries, so the following requests are aligned to parts.
+//
+// A part size of zero means no limit of the request size.
+class RangePlanner {
+ public:
+  RangePlanner(size_t partSize, size_t maxGap)
+      : m_partSize(partSize), m_maxGap(maxGap) {}
+
+  ~RangePlanner() {}
+
+ public:
+  // Plan the requests to download ranges
+  //
+  // @param  : ranges sorted by start without overlapping
+  // @return : requests sorted by offset
+  std::vector<RangeRequest> Plan(const ContentRangeDeque &ranges) const;
+
+  size_t GetPartSize() const { return m_partSize; }
+  size_t GetMaxGap() const { return m_maxGap; }
+
+ private:
+  // Offset of the part boundary after the offset
+  off_t NextBoundary(off_t offset) const;
+
+ private:
+  size_t m_partSize;
+  size_t m_maxGap;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_RANGEPLANNER_H_
@@ -0,0 +1,108 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include "data/Readahead.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using std::make_pair;
+using std::pair;
+using std::string;
+
+// --------------------------------------------------------------------------
+Readahead::Readahead(size_t minWindow, size_t maxWindow)
+    : m_minWindow(std::min(minWindow, maxWindow)), m_maxWindow(maxWindow) {}
+
+// --------------------------------------------------------------------------
+pair<off_t, size_t> Readahead::OnRead(const string &filePath, off_t offset,
+                                      size_t size, uint64_t fileSize) {
+  off_t stop = offset + static_cast<off_t>(size);
+  if (m_maxWindow == 0) {
+    return make_pair(stop, 0);
+  }
+
+  lock_guard<mutex> lock(m_mutex);
+  Stream &stream = m_streams[filePath];
+  // A read in the run of sequential reads or in the content read ahead is
+  // still sequential, as the reads of a file could be served by multiple
+  // threads out of order.
+  bool sequential =
+      stream.m_started
+          ? offset >= stream.m_runStart &&
+                offset <= std::max(stream.m_next, stream.m_aheadStop)
+          : offset == 0;
+  stream.m_started = true;
+  if (!sequential) {
+    // start a new run, the shrunk window is used once the run goes on
+    stream.m_window /= 2;
+    if (stream.m_window < m_minWindow) {
+      stream.m_window = 0;
+    }
+    stream.m_runStart = offset;
+    stream.m_next = stop;
+    stream.m_aheadStop = stop;
+    return make_pair(stop, 0);
+  }
+  stream.m_window = stream.m_window == 0
+                        ? m_minWindow
+                        : std::min(stream.m_window * 2, m_maxWindow);
+  stream.m_next = std::max(stream.m_next, stop);
+
+  off_t next = stream.m_next;
+  off_t aheadStart = std::max(next, stream.m_aheadStop);
+  off_t aheadStop = std::min(next + static_cast<off_t>(stream.m_window),
+                             static_cast<off_t>(fileSize));
+  if (stream.m_window == 0 || aheadStop <= aheadStart ||
+      aheadStart - next >= static_cast<off_t>(stream.m_window / 2)) {
+    return make_pair(aheadStart, 0);
+  }
+  stream.m_aheadStop = aheadStop;
+  return make_pair(aheadStart, static_cast<size_t>(aheadStop - aheadStart));
+}
+
+// --------------------------------------------------------------------------
+void Readahead::Erase(const string &filePath) {
+  lock_guard<mutex> lock(m_mutex);
+  m_streams.erase(filePath);
+}
+
+// --------------------------------------------------------------------------
+size_t Readahead::GetWindow(const string &filePath) const {
+  lock_guard<mutex> lock(m_mutex);
+  StreamMap::const_iterator it = m_streams.find(filePath);
+  return it != m_streams.end() ? it->second.m_window : 0;
+}
+
+// --------------------------------------------------------------------------
+size_t Readahead::GetNumFiles() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_streams.size();
+}
+
+}  // namespace Data
+}  // namespace QS
@@ -0,0 +1,106 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_DATA_READAHEAD_H_
+#define QSFS_DATA_READAHEAD_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+#include <sys/types.h>  // for off_t
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+// Readahead windows of the open files
+//
+// Each read of a file is checked against the previous one. A sequential read
+// doubles the window of the file up to the max window, starting from the min
+// window, while a random read halves it, and the window closes once it is
+// smaller than the min window. So a file read sequentially is downloaded
+// ahead of the reader, and a file read randomly is downloaded no more than
+// the reader asks for.
+//
+// The first read of a file is sequential if it starts at the beginning.
+// A max window of zero disables readahead.
+class Readahead : private boost::noncopyable {
+ public:
+  Readahead(size_t minWindow, size_t maxWindow);
+
+  ~Readahead() {}
+
+ public:
+  // Record a read of a file and return the range to read ahead
+  //
+  // @param  : file path, offset, size of the read, file size
+  // @return : a pair of {range start, range size}, size is zero if there is
+  //           nothing to read ahead
+  //
+  // Nothing is read ahead for a random read. The range starts after the
+  // content read ahead before, and it is returned only when the content ahead
+  // of the reader is less than half of the window, so the window is not asked
+  // again at every read.
+  std::pair<off_t, size_t> OnRead(const std::string &filePath, off_t offset,
+                                  size_t size, uint64_t fileSize);
+
+  // Forget a file, e.g. it is closed or deleted
+  void Erase(const std::string &filePath);
+
+  // Return the current window of a file
+  size_t GetWindow(const std::string &filePath) const;
+
+  size_t GetMinWindow() const { return m_minWindow; }
+  size_t GetMaxWindow() const { return m_maxWindow; }
+  size_t GetNumFiles() const;
+
+ private:
+  struct Stream {
+    off_t m_runStart;   // offset of the first read of sequential run
+    off_t m_next;       // offset after the sequential run
+    off_t m_aheadStop;  // offset after the content read ahead
+    size_t m_window;    // zero if the file is read randomly
+    bool m_started;     // whether the file is read before
+
+    Stream()
+        : m_runStart(0),
+          m_next(0),
+          m_aheadStop(0),
+          m_window(0),
+          m_started(false) {}
+  };
+  typedef std::map<std::string, Stream> StreamMap;
+
+ private:
+  size_t m_minWindow;
+  size_t m_maxWindow;
+
+  mutable boost::mutex m_mutex;
+  StreamMap m_streams;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_READAHEAD_H_
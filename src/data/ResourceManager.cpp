@@ -25,6 +25,8 @@
 #include "boost/thread/locks.hpp"
 
 #include "base/LogMacros.h"
+#include "data/MemoryBudget.h"
+#include "data/SlabAllocator.h"
 
 namespace QS {
 
@@ -36,6 +38,11 @@ using boost::mutex;
 using boost::unique_lock;
 using std::vector;
 
+// --------------------------------------------------------------------------
+ResourceManager::~ResourceManager() {
+  MemoryBudget::Instance().Subtract(MemoryUser::TransferBuffer, m_memoryUsage);
+}
+
 // --------------------------------------------------------------------------
 bool ResourceManager::ResourcesAvailable() {
   lock_guard<mutex> lock(m_queueLock);
@@ -46,6 +53,10 @@ bool ResourceManager::ResourcesAvailable() {
 void ResourceManager::PutResource(const Resource &resource) {
   if (resource) {
     m_resources.push_back(resource);
+    size_t size = SharedCountSize() + HeapSize(sizeof(ByteVector)) +
+                  SlabPool::Instance().GetChunkSize(resource->capacity());
+    m_memoryUsage += size;
+    MemoryBudget::Instance().Add(MemoryUser::TransferBuffer, size);
   }
 }
 
@@ -18,6 +18,7 @@
 #define QSFS_DATA_RESOURCEMANAGER_H_
 
 #include <stddef.h>  // for size_t
+#include <stdint.h>
 
 #include <vector>
 
@@ -26,6 +27,8 @@
 #include "boost/thread/condition_variable.hpp"
 #include "boost/thread/mutex.hpp"
 
+#include "data/StreamBuf.h"
+
 namespace QS {
 
 namespace Client {
@@ -37,7 +40,7 @@ struct ReceivedHandlerMultipleUpload;
 
 namespace Data {
 
-typedef boost::shared_ptr<std::vector<char> >Resource;
+typedef Buffer Resource;
 
 /**
  * Resouce manager with Acquire/Release semantics.
@@ -48,12 +51,15 @@ typedef boost::shared_ptr<std::vector<char> >Resource;
  * this will unblock the listening thread and give you a chance to
  * clean up the resouce if needed.
  * After calling ShutdownAndWait, you must not call Acquire any more.
+ *
+ * Memory of the resources put to the pool is reported to the global memory
+ * budget until the resource manager is destroyed.
  */
 class ResourceManager : private boost::noncopyable {
  public:
-  ResourceManager() : m_shutdown(false) {}
+  ResourceManager() : m_shutdown(false), m_memoryUsage(0) {}
 
-  ~ResourceManager() {}
+  ~ResourceManager();
 
  public:
   // Return whether or not resources are currently available for acquisition.
@@ -72,6 +78,9 @@ class ResourceManager : private boost::noncopyable {
   // @return : bool
   bool IsShutdown() const;
 
+  // Return memory of the resources put to the pool
+  uint64_t GetMemoryUsage() const { return m_memoryUsage; }
+
  private:
   // Put resouce to the pool
   //
@@ -128,6 +137,7 @@ class ResourceManager : private boost::noncopyable {
   boost::condition_variable m_semaphore;
   bool m_shutdown;
   mutable boost::mutex m_shutdownLock;
+  uint64_t m_memoryUsage;  // memory reported to memory budget
 
   friend class QS::Client::TransferManager;
   friend class QS::Client::QSTransferManager;
@@ -0,0 +1,327 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include "data/SlabAllocator.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>  // for strerror
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "boost/exception/to_string.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/once.hpp"
+
+#include "base/LogMacros.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::to_string;
+
+const size_t SlabPool::kSlabSize = 2 * 1024 * 1024;  // size of a huge page
+const size_t SlabPool::kMinChunkSize = 64;
+const size_t SlabPool::kMaxChunkSize = 512 * 1024;
+
+namespace {
+
+const size_t kClassesPerDoubling = 4;
+
+SlabPool *g_pool = NULL;
+boost::once_flag g_poolFlag = BOOST_ONCE_INIT;
+
+// --------------------------------------------------------------------------
+void InitPool() { g_pool = new SlabPool; }
+
+// --------------------------------------------------------------------------
+size_t RoundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+SlabPool::SlabPool()
+    : m_pageSize(static_cast<size_t>(sysconf(_SC_PAGESIZE))),
+      m_hugePages(false),
+      m_numSlabs(0),
+      m_mappedSize(0),
+      m_largeSize(0) {
+  for (size_t base = kMinChunkSize; base < kMaxChunkSize; base *= 2) {
+    size_t step = base / kClassesPerDoubling;
+    for (size_t i = 0; i < kClassesPerDoubling; ++i) {
+      m_classes.push_back(new SizeClass(base + i * step));
+    }
+  }
+  m_classes.push_back(new SizeClass(kMaxChunkSize));
+  for (size_t i = 0; i < m_classes.size(); ++i) {
+    m_classes[i]->m_numChunks = kSlabSize / m_classes[i]->m_chunkSize;
+  }
+}
+
+// --------------------------------------------------------------------------
+SlabPool::~SlabPool() {
+  for (size_t i = 0; i < m_classes.size(); ++i) {
+    SizeClass *sizeClass = m_classes[i];
+    for (SlabMap::iterator it = sizeClass->m_slabs.begin();
+         it != sizeClass->m_slabs.end(); ++it) {
+      Unmap(it->first, kSlabSize, true);
+    }
+    delete sizeClass;
+  }
+  m_classes.clear();
+}
+
+// --------------------------------------------------------------------------
+SlabPool &SlabPool::Instance() {
+  boost::call_once(g_poolFlag, InitPool);
+  return *g_pool;
+}
+
+// --------------------------------------------------------------------------
+void *SlabPool::Allocate(size_t size) {
+  if (size == 0) {
+    return NULL;
+  }
+
+  if (size > kMaxChunkSize) {
+    size_t len = RoundUp(size, m_pageSize);
+    char *ptr = Map(len, false);
+    if (ptr != NULL) {
+      lock_guard<mutex> lock(m_mutex);
+      m_largeSize += len;
+    }
+    return ptr;
+  }
+
+  SizeClass *sizeClass = m_classes[GetSizeClass(size)];
+  lock_guard<mutex> lock(sizeClass->m_mutex);
+  if (sizeClass->m_partial.empty()) {
+    char *base = Map(kSlabSize, true);
+    if (base == NULL) {
+      return NULL;
+    }
+    sizeClass->m_slabs[base] = Slab();
+    sizeClass->m_partial.insert(base);
+  }
+
+  char *base = *sizeClass->m_partial.begin();
+  Slab &slab = sizeClass->m_slabs[base];
+  if (base == sizeClass->m_spare) {
+    sizeClass->m_spare = NULL;
+  }
+  void *chunk = NULL;
+  if (slab.m_freeList != NULL) {
+    chunk = slab.m_freeList;
+    slab.m_freeList = *static_cast<void **>(chunk);
+  } else {
+    assert(slab.m_numCarved < sizeClass->m_numChunks);
+    chunk = base + slab.m_numCarved * sizeClass->m_chunkSize;
+    ++slab.m_numCarved;
+  }
+  ++slab.m_numUsed;
+  if (slab.m_numUsed == sizeClass->m_numChunks) {
+    sizeClass->m_partial.erase(base);
+  }
+  return chunk;
+}
+
+// --------------------------------------------------------------------------
+void SlabPool::Deallocate(void *ptr, size_t size) {
+  if (ptr == NULL || size == 0) {
+    return;
+  }
+
+  if (size > kMaxChunkSize) {
+    size_t len = RoundUp(size, m_pageSize);
+    Unmap(ptr, len, false);
+    lock_guard<mutex> lock(m_mutex);
+    assert(m_largeSize >= len);
+    m_largeSize -= len;
+    return;
+  }
+
+  SizeClass *sizeClass = m_classes[GetSizeClass(size)];
+  char *base = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(ptr) &
+                                        ~(kSlabSize - 1));
+  lock_guard<mutex> lock(sizeClass->m_mutex);
+  SlabMap::iterator it = sizeClass->m_slabs.find(base);
+  if (it == sizeClass->m_slabs.end()) {
+    DebugError("Free memory not allocated from slab of size " +
+               to_string(sizeClass->m_chunkSize));
+    return;
+  }
+  Slab &slab = it->second;
+  assert(slab.m_numUsed > 0);
+  *static_cast<void **>(ptr) = slab.m_freeList;
+  slab.m_freeList = ptr;
+  if (slab.m_numUsed == sizeClass->m_numChunks) {
+    sizeClass->m_partial.insert(base);
+  }
+  --slab.m_numUsed;
+  if (slab.m_numUsed == 0) {
+    UnguardedReleaseSlab(sizeClass, it);
+  }
+}
+
+// --------------------------------------------------------------------------
+size_t SlabPool::GetChunkSize(size_t size) const {
+  if (size == 0) {
+    return 0;
+  }
+  if (size > kMaxChunkSize) {
+    return RoundUp(size, m_pageSize);
+  }
+  return m_classes[GetSizeClass(size)]->m_chunkSize;
+}
+
+// --------------------------------------------------------------------------
+bool SlabPool::IsHugePages() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_hugePages;
+}
+
+// --------------------------------------------------------------------------
+void SlabPool::SetHugePages(bool hugePages) {
+#ifndef MADV_HUGEPAGE
+  DebugWarningIf(hugePages, "Huge pages not supported by the system");
+  hugePages = false;
+#endif
+  lock_guard<mutex> lock(m_mutex);
+  m_hugePages = hugePages;
+}
+
+// --------------------------------------------------------------------------
+size_t SlabPool::GetNumSlabs() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_numSlabs;
+}
+
+// --------------------------------------------------------------------------
+uint64_t SlabPool::GetMappedSize() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_mappedSize;
+}
+
+// --------------------------------------------------------------------------
+uint64_t SlabPool::GetAllocatedSize() const {
+  uint64_t size = 0;
+  for (size_t i = 0; i < m_classes.size(); ++i) {
+    SizeClass *sizeClass = m_classes[i];
+    lock_guard<mutex> lock(sizeClass->m_mutex);
+    for (SlabMap::const_iterator it = sizeClass->m_slabs.begin();
+         it != sizeClass->m_slabs.end(); ++it) {
+      size += it->second.m_numUsed * sizeClass->m_chunkSize;
+    }
+  }
+  lock_guard<mutex> lock(m_mutex);
+  return size + m_largeSize;
+}
+
+// --------------------------------------------------------------------------
+size_t SlabPool::GetSizeClass(size_t size) const {
+  assert(size <= kMaxChunkSize);
+  // classes are few, a binary search over the chunk sizes
+  size_t low = 0;
+  size_t high = m_classes.size() - 1;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (m_classes[mid]->m_chunkSize < size) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// --------------------------------------------------------------------------
+char *SlabPool::Map(size_t size, bool slab) {
+  // over map and trim both ends to align a slab to its size
+  size_t alignment = slab ? kSlabSize : m_pageSize;
+  size_t len = slab ? size + alignment : size;
+  void *ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    DebugError("Fail to map memory of size " + to_string(len) + " : " +
+               strerror(errno));
+    return NULL;
+  }
+  uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+  uintptr_t aligned = (start + alignment - 1) & ~(alignment - 1);
+  if (aligned > start) {
+    munmap(ptr, aligned - start);
+  }
+  if (start + len > aligned + size) {
+    munmap(reinterpret_cast<void *>(aligned + size),
+           start + len - (aligned + size));
+  }
+
+  lock_guard<mutex> lock(m_mutex);
+#ifdef MADV_HUGEPAGE
+  if (m_hugePages && size >= kSlabSize) {
+    madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+  }
+#endif
+  if (slab) {
+    ++m_numSlabs;
+  }
+  m_mappedSize += size;
+  return reinterpret_cast<char *>(aligned);
+}
+
+// --------------------------------------------------------------------------
+void SlabPool::Unmap(void *ptr, size_t size, bool slab) {
+  int ret = munmap(ptr, size);
+  DebugErrorIf(ret != 0, "Fail to unmap memory of size " + to_string(size) +
+                             " : " + strerror(errno));
+  lock_guard<mutex> lock(m_mutex);
+  if (slab) {
+    --m_numSlabs;
+  }
+  m_mappedSize -= size;
+}
+
+// --------------------------------------------------------------------------
+void SlabPool::UnguardedReleaseSlab(SizeClass *sizeClass,
+                                    SlabMap::iterator it) {
+  char *base = it->first;
+  if (sizeClass->m_spare != NULL && sizeClass->m_spare != base) {
+    sizeClass->m_partial.erase(base);
+    sizeClass->m_slabs.erase(it);
+    Unmap(base, kSlabSize, true);
+    return;
+  }
+  // keep the mapping but give back the touched pages
+  Slab &slab = it->second;
+  size_t touched =
+      RoundUp(slab.m_numCarved * sizeClass->m_chunkSize, m_pageSize);
+  madvise(base, std::min(touched, kSlabSize), MADV_DONTNEED);
+  slab.m_numCarved = 0;
+  slab.m_freeList = NULL;
+  sizeClass->m_spare = base;
+}
+
+}  // namespace Data
+}  // namespace QS
@@ -0,0 +1,217 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#ifndef QSFS_DATA_SLABALLOCATOR_H_
+#define QSFS_DATA_SLABALLOCATOR_H_
+
+#include <stddef.h>  // for size_t, ptrdiff_t
+#include <stdint.h>
+
+#include <map>
+#include <new>  // for bad_alloc, placement new
+#include <set>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+// Size-classed slab allocator for page payloads and stream objects
+//
+// Allocations up to kMaxChunkSize are rounded up to a size class, with four
+// classes between two powers of two, and carved from slabs of kSlabSize.
+// Each slab holds chunks of one size class only and is mapped from the
+// kernel aligned to its size, so the slab of a chunk is found by masking its
+// address. Chunks are handed out from the slab with the lowest address
+// first, which packs the live chunks into fewer slabs under churn. A slab is
+// unmapped as soon as all its chunks are freed, except one empty slab per
+// size class which is kept mapped with its pages released to the kernel, so
+// a class going back and forth around a slab boundary does not remap.
+//
+// Allocations larger than kMaxChunkSize get their own mapping and are
+// unmapped when freed.
+//
+// With huge pages, the slabs and large mappings are advised to be backed by
+// transparent huge pages, which takes effect for the mappings made after it
+// is set.
+class SlabPool : private boost::noncopyable {
+ public:
+  static const size_t kSlabSize;
+  static const size_t kMinChunkSize;
+  static const size_t kMaxChunkSize;
+
+ public:
+  SlabPool();
+
+  // Unmap all slabs, the chunks not freed are not accessible any more
+  ~SlabPool();
+
+  // Return the pool shared by page payloads and stream objects
+  //
+  // The pool is never destroyed, as buffers may be freed by the destructors
+  // of the other static objects at exit.
+  static SlabPool &Instance();
+
+ public:
+  // Allocate memory
+  //
+  // @param  : size in bytes
+  // @return : memory aligned to 16 bytes at least, NULL if size is zero or
+  //           fail to map memory
+  void *Allocate(size_t size);
+
+  // Free memory allocated by Allocate
+  //
+  // @param  : memory, size in bytes passed to Allocate
+  // @return : void
+  void Deallocate(void *ptr, size_t size);
+
+  // Return size in bytes reserved for an allocation of the given size
+  size_t GetChunkSize(size_t size) const;
+
+  // Whether to advise new mappings to be backed by huge pages
+  bool IsHugePages() const;
+  void SetHugePages(bool hugePages);
+
+  // Return count of the slabs mapped
+  size_t GetNumSlabs() const;
+
+  // Return bytes mapped by slabs and large allocations
+  uint64_t GetMappedSize() const;
+
+  // Return bytes reserved for the allocations not freed
+  uint64_t GetAllocatedSize() const;
+
+ private:
+  struct Slab {
+    size_t m_numUsed;    // chunks allocated
+    size_t m_numCarved;  // chunks ever handed out, the rest are untouched
+    void *m_freeList;    // chunks freed, linked through their first word
+
+    Slab() : m_numUsed(0), m_numCarved(0), m_freeList(NULL) {}
+  };
+
+  typedef std::map<char *, Slab> SlabMap;
+
+  struct SizeClass {
+    boost::mutex m_mutex;
+    size_t m_chunkSize;
+    size_t m_numChunks;          // chunks per slab
+    SlabMap m_slabs;             // by base address
+    std::set<char *> m_partial;  // slabs with free chunks, lowest first
+    char *m_spare;               // the empty slab kept mapped, NULL if none
+
+    explicit SizeClass(size_t chunkSize)
+        : m_chunkSize(chunkSize),
+          m_numChunks(0),
+          m_spare(NULL) {}
+  };
+
+  // Return index of size class holding the size
+  size_t GetSizeClass(size_t size) const;
+
+  // Map memory of size, aligned to kSlabSize if it is a slab
+  //
+  // @param  : size in bytes, whether it is a slab
+  // @return : memory mapped, NULL if fail
+  char *Map(size_t size, bool slab);
+  void Unmap(void *ptr, size_t size, bool slab);
+
+  // Release pages of an empty slab and make it the spare of its class, or
+  // unmap it if the class has a spare already
+  void UnguardedReleaseSlab(SizeClass *sizeClass, SlabMap::iterator it);
+
+ private:
+  std::vector<SizeClass *> m_classes;  // by chunk size ascending
+  size_t m_pageSize;
+
+  mutable boost::mutex m_mutex;  // guard the following
+  bool m_hugePages;
+  size_t m_numSlabs;
+  uint64_t m_mappedSize;
+  uint64_t m_largeSize;  // bytes allocated by large allocations
+};
+
+// STL allocator over the shared slab pool
+template <typename T>
+class SlabAllocator {
+ public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind {
+    typedef SlabAllocator<U> other;
+  };
+
+  SlabAllocator() throw() {}
+  SlabAllocator(const SlabAllocator &) throw() {}
+  template <typename U>
+  SlabAllocator(const SlabAllocator<U> &) throw() {}
+  ~SlabAllocator() throw() {}
+
+  pointer address(reference x) const { return &x; }
+  const_pointer address(const_reference x) const { return &x; }
+
+  pointer allocate(size_type n, const void * = 0) {
+    if (n == 0) {
+      return NULL;
+    }
+    if (n > max_size()) {
+      throw std::bad_alloc();
+    }
+    void *p = SlabPool::Instance().Allocate(n * sizeof(T));
+    if (p == NULL) {
+      throw std::bad_alloc();
+    }
+    return static_cast<pointer>(p);
+  }
+
+  void deallocate(pointer p, size_type n) {
+    SlabPool::Instance().Deallocate(p, n * sizeof(T));
+  }
+
+  size_type max_size() const throw() { return size_t(-1) / sizeof(T); }
+
+  void construct(pointer p, const T &val) {
+    new (static_cast<void *>(p)) T(val);
+  }
+  void destroy(pointer p) { p->~T(); }
+};
+
+template <typename T, typename U>
+inline bool operator==(const SlabAllocator<T> &, const SlabAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const SlabAllocator<T> &, const SlabAllocator<U> &) {
+  return false;
+}
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_SLABALLOCATOR_H_
@@ -25,6 +25,8 @@
 #include "boost/noncopyable.hpp"
 #include "boost/shared_ptr.hpp"
 
+#include "data/SlabAllocator.h"
+
 namespace QS {
 
 namespace Client {
@@ -38,7 +40,9 @@ namespace Data {
 
 class IOSTream;
 
-typedef boost::shared_ptr<std::vector<char> >Buffer;
+// Bytes allocated from the slab pool
+typedef std::vector<char, SlabAllocator<char> > ByteVector;
+typedef boost::shared_ptr<ByteVector> Buffer;
 
 /**
  * A stream buf to use with std::iostream
@@ -0,0 +1,197 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/StreamUploads.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::unique_lock;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+// --------------------------------------------------------------------------
+StreamUploads::StreamUploads(size_t partSize) : m_partSize(partSize) {}
+
+// --------------------------------------------------------------------------
+bool StreamUploads::OnWrite(const string &filePath, off_t offset, size_t size,
+                            uint64_t fileSize) {
+  if (m_partSize == 0 || size == 0) {
+    return false;
+  }
+
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end()) {
+    if (offset != 0 || fileSize != 0) {
+      return false;  // not written from the beginning
+    }
+    it = m_entries.insert(make_pair(filePath, Entry())).first;
+  }
+
+  Entry &entry = it->second;
+  if (!entry.m_valid || entry.m_closing) {
+    return false;
+  }
+  // the part in flight is read from cache meanwhile, it is changed as well
+  uint64_t popped = entry.m_uploaded + (entry.m_uploading ? m_partSize : 0);
+  if (static_cast<uint64_t>(offset) < popped) {
+    entry.m_valid = false;
+    return false;
+  }
+  AddContentRange(&entry.m_written, offset, size);
+  if (!entry.m_running && UnguardedIsPartReady(entry)) {
+    entry.m_running = true;
+    return true;
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------
+void StreamUploads::OnTruncate(const string &filePath, uint64_t newSize) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end()) {
+    return;
+  }
+  Entry &entry = it->second;
+  uint64_t popped = entry.m_uploaded + (entry.m_uploading ? m_partSize : 0);
+  if (newSize < popped) {
+    entry.m_valid = false;
+  } else if (!entry.m_written.empty()) {
+    const ContentRangeDeque::value_type &last = entry.m_written.back();
+    uint64_t stop = last.first + last.second;
+    if (stop > newSize) {
+      RemoveContentRange(&entry.m_written, newSize,
+                         static_cast<size_t>(stop - newSize));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+uint16_t StreamUploads::PopPart(const string &filePath,
+                                pair<off_t, size_t> *range, string *uploadId) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end()) {
+    return 0;
+  }
+  Entry &entry = it->second;
+  if (!entry.m_valid || entry.m_closing || !UnguardedIsPartReady(entry)) {
+    entry.m_running = false;
+    m_uploaderCond.notify_all();
+    return 0;
+  }
+  entry.m_uploading = true;
+  *range = make_pair(static_cast<off_t>(entry.m_uploaded), m_partSize);
+  *uploadId = entry.m_uploadId;
+  return static_cast<uint16_t>(entry.m_uploaded / m_partSize + 1);
+}
+
+// --------------------------------------------------------------------------
+void StreamUploads::SetUploadId(const string &filePath,
+                                const string &uploadId) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it != m_entries.end()) {
+    it->second.m_uploadId = uploadId;
+  }
+}
+
+// --------------------------------------------------------------------------
+void StreamUploads::FinishPart(const string &filePath, bool success) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end() || !it->second.m_uploading) {
+    return;
+  }
+  Entry &entry = it->second;
+  entry.m_uploading = false;
+  if (success) {
+    entry.m_uploaded += m_partSize;
+  } else {
+    entry.m_valid = false;
+  }
+}
+
+// --------------------------------------------------------------------------
+bool StreamUploads::Take(const string &filePath, StreamedUpload *upload) {
+  unique_lock<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end()) {
+    return false;
+  }
+  it->second.m_closing = true;
+  while (it->second.m_running) {
+    m_uploaderCond.wait(lock);
+    it = m_entries.find(filePath);
+    if (it == m_entries.end()) {
+      return false;  // taken by others meanwhile
+    }
+  }
+  upload->m_uploadId = it->second.m_uploadId;
+  upload->m_size = it->second.m_uploaded;
+  upload->m_valid = it->second.m_valid;
+  m_entries.erase(it);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+vector<string> StreamUploads::GetFilePaths() const {
+  lock_guard<mutex> lock(m_mutex);
+  vector<string> filePaths;
+  for (EntryMap::const_iterator it = m_entries.begin(); it != m_entries.end();
+       ++it) {
+    filePaths.push_back(it->first);
+  }
+  return filePaths;
+}
+
+// --------------------------------------------------------------------------
+bool StreamUploads::HasFile(const string &filePath) const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_entries.find(filePath) != m_entries.end();
+}
+
+// --------------------------------------------------------------------------
+size_t StreamUploads::GetNumFiles() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_entries.size();
+}
+
+// --------------------------------------------------------------------------
+bool StreamUploads::UnguardedIsPartReady(const Entry &entry) const {
+  if (entry.m_uploading || entry.m_written.empty() ||
+      entry.m_written.front().first != 0) {
+    return false;
+  }
+  return entry.m_written.front().second >= entry.m_uploaded + m_partSize;
+}
+
+}  // namespace Data
+}  // namespace QS
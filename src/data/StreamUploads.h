@@ -0,0 +1,145 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_STREAMUPLOADS_H_
+#define QSFS_DATA_STREAMUPLOADS_H_
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>
+
+#include <sys/types.h>  // for off_t
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+
+#include "data/Page.h"  // for ContentRangeDeque
+
+namespace QS {
+
+namespace Data {
+
+// Multipart upload of a file started while the file is written
+struct StreamedUpload {
+  StreamedUpload() : m_size(0), m_valid(false) {}
+
+  std::string m_uploadId;  // empty if not initiated
+  uint64_t m_size;         // size of the leading parts uploaded
+  bool m_valid;            // false if the uploaded parts are changed since
+};
+
+// Files uploaded while they are written
+//
+// A file is tracked once it is written at offset zero while it is empty, e.g.
+// it is created or truncated. Whenever the writes complete the next part from
+// the beginning of the file, the part is handed to the uploader of the file,
+// which uploads the parts one by one into a multipart upload of the file.
+// When the file is uploaded at last, only the parts after the uploaded ones
+// are sent.
+//
+// A write or truncation touching the uploaded parts invalidates the upload,
+// whose multipart upload should be aborted then.
+class StreamUploads : private boost::noncopyable {
+ public:
+  explicit StreamUploads(size_t partSize);
+
+  ~StreamUploads() {}
+
+ public:
+  // Record a write of a file
+  //
+  // @param  : file path, offset, size of the write, file size before write
+  // @return : true if a part is ready and no uploader runs for the file, the
+  //           caller should start the uploader then
+  bool OnWrite(const std::string &filePath, off_t offset, size_t size,
+               uint64_t fileSize);
+
+  // Record a truncation of a file
+  void OnTruncate(const std::string &filePath, uint64_t newSize);
+
+  // Pop the next part to upload, for the uploader of a file
+  //
+  // @param  : file path, part range to fill, upload id to fill
+  // @return : part id, zero if no part is ready and the uploader should exit
+  //
+  // The upload id is empty for the first part, the uploader initiates the
+  // multipart upload then and sets its id.
+  uint16_t PopPart(const std::string &filePath, std::pair<off_t, size_t> *range,
+                   std::string *uploadId);
+
+  // Set the id of the multipart upload of a file
+  void SetUploadId(const std::string &filePath, const std::string &uploadId);
+
+  // Report the end of the upload of the part popped before
+  //
+  // @param  : file path, whether the part is uploaded
+  // @return : void
+  //
+  // A failed part invalidates the upload.
+  void FinishPart(const std::string &filePath, bool success);
+
+  // Stop tracking a file and return its upload
+  //
+  // @param  : file path, upload to fill
+  // @return : false if the file is not tracked
+  //
+  // Block until the part in flight is finished.
+  bool Take(const std::string &filePath, StreamedUpload *upload);
+
+  std::vector<std::string> GetFilePaths() const;
+  bool HasFile(const std::string &filePath) const;
+  size_t GetNumFiles() const;
+  size_t GetPartSize() const { return m_partSize; }
+
+ private:
+  struct Entry {
+    std::string m_uploadId;
+    ContentRangeDeque m_written;  // ranges written since tracked
+    uint64_t m_uploaded;          // size of the leading parts uploaded
+    bool m_valid;
+    bool m_uploading;  // a part is in flight
+    bool m_running;    // the uploader is started
+    bool m_closing;    // being taken
+
+    Entry()
+        : m_uploaded(0),
+          m_valid(true),
+          m_uploading(false),
+          m_running(false),
+          m_closing(false) {}
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  // Whether the next part is written and could be popped
+  bool UnguardedIsPartReady(const Entry &entry) const;
+
+ private:
+  size_t m_partSize;
+
+  mutable boost::mutex m_mutex;
+  boost::condition_variable m_uploaderCond;  // wake up the takers
+  EntryMap m_entries;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_STREAMUPLOADS_H_
@@ -0,0 +1,110 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/WarmUpManifest.h"
+
+#include <stdlib.h>  // for strtol
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "base/LogMacros.h"
+#include "base/StringUtils.h"
+
+namespace QS {
+
+namespace Data {
+
+using QS::StringUtils::FormatPath;
+using std::ifstream;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char *const kBlanks = " \t\r";
+
+// Order entries by priority, higher first
+bool HigherPriority(const WarmUpEntry &a, const WarmUpEntry &b) {
+  return a.m_priority > b.m_priority;
+}
+
+}  // namespace
+
+// --------------------------------------------------------------------------
+bool WarmUpManifest::Load(const string &manifestFile) {
+  ifstream file(manifestFile.c_str());
+  if (!file.is_open()) {
+    DebugWarning("Fail to open warm-up manifest " + FormatPath(manifestFile));
+    return false;
+  }
+
+  vector<WarmUpEntry> entries;
+  string line;
+  while (std::getline(file, line)) {
+    WarmUpEntry entry;
+    if (ParseLine(line, &entry)) {
+      entries.push_back(entry);
+    }
+  }
+  std::stable_sort(entries.begin(), entries.end(), HigherPriority);
+  m_entries.swap(entries);
+  return true;
+}
+
+// --------------------------------------------------------------------------
+bool WarmUpManifest::ParseLine(const string &line, WarmUpEntry *entry) {
+  size_t pos = line.find_first_not_of(kBlanks);
+  if (pos == string::npos || line[pos] == '#') {
+    return false;
+  }
+
+  bool hasPin = false;
+  bool hasPriority = false;
+  WarmUpEntry parsed;
+  // leading words until the path, which may contain blanks
+  while (pos != string::npos && line[pos] != '/') {
+    size_t end = line.find_first_of(kBlanks, pos);
+    string word = line.substr(pos, end == string::npos ? end : end - pos);
+    char *wordEnd = NULL;
+    long priority = strtol(word.c_str(), &wordEnd, 10);  // NOLINT
+    if (word == "pin" && !hasPin) {
+      parsed.m_pin = true;
+      hasPin = true;
+    } else if (*wordEnd == '\0' && !hasPriority) {
+      parsed.m_priority = static_cast<int>(priority);
+      hasPriority = true;
+    } else {
+      DebugWarning("Skip invalid warm-up manifest line [" + line + "]");
+      return false;
+    }
+    pos = end == string::npos ? end : line.find_first_not_of(kBlanks, end);
+  }
+  if (pos == string::npos) {
+    DebugWarning("Skip warm-up manifest line without path [" + line + "]");
+    return false;
+  }
+
+  size_t last = line.find_last_not_of(kBlanks);
+  parsed.m_path = line.substr(pos, last - pos + 1);
+  *entry = parsed;
+  return true;
+}
+
+}  // namespace Data
+}  // namespace QS
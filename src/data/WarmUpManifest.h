@@ -0,0 +1,88 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_WARMUPMANIFEST_H_
+#define QSFS_DATA_WARMUPMANIFEST_H_
+
+#include <string>
+#include <vector>
+
+namespace QS {
+
+namespace Data {
+
+// Entry of a warm-up manifest
+struct WarmUpEntry {
+  WarmUpEntry() : m_priority(0), m_pin(false) {}
+  WarmUpEntry(const std::string &path, int priority, bool pin)
+      : m_path(path), m_priority(priority), m_pin(pin) {}
+
+  // Whether the entry is a directory whose files are all warmed up
+  bool IsPrefix() const {
+    return !m_path.empty() && m_path[m_path.size() - 1] == '/';
+  }
+
+  std::string m_path;  // file path, or directory path ending with '/'
+  int m_priority;      // entries of higher priority are warmed up first
+  bool m_pin;          // pin the files in cache
+};
+
+// Manifest of the files to download into cache at mount
+//
+// Each line of the manifest file is a path, which could be preceded by the
+// word 'pin' and a priority separated by blanks, e.g.
+//   pin 10 /models/
+//   5 /data/train/
+//   /config.json
+// A path ending with '/' is a prefix, all the files under it are warmed up.
+// Empty lines and lines starting with '#' are ignored.
+class WarmUpManifest {
+ public:
+  WarmUpManifest() {}
+
+  ~WarmUpManifest() {}
+
+ public:
+  // Load entries from manifest file
+  //
+  // @param  : manifest file path
+  // @return : bool
+  //
+  // Invalid lines are skipped with a warning, the existing entries are
+  // replaced.
+  bool Load(const std::string &manifestFile);
+
+  // Parse a line of manifest
+  //
+  // @param  : line, entry to fill
+  // @return : false if the line is invalid or has no entry
+  static bool ParseLine(const std::string &line, WarmUpEntry *entry);
+
+  // Return the entries, higher priority first and in file order for the
+  // same priority
+  const std::vector<WarmUpEntry> &GetEntries() const { return m_entries; }
+
+  bool Empty() const { return m_entries.empty(); }
+  size_t Size() const { return m_entries.size(); }
+
+ private:
+  std::vector<WarmUpEntry> m_entries;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_WARMUPMANIFEST_H_
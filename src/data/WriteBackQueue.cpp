@@ -0,0 +1,330 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include "data/WriteBackQueue.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time_types.hpp"
+#include "boost/thread/locks.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+using boost::lock_guard;
+using boost::mutex;
+using boost::unique_lock;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+// --------------------------------------------------------------------------
+WriteBackQueue::WriteBackQueue(uint64_t lowMark, uint64_t highMark,
+                               uint64_t hardLimit, time_t expireSecs)
+    : m_lowMark(lowMark),
+      m_highMark(highMark),
+      m_hardLimit(hardLimit),
+      m_expireSecs(expireSecs),
+      m_dirtySize(0),
+      m_stopped(false) {}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::MarkDirty(const string &filePath, uint64_t dirtySize,
+                               time_t now) {
+  lock_guard<mutex> lock(m_mutex);
+  pair<EntryMap::iterator, bool> res =
+      m_entries.insert(make_pair(filePath, Entry()));
+  Entry &entry = res.first->second;
+  if (res.second) {
+    entry.m_since = now;
+  }
+  if (entry.m_flushing) {
+    entry.m_redirtied = true;
+  }
+  UnguardedSetDirtySize(&entry, dirtySize);
+  if (UnguardedNeedFlush()) {
+    m_flushCond.notify_one();
+  }
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::Expedite(const string &filePath) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it != m_entries.end()) {
+    it->second.m_expedite = true;
+    m_flushCond.notify_one();
+  }
+}
+
+// --------------------------------------------------------------------------
+vector<string> WriteBackQueue::PopFilesToFlush(time_t now) {
+  lock_guard<mutex> lock(m_mutex);
+  vector<pair<time_t, string> > popped;
+  vector<pair<time_t, string> > candidates;
+  // bytes to be dirty after the files in flushing and the popped files are
+  // uploaded
+  uint64_t remaining = m_dirtySize;
+  for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end();
+       ++it) {
+    const Entry &entry = it->second;
+    if (entry.m_flushing) {
+      remaining -= entry.m_dirtySize;
+    } else if (entry.m_held) {
+      continue;
+    } else if (entry.m_expedite || now - entry.m_since >= m_expireSecs) {
+      remaining -= entry.m_dirtySize;
+      popped.push_back(make_pair(entry.m_since, it->first));
+    } else {
+      candidates.push_back(make_pair(entry.m_since, it->first));
+    }
+  }
+
+  if (m_highMark > 0 && m_dirtySize >= m_highMark) {
+    std::sort(candidates.begin(), candidates.end());
+    for (vector<pair<time_t, string> >::iterator it = candidates.begin();
+         it != candidates.end() && remaining > m_lowMark; ++it) {
+      remaining -= m_entries[it->second].m_dirtySize;
+      popped.push_back(*it);
+    }
+  }
+
+  return UnguardedPop(&popped);
+}
+
+// --------------------------------------------------------------------------
+vector<string> WriteBackQueue::PopAllFiles() {
+  lock_guard<mutex> lock(m_mutex);
+  vector<pair<time_t, string> > popped;
+  for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end();
+       ++it) {
+    if (!(it->second.m_flushing || it->second.m_held)) {
+      popped.push_back(make_pair(it->second.m_since, it->first));
+    }
+  }
+  return UnguardedPop(&popped);
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::FinishFlush(const string &filePath, uint64_t dirtySize,
+                                 time_t now) {
+  lock_guard<mutex> lock(m_mutex);
+  m_flushDoneCond.notify_all();
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end()) {
+    return true;  // removed or renamed during the upload
+  }
+
+  Entry &entry = it->second;
+  if (dirtySize == 0 && !entry.m_redirtied) {
+    UnguardedErase(it);
+    return true;
+  }
+  // queue again for the bytes written during the upload or not uploaded
+  entry.m_since = now;
+  entry.m_flushing = false;
+  entry.m_redirtied = false;
+  UnguardedSetDirtySize(&entry, dirtySize);
+  return false;
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::Erase(const string &filePath) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it != m_entries.end()) {
+    UnguardedErase(it);
+    m_flushDoneCond.notify_all();
+  }
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::Rename(const string &filePath,
+                            const string &newFilePath) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it == m_entries.end() || filePath == newFilePath) {
+    return;
+  }
+  EntryMap::iterator target = m_entries.find(newFilePath);
+  if (target != m_entries.end()) {
+    UnguardedErase(target);  // overwritten by the renamed file
+  }
+  Entry entry = it->second;
+  // an upload in flight goes to the old path unless the file is held before
+  // the rename, flush again with the new path anyway
+  entry.m_flushing = false;
+  entry.m_redirtied = false;
+  entry.m_held = false;
+  m_entries.erase(it);
+  m_entries[newFilePath] = entry;
+  m_flushDoneCond.notify_all();
+  if (UnguardedNeedFlush()) {
+    m_flushCond.notify_one();
+  }
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::Hold(const string &filePath) {
+  unique_lock<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  while (!m_stopped && it != m_entries.end() && it->second.m_flushing) {
+    m_flushDoneCond.wait(lock);
+    it = m_entries.find(filePath);
+  }
+  if (it != m_entries.end()) {
+    it->second.m_held = true;
+  }
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::Unhold(const string &filePath) {
+  lock_guard<mutex> lock(m_mutex);
+  EntryMap::iterator it = m_entries.find(filePath);
+  if (it != m_entries.end() && it->second.m_held) {
+    it->second.m_held = false;
+    if (UnguardedNeedFlush()) {
+      m_flushCond.notify_one();
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::WaitForSpace() {
+  unique_lock<mutex> lock(m_mutex);
+  while (!m_stopped && UnguardedIsOverHardLimit()) {
+    m_flushCond.notify_one();
+    m_spaceCond.wait(lock);
+  }
+  return !m_stopped;
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::WaitForFlush(unsigned timeoutMs) {
+  unique_lock<mutex> lock(m_mutex);
+  if (!m_stopped && !UnguardedNeedFlush()) {
+    m_flushCond.timed_wait(lock, boost::posix_time::milliseconds(timeoutMs));
+  }
+  return !m_stopped;
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::Stop() {
+  lock_guard<mutex> lock(m_mutex);
+  m_stopped = true;
+  m_flushCond.notify_all();
+  m_spaceCond.notify_all();
+  m_flushDoneCond.notify_all();
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::IsStopped() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_stopped;
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::HasFile(const string &filePath) const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_entries.find(filePath) != m_entries.end();
+}
+
+// --------------------------------------------------------------------------
+vector<string> WriteBackQueue::GetFilePaths() const {
+  lock_guard<mutex> lock(m_mutex);
+  vector<string> filePaths;
+  for (EntryMap::const_iterator it = m_entries.begin(); it != m_entries.end();
+       ++it) {
+    filePaths.push_back(it->first);
+  }
+  return filePaths;
+}
+
+// --------------------------------------------------------------------------
+size_t WriteBackQueue::GetNumFiles() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_entries.size();
+}
+
+// --------------------------------------------------------------------------
+uint64_t WriteBackQueue::GetDirtySize() const {
+  lock_guard<mutex> lock(m_mutex);
+  return m_dirtySize;
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::UnguardedSetDirtySize(Entry *entry, uint64_t dirtySize) {
+  assert(m_dirtySize >= entry->m_dirtySize);
+  m_dirtySize = m_dirtySize - entry->m_dirtySize + dirtySize;
+  if (dirtySize < entry->m_dirtySize) {
+    m_spaceCond.notify_all();
+  }
+  entry->m_dirtySize = dirtySize;
+}
+
+// --------------------------------------------------------------------------
+void WriteBackQueue::UnguardedErase(EntryMap::iterator it) {
+  UnguardedSetDirtySize(&it->second, 0);
+  m_entries.erase(it);
+}
+
+// --------------------------------------------------------------------------
+vector<string> WriteBackQueue::UnguardedPop(
+    vector<pair<time_t, string> > *files) {
+  std::sort(files->begin(), files->end());
+  vector<string> filePaths;
+  for (vector<pair<time_t, string> >::iterator it = files->begin();
+       it != files->end(); ++it) {
+    Entry &entry = m_entries[it->second];
+    entry.m_flushing = true;
+    entry.m_redirtied = false;
+    entry.m_expedite = false;
+    filePaths.push_back(it->second);
+  }
+  return filePaths;
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::UnguardedNeedFlush() const {
+  // files in flushing are not counted, or the flusher wakes up again and
+  // again until their uploads finish
+  bool overHighMark = m_highMark > 0 && m_dirtySize >= m_highMark;
+  for (EntryMap::const_iterator it = m_entries.begin(); it != m_entries.end();
+       ++it) {
+    const Entry &entry = it->second;
+    if (!entry.m_flushing && !entry.m_held &&
+        (entry.m_expedite || (overHighMark && entry.m_dirtySize > 0))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// --------------------------------------------------------------------------
+bool WriteBackQueue::UnguardedIsOverHardLimit() const {
+  return m_hardLimit > 0 && m_dirtySize >= m_hardLimit;
+}
+
+}  // namespace Data
+}  // namespace QS
@@ -0,0 +1,167 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#ifndef QSFS_DATA_WRITEBACKQUEUE_H_
+#define QSFS_DATA_WRITEBACKQUEUE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/noncopyable.hpp"
+#include "boost/thread/condition_variable.hpp"
+#include "boost/thread/mutex.hpp"
+
+namespace QS {
+
+namespace Data {
+
+// Files written but not uploaded yet in write-back mode
+//
+// The queue only does the bookkeeping, a flusher thread pops the files to
+// upload and reports back when the uploads finish. A file is popped when
+// - it is dirty for longer than the expire time, or
+// - the dirty bytes of all files reach the high watermark, in which case the
+//   oldest files are popped until the rest are under the low watermark.
+// Writers wait while the dirty bytes are over the hard limit.
+//
+// Watermarks of zero mean no limit.
+class WriteBackQueue : private boost::noncopyable {
+ public:
+  WriteBackQueue(uint64_t lowMark, uint64_t highMark, uint64_t hardLimit,
+                 time_t expireSecs);
+
+  ~WriteBackQueue() {}
+
+ public:
+  // Mark a file need to be uploaded
+  //
+  // @param  : file path, size of dirty ranges of the file, current time
+  // @return : void
+  //
+  // The file is queued even if dirty size is zero, e.g. it is truncated.
+  void MarkDirty(const std::string &filePath, uint64_t dirtySize, time_t now);
+
+  // Flush the file at the next round regardless of its age
+  void Expedite(const std::string &filePath);
+
+  // Pop the files to upload, which are marked as flushing
+  //
+  // @param  : current time
+  // @return : file paths, oldest first
+  std::vector<std::string> PopFilesToFlush(time_t now);
+
+  // Pop all the files not in flushing
+  std::vector<std::string> PopAllFiles();
+
+  // Finish the upload of a file popped before
+  //
+  // @param  : file path, size of dirty ranges left, current time
+  // @return : true if the file is clean and removed from the queue
+  //
+  // The file is queued again if it is written during the upload or the
+  // upload fails.
+  bool FinishFlush(const std::string &filePath, uint64_t dirtySize,
+                   time_t now);
+
+  // Remove a file, e.g. it is deleted
+  void Erase(const std::string &filePath);
+
+  // Rename a file, which is released if it is held
+  void Rename(const std::string &filePath, const std::string &newFilePath);
+
+  // Keep a file from flushing, e.g. it is being renamed
+  //
+  // @param  : file path
+  // @return : void
+  //
+  // Block until the upload of the file in flight finishes, or it would
+  // recreate the object at the old path after the object is moved.
+  void Hold(const std::string &filePath);
+
+  // Let a file held before flush again, e.g. it fails to rename
+  void Unhold(const std::string &filePath);
+
+  // Block while the dirty bytes are over the hard limit
+  //
+  // @param  : void
+  // @return : false if the queue is stopped
+  bool WaitForSpace();
+
+  // Block until there are files to flush or timeout
+  //
+  // @param  : timeout in milliseconds
+  // @return : false if the queue is stopped
+  bool WaitForFlush(unsigned timeoutMs);
+
+  // Wake up all waiters, which return immediately from now on
+  void Stop();
+
+  bool IsStopped() const;
+  bool HasFile(const std::string &filePath) const;
+  std::vector<std::string> GetFilePaths() const;
+  size_t GetNumFiles() const;
+  uint64_t GetDirtySize() const;
+
+ private:
+  struct Entry {
+    uint64_t m_dirtySize;
+    time_t m_since;  // time when the file gets dirty
+    bool m_flushing;
+    bool m_redirtied;  // marked dirty again while flushing
+    bool m_expedite;
+    bool m_held;  // not to flush
+
+    Entry()
+        : m_dirtySize(0),
+          m_since(0),
+          m_flushing(false),
+          m_redirtied(false),
+          m_expedite(false),
+          m_held(false) {}
+  };
+  typedef std::map<std::string, Entry> EntryMap;
+
+  void UnguardedSetDirtySize(Entry *entry, uint64_t dirtySize);
+  void UnguardedErase(EntryMap::iterator it);
+  std::vector<std::string> UnguardedPop(
+      std::vector<std::pair<time_t, std::string> > *files);
+  bool UnguardedNeedFlush() const;
+  bool UnguardedIsOverHardLimit() const;
+
+ private:
+  uint64_t m_lowMark;
+  uint64_t m_highMark;
+  uint64_t m_hardLimit;
+  time_t m_expireSecs;
+
+  mutable boost::mutex m_mutex;
+  boost::condition_variable m_flushCond;  // wake up flusher
+  boost::condition_variable m_spaceCond;  // wake up writers
+  boost::condition_variable m_flushDoneCond;  // wake up holders
+  EntryMap m_entries;
+  uint64_t m_dirtySize;  // total dirty bytes of the files
+  bool m_stopped;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+#endif  // QSFS_DATA_WRITEBACKQUEUE_H_
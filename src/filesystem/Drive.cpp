@@ -23,7 +23,11 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <deque>
+#include <iostream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -55,11 +59,19 @@
 #include "configure/Default.h"
 #include "configure/Options.h"
 #include "data/Cache.h"
+#include "data/CachePolicy.h"
 #include "data/DirectoryTree.h"
+#include "data/DiskCacheIndex.h"
 #include "data/FileMetaData.h"
 #include "data/FileMetaDataManager.h"
+#include "data/InFlightRanges.h"
 #include "data/IOStream.h"
+#include "data/MemoryBudget.h"
 #include "data/Node.h"
+#include "data/Readahead.h"
+#include "data/SlabAllocator.h"
+#include "data/StreamUploads.h"
+#include "data/WarmUpManifest.h"
 
 namespace QS {
 
@@ -84,30 +96,84 @@ using QS::Data::Cache;
 using QS::Data::ContentRangeDeque;
 using QS::Data::ChildrenMultiMapConstIterator;
 using QS::Data::DirectoryTree;
+using QS::Data::DiskCacheRecord;
 using QS::Data::Entry;
+using QS::Data::File;
 using QS::Data::FileMetaData;
 using QS::Data::FileType;
 using QS::Data::FilePathToNodeUnorderedMap;
+using QS::Data::GetCachePolicyByName;
+using QS::Data::GetCachePolicyName;
+using QS::Data::InFlightRanges;
 using QS::Data::IOStream;
+using QS::Data::Journal;
+using QS::Data::JournalOp;
+using QS::Data::JournalOpType;
+using QS::Data::MemoryBudget;
 using QS::Data::Node;
+using QS::Data::RangePlanner;
+using QS::Data::RangeRequest;
+using QS::Data::Readahead;
+using QS::Data::SlabPool;
+using QS::Data::StreamedUpload;
+using QS::Data::StreamUploads;
+using QS::Data::WarmUpEntry;
+using QS::Data::WarmUpManifest;
+using QS::Data::WriteBackQueue;
 using QS::Exception::QSException;
 using QS::StringUtils::FormatPath;
 using QS::Utils::AppendPathDelim;
 using QS::UtilsWithLog::DeleteFilesInDirectory;
 using QS::UtilsWithLog::IsDirectory;
+using QS::UtilsWithLog::RemoveFileIfExists;
+using QS::Utils::GetBaseName;
 using QS::Utils::GetDirName;
 using QS::Utils::GetProcessEffectiveUserID;
 using QS::Utils::GetProcessEffectiveGroupID;
 using QS::Utils::IsRootDirectory;
 using std::deque;
+using std::iostream;
 using std::make_pair;
+using std::map;
 using std::pair;
+using std::set;
 using std::string;
 using std::stringstream;
 using std::vector;
 
 static boost::once_flag connectOnceFalg = BOOST_ONCE_INIT;
 
+namespace {
+
+// --------------------------------------------------------------------------
+string GetDiskCacheIndexFile() {
+  return AppendPathDelim(
+             QS::Configure::Options::Instance().GetDiskCacheDirectory()) +
+         ".qsfs_cache_index";
+}
+
+// --------------------------------------------------------------------------
+string TrimETag(const string &eTag) { return QS::StringUtils::Trim(eTag, '"'); }
+
+// --------------------------------------------------------------------------
+vector<string> SplitPrefetchPaths(const string &paths) {
+  vector<string> result;
+  string::size_type start = 0;
+  while (start < paths.size()) {
+    string::size_type stop = paths.find(':', start);
+    if (stop == string::npos) {
+      stop = paths.size();
+    }
+    if (stop > start) {
+      result.push_back(paths.substr(start, stop - start));
+    }
+    start = stop + 1;
+  }
+  return result;
+}
+
+}  // namespace
+
 // --------------------------------------------------------------------------
 struct PrintErrorMsg {
   PrintErrorMsg() {}
@@ -121,13 +187,63 @@ Drive::Drive()
     : m_mountable(true),
       m_cleanup(false),
       m_connect(false),
+      m_replayingJournal(false),
+      m_stopWarmUp(false),
       m_client(ClientFactory::Instance().MakeClient()),
       m_transferManager(
           TransferManagerFactory::Create(TransferManagerConfigure())) {
   QS::Configure::Options &options = QS::Configure::Options::Instance();
+  SlabPool::Instance().SetHugePages(options.IsHugePages());
+  MemoryBudget::Instance().SetBudget(
+      static_cast<uint64_t>(options.GetMaxMemoryInMB()) * QS::Size::MB1);
   uint64_t cacheSize =
       static_cast<uint64_t>(options.GetMaxCacheSizeInMB() * QS::Size::MB1);
-  m_cache = make_shared<Cache>(cacheSize);
+  m_cache = make_shared<Cache>(
+      cacheSize, options.GetCacheShards(),
+      static_cast<size_t>(options.GetCacheBlockSizeInKB() * QS::Size::KB1),
+      static_cast<size_t>(options.GetMaxPageSizeInMB() * QS::Size::MB1),
+      static_cast<uint64_t>(options.GetMaxDiskCacheSizeInMB()) * QS::Size::MB1,
+      GetCachePolicyByName(options.GetCachePolicy()));
+  m_cache->SetPinQuota(static_cast<uint64_t>(options.GetPinQuotaInMB()) *
+                       QS::Size::MB1);
+  m_cache->SetCompression(options.IsCompressCache());
+  m_cache->SetDedup(options.IsDedupCache());
+  // the readahead window starts from 1MB and grows to the max
+  size_t maxReadahead =
+      static_cast<size_t>(options.GetMaxReadaheadInMB()) * QS::Size::MB1;
+  size_t minReadahead =
+      std::min(maxReadahead, static_cast<size_t>(QS::Size::MB1));
+  m_readahead.reset(new Readahead(minReadahead, maxReadahead));
+  // a request is no larger than the transfer buffer
+  m_rangePlanner.reset(new RangePlanner(
+      static_cast<size_t>(m_transferManager->GetBufferSize()),
+      static_cast<size_t>(options.GetMaxRangeGapInKB()) * QS::Size::KB1));
+  m_prefetchPaths = SplitPrefetchPaths(options.GetPrefetchPaths());
+  if (options.IsWriteBack()) {
+    uint64_t maxDirty =
+        static_cast<uint64_t>(options.GetMaxDirtySizeInMB()) * QS::Size::MB1;
+    // flush the oldest files from half of the hard limit until a quarter of
+    // it is left, so writers seldom wait for the flusher
+    m_writeBackQueue.reset(new WriteBackQueue(
+        maxDirty / 4, maxDirty / 2, maxDirty, options.GetDirtyExpireInSec()));
+  }
+  if (options.IsStreamUpload()) {
+    uint64_t partSize = m_transferManager->GetBufferSize();
+    if (partSize >= QS::Configure::Default::GetUploadMultipartMinPartSize()) {
+      m_streamUploads.reset(new StreamUploads(partSize));
+    } else {
+      Warning("Transfer buffer is smaller than the min part size, files are "
+              "not uploaded while written");
+    }
+  }
+  if (options.IsJournal()) {
+    m_journal.reset(new Journal(options.GetJournalDirectory()));
+    if (!m_journal->Open()) {
+      Error("Unable to open journal, local changes are not recorded " +
+            FormatPath(options.GetJournalDirectory()));
+      m_journal.reset();
+    }
+  }
 
   uid_t uid =
       options.IsOverrideUID() ? options.GetUID() : GetProcessEffectiveUserID();
@@ -152,6 +268,33 @@ Drive::~Drive() { CleanUp(); }
 // --------------------------------------------------------------------------
 void Drive::CleanUp() {
   if (!GetCleanup()) {
+    // stop warming up, the downloads in flight are waited
+    {
+      boost::lock_guard<boost::mutex> locker(m_warmUpLock);
+      m_stopWarmUp = true;
+      m_warmUpCond.notify_all();
+    }
+    if (m_warmer) {
+      m_warmer->join();
+      m_warmer.reset();
+    }
+    // upload the dirty files left in write-back mode
+    if (m_writeBackQueue) {
+      m_writeBackQueue->Stop();
+      if (m_flusher) {
+        m_flusher->join();
+        m_flusher.reset();
+      }
+      if (m_cache) {
+        FlushDirtyFiles(true);
+      }
+    }
+    // abort the uploads of the files written but not flushed
+    if (m_streamUploads) {
+      BOOST_FOREACH (const string &filePath, m_streamUploads->GetFilePaths()) {
+        AbortStreamUpload(filePath);
+      }
+    }
     // abort unfinished multipart uploads
     if (!m_unfinishedMultipartUploadHandles.empty()) {
       BOOST_FOREACH (StringToTransferHandleMap::value_type &p,
@@ -159,18 +302,35 @@ void Drive::CleanUp() {
         m_transferManager->AbortMultipartUpload(p.second);
       }
     }
-    // remove disk cache folder if existing
+    // remove disk cache folder if existing, unless it is kept for next mount
     string diskfolder =
         QS::Configure::Options::Instance().GetDiskCacheDirectory();
-    if (QS::Utils::FileExists(diskfolder) && IsDirectory(diskfolder)) {
+    if (QS::Configure::Options::Instance().IsPersistDiskCache() && m_cache) {
+      PersistDiskCache();
+    } else if (QS::Utils::FileExists(diskfolder) && IsDirectory(diskfolder)) {
       DeleteFilesInDirectory(diskfolder, true);  // delete folder itself
     }
 
+    if (m_cache) {
+      stringstream stats;
+      stats << m_cache->GetPolicyStats();
+      Info("Cache policy " + GetCachePolicyName(m_cache->GetPolicy()) + " " +
+           stats.str());
+    }
+    stringstream memory;
+    memory << MemoryBudget::Instance();
+    Info("Memory usage " + memory.str());
+
     m_client.reset();
     m_transferManager.reset();
     m_cache.reset();
     m_directoryTree.reset();
     m_unfinishedMultipartUploadHandles.clear();
+    m_writeBackQueue.reset();
+    if (m_journal) {
+      m_journal->Sync();
+      m_journal.reset();
+    }
 
     SetCleanup(true);
   }
@@ -199,6 +359,213 @@ bool Drive::IsMountable() {
   return GetMountable();
 }
 
+// --------------------------------------------------------------------------
+void Drive::StartFlusher() {
+  if (m_writeBackQueue && !m_flusher) {
+    m_flusher.reset(new boost::thread(
+        bind(boost::type<void>(), &Drive::RunFlusher, this)));
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::ReplayJournal() {
+  if (!m_journal || m_journal->Empty()) {
+    return;
+  }
+  Info("Replay journal " + FormatPath(m_journal->GetDirectory()));
+  m_replayingJournal = true;
+  try {
+    // intents interrupted by crash
+    BOOST_FOREACH (const JournalOp &op, m_journal->GetPendingIntents()) {
+      shared_ptr<Node> node = GetNode(op.m_path, true).first;
+      bool exists = node && *node;
+      if (op.m_type == JournalOpType::Create && !exists) {
+        MakeFile(op.m_path, op.m_mode);
+      } else if (op.m_type == JournalOpType::Rename && exists) {
+        RenameFile(op.m_path, op.m_newPath);
+      }
+      m_journal->Confirm(op.m_seq);
+    }
+
+    // changes not uploaded, which are written again and uploaded
+    BOOST_FOREACH (const string &filePath, m_journal->GetPendingFiles()) {
+      shared_ptr<Node> node = GetNode(filePath, true).first;
+      if (!(node && *node)) {
+        Warning("Drop journal of not existing file " + FormatPath(filePath));
+        m_journal->Commit(filePath, m_journal->GetLastSequence());
+        continue;
+      }
+      BOOST_FOREACH (const JournalOp &op, m_journal->GetPendingOps(filePath)) {
+        if (op.m_type == JournalOpType::Truncate) {
+          TruncateFile(filePath, op.m_size);
+          continue;
+        }
+        vector<char> buf(op.m_size);
+        if (op.m_size > 0 && m_journal->ReadData(op, &buf[0])) {
+          WriteFile(filePath, op.m_offset, op.m_size, &buf[0]);
+        } else {
+          Warning("Fail to read journal data " + FormatPath(filePath));
+        }
+      }
+      UploadFile(filePath, false, true, false);  // sync
+    }
+  } catch (const QSException &err) {
+    Error(err.get());
+  }
+  m_replayingJournal = false;
+}
+
+// --------------------------------------------------------------------------
+void Drive::SyncJournal() {
+  if (m_journal) {
+    m_journal->Sync();
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::StartWarmUp() {
+  if (QS::Configure::Options::Instance().IsWarmUp() && !m_warmer) {
+    m_warmer.reset(new boost::thread(
+        bind(boost::type<void>(), &Drive::RunWarmUp, this)));
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::WarmUpCache(const string &manifestFile) {
+  WarmUpManifest manifest;
+  if (!manifest.Load(manifestFile)) {
+    Warning("Unable to load warm-up manifest " + FormatPath(manifestFile));
+    return;
+  }
+
+  // files in order of priority, a file listed more than once takes the first
+  vector<string> filePaths;
+  vector<pair<string, uint64_t> > filesToPin;
+  set<string> found;
+  BOOST_FOREACH (const WarmUpEntry &entry, manifest.GetEntries()) {
+    vector<shared_ptr<Node> > files;
+    shared_ptr<Node> node = GetNode(entry.m_path, true).first;
+    if (!(node && *node)) {
+      Warning("Skip not existing warm-up path " + FormatPath(entry.m_path));
+      continue;
+    } else if (node->IsDirectory()) {
+      FindFilesRecursively(AppendPathDelim(entry.m_path), &files);
+    } else if (!node->IsSymLink()) {
+      files.push_back(node);
+    }
+    BOOST_FOREACH (const shared_ptr<Node> &file, files) {
+      string filePath = file->GetFilePath();
+      if (!found.insert(filePath).second) {
+        continue;
+      }
+      filePaths.push_back(filePath);
+      if (entry.m_pin) {
+        filesToPin.push_back(make_pair(filePath, file->GetFileSize()));
+      }
+    }
+  }
+
+  // pin again from scratch, so the files not pinned any more free the quota
+  {
+    boost::lock_guard<boost::mutex> locker(m_warmUpLock);
+    BOOST_FOREACH (const string &filePath, m_warmUpPinned) {
+      m_cache->Unpin(filePath);
+    }
+    m_warmUpPinned.clear();
+    for (size_t i = 0; i < filesToPin.size(); ++i) {
+      if (!m_cache->Pin(filesToPin[i].first, filesToPin[i].second)) {
+        Warning("Exceed pin quota, " + to_string(filesToPin.size() - i) +
+                " files are not pinned");
+        break;
+      }
+      m_warmUpPinned.insert(filesToPin[i].first);
+    }
+  }
+
+  Info("Warm up cache with " + to_string(filePaths.size()) + " files " +
+       FormatPath(manifestFile));
+  size_t numJobs = std::min(
+      static_cast<size_t>(QS::Configure::Options::Instance().GetWarmUpJobs()),
+      filePaths.size());
+  size_t next = 0;
+  boost::mutex nextLock;
+  boost::thread_group jobs;
+  for (size_t i = 0; i < numJobs; ++i) {
+    jobs.create_thread(bind(boost::type<void>(), &Drive::RunWarmUpJob, this,
+                            &filePaths, &next, &nextLock));
+  }
+  jobs.join_all();
+}
+
+// --------------------------------------------------------------------------
+void Drive::RunWarmUp() {
+  const string &manifestFile =
+      QS::Configure::Options::Instance().GetWarmUpManifest();
+  time_t manifestMTime = 0;
+  boost::unique_lock<boost::mutex> lock(m_warmUpLock);
+  while (!m_stopWarmUp) {
+    struct stat st;
+    if (stat(manifestFile.c_str(), &st) == 0 &&
+        st.st_mtime != manifestMTime) {
+      manifestMTime = st.st_mtime;
+      lock.unlock();
+      WarmUpCache(manifestFile);
+      lock.lock();
+    }
+    // check the manifest for changes every ten seconds
+    if (!m_stopWarmUp) {
+      m_warmUpCond.timed_wait(lock, boost::posix_time::seconds(10));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::FindFilesRecursively(const string &dirPath,
+                                 vector<shared_ptr<Node> > *files) {
+  // list the directory synchronously
+  GetNode(dirPath, true, true, false);
+  BOOST_FOREACH (const weak_ptr<Node> &child,
+                 m_directoryTree->FindChildren(dirPath)) {
+    shared_ptr<Node> node = child.lock();
+    if (!(node && *node) || IsWarmUpStopped()) {
+      continue;
+    }
+    if (node->IsDirectory()) {
+      FindFilesRecursively(AppendPathDelim(node->GetFilePath()), files);
+    } else if (!node->IsSymLink()) {
+      files->push_back(node);
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::RunWarmUpJob(const vector<string> *filePaths, size_t *next,
+                         boost::mutex *lock) {
+  while (!IsWarmUpStopped()) {
+    string filePath;
+    {
+      boost::lock_guard<boost::mutex> locker(*lock);
+      if (*next >= filePaths->size()) {
+        return;
+      }
+      filePath = (*filePaths)[(*next)++];
+    }
+    shared_ptr<Node> node = GetNodeSimple(filePath);
+    if (!(node && *node) || node->GetFileSize() == 0) {
+      continue;
+    }
+    time_t mtime = node->GetMTime();
+    if (m_cache->HasFile(filePath) && mtime > m_cache->GetTime(filePath)) {
+      m_cache->Erase(filePath);  // outdated
+    }
+    ContentRangeDeque ranges =
+        m_cache->GetUnloadedRanges(filePath, 0, node->GetFileSize());
+    if (!ranges.empty()) {
+      DownloadFileContentRanges(filePath, ranges, mtime, node->IsFileOpen());
+    }
+  }
+}
+
 // --------------------------------------------------------------------------
 void DoListRootDirectory(shared_ptr<Client> client,
                          shared_ptr<DirectoryTree> dirTree) {
@@ -221,6 +588,10 @@ void Drive::DoConnect() {
     m_directoryTree->Grow(QS::Data::BuildDefaultDirectoryMeta("/", time(NULL)));
   }
 
+  if (QS::Configure::Options::Instance().IsPersistDiskCache()) {
+    RestoreDiskCache();
+  }
+
   // Build up the root level of directory tree asynchornizely.
   boost::thread(
       bind(boost::type<void>(), DoListRootDirectory, m_client, m_directoryTree))
@@ -308,6 +679,7 @@ pair<shared_ptr<Node>, bool> Drive::GetNode(const string &path,
     }
   }
 
+  RevalidateDiskCache(path, node);
   return make_pair(node, modified);
 }
 
@@ -375,6 +747,14 @@ struct PrintMsgForDeleteFile {
 // Remove a file or an empty directory
 void Drive::RemoveFile(const string &filePath, bool async) {
   PrintMsgForDeleteFile receivedHandler(filePath);
+  if (m_writeBackQueue) {
+    m_writeBackQueue->Erase(filePath);
+  }
+  AbortStreamUpload(filePath);
+  Journal *journal = GetActiveJournal();
+  if (journal != NULL) {
+    journal->AppendRemove(filePath);
+  }
 
   if (async) {  // delete file asynchronously
     GetClient()->GetExecutor()->SubmitAsyncPrioritized(
@@ -409,7 +789,13 @@ void Drive::MakeFile(const string &filePath, mode_t mode, dev_t dev) {
   }
 
   if (type == FileType::File) {
+    Journal *journal = GetActiveJournal();
+    uint64_t intent =
+        journal != NULL ? journal->AppendCreate(filePath, mode) : 0;
     ClientError<QSError::Value> err = GetClient()->MakeFile(filePath);
+    if (journal != NULL) {
+      journal->Confirm(intent);
+    }
     if (!IsGoodQSError(err)) {
       Error(GetMessageForQSError(err));
       return;
@@ -468,8 +854,12 @@ void Drive::OpenFile(const string &filePath, bool async) {
   assert(fileSize >= 0);
   if (fileSize == 0) {
     m_cache->Write(filePath, 0, 0, NULL, mtime, isOpen);
-  } else if (fileSize > 0) {
+  } else if (IsPrefetch(filePath)) {
     bool fileContentExist = m_cache->HasFileData(filePath, 0, fileSize);
+    if (!fileContentExist &&
+        ShareCachedContent(filePath, node, 0, fileSize) > 0) {
+      fileContentExist = m_cache->HasFileData(filePath, 0, fileSize);
+    }
     if (!fileContentExist || modified) {
       QS::Data::ContentRangeDeque ranges =
           m_cache->GetUnloadedRanges(filePath, 0, fileSize);
@@ -482,6 +872,18 @@ void Drive::OpenFile(const string &filePath, bool async) {
   node->SetFileOpen(true);
 }
 
+// --------------------------------------------------------------------------
+bool Drive::IsPrefetch(const string &filePath) const {
+  BOOST_FOREACH (const string &path, m_prefetchPaths) {
+    bool isPrefix = path[path.size() - 1] == '/';
+    if (isPrefix ? filePath.compare(0, path.size(), path) == 0
+                 : filePath == path) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // --------------------------------------------------------------------------
 size_t Drive::ReadFile(const string &filePath, off_t offset, size_t size,
                        char *buf, bool async) {
@@ -518,40 +920,38 @@ size_t Drive::ReadFile(const string &filePath, off_t offset, size_t size,
   // Download file if not found in cache or if cache need update
   bool fileContentExist = m_cache->HasFileData(filePath, offset, downloadSize);
   if (!fileContentExist) {
-    // download synchronizely for request file part
-    shared_ptr<IOStream> stream = make_shared<IOStream>(downloadSize);
-    shared_ptr<TransferHandle> handle =
-        m_transferManager->DownloadFile(filePath, offset, downloadSize, stream);
-
-    // waiting for download to finish for request file part
-    if (handle) {
-      handle->WaitUntilFinished();
-      if (handle->DoneTransfer() && !handle->HasFailedParts()) {
-        Info("Download file [offset:len=" + to_string(offset) + ":" +
-             to_string(downloadSize) + "] " + FormatPath(filePath));
-
-        bool success = m_cache->Write(filePath, offset, downloadSize, stream,
-                                      mtime, isOpen);
-        DebugErrorIf(!success,
-                     "Fail to write cache [offset:len=" + to_string(offset) +
-                         ":" + to_string(downloadSize) + "] " +
-                         FormatPath(filePath));
-      }
+    ShareCachedContent(filePath, node, offset, downloadSize);
+    // download synchronizely for the unloaded part of request, the part in
+    // flight is waited for instead of downloaded again
+    ContentRangeDeque ranges =
+        m_cache->GetUnloadedRanges(filePath, offset, downloadSize);
+    if (!ranges.empty()) {
+      DownloadFileContentRanges(filePath, ranges, mtime, isOpen, false);
     }
   }
 
-  // download unloaded part
+  // download the window ahead of a sequential reader
   if (remainingSize > 0) {
-    ContentRangeDeque ranges =
-        m_cache->GetUnloadedRanges(filePath, 0, fileSize);
-    if (!ranges.empty()) {
-      DownloadFileContentRanges(filePath, ranges, mtime, isOpen, async);
+    pair<off_t, size_t> ahead =
+        m_readahead->OnRead(filePath, offset, downloadSize, fileSize);
+    if (ahead.second > 0) {
+      ContentRangeDeque ranges =
+          m_cache->GetUnloadedRanges(filePath, ahead.first, ahead.second);
+      if (!ranges.empty()) {
+        DownloadFileContentRanges(filePath, ranges, mtime, isOpen, async);
+      }
     }
   }
 
   // Read from cache
   pair<size_t, ContentRangeDeque> outcome =
       m_cache->Read(filePath, offset, downloadSize, buf, mtime);
+  if (!outcome.second.empty()) {
+    // Content is evicted meanwhile or fails the checksum verification in disk
+    // file, download it again
+    DownloadFileContentRanges(filePath, outcome.second, mtime, isOpen, false);
+    outcome = m_cache->Read(filePath, offset, downloadSize, buf, mtime);
+  }
   return outcome.first;
 }
 
@@ -569,14 +969,29 @@ void Drive::ReadSymlink(const std::string &linkPath) {
 
 // --------------------------------------------------------------------------
 void Drive::RenameFile(const string &filePath, const string &newFilePath) {
+  Journal *journal = GetActiveJournal();
+  uint64_t intent =
+      journal != NULL ? journal->AppendRename(filePath, newFilePath) : 0;
+  // an upload in flight would recreate the object at the old path
+  if (m_writeBackQueue) {
+    m_writeBackQueue->Hold(filePath);
+  }
   // Do Renaming
   ClientError<QSError::Value> err =
       GetClient()->MoveFile(filePath, newFilePath, m_directoryTree, m_cache);
+  if (journal != NULL) {
+    journal->Confirm(intent);
+  }
 
   // Update meta(such as mtime, .etc)
   if (IsGoodQSError(err)) {
     pair<shared_ptr<Node>, bool> res = GetNode(newFilePath, true, false, false);
     shared_ptr<Node> node = res.first;
+    if (m_writeBackQueue) {
+      m_writeBackQueue->Rename(filePath, newFilePath);
+    }
+    m_readahead->Erase(filePath);
+    AbortStreamUpload(filePath);
     if (node && *node) {
       Info("Rename file " + FormatPath(filePath, newFilePath));
     } else {
@@ -584,6 +999,9 @@ void Drive::RenameFile(const string &filePath, const string &newFilePath) {
     }
     return;
   } else {
+    if (m_writeBackQueue) {
+      m_writeBackQueue->Unhold(filePath);
+    }
     Error(GetMessageForQSError(err));
     return;
   }
@@ -626,9 +1044,24 @@ struct RenameDirCallback {
         childPaths.pop_back();
         string target = childTargetPaths.back();
         childTargetPaths.pop_back();
+        if (drive) {
+          // drop the restored content which is not revalidated yet
+          drive->RevalidateDiskCache(source, shared_ptr<Node>());
+        }
         if (cache && cache->HasFile(source)) {
           cache->Rename(source, target);
         }
+        if (drive && drive->m_writeBackQueue) {
+          drive->m_writeBackQueue->Rename(source, target);
+        }
+        if (drive) {
+          drive->AbortStreamUpload(source);
+        }
+        Journal *journal = drive ? drive->GetActiveJournal() : NULL;
+        if (journal != NULL) {
+          // move the pending changes along, the rename is done already
+          journal->Confirm(journal->AppendRename(source, target));
+        }
       }
 
       // Remove old dir node from dir tree
@@ -650,12 +1083,26 @@ struct RenameDirCallback {
     } else {
       Error(GetMessageForQSError(err));
     }
+    // release the files held before the rename, which are left if it fails
+    if (drive && drive->m_writeBackQueue) {
+      BOOST_FOREACH (const string &path,
+                     drive->GetWriteBackFilesUnder(dirPath)) {
+        drive->m_writeBackQueue->Unhold(path);
+      }
+    }
   }
 };
 
 // --------------------------------------------------------------------------
 void Drive::RenameDir(const string &dirPath, const string &newDirPath,
                       bool async) {
+  // an upload in flight would recreate the object at the old path, the files
+  // are released when they are renamed or the rename fails
+  if (m_writeBackQueue) {
+    BOOST_FOREACH (const string &filePath, GetWriteBackFilesUnder(dirPath)) {
+      m_writeBackQueue->Hold(filePath);
+    }
+  }
   // Do Renaming
   RenameDirCallback receivedHandler(dirPath, newDirPath, m_directoryTree,
                                     m_cache, this);
@@ -715,9 +1162,31 @@ void Drive::TruncateFile(const string &filePath, size_t newSize) {
   if (newSize != node->GetFileSize()) {
     Info("Truncate file [oldsize:newsize=" + to_string(node->GetFileSize()) +
          ":" + to_string(newSize) + "]" + FormatPath(filePath));
+    if (!m_cache->HasFile(filePath)) {
+      // load the content kept by the truncate, so the file is uploaded with
+      // it, e.g. a closed file is truncated
+      time_t mtime = node->GetMTime();
+      bool isOpen = node->IsFileOpen();
+      size_t keptSize = std::min(newSize, node->GetFileSize());
+      if (keptSize > 0) {
+        DownloadFileContentRanges(
+            filePath, ContentRangeDeque(1, make_pair(0, keptSize)), mtime,
+            isOpen, false);
+      } else {
+        m_cache->Write(filePath, 0, 0, NULL, mtime, isOpen);
+      }
+    }
     m_cache->Resize(filePath, newSize, node->GetMTime());
+    if (m_streamUploads) {
+      m_streamUploads->OnTruncate(filePath, newSize);
+    }
     node->SetFileSize(newSize);
     node->SetNeedUpload(true);
+    MarkDirty(filePath, node);
+    Journal *journal = GetActiveJournal();
+    if (journal != NULL && !journal->AppendTruncate(filePath, newSize)) {
+      Warning("Fail to journal truncate " + FormatPath(filePath));
+    }
   }
 }
 
@@ -731,12 +1200,15 @@ struct UploadFileCallback {
   Drive *drive;
   bool releaseFile;
   bool updateMeta;
+  uint64_t journalSeq;     // last journal record when upload starts
+  uint64_t dirtySnapshot;  // snapshot of the dirty ranges to upload
 
   UploadFileCallback(const string &filePath_, const shared_ptr<Node> &node_,
                      const shared_ptr<Cache> &cache_,
                      const shared_ptr<Client> &client_,
                      const shared_ptr<DirectoryTree> &dirTree_, Drive *drive_,
-                     bool releaseFile_, bool updateMeta_)
+                     bool releaseFile_, bool updateMeta_, uint64_t journalSeq_,
+                     uint64_t dirtySnapshot_)
       : filePath(filePath_),
         node(node_),
         cache(cache_),
@@ -744,7 +1216,26 @@ struct UploadFileCallback {
         dirTree(dirTree_),
         drive(drive_),
         releaseFile(releaseFile_),
-        updateMeta(updateMeta_) {}
+        updateMeta(updateMeta_),
+        journalSeq(journalSeq_),
+        dirtySnapshot(dirtySnapshot_) {}
+
+  // Report the end of the upload to write-back queue
+  //
+  // @param  : void
+  // @return : true if the file is clean, always true if not in write-back
+  bool FinishFlush() {
+    if (!drive->m_writeBackQueue) {
+      return true;
+    }
+    bool clean = drive->m_writeBackQueue->FinishFlush(
+        filePath, cache->GetDirtySize(filePath), time(NULL));
+    if (clean && !node->IsFileOpen()) {
+      // the file is closed when it is dirty, release it as it is uploaded
+      cache->SetFileOpen(filePath, false);
+    }
+    return clean;
+  }
 
   void operator()(const shared_ptr<TransferHandle> &handle) {
     if (handle && cache && client && drive) {
@@ -763,8 +1254,17 @@ struct UploadFileCallback {
 
       if (handle->DoneTransfer() && !handle->HasFailedParts()) {
         Info("Done Upload file " + FormatPath(filePath));
+        // the uploaded ranges are the same as the object now
+        cache->CleanRanges(handle->GetObjectKey(), handle->GetDirtyRanges(),
+                           dirtySnapshot);
+        if (drive->m_journal) {
+          drive->m_journal->Commit(handle->GetObjectKey(), journalSeq);
+        }
+        // keep the local meta of a file written during the upload, which is
+        // newer than the uploaded object
+        bool clean = FinishFlush();
         // update meta mtime
-        if (updateMeta) {
+        if (updateMeta && clean) {
           ClientError<QSError::Value> err =
               client->Stat(handle->GetObjectKey(), dirTree);
           if (IsGoodQSError(err)) {
@@ -778,7 +1278,11 @@ struct UploadFileCallback {
             Error(GetMessageForQSError(err));
           }
         }  // update Meta
+      } else {
+        FinishFlush();  // queued again to retry
       }    // Done Transfer
+    } else if (cache && drive) {
+      FinishFlush();
     }
   }
 };
@@ -792,15 +1296,34 @@ void Drive::UploadFile(const string &filePath, bool releaseFile,
 
   if (!(node && *node)) {
     Warning("File not exist " + FormatPath(filePath));
+    if (m_writeBackQueue) {
+      m_writeBackQueue->Erase(filePath);
+    }
     return;
   }
 
   uint64_t fileSize = node->GetFileSize();
   time_t mtime = node->GetMTime();
-  ContentRangeDeque ranges = m_cache->GetUnloadedRanges(filePath, 0, fileSize);
-  // download unloaded pages for file
-  // this is need as user could open a file and edit a part of it,
-  // but you need the completed file in order to upload it.
+  // take it before the dirty ranges, so the changes journaled up to it are
+  // written into cache before the upload starts
+  uint64_t journalSeq = m_journal ? m_journal->GetLastSequence() : 0;
+  // the parts uploaded while the file is written are not sent again
+  StreamedUpload streamed = TakeStreamUpload(filePath, fileSize);
+  // the ranges written since are kept dirty when the upload finishes
+  uint64_t dirtySnapshot = 0;
+  ContentRangeDeque dirtyRanges =
+      m_cache->SnapshotDirtyRanges(filePath, &dirtySnapshot);
+  // download unloaded pages of the ranges to send
+  // this is need as user could open a file and edit a part of it, the parts
+  // not edited are copied from the existing object by server, but you need
+  // the completed content of the other parts in order to upload them.
+  ContentRangeDeque ranges;
+  BOOST_FOREACH (const ContentRangeDeque::value_type &range,
+                 m_transferManager->GetUploadRanges(fileSize, dirtyRanges)) {
+    ContentRangeDeque unloaded =
+        m_cache->GetUnloadedRanges(filePath, range.first, range.second);
+    ranges.insert(ranges.end(), unloaded.begin(), unloaded.end());
+  }
   if (!ranges.empty()) {
     bool fileOpen = node->IsFileOpen();
     DownloadFileContentRanges(filePath, ranges, mtime, fileOpen,
@@ -808,19 +1331,84 @@ void Drive::UploadFile(const string &filePath, bool releaseFile,
   }
 
   UploadFileCallback callback(filePath, node, m_cache, m_client,
-                              m_directoryTree, this, releaseFile, updateMeta);
-  if (async) {
+                              m_directoryTree, this, releaseFile, updateMeta,
+                              journalSeq, dirtySnapshot);
+  if (streamed.m_size > 0) {
+    if (async) {
+      GetTransferManager()->GetExecutor()->SubmitAsync(
+          bind(boost::type<void>(), callback, _1),
+          bind(boost::type<shared_ptr<TransferHandle> >(),
+               &QS::Client::TransferManager::UploadStreamedFile,
+               m_transferManager.get(), _1, fileSize, mtime, m_cache,
+               dirtyRanges, streamed.m_uploadId, streamed.m_size, false),
+          filePath);
+    } else {
+      callback(m_transferManager->UploadStreamedFile(
+          filePath, fileSize, mtime, m_cache, dirtyRanges, streamed.m_uploadId,
+          streamed.m_size));
+    }
+  } else if (async) {
     GetTransferManager()->GetExecutor()->SubmitAsync(
         bind(boost::type<void>(), callback, _1),
         bind(boost::type<shared_ptr<TransferHandle> >(),
              &QS::Client::TransferManager::UploadFile, m_transferManager.get(),
-             _1, fileSize, mtime, m_cache, false),
+             _1, fileSize, mtime, m_cache, dirtyRanges, false),
         filePath);
   } else {
-    callback(m_transferManager->UploadFile(filePath, fileSize, mtime, m_cache));
+    callback(m_transferManager->UploadFile(filePath, fileSize, mtime, m_cache,
+                                           dirtyRanges));
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::RunStreamUpload(const string &filePath) {
+  pair<off_t, size_t> range;
+  string uploadId;
+  uint16_t partId = 0;
+  while ((partId = m_streamUploads->PopPart(filePath, &range, &uploadId)) > 0) {
+    if (uploadId.empty()) {
+      ClientError<QSError::Value> err =
+          GetClient()->InitiateMultipartUpload(filePath, &uploadId);
+      if (!IsGoodQSError(err)) {
+        Error(GetMessageForQSError(err));
+        m_streamUploads->FinishPart(filePath, false);  // stop the upload
+        continue;
+      }
+      m_streamUploads->SetUploadId(filePath, uploadId);
+    }
+    bool success = m_transferManager->UploadStreamPart(
+        filePath, uploadId, partId, range.first, range.second, m_cache);
+    DebugInfoIf(success, "Upload part [id:offset:len=" + to_string(partId) +
+                             ":" + to_string(range.first) + ":" +
+                             to_string(range.second) + "] " +
+                             FormatPath(filePath));
+    m_streamUploads->FinishPart(filePath, success);
   }
 }
 
+// --------------------------------------------------------------------------
+StreamedUpload Drive::TakeStreamUpload(const string &filePath,
+                                       uint64_t fileSize) {
+  StreamedUpload upload;
+  if (!(m_streamUploads && m_streamUploads->Take(filePath, &upload))) {
+    return StreamedUpload();
+  }
+  if (upload.m_valid && upload.m_size > 0 && upload.m_size <= fileSize) {
+    return upload;
+  }
+  if (!upload.m_uploadId.empty()) {
+    ClientError<QSError::Value> err =
+        GetClient()->AbortMultipartUpload(filePath, upload.m_uploadId);
+    DebugErrorIf(!IsGoodQSError(err), GetMessageForQSError(err));
+  }
+  return StreamedUpload();
+}
+
+// --------------------------------------------------------------------------
+void Drive::AbortStreamUpload(const string &filePath) {
+  TakeStreamUpload(filePath, 0);  // no upload fits an empty file
+}
+
 // --------------------------------------------------------------------------
 void Drive::ReleaseFile(const string &filePath) {
   shared_ptr<Node> node = GetNodeSimple(filePath);
@@ -831,10 +1419,30 @@ void Drive::ReleaseFile(const string &filePath) {
   }
 
   Info("Close file " + FormatPath(filePath));
-  node->SetNeedUpload(false);
+  // a dirty file is released after the flusher uploads it
+  bool queued = m_writeBackQueue && m_writeBackQueue->HasFile(filePath);
+  if (!queued) {
+    node->SetNeedUpload(false);
+  }
   node->SetFileOpen(false);
+  m_readahead->Erase(filePath);
   if (m_cache->HasFile(filePath)) {
-    m_cache->SetFileOpen(filePath, false);
+    if (!queued) {
+      m_cache->SetFileOpen(filePath, false);
+    }
+    if (m_cache->GetMaxPageSize() > 0 && m_cache->GetBlockSize() == 0) {
+      // merge the pages of closed file in background
+      GetClient()->GetExecutor()->SubmitToThread(
+          bind(boost::type<size_t>(), &Cache::Compact, m_cache, filePath));
+    }
+    DemoteColdPagesIfNeeded();
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::ExpediteFlush(const string &filePath) {
+  if (m_writeBackQueue) {
+    m_writeBackQueue->Expedite(filePath);
   }
 }
 
@@ -858,108 +1466,319 @@ int Drive::WriteFile(const string &filePath, off_t offset, size_t size,
     return 0;
   }
 
+  if (m_writeBackQueue) {
+    m_writeBackQueue->WaitForSpace();  // block only at the hard limit
+  }
   bool isOpen = node->IsFileOpen();
   time_t mtime = node->GetMTime();
+  uint64_t fileSize = node->GetFileSize();
   bool success = m_cache->Write(filePath, offset, size, buf, mtime, isOpen);
   if (success) {
     node->SetNeedUpload(true);
     if (offset + size > node->GetFileSize()) {
       node->SetFileSize(offset + size);
     }
+    if (m_streamUploads &&
+        m_streamUploads->OnWrite(filePath, offset, size, fileSize)) {
+      // upload the parts completed by the writes in background
+      GetTransferManager()->GetExecutor()->SubmitToThread(bind(
+          boost::type<void>(), &Drive::RunStreamUpload, this, filePath));
+    }
+    MarkDirty(filePath, node);
+    Journal *journal = GetActiveJournal();
+    if (journal != NULL && !journal->AppendWrite(filePath, offset, size, buf)) {
+      Warning("Fail to journal write " + FormatPath(filePath));
+    }
+    DemoteColdPagesIfNeeded();
   }
 
   return success ? size : 0;
 }
 
-// --------------------------------------------------------------------------
-void Drive::DownloadFileContentRanges(const string &filePath,
-                                      const ContentRangeDeque &ranges,
-                                      time_t mtime, bool open, bool async) {
-  BOOST_FOREACH (const ContentRangeDeque::value_type &range, ranges) {
-    DownloadFileContentRange(filePath, range, mtime, open, async);
-  }
-}
-
 // --------------------------------------------------------------------------
 struct DownloadFileContentRangeCallback {
   string filePath;
-  off_t offset;
-  size_t downloadSize;
+  RangeRequest request;
   shared_ptr<IOStream> stream;
   time_t mtime;
   bool fileOpen;
   shared_ptr<Cache> cache;
+  InFlightRanges *inFlightRanges;
 
-  DownloadFileContentRangeCallback(const string &filePath_, off_t offset_,
-                                   size_t downloadSize_,
+  DownloadFileContentRangeCallback(const string &filePath_,
+                                   const RangeRequest &request_,
                                    const shared_ptr<IOStream> &stream_,
                                    time_t mtime_, bool open_,
-                                   const shared_ptr<Cache> &cache_)
+                                   const shared_ptr<Cache> &cache_,
+                                   InFlightRanges *inFlightRanges_)
       : filePath(filePath_),
-        offset(offset_),
-        downloadSize(downloadSize_),
+        request(request_),
         stream(stream_),
         mtime(mtime_),
         fileOpen(open_),
-        cache(cache_) {}
+        cache(cache_),
+        inFlightRanges(inFlightRanges_) {}
 
   void operator()(const shared_ptr<TransferHandle> &handle) {
     if (handle) {
       handle->WaitUntilFinished();
       if (handle->DoneTransfer() && !handle->HasFailedParts()) {
-        bool success = cache->Write(filePath, offset, downloadSize, stream,
-                                    mtime, fileOpen);
-        DebugErrorIf(!success,
-                     "Fail to write cache [file:offset:len=" + filePath + ":" +
-                         to_string(offset) + ":" + to_string(downloadSize) +
-                         "]");
+        BOOST_FOREACH (const ContentRangeDeque::value_type &range,
+                       request.m_ranges) {
+          WriteCache(range.first, range.second);
+        }
       }
     }
+    // wake up the readers waiting for the ranges even if the download fails,
+    // they will download them again
+    BOOST_FOREACH (const ContentRangeDeque::value_type &range,
+                   request.m_ranges) {
+      inFlightRanges->Release(filePath, range.first, range.second);
+    }
+  }
+
+  // The gaps downloaded along are cached already, and the wanted ranges may
+  // be written by user since they are claimed, so only the parts of the
+  // wanted ranges still unloaded are written into cache
+  void WriteCache(off_t offset, size_t size) {
+    shared_ptr<iostream> body = stream;
+    if (size != request.m_size) {
+      vector<char> buf(size);
+      stream->seekg(offset - request.m_offset, std::ios_base::beg);
+      stream->read(&buf[0], size);
+      body = make_shared<IOStream>(size);
+      body->write(&buf[0], size);
+    }
+    bool success =
+        cache->Write(filePath, offset, size, body, mtime, fileOpen, true);
+    DebugErrorIf(!success, "Fail to write cache [file:offset:len=" + filePath +
+                               ":" + to_string(offset) + ":" +
+                               to_string(size) + "]");
   }
 };
 
 // --------------------------------------------------------------------------
-void Drive::DownloadFileContentRange(const string &filePath,
-                                     const pair<off_t, size_t> &range,
-                                     time_t mtime, bool open, bool async) {
-  off_t offset = range.first;
-  size_t size = range.second;
-  // Download file if not found in cache or if cache need update
-  bool fileContentExist = m_cache->HasFileData(filePath, offset, size);
-  if (!fileContentExist) {
-    uint64_t bufSize = QS::Client::ClientConfiguration::Instance()
-                           .GetTransferBufferSizeInMB() *
-                       QS::Size::MB1;
-    size_t remainingSize = size;
-    uint64_t downloadedSize = 0;
-
-    while (remainingSize > 0) {
-      off_t offset_ = offset + downloadedSize;
-      int64_t downloadSize_ = remainingSize > bufSize ? bufSize : remainingSize;
-      if (downloadSize_ <= 0) {
-        break;
-      }
+void Drive::DownloadFileContentRanges(const string &filePath,
+                                      const ContentRangeDeque &ranges,
+                                      time_t mtime, bool open, bool async) {
+  // download the parts not in flight only, each part is released by the
+  // callback once it is written into cache
+  ContentRangeDeque missing;
+  ContentRangeDeque claimed;
+  BOOST_FOREACH (const ContentRangeDeque::value_type &range, ranges) {
+    if (m_cache->HasFileData(filePath, range.first, range.second)) {
+      continue;
+    }
+    missing.push_back(range);
+    ContentRangeDeque parts =
+        m_inFlightRanges.Claim(filePath, range.first, range.second);
+    claimed.insert(claimed.end(), parts.begin(), parts.end());
+  }
+  if (missing.empty()) {
+    return;
+  }
 
-      shared_ptr<IOStream> stream_ = make_shared<IOStream>(downloadSize_);
-      DownloadFileContentRangeCallback callback(
-          filePath, offset_, downloadSize_, stream_, mtime, open, m_cache);
-
-      if (async) {
-        GetTransferManager()->GetExecutor()->SubmitAsync(
-            bind(boost::type<void>(), callback, _1),
-            bind(boost::type<shared_ptr<TransferHandle> >(),
-                 &QS::Client::TransferManager::DownloadFile,
-                 m_transferManager.get(), _1, offset_, downloadSize_, stream_,
-                 false),
-            filePath);
-      } else {
-        shared_ptr<TransferHandle> handle = m_transferManager->DownloadFile(
-            filePath, offset_, downloadSize_, stream_);
-        callback(handle);
+  // coalesce the parts into fewer requests
+  vector<RangeRequest> requests = m_rangePlanner->Plan(claimed);
+  BOOST_FOREACH (const RangeRequest &request, requests) {
+    shared_ptr<IOStream> stream_ = make_shared<IOStream>(request.m_size);
+    DownloadFileContentRangeCallback callback(filePath, request, stream_,
+                                              mtime, open, m_cache,
+                                              &m_inFlightRanges);
+    if (async) {
+      GetTransferManager()->GetExecutor()->SubmitAsync(
+          bind(boost::type<void>(), callback, _1),
+          bind(boost::type<shared_ptr<TransferHandle> >(),
+               &QS::Client::TransferManager::DownloadFile,
+               m_transferManager.get(), _1, request.m_offset, request.m_size,
+               stream_, false),
+          filePath);
+    } else {
+      shared_ptr<TransferHandle> handle = m_transferManager->DownloadFile(
+          filePath, request.m_offset, request.m_size, stream_);
+      callback(handle);
+    }
+  }
+  if (!async) {
+    // wait for the parts downloaded by others
+    BOOST_FOREACH (const ContentRangeDeque::value_type &range, missing) {
+      m_inFlightRanges.Wait(filePath, range.first, range.second);
+    }
+  }
+  DemoteColdPagesIfNeeded();
+}
+
+// --------------------------------------------------------------------------
+void Drive::RestoreDiskCache() {
+  string indexFile = GetDiskCacheIndexFile();
+  if (!m_diskCacheIndex.Load(indexFile)) {
+    return;
+  }
+  // The index is saved again when unmount, remove it now so it will not be
+  // used if the files are changed but qsfs exits unexpectedly.
+  RemoveFileIfExists(indexFile);
+
+  size_t numRestored = 0;
+  vector<DiskCacheRecord> records = m_diskCacheIndex.GetRecords();
+  BOOST_FOREACH (const DiskCacheRecord &record, records) {
+    if (m_cache->Restore(record.m_fileId, record.m_mtime, record.m_ranges)) {
+      ++numRestored;
+    } else {
+      m_diskCacheIndex.Take(record.m_fileId);
+      RemoveFileIfExists(
+          AppendPathDelim(
+              QS::Configure::Options::Instance().GetDiskCacheDirectory()) +
+          GetBaseName(record.m_fileId));
+    }
+  }
+  Info("Restore " + to_string(numRestored) + " files from disk cache " +
+       FormatPath(indexFile));
+}
+
+// --------------------------------------------------------------------------
+void Drive::PersistDiskCache() {
+  vector<string> fileIds = m_cache->GetFileIds();
+  // Files with the same base name share a disk file, they are not kept
+  map<string, size_t> baseNameCount;
+  BOOST_FOREACH (const string &fileId, fileIds) {
+    shared_ptr<File> file = m_cache->GetFile(fileId);
+    if (file) {
+      ++baseNameCount[file->GetBaseName()];
+    }
+  }
+
+  QS::Data::DiskCacheIndex index;
+  BOOST_FOREACH (const string &fileId, fileIds) {
+    shared_ptr<File> file = m_cache->GetFile(fileId);
+    if (!file || file->GetSize() == 0 || file->IsOpen() ||
+        file->GetBaseName() != GetBaseName(fileId) ||
+        baseNameCount[file->GetBaseName()] > 1) {
+      continue;
+    }
+    // A restored file not revalidated yet is kept with its original record
+    pair<bool, DiskCacheRecord> pending = m_diskCacheIndex.Take(fileId);
+    string eTag = pending.second.m_eTag;
+    uint64_t fileSize = pending.second.m_fileSize;
+    if (!pending.first) {
+      shared_ptr<Node> node = GetNodeSimple(fileId);
+      if (!(node && *node) || node->IsNeedUpload() ||
+          node->GetETag().empty()) {
+        continue;
       }
+      eTag = TrimETag(node->GetETag());
+      fileSize = node->GetFileSize();
+    }
+    pair<bool, ContentRangeDeque> res = m_cache->Persist(fileId);
+    if (res.first) {
+      index.Add(DiskCacheRecord(fileId, eTag, file->GetTime(), fileSize,
+                                res.second));
+    }
+  }
+
+  if (index.Save(GetDiskCacheIndexFile())) {
+    Info("Keep " + to_string(index.Size()) + " files in disk cache " +
+         FormatPath(GetDiskCacheIndexFile()));
+  }
+}
 
-      downloadedSize += downloadSize_;
-      remainingSize -= downloadSize_;
+// --------------------------------------------------------------------------
+void Drive::DemoteColdPagesIfNeeded() {
+  if (m_cache && m_cache->NeedDemote()) {
+    GetClient()->GetExecutor()->SubmitToThread(
+        bind(boost::type<uint64_t>(), &Cache::DemoteColdPages, m_cache));
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::RevalidateDiskCache(const string &filePath,
+                                const shared_ptr<Node> &node) {
+  if (m_diskCacheIndex.Empty()) {
+    return;
+  }
+  pair<bool, DiskCacheRecord> res = m_diskCacheIndex.Take(filePath);
+  if (!res.first) {
+    return;
+  }
+  const DiskCacheRecord &record = res.second;
+  if (node && *node && !node->GetETag().empty() &&
+      TrimETag(node->GetETag()) == record.m_eTag &&
+      node->GetFileSize() == record.m_fileSize) {
+    m_cache->SetTime(filePath, node->GetMTime());
+    DebugInfo("Reuse disk cache " + FormatPath(filePath));
+  } else {
+    m_cache->Erase(filePath);
+    DebugInfo("Drop outdated disk cache " + FormatPath(filePath));
+  }
+}
+
+// --------------------------------------------------------------------------
+size_t Drive::ShareCachedContent(const string &filePath,
+                                 const shared_ptr<Node> &node, off_t offset,
+                                 size_t size) {
+  if (!m_cache->IsDedup() || node->GetETag().empty()) {
+    return 0;
+  }
+  m_cache->SetContentKey(filePath, TrimETag(node->GetETag()),
+                         node->GetFileSize());
+  return m_cache->ShareContent(filePath, offset, size, node->GetMTime(),
+                               node->IsFileOpen());
+}
+
+// --------------------------------------------------------------------------
+void Drive::MarkDirty(const string &filePath, const shared_ptr<Node> &node) {
+  if (!m_writeBackQueue) {
+    return;
+  }
+  // the file is queued even if it is not cached, e.g. it fails to load the
+  // content kept by a truncate, the upload loads it again
+  if (!node->IsFileOpen() && m_cache->HasFile(filePath)) {
+    // e.g. truncate a closed file, keep it until it is uploaded
+    m_cache->SetFileOpen(filePath, true);
+  }
+  m_writeBackQueue->MarkDirty(filePath, m_cache->GetDirtySize(filePath),
+                              time(NULL));
+}
+
+// --------------------------------------------------------------------------
+vector<string> Drive::GetWriteBackFilesUnder(const string &dirPath) const {
+  string prefix = AppendPathDelim(dirPath);
+  vector<string> filePaths;
+  BOOST_FOREACH (const string &filePath, m_writeBackQueue->GetFilePaths()) {
+    if (filePath.compare(0, prefix.size(), prefix) == 0) {
+      filePaths.push_back(filePath);
+    }
+  }
+  return filePaths;
+}
+
+// --------------------------------------------------------------------------
+void Drive::RunFlusher() {
+  // wake up every second to check the expired files
+  while (m_writeBackQueue->WaitForFlush(1000)) {
+    FlushDirtyFiles(false);
+  }
+}
+
+// --------------------------------------------------------------------------
+void Drive::FlushDirtyFiles(bool all) {
+  vector<string> filePaths =
+      all ? m_writeBackQueue->PopAllFiles()
+          : m_writeBackQueue->PopFilesToFlush(time(NULL));
+  BOOST_FOREACH (const string &filePath, filePaths) {
+    shared_ptr<Node> node = GetNodeSimple(filePath);
+    if (!(node && *node) ||
+        !(node->IsNeedUpload() || m_cache->HasFile(filePath))) {
+      m_writeBackQueue->Erase(filePath);  // removed or uploaded meanwhile
+      continue;
+    }
+    try {
+      // upload one by one, so the files being uploaded are done before
+      // unmount
+      UploadFile(filePath, false, true, false);
+    } catch (const QSException &err) {
+      Error(err.get());
+      m_writeBackQueue->FinishFlush(filePath, m_cache->GetDirtySize(filePath),
+                                    time(NULL));
     }
   }
 }
@@ -20,13 +20,17 @@
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/scoped_ptr.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/condition_variable.hpp"
 #include "boost/thread/locks.hpp"
 #include "boost/thread/mutex.hpp"
+#include "boost/thread/thread.hpp"
 #include "boost/unordered_map.hpp"
 #include "boost/weak_ptr.hpp"
 
@@ -34,6 +38,13 @@
 #include "base/Singleton.hpp"
 #include "data/Cache.h"
 #include "data/DirectoryTree.h"
+#include "data/DiskCacheIndex.h"
+#include "data/InFlightRanges.h"
+#include "data/Journal.h"
+#include "data/RangePlanner.h"
+#include "data/Readahead.h"
+#include "data/StreamUploads.h"
+#include "data/WriteBackQueue.h"
 
 namespace QS {
 
@@ -64,6 +75,42 @@ class Drive : public Singleton<Drive> {
  public:
   bool IsMountable();
 
+  // Start the background flusher in write-back mode
+  //
+  // @param  : void
+  // @return : void
+  //
+  // Threads should be started from fuse init, as threads started before
+  // fuse_main exit when the process goes into the background.
+  void StartFlusher();
+
+  // Whether dirty files are uploaded by the background flusher
+  bool IsWriteBack() const { return m_writeBackQueue.get() != NULL; }
+
+  // Replay the changes left in journal by last mount and upload them
+  //
+  // @param  : void
+  // @return : void
+  //
+  // Uploads need the thread pools, so call it from fuse init.
+  void ReplayJournal();
+
+  // Flush the journal to the storage device, so the changes not uploaded
+  // survive a crash of the system
+  void SyncJournal();
+
+  // Start the thread to warm up cache by the manifest of options, which warms
+  // it up again whenever the manifest is changed
+  void StartWarmUp();
+
+  // Download the files listed in a manifest into cache, and pin them
+  //
+  // @param  : manifest file path
+  // @return : void
+  //
+  // Files pinned by the last manifest are unpinned if not pinned any more.
+  void WarmUpCache(const std::string &manifestFile);
+
   // accessor
   const boost::shared_ptr<QS::Client::Client> &GetClient() const {
     return m_client;
@@ -181,8 +228,15 @@ class Drive : public Singleton<Drive> {
   //
   // @param  : file path, asynchronously download file if not loaded yet
   // @return : void
+  //
+  // Only the metadata of the file is validated, its content is downloaded
+  // on demand by reads, unless the file is in the prefetch paths, in which
+  // case the whole file is downloaded.
   void OpenFile(const std::string &filePath, bool async = false);
 
+  // Whether a file is downloaded in full when opened
+  bool IsPrefetch(const std::string &filePath) const;
+
   // Read data from a file
   //
   // @param  : file path to read data from, offset, size, buf, flag doCheck
@@ -243,8 +297,13 @@ class Drive : public Singleton<Drive> {
                   bool updateMeta, bool async = false);
 
   // Release a file
+  //
+  // In write-back mode, a dirty file is kept in cache until it is uploaded.
   void ReleaseFile(const std::string &filePath);
 
+  // Ask the background flusher to upload a dirty file at once
+  void ExpediteFlush(const std::string &filePath);
+
   // Change access and modification times of a file
   //
   // @param  : file path, mtime
@@ -263,14 +322,120 @@ class Drive : public Singleton<Drive> {
   //
   // @param  : file path, file content ranges, asynchronously or synchronizely
   // @return : void
+  //
+  // The parts of the ranges being downloaded by others are not downloaded
+  // again, a synchronous download waits for them to finish instead. The rest
+  // are coalesced into requests by the range planner.
   void DownloadFileContentRanges(const std::string &filePath,
                                  const QS::Data::ContentRangeDeque &ranges,
                                  time_t mtime, bool fileOpen,
                                  bool async = false);
 
-  void DownloadFileContentRange(const std::string &filePath,
-                                const std::pair<off_t, size_t> &range,
-                                time_t mtime, bool fileOpen, bool async = false);
+  // Restore the files kept in disk cache directory since last unmount
+  //
+  // @param  : void
+  // @return : void
+  //
+  // Restored files are revalidated when they are accessed at first time.
+  void RestoreDiskCache();
+
+  // Keep the cached files in disk cache directory for next mount
+  //
+  // @param  : void
+  // @return : void
+  void PersistDiskCache();
+
+  // Revalidate the restored file with the latest meta
+  //
+  // @param  : file path, node of file (null if file not exists)
+  // @return : void
+  //
+  // The restored content is dropped unless the file etag and size are not
+  // changed since the content is cached.
+  void RevalidateDiskCache(const std::string &filePath,
+                           const boost::shared_ptr<QS::Data::Node> &node);
+
+  // Load the unloaded content of a file from the cached files with the same
+  // ETag and size, if cache dedup is enabled
+  //
+  // @param  : file path, node of file, range start, range size
+  // @return : size of the loaded bytes
+  size_t ShareCachedContent(const std::string &filePath,
+                            const boost::shared_ptr<QS::Data::Node> &node,
+                            off_t offset, size_t size);
+
+  // Demote cold file content from memory to disk files in background, if the
+  // in-memory cache is nearly full
+  void DemoteColdPagesIfNeeded();
+
+  // Queue a written file for the background flusher in write-back mode
+  //
+  // @param  : file path, file node
+  // @return : void
+  //
+  // The file is pinned in cache, so the dirty content is not evicted before
+  // it is uploaded. A file not in cache is queued as well, the flusher uploads
+  // it as long as it needs upload.
+  void MarkDirty(const std::string &filePath,
+                 const boost::shared_ptr<QS::Data::Node> &node);
+
+  // Return journal to record local changes, null if there is no journal or
+  // the changes are being replayed from it
+  QS::Data::Journal *GetActiveJournal() const {
+    return m_replayingJournal ? NULL : m_journal.get();
+  }
+
+  // Return the files in write-back queue under a directory
+  std::vector<std::string> GetWriteBackFilesUnder(
+      const std::string &dirPath) const;
+
+  // Loop of the background flusher until the write-back queue is stopped
+  void RunFlusher();
+
+  // Upload the dirty files popped from write-back queue
+  //
+  // @param  : flag to upload all dirty files synchronously
+  // @return : void
+  void FlushDirtyFiles(bool all);
+
+  // Loop of the warm-up thread until it is stopped
+  void RunWarmUp();
+
+  // Find the files under a directory recursively
+  //
+  // @param  : dir path, nodes to append the files to
+  // @return : void
+  void FindFilesRecursively(
+      const std::string &dirPath,
+      std::vector<boost::shared_ptr<QS::Data::Node> > *files);
+
+  // Download the files popped from the list shared by warm-up jobs
+  //
+  // @param  : file paths, index of next file to pop, lock of index
+  // @return : void
+  void RunWarmUpJob(const std::vector<std::string> *filePaths, size_t *next,
+                    boost::mutex *lock);
+
+  // Upload the parts of a file completed by the writes, until no part is
+  // ready or the streaming upload is stopped
+  void RunStreamUpload(const std::string &filePath);
+
+  // Stop the streaming upload of a file
+  //
+  // @param  : file path, file size
+  // @return : the upload to complete, which has a size of zero if none
+  //
+  // An upload which could not be completed is aborted.
+  QS::Data::StreamedUpload TakeStreamUpload(const std::string &filePath,
+                                            uint64_t fileSize);
+
+  // Abort the streaming upload of a file, e.g. it is removed or renamed
+  void AbortStreamUpload(const std::string &filePath);
+
+  bool IsWarmUpStopped() const {
+    boost::lock_guard<boost::mutex> locker(m_warmUpLock);
+    return m_stopWarmUp;
+  }
 
  private:
   boost::shared_ptr<QS::Client::Client> &GetClient() { return m_client; }
@@ -315,12 +480,43 @@ class Drive : public Singleton<Drive> {
   boost::shared_ptr<QS::Data::Cache> m_cache;
   boost::shared_ptr<QS::Data::DirectoryTree> m_directoryTree;
   StringToTransferHandleMap m_unfinishedMultipartUploadHandles;
+  // records of the restored files not revalidated yet
+  QS::Data::DiskCacheIndex m_diskCacheIndex;
+
+  // ranges being downloaded, which are not downloaded again meanwhile
+  QS::Data::InFlightRanges m_inFlightRanges;
+
+  // readahead windows of the files being read
+  boost::scoped_ptr<QS::Data::Readahead> m_readahead;
+  // coalescer of the ranges to download into fewer requests
+  boost::scoped_ptr<QS::Data::RangePlanner> m_rangePlanner;
+  // files or directories ending with '/' to download in full at open
+  std::vector<std::string> m_prefetchPaths;
+
+  // dirty files to upload in background, null if not in write-back mode
+  boost::scoped_ptr<QS::Data::WriteBackQueue> m_writeBackQueue;
+  boost::scoped_ptr<boost::thread> m_flusher;
+
+  // files uploaded while written, null if not to stream uploads
+  boost::scoped_ptr<QS::Data::StreamUploads> m_streamUploads;
+
+  // local changes not uploaded, null if not to journal
+  boost::scoped_ptr<QS::Data::Journal> m_journal;
+  bool m_replayingJournal;
+
+  // thread warming up cache by manifest, null if there is no manifest
+  boost::scoped_ptr<boost::thread> m_warmer;
+  mutable boost::mutex m_warmUpLock;
+  boost::condition_variable m_warmUpCond;  // wake up warmer to stop
+  bool m_stopWarmUp;
+  std::set<std::string> m_warmUpPinned;  // files pinned by last manifest
 
   friend class Singleton<Drive>;
   friend class QS::Client::QSClient;
   friend class QS::Client::QSTransferManager;  // for cache
   friend void qsfs_destroy(void *userdata);
   friend struct UploadFileCallback;
+  friend struct RenameDirCallback;
 };
 
 }  // namespace FileSystem
@@ -34,6 +34,19 @@ namespace HelpText {
 
 using boost::to_string;
 using QS::Configure::Default::GetDefaultCredentialsFile;
+using QS::Configure::Default::GetDefaultCacheBlockSize;
+using QS::Configure::Default::GetDefaultMaxDiskCacheSize;
+using QS::Configure::Default::GetDefaultDirtyExpireTime;
+using QS::Configure::Default::GetDefaultMaxDirtySize;
+using QS::Configure::Default::GetDefaultMaxRangeGap;
+using QS::Configure::Default::GetDefaultMaxReadahead;
+using QS::Configure::Default::GetDefaultPinQuota;
+using QS::Configure::Default::GetDefaultWarmUpJobs;
+using QS::Configure::Default::GetDefaultMaxMemorySize;
+using QS::Configure::Default::GetDefaultMaxPageSize;
+using QS::Configure::Default::GetDefaultCachePolicyName;
+using QS::Configure::Default::GetDefaultCacheShards;
+using QS::Configure::Default::GetMaxCacheShards;
 using QS::Configure::Default::GetDefaultDiskCacheDirectory;
 using QS::Configure::Default::GetDefaultDirMode;
 using QS::Configure::Default::GetDefaultFileMode;
@@ -96,8 +109,87 @@ void ShowQSFSHelp() {
                                           << " seconds\n"
   "  -Z, --maxcache     Max in-memory cache size(MB) for files, default value is "
                         << to_string(GetMaxCacheSize() / QS::Size::MB1) << "MB\n"
+  "      --cacheshards  Number of independently locked shards of file cache, increase\n"
+  "                     it for parallel access to many files, at most "
+                        << to_string(GetMaxCacheShards()) << ", default value is "
+                        << to_string(GetDefaultCacheShards()) << "\n"
+  "      --blocksize    Store file data in fixed size blocks(KB) instead of pages,\n"
+  "                     the value should be power of two, e.g. 1024. A value of zero\n"
+  "                     will use pages, default value is "
+                        << to_string(GetDefaultCacheBlockSize() / QS::Size::KB1) << "\n"
+  "      --maxpage      Max size(MB) of a page merged from successive writes or\n"
+  "                     downloads of a file. A value of zero will not merge pages,\n"
+  "                     default value is "
+                        << to_string(GetDefaultMaxPageSize() / QS::Size::MB1) << "MB\n"
+  "      --maxdiskcache Max disk cache size(MB) for files, cold data is moved from\n"
+  "                     in-memory cache to disk cache and hot data is moved back.\n"
+  "                     A value of zero is only limited by free disk space, default\n"
+  "                     value is "
+                        << to_string(GetDefaultMaxDiskCacheSize() / QS::Size::MB1) << "MB\n"
+  "      --cachepolicy  Specify the policy to evict files from cache, one of lru, 2q,\n"
+  "                     arc and tinylfu. 2q, arc and tinylfu keep the files accessed\n"
+  "                     repeatedly from being flushed by a scan over many files,\n"
+  "                     default policy is " << GetDefaultCachePolicyName() << "\n"
+  "      --maxmemory    Max memory(MB) used by file data cache, file meta data,\n"
+  "                     directory tree and transfer buffers together. Caches free\n"
+  "                     their least recently used data when it is exceeded. A value\n"
+  "                     of zero means no limit, default value is "
+                        << to_string(GetDefaultMaxMemorySize() / QS::Size::MB1) << "MB\n"
   "  -k, --diskdir      Specify the directory to store file data when in-memory cache\n"
   "                     is not availabe, default path is " << GetDefaultDiskCacheDirectory() << "\n"
+  "      --persistcache Keep the disk cache directory when unmount, the cached files\n"
+  "                     are reused after remount if their ETags are not changed\n"
+  "      --compress     Compress the cold pages of in-memory cache with LZ4 before\n"
+  "                     moving them to disk cache, so more data fits in memory for\n"
+  "                     compressible files, e.g. logs and JSON\n"
+  "      --hugepages    Back the slabs holding the page buffers of in-memory cache\n"
+  "                     with transparent huge pages, which saves TLB misses for a\n"
+  "                     large cache\n"
+  "      --dedup        Share the cached pages of the files with the same ETag and\n"
+  "                     size, e.g. copies of an object, so they are downloaded and\n"
+  "                     held in memory only once. A file written locally gets its\n"
+  "                     own copy of the pages\n"
+  "      --writeback    Acknowledge flush and fsync locally and upload the written\n"
+  "                     files by a background flusher, when they get older than\n"
+  "                     --dirtyexpire or when the written bytes not uploaded exceed\n"
+  "                     half of --maxdirty\n"
+  "      --streamupload Upload the files written sequentially from the beginning\n"
+  "                     part by part while they are written, so only the tail is\n"
+  "                     left to send when they are flushed\n"
+  "      --maxdirty     Max size(MB) of the written bytes not uploaded in write-back\n"
+  "                     mode, writers wait for the flusher when it is reached. A\n"
+  "                     value of zero means no limit, default value is "
+                        << to_string(GetDefaultMaxDirtySize() / QS::Size::MB1) << "MB\n"
+  "      --dirtyexpire  Time(seconds) a written file waits before it is uploaded in\n"
+  "                     write-back mode, default value is "
+                        << to_string(GetDefaultDirtyExpireTime()) << " seconds\n"
+  "      --journaldir   Record the changes not uploaded in the directory, they are\n"
+  "                     replayed at next mount if qsfs crashes. Use a directory\n"
+  "                     per mount, default is not to record\n"
+  "      --warmup       Specify a manifest of the files and directories to download\n"
+  "                     into cache at mount, one path per line which could be\n"
+  "                     preceded by a priority and 'pin', e.g. 'pin 10 /models/'.\n"
+  "                     The cache is warmed up again when the manifest is changed\n"
+  "      --warmupjobs   Max number of files to download in parallel for warm-up,\n"
+  "                     default value is " << to_string(GetDefaultWarmUpJobs()) << "\n"
+  "      --pinquota     Max size(MB) of the files pinned by the warm-up manifest,\n"
+  "                     which are not evicted from cache. A value of zero means not\n"
+  "                     to pin, default value is "
+                        << to_string(GetDefaultPinQuota() / QS::Size::MB1) << "MB\n"
+  "      --readahead    Max size(MB) of the content downloaded ahead of a file read\n"
+  "                     sequentially, the window grows from 1MB as the reads go on\n"
+  "                     and shrinks at random reads. A value of zero means not to\n"
+  "                     read ahead, default value is "
+                        << to_string(GetDefaultMaxReadahead() / QS::Size::MB1) << "MB\n"
+  "      --rangegap     Max size(KB) of the cached gap between two ranges which are\n"
+  "                     downloaded in one request rather than two. A value of zero\n"
+  "                     means to download adjacent ranges only in one request,\n"
+  "                     default value is "
+                        << to_string(GetDefaultMaxRangeGap() / QS::Size::KB1) << "KB\n"
+  "      --prefetch     Specify the files and directories which are downloaded in\n"
+  "                     full when opened, separated by ':', e.g. '/models/:/a.json'.\n"
+  "                     A path ending with '/' covers all the files under it. Other\n"
+  "                     files are downloaded on demand by reads, default is none\n"
   "  -t, --maxstat      Max count(K) of cached stat entrys, default value is "
                         << to_string(GetMaxStatCount() / QS::Size::K1) << "K\n"
   "  -e, --statexpire   Expire time(minutes) for stat entries, negative value will\n"
@@ -142,7 +234,17 @@ void ShowQSFSUsage() {
   "       [-F|--filemode=[octal-mode]] [-D|--dirmode=[octal-mode]]\n"
   "       [-u|--umaskmp=[octal-mode]]\n"
   "       [-r|--retries=[value]] [-R|reqtimeout=[value]]\n"
-  "       [-Z|--maxcache=[value]] [-k|--diskdir=[value]]\n"
+  "       [-Z|--maxcache=[value]] [--cacheshards=[value]]\n"
+  "       [--blocksize=[value]] [--maxpage=[value]]\n"
+  "       [--maxdiskcache=[value]] [--cachepolicy=[value]]\n"
+  "       [--maxmemory=[value]]\n"
+  "       [-k|--diskdir=[value]] [--persistcache] [--compress]\n"
+  "       [--hugepages] [--dedup]\n"
+  "       [--writeback] [--maxdirty=[value]] [--dirtyexpire=[value]]\n"
+  "       [--streamupload]\n"
+  "       [--journaldir=[value]]\n"
+  "       [--warmup=[value]] [--warmupjobs=[value]] [--pinquota=[value]]\n"
+  "       [--readahead=[value]] [--rangegap=[value]] [--prefetch=[value]]\n"
   "       [-t|--maxstat=[value]] [-e|--statexpire=[value]]\n"
   "       [-i|--maxlist=[value]]\n"
   "       [-n|--numtransfer=[value]] [-b|--bufsize=value]]\n"
@@ -990,7 +990,7 @@ int qsfs_open(const char* path, struct fuse_file_info* fi) {
       }
 
       // Do Open
-      drive.OpenFile(path, false);  // load file synchronizely if not exist
+      drive.OpenFile(path, false);  // only prefetch paths are loaded here
     }
   } catch (const QSException& err) {
     Error(err.get());
@@ -1195,8 +1195,11 @@ int qsfs_flush(const char* path, struct fuse_file_info* fi) {
       throw QSException("No access permission " + FormatPath(path_));
     }
 
-    // Write the file to object storage
-    if (node->IsNeedUpload()) {
+    // Changes not uploaded yet are kept by journal on the storage device
+    Drive::Instance().SyncJournal();
+    // Write the file to object storage, which is left to the background
+    // flusher in write-back mode
+    if (node->IsNeedUpload() && !Drive::Instance().IsWriteBack()) {
       try {
         bool releasefile = false;
         bool updatemeta = true;
@@ -1287,8 +1290,12 @@ int qsfs_fsync(const char* path, int datasync, struct fuse_file_info* fi) {
       ret = -ENOENT;
       throw QSException("No such file or directory " + FormatPath(path_));
     }
+    Drive::Instance().SyncJournal();
     // Write the file to object storage
-    if (node->IsNeedUpload()) {
+    if (Drive::Instance().IsWriteBack()) {
+      // acknowledged locally, ask the background flusher to upload it soon
+      Drive::Instance().ExpediteFlush(path_);
+    } else if (node->IsNeedUpload()) {
       try {
         bool releasefile = false;
         bool updatemeta = datasync == 0;
@@ -1516,6 +1523,9 @@ void* qsfs_init(struct fuse_conn_info* conn) {
   // Threads should be started from the init() method. Threads started
   // before fuse_main will exit when the process goes into the background.
   QS::Threading::ThreadPoolInitializer::Instance().DoInitialize();
+  drive.StartFlusher();
+  drive.ReplayJournal();
+  drive.StartWarmUp();
 
   return static_cast<QS::FileSystem::Drive*>(fuse_get_context()->private_data);
 }
@@ -51,6 +51,19 @@ namespace {
 
 using boost::to_string;
 using QS::Configure::Default::GetClientDefaultPoolSize;
+using QS::Configure::Default::GetDefaultCacheBlockSize;
+using QS::Configure::Default::GetDefaultMaxDiskCacheSize;
+using QS::Configure::Default::GetDefaultDirtyExpireTime;
+using QS::Configure::Default::GetDefaultMaxDirtySize;
+using QS::Configure::Default::GetDefaultMaxRangeGap;
+using QS::Configure::Default::GetDefaultMaxReadahead;
+using QS::Configure::Default::GetDefaultPinQuota;
+using QS::Configure::Default::GetDefaultWarmUpJobs;
+using QS::Configure::Default::GetDefaultMaxMemorySize;
+using QS::Configure::Default::GetDefaultMaxPageSize;
+using QS::Configure::Default::GetDefaultCachePolicyName;
+using QS::Configure::Default::GetDefaultCacheShards;
+using QS::Configure::Default::GetMaxCacheShards;
 using QS::Configure::Default::GetDefaultCredentialsFile;
 using QS::Configure::Default::GetDefaultDiskCacheDirectory;
 using QS::Configure::Default::GetDefaultDirMode;
@@ -104,7 +117,28 @@ static struct options {
   int retries;           // transaction retries
   int reqtimeout;    // in ms
   int maxcache;      // in MB
+  int cacheshards;
+  int blocksize;     // in KB
+  int maxpagesize;   // in MB
+  int maxdiskcache;  // in MB
+  const char *cachepolicy;  // lru, 2q, arc, tinylfu
+  int maxmemory;     // in MB
   const char *diskdir;
+  int persistcache;  // default not keep disk cache when unmount
+  int compress;      // default not compress cold pages
+  int hugepages;     // default not use huge pages for page buffers
+  int dedup;         // default not share pages of the same content
+  int writeback;     // default upload dirty file at flush
+  int streamupload;  // default upload written file at flush in one go
+  int maxdirty;      // in MB
+  int dirtyexpire;   // in seconds
+  const char *journaldir;  // empty not to journal
+  const char *warmup;  // manifest file, empty not to warm up
+  int warmupjobs;
+  int pinquota;      // in MB
+  int readahead;     // in MB
+  int rangegap;      // in KB
+  const char *prefetch;  // paths to download in full at open
   int maxstat;       // in K
   int maxlist;       // max file count for ls
   int statexpire;    // in mins, negative value disable state expire
@@ -148,7 +182,28 @@ static const struct fuse_opt optionSpec[] = {
     OPTION("-r=%i", retries),        OPTION("--retries=%i",     retries),
     OPTION("-R=%i", reqtimeout),     OPTION("--reqtimeout=%i",  reqtimeout),
     OPTION("-Z=%i", maxcache),       OPTION("--maxcache=%i",    maxcache),
+                                     OPTION("--cacheshards=%i", cacheshards),
+                                     OPTION("--blocksize=%i",   blocksize),
+                                     OPTION("--maxpage=%i",     maxpagesize),
+                                     OPTION("--maxdiskcache=%i", maxdiskcache),
+                                     OPTION("--cachepolicy=%s", cachepolicy),
+                                     OPTION("--maxmemory=%i",   maxmemory),
     OPTION("-k=%s", diskdir),        OPTION("--diskdir=%s",     diskdir),
+                                     OPTION("--persistcache",   persistcache),
+                                     OPTION("--compress",       compress),
+                                     OPTION("--hugepages",      hugepages),
+                                     OPTION("--dedup",          dedup),
+                                     OPTION("--writeback",      writeback),
+                                     OPTION("--streamupload",   streamupload),
+                                     OPTION("--maxdirty=%i",    maxdirty),
+                                     OPTION("--dirtyexpire=%i", dirtyexpire),
+                                     OPTION("--journaldir=%s",  journaldir),
+                                     OPTION("--warmup=%s",      warmup),
+                                     OPTION("--warmupjobs=%i",  warmupjobs),
+                                     OPTION("--pinquota=%i",    pinquota),
+                                     OPTION("--readahead=%i",   readahead),
+                                     OPTION("--rangegap=%i",    rangegap),
+                                     OPTION("--prefetch=%s",    prefetch),
     OPTION("-t=%i", maxstat),        OPTION("--maxstat=%i",     maxstat),
     OPTION("-i=%i", maxlist),        OPTION("--maxlist=%i",     maxlist),
     OPTION("-e=%i", statexpire),     OPTION("--statexpire=%i",  statexpire),
@@ -247,7 +302,28 @@ void Parse(int argc, char **argv) {
   options.retries        = GetDefaultTransactionRetries();
   options.reqtimeout     = GetDefaultTransactionTimeDuration();
   options.maxcache       = GetMaxCacheSize() / QS::Size::MB1;
+  options.cacheshards    = GetDefaultCacheShards();
+  options.blocksize      = GetDefaultCacheBlockSize() / QS::Size::KB1;
+  options.maxpagesize    = GetDefaultMaxPageSize() / QS::Size::MB1;
+  options.maxdiskcache   = GetDefaultMaxDiskCacheSize() / QS::Size::MB1;
+  options.cachepolicy    = strdup(GetDefaultCachePolicyName().c_str());
+  options.maxmemory      = GetDefaultMaxMemorySize() / QS::Size::MB1;
   options.diskdir        = strdup(GetDefaultDiskCacheDirectory().c_str());
+  options.persistcache   = 0;
+  options.compress       = 0;
+  options.hugepages      = 0;
+  options.dedup          = 0;
+  options.writeback      = 0;
+  options.streamupload   = 0;
+  options.maxdirty       = GetDefaultMaxDirtySize() / QS::Size::MB1;
+  options.dirtyexpire    = GetDefaultDirtyExpireTime();
+  options.journaldir     = strdup("");
+  options.warmup         = strdup("");
+  options.prefetch       = strdup("");
+  options.warmupjobs     = GetDefaultWarmUpJobs();
+  options.pinquota       = GetDefaultPinQuota() / QS::Size::MB1;
+  options.readahead      = GetDefaultMaxReadahead() / QS::Size::MB1;
+  options.rangegap       = GetDefaultMaxRangeGap() / QS::Size::KB1;
   options.maxstat        = GetMaxStatCount() / QS::Size::K1;
   options.maxlist        = GetMaxListObjectsCount();
   options.statexpire     =  -1;
@@ -321,7 +397,120 @@ void Parse(int argc, char **argv) {
     qsOptions.SetMaxCacheSizeInMB(options.maxcache);
   }
 
+  if (options.cacheshards <= 0) {
+    PrintWarnMsg("--cacheshards", options.cacheshards, GetDefaultCacheShards());
+    qsOptions.SetCacheShards(GetDefaultCacheShards());
+  } else if (static_cast<size_t>(options.cacheshards) > GetMaxCacheShards()) {
+    string msg =
+        "Cache shards should not exceed " + to_string(GetMaxCacheShards());
+    PrintWarnMsg("--cacheshards", options.cacheshards, GetDefaultCacheShards(),
+                 msg.c_str());
+    qsOptions.SetCacheShards(GetDefaultCacheShards());
+  } else {
+    qsOptions.SetCacheShards(options.cacheshards);
+  }
+
+  // block size should be power of two
+  if (options.blocksize < 0 ||
+      (options.blocksize & (options.blocksize - 1)) != 0) {
+    PrintWarnMsg("--blocksize", options.blocksize,
+                 GetDefaultCacheBlockSize() / QS::Size::KB1,
+                 "Block size should be power of two.");
+    qsOptions.SetCacheBlockSizeInKB(GetDefaultCacheBlockSize() /
+                                    QS::Size::KB1);
+  } else {
+    qsOptions.SetCacheBlockSizeInKB(options.blocksize);
+  }
+
+  if (options.maxpagesize < 0) {
+    PrintWarnMsg("--maxpage", options.maxpagesize,
+                 GetDefaultMaxPageSize() / QS::Size::MB1);
+    qsOptions.SetMaxPageSizeInMB(GetDefaultMaxPageSize() / QS::Size::MB1);
+  } else {
+    qsOptions.SetMaxPageSizeInMB(options.maxpagesize);
+  }
+
+  if (options.maxdiskcache < 0) {
+    PrintWarnMsg("--maxdiskcache", options.maxdiskcache,
+                 GetDefaultMaxDiskCacheSize() / QS::Size::MB1);
+    qsOptions.SetMaxDiskCacheSizeInMB(GetDefaultMaxDiskCacheSize() /
+                                      QS::Size::MB1);
+  } else {
+    qsOptions.SetMaxDiskCacheSizeInMB(options.maxdiskcache);
+  }
+
+  qsOptions.SetCachePolicy(options.cachepolicy);
+
+  if (options.maxmemory < 0) {
+    PrintWarnMsg("--maxmemory", options.maxmemory,
+                 GetDefaultMaxMemorySize() / QS::Size::MB1);
+    qsOptions.SetMaxMemoryInMB(GetDefaultMaxMemorySize() / QS::Size::MB1);
+  } else {
+    qsOptions.SetMaxMemoryInMB(options.maxmemory);
+  }
+
   qsOptions.SetDiskCacheDirectory(options.diskdir);
+  qsOptions.SetPersistDiskCache(options.persistcache != 0);
+  qsOptions.SetCompressCache(options.compress != 0);
+  qsOptions.SetHugePages(options.hugepages != 0);
+  qsOptions.SetDedupCache(options.dedup != 0);
+  qsOptions.SetWriteBack(options.writeback != 0);
+  qsOptions.SetStreamUpload(options.streamupload != 0);
+
+  if (options.maxdirty < 0) {
+    PrintWarnMsg("--maxdirty", options.maxdirty,
+                 GetDefaultMaxDirtySize() / QS::Size::MB1);
+    qsOptions.SetMaxDirtySizeInMB(GetDefaultMaxDirtySize() / QS::Size::MB1);
+  } else {
+    qsOptions.SetMaxDirtySizeInMB(options.maxdirty);
+  }
+
+  if (options.dirtyexpire < 0) {
+    PrintWarnMsg("--dirtyexpire", options.dirtyexpire,
+                 GetDefaultDirtyExpireTime());
+    qsOptions.SetDirtyExpireInSec(GetDefaultDirtyExpireTime());
+  } else {
+    qsOptions.SetDirtyExpireInSec(options.dirtyexpire);
+  }
+
+  qsOptions.SetJournalDirectory(options.journaldir);
+  qsOptions.SetWarmUpManifest(options.warmup);
+
+  if (options.warmupjobs <= 0) {
+    PrintWarnMsg("--warmupjobs", options.warmupjobs, GetDefaultWarmUpJobs());
+    qsOptions.SetWarmUpJobs(GetDefaultWarmUpJobs());
+  } else {
+    qsOptions.SetWarmUpJobs(options.warmupjobs);
+  }
+
+  if (options.pinquota < 0 ||
+      static_cast<uint64_t>(options.pinquota) >
+          qsOptions.GetMaxCacheSizeInMB()) {
+    PrintWarnMsg("--pinquota", options.pinquota,
+                 GetDefaultPinQuota() / QS::Size::MB1,
+                 "Pin quota should not exceed max cache");
+    qsOptions.SetPinQuotaInMB(GetDefaultPinQuota() / QS::Size::MB1);
+  } else {
+    qsOptions.SetPinQuotaInMB(options.pinquota);
+  }
+
+  if (options.readahead < 0) {
+    PrintWarnMsg("--readahead", options.readahead,
+                 GetDefaultMaxReadahead() / QS::Size::MB1);
+    qsOptions.SetMaxReadaheadInMB(GetDefaultMaxReadahead() / QS::Size::MB1);
+  } else {
+    qsOptions.SetMaxReadaheadInMB(options.readahead);
+  }
+
+  if (options.rangegap < 0) {
+    PrintWarnMsg("--rangegap", options.rangegap,
+                 GetDefaultMaxRangeGap() / QS::Size::KB1);
+    qsOptions.SetMaxRangeGapInKB(GetDefaultMaxRangeGap() / QS::Size::KB1);
+  } else {
+    qsOptions.SetMaxRangeGapInKB(options.rangegap);
+  }
+
+  qsOptions.SetPrefetchPaths(options.prefetch);
 
   if (options.maxstat <= 0) {
     PrintWarnMsg("-t|--maxstat", options.maxstat,
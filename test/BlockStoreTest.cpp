@@ -0,0 +1,268 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "boost/make_shared.hpp"
+#include "boost/shared_ptr.hpp"
+#include "boost/tuple/tuple.hpp"
+
+#include "base/Logging.h"
+#include "base/Utils.h"
+#include "base/UtilsWithLog.h"
+#include "configure/Options.h"
+#include "data/BlockStore.h"
+#include "data/DiskFile.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::make_shared;
+using boost::shared_ptr;
+using boost::tuple;
+using QS::UtilsWithLog::RemoveFileIfExists;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+// default log dir
+static const char *defaultLogDir = "/tmp/qsfs.test.logs/";
+void InitLog() {
+  QS::Utils::CreateDirectoryIfNotExists(defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(defaultLogDir);
+}
+
+class BlockStoreTest : public Test {
+ protected:
+  static void SetUpTestCase() { InitLog(); }
+
+  void TestWrite(const shared_ptr<DiskFile> &diskFile) {
+    size_t blockSize = 4;
+    BlockStore store(blockSize);
+
+    // write [2, 5) which across block 0 and block 1
+    tuple<bool, size_t, size_t> res = store.Write(2, 3, "abc", diskFile);
+    EXPECT_TRUE(boost::get<0>(res));
+    EXPECT_EQ(boost::get<1>(res), !diskFile ? 2 * blockSize : 0u);
+    EXPECT_EQ(boost::get<2>(res), 3u);
+    EXPECT_EQ(store.GetNumBlocks(), 2u);
+    EXPECT_EQ(store.GetValidSize(), 3u);
+    EXPECT_TRUE(store.HasData(2, 3));
+    EXPECT_FALSE(store.HasData(1, 3));
+    EXPECT_FALSE(store.HasData(2, 4));
+
+    ContentRangeDeque unloaded;
+    unloaded.push_back(make_pair(0, 2));
+    unloaded.push_back(make_pair(5, 4));
+    EXPECT_EQ(store.GetUnloadedRanges(0, 9), unloaded);
+
+    // overwrite and fill block 0
+    res = store.Write(0, 4, "0123", diskFile);
+    EXPECT_TRUE(boost::get<0>(res));
+    EXPECT_EQ(boost::get<1>(res), 0u);
+    EXPECT_EQ(boost::get<2>(res), 2u);
+    EXPECT_EQ(store.GetValidSize(), 5u);
+    EXPECT_TRUE(store.HasData(0, 5));
+
+    // write block 2 with a hole in block 1
+    res = store.Write(7, 2, "xy", diskFile);
+    EXPECT_TRUE(boost::get<0>(res));
+    EXPECT_EQ(store.GetValidSize(), 7u);
+    ContentRangeDeque unloaded1;
+    unloaded1.push_back(make_pair(5, 2));
+    unloaded1.push_back(make_pair(9, 1));
+    EXPECT_EQ(store.GetUnloadedRanges(0, 10), unloaded1);
+
+    vector<char> buf(9, '-');
+    EXPECT_EQ(store.Read(0, 9, &buf[0], diskFile), 7u);
+    EXPECT_EQ(string(buf.begin(), buf.end()), string("0123c--xy"));
+  }
+
+  void TestTruncate() {
+    size_t blockSize = 4;
+    BlockStore store(blockSize);
+    store.Write(0, 10, "0123456789", shared_ptr<DiskFile>());
+    EXPECT_EQ(store.GetNumBlocks(), 3u);
+    EXPECT_EQ(store.GetMemorySize(), 3 * blockSize);
+
+    pair<size_t, size_t> removed = store.Truncate(6);
+    EXPECT_EQ(removed.first, blockSize);
+    EXPECT_EQ(removed.second, 4u);
+    EXPECT_EQ(store.GetValidSize(), 6u);
+    EXPECT_TRUE(store.HasData(0, 6));
+    EXPECT_FALSE(store.HasData(0, 7));
+
+    removed = store.Truncate(0);
+    EXPECT_EQ(removed.first, 2 * blockSize);
+    EXPECT_EQ(removed.second, 6u);
+    EXPECT_EQ(store.GetNumBlocks(), 0u);
+    EXPECT_EQ(store.GetMemorySize(), 0u);
+  }
+
+  void TestPersistRestore(const shared_ptr<DiskFile> &diskFile) {
+    size_t blockSize = 4;
+    BlockStore store(blockSize);
+    store.Write(2, 5, "abcde", shared_ptr<DiskFile>());
+    store.Write(8, 4, "wxyz", shared_ptr<DiskFile>());
+    EXPECT_EQ(store.GetMemorySize(), 3 * blockSize);
+    ContentRangeDeque loaded;
+    loaded.push_back(make_pair(2, 5));
+    loaded.push_back(make_pair(8, 4));
+    EXPECT_EQ(store.GetLoadedRanges(), loaded);
+
+    pair<bool, size_t> res = store.Persist(diskFile);
+    EXPECT_TRUE(res.first);
+    EXPECT_EQ(res.second, 3 * blockSize);
+    EXPECT_EQ(store.GetMemorySize(), 0u);
+    EXPECT_EQ(store.GetLoadedRanges(), loaded);
+
+    BlockStore store1(blockSize);
+    EXPECT_EQ(store1.Restore(2, 5) + store1.Restore(8, 4), 9u);
+    EXPECT_EQ(store1.GetValidSize(), 9u);
+    EXPECT_EQ(store1.GetMemorySize(), 0u);
+    EXPECT_EQ(store1.GetLoadedRanges(), loaded);
+    vector<char> buf(12, '-');
+    EXPECT_EQ(store1.Read(0, 12, &buf[0], diskFile), 9u);
+    EXPECT_EQ(string(buf.begin(), buf.end()), string("--abcde-wxyz"));
+  }
+
+  void TestDemotePromote(const shared_ptr<DiskFile> &diskFile) {
+    size_t blockSize = 4;
+    BlockStore store(blockSize);
+    store.Write(0, 4, "0123", shared_ptr<DiskFile>());
+    store.Write(4, 4, "abcd", shared_ptr<DiskFile>());
+    store.Touch(4, 4);  // block 0 is the least recently accessed
+    pair<bool, size_t> res = store.Demote(1, diskFile);
+    EXPECT_TRUE(res.first);
+    EXPECT_EQ(res.second, blockSize);
+    EXPECT_EQ(store.GetMemorySize(), blockSize);
+    EXPECT_EQ(store.GetDiskSize(), blockSize);
+    vector<char> buf(8, '-');
+    EXPECT_EQ(store.Read(0, 8, &buf[0], diskFile), 8u);
+    EXPECT_EQ(string(buf.begin(), buf.end()), string("0123abcd"));
+
+    EXPECT_EQ(store.GetPromotableSize(0, 8, 2), 0u);
+    store.Touch(0, 4);
+    store.Touch(0, 4);
+    EXPECT_EQ(store.GetPromotableSize(0, 8, 2), blockSize);
+    EXPECT_EQ(store.Promote(0, 8, 2, diskFile), blockSize);
+    EXPECT_EQ(store.GetMemorySize(), 2 * blockSize);
+    EXPECT_EQ(store.GetDiskSize(), 0u);
+    EXPECT_EQ(store.Read(0, 4, &buf[0], shared_ptr<DiskFile>()), 4u);
+    EXPECT_EQ(string(buf.begin(), buf.begin() + 4), string("0123"));
+
+    store.Demote(2 * blockSize, diskFile);
+    EXPECT_EQ(store.GetMemorySize(), 0u);
+    EXPECT_EQ(store.GetDiskSize(), 2 * blockSize);
+    EXPECT_EQ(store.DropDiskBlocks(), 8u);
+    EXPECT_EQ(store.GetNumBlocks(), 0u);
+    EXPECT_EQ(store.GetDiskSize(), 0u);
+  }
+
+  void TestEvict(const shared_ptr<DiskFile> &diskFile) {
+    size_t blockSize = 4;
+    BlockStore store(blockSize);
+    store.Write(0, 4, "0123", shared_ptr<DiskFile>());
+    store.Write(4, 4, "abcd", shared_ptr<DiskFile>());
+    store.Write(8, 4, "ABCD", shared_ptr<DiskFile>());
+    store.Touch(0, 4);  // block 1 is the least recently accessed
+    pair<size_t, size_t> res = store.Evict(1, false, diskFile, ContentRangeDeque());
+    EXPECT_EQ(res.first, blockSize);
+    EXPECT_EQ(res.second, blockSize);
+    EXPECT_EQ(store.GetMemorySize(), 2 * blockSize);
+    EXPECT_EQ(store.GetValidSize(), 2 * blockSize);
+    EXPECT_FALSE(store.HasData(4, 4));
+
+    store.Demote(2 * blockSize, diskFile);
+    res = store.Evict(1, true, diskFile, ContentRangeDeque());  // block 2
+    EXPECT_EQ(res.first, blockSize);
+    EXPECT_EQ(store.GetDiskSize(), blockSize);
+    EXPECT_EQ(store.GetValidSize(), blockSize);
+    EXPECT_FALSE(store.HasData(8, 4));
+    vector<char> buf(4, '-');
+    EXPECT_EQ(store.Read(0, 4, &buf[0], diskFile), 4u);
+    EXPECT_EQ(string(buf.begin(), buf.end()), string("0123"));
+  }
+};
+
+TEST_F(BlockStoreTest, Default) {
+  BlockStore store(1000);  // round up to power of two
+  EXPECT_EQ(store.GetBlockSize(), 1024u);
+  EXPECT_EQ(store.GetNumBlocks(), 0u);
+  EXPECT_TRUE(store.HasData(0, 0));
+  EXPECT_FALSE(store.HasData(0, 1));
+  ContentRangeDeque unloaded;
+  unloaded.push_back(make_pair(0, 1));
+  EXPECT_EQ(store.GetUnloadedRanges(0, 1), unloaded);
+}
+
+TEST_F(BlockStoreTest, Write) { TestWrite(shared_ptr<DiskFile>()); }
+
+TEST_F(BlockStoreTest, WriteDiskFile) {
+  string path = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+                "test_blockstore";
+  RemoveFileIfExists(path);
+  shared_ptr<DiskFile> diskFile = make_shared<DiskFile>(path);
+  TestWrite(diskFile);
+  diskFile->Remove();
+}
+
+TEST_F(BlockStoreTest, Truncate) { TestTruncate(); }
+
+TEST_F(BlockStoreTest, PersistRestore) {
+  string path = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+                "test_blockstore_persist";
+  RemoveFileIfExists(path);
+  shared_ptr<DiskFile> diskFile = make_shared<DiskFile>(path);
+  TestPersistRestore(diskFile);
+  diskFile->Remove();
+}
+
+TEST_F(BlockStoreTest, DemotePromote) {
+  string path = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+                "test_blockstore_demote";
+  RemoveFileIfExists(path);
+  shared_ptr<DiskFile> diskFile = make_shared<DiskFile>(path);
+  TestDemotePromote(diskFile);
+  diskFile->Remove();
+}
+
+TEST_F(BlockStoreTest, Evict) {
+  string path = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+                "test_blockstore_evict";
+  RemoveFileIfExists(path);
+  shared_ptr<DiskFile> diskFile = make_shared<DiskFile>(path);
+  TestEvict(diskFile);
+  diskFile->Remove();
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
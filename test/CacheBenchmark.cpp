@@ -0,0 +1,122 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+// Benchmark of cache throughput versus thread count.
+//
+// Each thread writes its own set of files into the cache and then reads them
+// repeatedly, so all threads run in parallel when their files are hashed to
+// different shards. The throughput is reported for a single shard cache and
+// for a sharded cache.
+//
+// Usage: CacheBenchmark [max threads] [num shards]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/exception/to_string.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "base/Logging.h"
+#include "base/Size.h"
+#include "base/Utils.h"
+#include "data/Cache.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::to_string;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+static const char *defaultLogDir = "/tmp/qsfs.benchmark.logs/";
+static const int kFilesPerThread = 16;
+static const int kReadsPerFile = 2000;
+static const size_t kFileSize = 4 * QS::Size::KB1;
+
+class CacheBenchmark {
+ public:
+  static void Worker(Cache *cache, int id) {
+    vector<char> data(kFileSize, 'a' + id % 26);
+    vector<char> buf(kFileSize);
+    vector<string> files;
+    for (int i = 0; i < kFilesPerThread; ++i) {
+      files.push_back("/thread" + to_string(id) + "/file" + to_string(i));
+      cache->Write(files.back(), 0, kFileSize, &data[0], 0);
+    }
+    for (int n = 0; n < kReadsPerFile; ++n) {
+      for (int i = 0; i < kFilesPerThread; ++i) {
+        cache->Read(files[i], 0, kFileSize, &buf[0]);
+      }
+    }
+  }
+
+  // Return operations per second
+  static double Run(int numThreads, size_t numShards) {
+    uint64_t cap =
+        static_cast<uint64_t>(numThreads) * kFilesPerThread * kFileSize;
+    Cache cache(cap, numShards);
+
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
+    boost::thread_group threads;
+    for (int i = 0; i < numThreads; ++i) {
+      threads.create_thread(boost::bind(&CacheBenchmark::Worker, &cache, i));
+    }
+    threads.join_all();
+    gettimeofday(&end, NULL);
+
+    double seconds = (end.tv_sec - begin.tv_sec) +
+                     (end.tv_usec - begin.tv_usec) / 1000000.0;
+    double ops = static_cast<double>(numThreads) * kFilesPerThread *
+                 (kReadsPerFile + 1);
+    return seconds > 0 ? ops / seconds : 0;
+  }
+};
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  int maxThreads = argc > 1 ? atoi(argv[1]) : 32;
+  size_t numShards = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 16;
+  if (maxThreads <= 0) maxThreads = 32;
+  if (numShards == 0) numShards = 16;
+
+  QS::Utils::CreateDirectoryIfNotExists(QS::Data::defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(QS::Data::defaultLogDir);
+
+  std::cout << std::setw(8) << "threads" << std::setw(20) << "1 shard(ops/s)"
+            << std::setw(16) << numShards << " shards(ops/s)" << std::endl;
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    double single = QS::Data::CacheBenchmark::Run(threads, 1);
+    double sharded = QS::Data::CacheBenchmark::Run(threads, numShards);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(0)
+              << std::setw(20) << single << std::setw(29) << sharded
+              << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,150 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+// Benchmark of the hit ratio of cache eviction policies.
+//
+// Replay a trace of file reads against the cache with each policy, a missed
+// read writes the file into cache as if it is downloaded. Each line of the
+// trace file is a file id and a file size in bytes. Without a trace file, a
+// working set of hot files is read repeatedly while scans over large
+// directories read each of their files once.
+//
+// Usage: CachePolicyBenchmark [cache size in MB] [trace file]
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "boost/exception/to_string.hpp"
+
+#include "base/Logging.h"
+#include "base/Size.h"
+#include "base/Utils.h"
+#include "configure/Options.h"
+#include "data/Cache.h"
+#include "data/CachePolicy.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::to_string;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+
+static const char *defaultLogDir = "/tmp/qsfs.benchmark.logs/";
+static const int kHotFiles = 200;
+static const int kRounds = 10;
+static const int kScanFiles = 1000;
+static const size_t kFileSize = 64 * QS::Size::KB1;
+
+typedef vector<pair<string, size_t> > Trace;
+
+class CachePolicyBenchmark {
+ public:
+  static Trace MakeTrace() {
+    Trace trace;
+    srand(1);
+    for (int round = 0; round < kRounds; ++round) {
+      for (int i = 0; i < kHotFiles * 5; ++i) {
+        trace.push_back(
+            make_pair("/hot/file" + to_string(rand() % kHotFiles), kFileSize));
+      }
+      for (int i = 0; i < kScanFiles; ++i) {
+        trace.push_back(make_pair("/scan" + to_string(round) + "/file" +
+                                      to_string(i),
+                                  kFileSize));
+      }
+    }
+    return trace;
+  }
+
+  static Trace LoadTrace(const char *path) {
+    Trace trace;
+    std::ifstream file(path);
+    string fileId;
+    size_t size = 0;
+    while (file >> fileId >> size) {
+      trace.push_back(make_pair(fileId, size));
+    }
+    return trace;
+  }
+
+  static CachePolicyStats Run(const Trace &trace, uint64_t capacity,
+                              CachePolicyType::Value policy) {
+    Cache cache(capacity, 1, 0, 0, capacity, policy);
+    vector<char> buf;
+    for (size_t i = 0; i < trace.size(); ++i) {
+      const string &fileId = trace[i].first;
+      size_t size = trace[i].second;
+      if (size == 0) {
+        continue;
+      }
+      buf.resize(size);
+      if (!cache.Read(fileId, 0, size, &buf[0]).second.empty()) {
+        cache.Write(fileId, 0, size, &buf[0], 0);
+      }
+    }
+    return cache.GetPolicyStats();
+  }
+};
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  int cacheSizeMB = argc > 1 ? atoi(argv[1]) : 8;
+  if (cacheSizeMB <= 0) cacheSizeMB = 8;
+
+  QS::Utils::CreateDirectoryIfNotExists(QS::Data::defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(QS::Data::defaultLogDir);
+  QS::Utils::CreateDirectoryIfNotExists(
+      QS::Configure::Options::Instance().GetDiskCacheDirectory());
+
+  QS::Data::Trace trace =
+      argc > 2 ? QS::Data::CachePolicyBenchmark::LoadTrace(argv[2])
+               : QS::Data::CachePolicyBenchmark::MakeTrace();
+  // Memory and disk tier have the same capacity
+  uint64_t capacity = static_cast<uint64_t>(cacheSizeMB) * QS::Size::MB1 / 2;
+
+  std::cout << std::setw(10) << "policy" << std::setw(12) << "hits"
+            << std::setw(12) << "misses" << std::setw(12) << "evictions"
+            << std::setw(16) << "hit ratio(%)" << std::endl;
+  for (int i = QS::Data::CachePolicyType::LRU;
+       i <= QS::Data::CachePolicyType::TinyLFU; ++i) {
+    QS::Data::CachePolicyType::Value policy =
+        static_cast<QS::Data::CachePolicyType::Value>(i);
+    QS::Data::CachePolicyStats stats =
+        QS::Data::CachePolicyBenchmark::Run(trace, capacity, policy);
+    uint64_t reads = stats.m_hits + stats.m_misses;
+    double ratio = reads > 0 ? 100.0 * stats.m_hits / reads : 0;
+    std::cout << std::setw(10) << QS::Data::GetCachePolicyName(policy)
+              << std::setw(12) << stats.m_hits << std::setw(12)
+              << stats.m_misses << std::setw(12) << stats.m_evictions
+              << std::fixed << std::setprecision(2) << std::setw(16) << ratio
+              << std::endl;
+  }
+  return 0;
+}
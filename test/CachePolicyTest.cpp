@@ -0,0 +1,179 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "boost/shared_ptr.hpp"
+
+#include "data/CachePolicy.h"
+
+namespace QS {
+
+namespace Data {
+
+using boost::shared_ptr;
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+// Record all the candidates in order
+class RecordVisitor : public CachePolicyVisitor {
+ public:
+  bool Visit(const string &fileId) {
+    m_ids.push_back(fileId);
+    return false;
+  }
+
+  vector<string> m_ids;
+};
+
+class CachePolicyTest : public Test {
+ protected:
+  static vector<string> GetVictims(const shared_ptr<CachePolicy> &policy) {
+    RecordVisitor visitor;
+    policy->VisitVictims(&visitor);
+    return visitor.m_ids;
+  }
+
+  static vector<string> MakeIds(const char *id1, const char *id2,
+                                const char *id3 = NULL) {
+    vector<string> ids;
+    ids.push_back(id1);
+    ids.push_back(id2);
+    if (id3 != NULL) {
+      ids.push_back(id3);
+    }
+    return ids;
+  }
+};
+
+TEST_F(CachePolicyTest, Name) {
+  EXPECT_EQ(GetCachePolicyByName("ARC"), CachePolicyType::ARC);
+  EXPECT_EQ(GetCachePolicyByName("2q"), CachePolicyType::TwoQ);
+  EXPECT_EQ(GetCachePolicyByName("tinylfu"), CachePolicyType::TinyLFU);
+  EXPECT_EQ(GetCachePolicyByName("unknown"), CachePolicyType::LRU);
+  EXPECT_EQ(GetCachePolicyName(CachePolicyType::TinyLFU), "tinylfu");
+  EXPECT_EQ(NewCachePolicy(CachePolicyType::ARC)->GetType(),
+            CachePolicyType::ARC);
+}
+
+TEST_F(CachePolicyTest, LRU) {
+  shared_ptr<CachePolicy> policy = NewCachePolicy(CachePolicyType::LRU);
+  policy->OnInsert("a");
+  policy->OnInsert("b");
+  policy->OnInsert("c");
+  policy->OnAccess("a");
+  EXPECT_EQ(policy->GetSize(), 3u);
+  EXPECT_EQ(GetVictims(policy), MakeIds("b", "c", "a"));
+
+  policy->OnRename("c", "d");
+  policy->OnErase("b", true);
+  EXPECT_EQ(policy->GetSize(), 2u);
+  EXPECT_EQ(GetVictims(policy), MakeIds("d", "a"));
+}
+
+TEST_F(CachePolicyTest, TwoQ) {
+  shared_ptr<CachePolicy> policy = NewCachePolicy(CachePolicyType::TwoQ);
+  policy->OnInsert("a");
+  policy->OnErase("a", true);  // kept as ghost
+  EXPECT_EQ(policy->GetSize(), 0u);
+  policy->OnInsert("a");  // seen again, put in main queue
+  policy->OnInsert("b");
+  policy->OnInsert("c");
+  policy->OnAccess("b");  // stay in FIFO queue
+  EXPECT_EQ(policy->GetSize(), 3u);
+  EXPECT_EQ(GetVictims(policy), MakeIds("b", "c", "a"));
+
+  policy->OnErase("c", false);  // not kept as ghost
+  policy->OnInsert("c");
+  policy->OnErase("b", true);
+  EXPECT_EQ(GetVictims(policy), MakeIds("a", "c"));
+}
+
+TEST_F(CachePolicyTest, ARC) {
+  shared_ptr<CachePolicy> policy = NewCachePolicy(CachePolicyType::ARC);
+  policy->OnInsert("a");
+  policy->OnInsert("b");
+  policy->OnAccess("a");  // seen again
+  EXPECT_EQ(GetVictims(policy), MakeIds("b", "a"));
+
+  policy->OnErase("b", true);  // kept as ghost
+  EXPECT_EQ(policy->GetSize(), 1u);
+  policy->OnInsert("b");  // ghost hit enlarges the target of recent files
+  policy->OnInsert("c");
+  EXPECT_EQ(policy->GetSize(), 3u);
+  EXPECT_EQ(GetVictims(policy), MakeIds("a", "b", "c"));
+}
+
+TEST_F(CachePolicyTest, TinyLFU) {
+  shared_ptr<CachePolicy> policy = NewCachePolicy(CachePolicyType::TinyLFU);
+  policy->OnInsert("hot");
+  for (int i = 0; i < 3; ++i) {
+    policy->OnAccess("hot");
+  }
+  // a scan does not flush the file used frequently
+  policy->OnInsert("scan1");
+  policy->OnInsert("scan2");
+  vector<string> victims = GetVictims(policy);
+  ASSERT_FALSE(victims.empty());
+  EXPECT_EQ(victims[0], "scan1");
+
+  policy->OnErase("scan1", true);
+  policy->OnInsert("scan3");
+  victims = GetVictims(policy);
+  ASSERT_FALSE(victims.empty());
+  EXPECT_EQ(victims[0], "scan2");
+  EXPECT_EQ(policy->GetSize(), 3u);
+}
+
+TEST_F(CachePolicyTest, Pin) {
+  for (int type = CachePolicyType::LRU; type <= CachePolicyType::TinyLFU;
+       ++type) {
+    shared_ptr<CachePolicy> policy =
+        NewCachePolicy(static_cast<CachePolicyType::Value>(type));
+    policy->OnInsert("a");
+    policy->OnInsert("b");
+    policy->OnPin("a");
+    policy->OnPin("a");  // pin again does nothing
+    policy->OnAccess("a");
+    EXPECT_EQ(policy->GetSize(), 2u);
+    EXPECT_EQ(GetVictims(policy), vector<string>(1, "b"));
+
+    policy->OnRename("a", "c");
+    policy->OnUnpin("c");
+    vector<string> victims = GetVictims(policy);
+    EXPECT_EQ(victims.size(), 2u);
+    EXPECT_NE(std::find(victims.begin(), victims.end(), "c"), victims.end());
+
+    policy->OnPin("b");
+    policy->OnErase("b", false);
+    EXPECT_EQ(policy->GetSize(), 1u);
+    EXPECT_EQ(GetVictims(policy), vector<string>(1, "c"));
+  }
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
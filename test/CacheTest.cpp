@@ -22,12 +22,18 @@
 
 #include "gtest/gtest.h"
 
+#include "boost/bind.hpp"
+#include "boost/exception/to_string.hpp"
 #include "boost/make_shared.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/thread.hpp"
 
 #include "base/Logging.h"
+#include "base/Size.h"
 #include "base/Utils.h"
 #include "data/Cache.h"
+#include "data/IOStream.h"
+#include "data/MemoryBudget.h"
 
 namespace QS {
 
@@ -35,7 +41,9 @@ namespace Data {
 
 using boost::make_shared;
 using boost::shared_ptr;
+using boost::to_string;
 using std::make_pair;
+using std::pair;
 using std::stringstream;
 using std::vector;
 using ::testing::Test;
@@ -55,6 +63,25 @@ class CacheTest : public Test {
  protected:
   static void SetUpTestCase() { InitLog(); }
 
+  static void WriteAndReadFiles(Cache *cache, int id, int numFiles,
+                                size_t fileSize) {
+    vector<char> data(fileSize, 'a' + id % 26);
+    vector<char> buf(fileSize);
+    for (int i = 0; i < numFiles; ++i) {
+      std::string fileId = "thread" + to_string(id) + "_file" + to_string(i);
+      cache->Write(fileId, 0, fileSize, &data[0], 0);
+      cache->Read(fileId, 0, fileSize, &buf[0]);
+      EXPECT_EQ(buf, data);
+    }
+  }
+
+  // Mark the content of a file as uploaded, so it could be evicted
+  static void CleanFile(Cache *cache, const std::string &fileId) {
+    uint64_t snapshot = 0;
+    ContentRangeDeque ranges = cache->SnapshotDirtyRanges(fileId, &snapshot);
+    cache->CleanRanges(fileId, ranges, snapshot);
+  }
+
   // --------------------------------------------------------------------------
   void TestDefault() {
     uint64_t cacheCap = 100;
@@ -113,6 +140,8 @@ class CacheTest : public Test {
     EXPECT_TRUE(cache.HasFile("newfile1"));
 
     EXPECT_FALSE(cache.Free(cacheCap, "newfile1"));
+    EXPECT_FALSE(cache.Free(cacheCap, ""));  // dirty files are not freed
+    CleanFile(&cache, "newfile1");
     EXPECT_TRUE(cache.Free(cacheCap, ""));
     EXPECT_FALSE(cache.HasFile("newfile1"));
 
@@ -157,6 +186,7 @@ class CacheTest : public Test {
     EXPECT_EQ(cache.Find("file2"), cache.Begin());
     EXPECT_TRUE(cache.HasFile("file1"));
     EXPECT_EQ(cache.Find("file1"), ++cache.Begin());
+    CleanFile(&cache, "file1");
     EXPECT_TRUE(cache.Free(cacheCap - len1, "file2"));
     EXPECT_FALSE(cache.HasFile("file1"));
     EXPECT_EQ(cache.GetSize(), len1);
@@ -188,7 +218,9 @@ class CacheTest : public Test {
 
     EXPECT_EQ(cache.GetFileSize("file1"), len1 + len2 + len3);
     pfile = cache.Find("file1");
-    EXPECT_TRUE(pfile->second->UseDiskFile());
+    // the cold pages are demoted to disk file, the latest page is in memory
+    EXPECT_FALSE(pfile->second->UseDiskFile());
+    EXPECT_EQ(cache.GetDiskSize(), len1 + len2);
 
     EXPECT_EQ(cache.GetSize(), len1);
     EXPECT_TRUE(cache.HasFileData("file1", off1, len1 + len2));
@@ -199,14 +231,20 @@ class CacheTest : public Test {
     EXPECT_EQ(cache.GetUnloadedRanges("file1", 0, len1 + len2 + holeLen + len3),
               range3);
 
+    // file1 is demoted to disk file entirely instead of being discarded
     cache.Write("file2", off1, len1, page1, 0);
-    EXPECT_FALSE(cache.HasFile("file1"));
-    EXPECT_EQ(cache.GetNumFile(), 1u);
+    EXPECT_TRUE(cache.HasFile("file1"));
+    EXPECT_TRUE(cache.HasFileData("file1", off1, len1 + len2));
+    EXPECT_EQ(cache.GetNumFile(), 2u);
     EXPECT_EQ(cache.GetSize(), len1);
+    EXPECT_EQ(cache.GetDiskSize(), len1 + len2 + len3);
     EXPECT_EQ(cache.Find("file2"), cache.Begin());
+    CleanFile(&cache, "file1");
+    CleanFile(&cache, "file2");
     EXPECT_TRUE(cache.Free(cacheCap, ""));
     EXPECT_FALSE(cache.HasFile("file2"));
     EXPECT_EQ(cache.GetSize(), 0u);
+    EXPECT_EQ(cache.GetDiskSize(), 0u);
   }
 
   // --------------------------------------------------------------------------
@@ -266,7 +304,8 @@ class CacheTest : public Test {
     EXPECT_EQ(cache.GetFileSize("file1"), newFile1Sz);
 
     cache.Write("file2", off1, len1, page1, 0);
-    EXPECT_FALSE(cache.HasFile("file1"));
+    EXPECT_TRUE(cache.HasFile("file1"));  // demoted to disk file
+    EXPECT_EQ(cache.GetFileSize("file1"), newFile1Sz);
     EXPECT_EQ(cache.GetFileSize("file2"), len1);
     size_t newFile2Sz = len1 - 1;
     cache.Resize("file2", newFile2Sz, 0);
@@ -461,6 +500,507 @@ class CacheTest : public Test {
     arr4.push_back('1');
     EXPECT_EQ(buf4, arr4);
   }
+
+  // --------------------------------------------------------------------------
+  void TestSharded() {
+    uint64_t cacheCap = 100;
+    size_t numShards = 4;
+    Cache cache(cacheCap, numShards);
+    EXPECT_EQ(cache.GetNumShards(), numShards);
+
+    const char *page1 = "012";
+    size_t len1 = strlen(page1);
+    size_t numFiles = 10;
+    for (size_t i = 0; i < numFiles; ++i) {
+      cache.Write("file" + to_string(i), 0, len1, page1, 0);
+    }
+    EXPECT_EQ(cache.GetNumFile(), numFiles);
+    EXPECT_EQ(cache.GetSize(), numFiles * len1);
+
+    // rename across shards keeps the cached size
+    for (size_t i = 0; i < numFiles; ++i) {
+      cache.Rename("file" + to_string(i), "newfile" + to_string(i));
+    }
+    EXPECT_EQ(cache.GetNumFile(), numFiles);
+    EXPECT_EQ(cache.GetSize(), numFiles * len1);
+    for (size_t i = 0; i < numFiles; ++i) {
+      EXPECT_FALSE(cache.HasFile("file" + to_string(i)));
+      EXPECT_TRUE(cache.HasFileData("newfile" + to_string(i), 0, len1));
+      CleanFile(&cache, "newfile" + to_string(i));
+    }
+
+    // free balances the capacity over all shards
+    EXPECT_TRUE(cache.Free(cacheCap - len1, "newfile0"));
+    EXPECT_TRUE(cache.HasFile("newfile0"));
+    EXPECT_EQ(cache.GetNumFile(), 1u);
+    EXPECT_EQ(cache.GetSize(), len1);
+    cache.Erase("newfile0");
+    EXPECT_FALSE(cache.HasFile("newfile0"));
+    EXPECT_EQ(cache.GetSize(), 0u);
+  }
+
+  // --------------------------------------------------------------------------
+  void TestBlockStore() {
+    uint64_t cacheCap = 100;
+    size_t blockSize = 4;
+    Cache cache(cacheCap, 1, blockSize);
+    EXPECT_EQ(cache.GetBlockSize(), blockSize);
+
+    const char *page1 = "012";
+    size_t len1 = strlen(page1);
+    cache.Write("file1", 0, len1, page1, 0);
+    shared_ptr<stringstream> page2 = make_shared<stringstream>("abc");
+    cache.Write("file1", len1, 3, page2, 0);
+    EXPECT_TRUE(cache.Find("file1")->second->UseBlockStore());
+    EXPECT_EQ(cache.GetFileSize("file1"), len1 + 3);
+    EXPECT_EQ(cache.GetSize(), 2 * blockSize);
+    EXPECT_TRUE(cache.HasFileData("file1", 0, len1 + 3));
+
+    vector<char> buf(len1 + 3);
+    EXPECT_EQ(cache.Read("file1", 0, len1 + 3, &buf[0]).first, len1 + 3);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("012abc"));
+
+    cache.Resize("file1", len1, 0);
+    EXPECT_EQ(cache.GetFileSize("file1"), len1);
+    EXPECT_EQ(cache.GetSize(), blockSize);
+    cache.Erase("file1");
+    EXPECT_EQ(cache.GetSize(), 0u);
+  }
+
+  // --------------------------------------------------------------------------
+  void TestMergePages() {
+    uint64_t cacheCap = 100;
+    size_t maxPageSize = 8;
+    Cache cache(cacheCap, 1, 0, maxPageSize);
+    EXPECT_EQ(cache.GetMaxPageSize(), maxPageSize);
+
+    cache.Write("file1", 0, 3, "012", 0);
+    cache.Write("file1", 6, 3, "ABC", 0);
+    cache.Write("file1", 3, 3, "abc", 0);  // merged into the 1st page
+    shared_ptr<File> file = cache.Find("file1")->second;
+    EXPECT_EQ(file->GetNumPages(), 2u);
+    EXPECT_EQ(cache.GetSize(), 9u);
+
+    vector<char> buf(9);
+    EXPECT_EQ(cache.Read("file1", 0, 9, &buf[0]).first, 9u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("012abcABC"));
+    vector<char> buf1(4);
+    EXPECT_EQ(cache.Read("file1", 4, 4, &buf1[0]).first, 4u);
+    EXPECT_EQ(std::string(buf1.begin(), buf1.end()), std::string("bcAB"));
+
+    // merged page is not larger than max page size
+    EXPECT_EQ(cache.Compact("file1"), 0u);
+    EXPECT_EQ(cache.Compact("file2"), 0u);
+
+    Cache cache1(cacheCap, 1, 0, cacheCap);
+    cache1.Write("file1", 0, 3, "012", 0);
+    cache1.Write("file1", 6, 3, "ABC", 0);
+    cache1.Write("file1", 3, 3, "abc", 0);
+    EXPECT_EQ(cache1.Compact("file1"), 1u);
+    EXPECT_EQ(cache1.Find("file1")->second->GetNumPages(), 1u);
+    EXPECT_EQ(cache1.GetSize(), 9u);
+    vector<char> buf2(9);
+    EXPECT_EQ(cache1.Read("file1", 0, 9, &buf2[0]).first, 9u);
+    EXPECT_EQ(std::string(buf2.begin(), buf2.end()), std::string("012abcABC"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestReadSlices() {
+    uint64_t cacheCap = 100;
+    Cache cache(cacheCap, 1, 0, cacheCap);
+    cache.Write("file1", 0, 3, "012", 0);
+    cache.Write("file1", 3, 3, "abc", 0);
+    cache.Write("file1", 8, 2, "AB", 0);
+
+    pair<ContentSliceDeque, ContentRangeDeque> res =
+        cache.ReadSlices("file1", 1, 9);
+    ASSERT_EQ(res.first.size(), 2u);
+    EXPECT_EQ(res.first[0].m_offset, (off_t)1);
+    EXPECT_EQ(std::string(res.first[0].Data(), res.first[0].m_size),
+              std::string("12abc"));
+    EXPECT_EQ(res.first[1].m_offset, (off_t)8);
+    EXPECT_EQ(std::string(res.first[1].Data(), res.first[1].m_size),
+              std::string("AB"));
+    ContentRangeDeque unloaded;
+    unloaded.push_back(make_pair(6, 2));
+    EXPECT_EQ(res.second, unloaded);
+
+    // holes are filled with zero
+    vector<char> buf(10, 'x');
+    EXPECT_EQ(cache.Read("file1", 0, 10, &buf[0]).first, 8u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()),
+              std::string("012abc\0\0AB", 10));
+
+    // slices pin the bytes after file is removed from cache
+    cache.Erase("file1");
+    EXPECT_EQ(std::string(res.first[0].Data(), res.first[0].m_size),
+              std::string("12abc"));
+
+    pair<ContentSliceDeque, ContentRangeDeque> res1 =
+        cache.ReadSlices("file2", 0, 3);
+    EXPECT_TRUE(res1.first.empty());
+    EXPECT_TRUE(cache.HasFile("file2"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestPersistRestore() {
+    uint64_t cacheCap = 100;
+    time_t mtime = time(NULL);
+    ContentRangeDeque ranges;
+    {
+      Cache cache(cacheCap);
+      cache.Write("/dir/file1", 0, 3, "012", mtime);
+      cache.Write("/dir/file1", 5, 3, "abc", mtime);
+      EXPECT_EQ(cache.GetSize(), 6u);
+      pair<bool, ContentRangeDeque> res = cache.Persist("/dir/file1");
+      EXPECT_TRUE(res.first);
+      EXPECT_EQ(cache.GetSize(), 0u);  // moved into disk file
+      ranges = res.second;
+      EXPECT_FALSE(cache.Persist("/dir/file2").first);
+      vector<std::string> fileIds = cache.GetFileIds();
+      ASSERT_EQ(fileIds.size(), 1u);
+      EXPECT_EQ(fileIds[0], "/dir/file1");
+    }
+
+    Cache cache(cacheCap);
+    EXPECT_TRUE(cache.Restore("/dir/file1", mtime, ranges));
+    EXPECT_FALSE(cache.Restore("/dir/file1", mtime, ranges));  // exists
+    EXPECT_EQ(cache.GetSize(), 0u);
+    EXPECT_EQ(cache.GetTime("/dir/file1"), mtime);
+    EXPECT_TRUE(cache.HasFileData("/dir/file1", 5, 3));
+    vector<char> buf(8, 'x');
+    EXPECT_EQ(cache.Read("/dir/file1", 0, 8, &buf[0]).first, 6u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()),
+              std::string("012\0\0abc", 8));
+    cache.Erase("/dir/file1");  // disk file is removed
+    EXPECT_FALSE(cache.Restore("/dir/file1", mtime, ranges));
+    EXPECT_FALSE(cache.HasFile("/dir/file1"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestDemotePromote() {
+    uint64_t cacheCap = 10;
+    Cache cache(cacheCap, 1, 0, 0, 100);
+    cache.Write("file1", 0, 6, "012345", 0);
+    cache.Write("file2", 0, 6, "abcdef", 0);  // file1 is demoted
+    EXPECT_EQ(cache.GetSize(), 6u);
+    EXPECT_EQ(cache.GetDiskSize(), 6u);
+    EXPECT_TRUE(cache.HasFileData("file1", 0, 6));
+
+    vector<char> buf(6);
+    EXPECT_EQ(cache.Read("file1", 0, 6, &buf[0]).first, 6u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("012345"));
+    EXPECT_EQ(cache.Find("file1")->second->GetCachedSize(), 0u);
+    // file1 is promoted when it is read again, and file2 is demoted
+    EXPECT_EQ(cache.Read("file1", 0, 6, &buf[0]).first, 6u);
+    EXPECT_EQ(cache.Find("file1")->second->GetCachedSize(), 6u);
+    EXPECT_EQ(cache.Find("file2")->second->GetCachedSize(), 0u);
+    EXPECT_EQ(cache.GetSize(), 6u);
+    EXPECT_EQ(cache.GetDiskSize(), 6u);
+
+    EXPECT_FALSE(cache.NeedDemote());
+    cache.Write("file3", 0, 4, "wxyz", 0);
+    EXPECT_EQ(cache.GetSize(), cacheCap);
+    EXPECT_TRUE(cache.NeedDemote());
+    EXPECT_EQ(cache.DemoteColdPages(), 6u);
+    EXPECT_EQ(cache.GetSize(), 4u);
+    EXPECT_EQ(cache.GetDiskSize(), 12u);
+    EXPECT_FALSE(cache.NeedDemote());
+    EXPECT_EQ(cache.Read("file1", 0, 6, &buf[0]).first, 6u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("012345"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestCompression() {
+    std::string text;
+    while (text.size() < 8192) {
+      text += "{\"level\":\"info\",\"msg\":\"compressible\"}\n";
+    }
+    size_t len = text.size();
+    uint64_t cacheCap = 2 * len;
+    Cache cache(cacheCap, 1, 0, 0, 100 * len);
+    cache.SetCompression(true);
+    EXPECT_TRUE(cache.IsCompression());
+    cache.Write("file1", 0, len, text.c_str(), 0);
+    cache.Write("file2", 0, len, text.c_str(), 0);
+    // file1 is compressed instead of demoted to disk file
+    cache.Write("file3", 0, 100, text.c_str(), 0);
+    size_t compressedSize = cache.Find("file1")->second->GetCachedSize();
+    EXPECT_LT(compressedSize * 4, len);
+    EXPECT_EQ(cache.GetSize(), compressedSize + len + 100);
+    EXPECT_EQ(cache.GetDiskSize(), 0u);
+
+    vector<char> buf(len);
+    EXPECT_EQ(cache.Read("file1", 0, len, &buf[0]).first, len);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), text);
+    EXPECT_EQ(cache.Read("file2", 0, len, &buf[0]).first, len);
+    CachePolicyStats stats = cache.GetPolicyStats();
+    EXPECT_EQ(stats.m_compressedHits, 1u);
+    EXPECT_EQ(stats.m_memoryHits, 1u);
+    EXPECT_EQ(stats.m_diskHits, 0u);
+
+    // file1 is decompressed when it is read again, and file3 which is too
+    // small to compress is demoted
+    EXPECT_EQ(cache.Read("file1", 0, len, &buf[0]).first, len);
+    EXPECT_EQ(cache.Find("file1")->second->GetCachedSize(), len);
+    EXPECT_EQ(cache.GetDiskSize(), 100u);
+    EXPECT_EQ(cache.GetSize(), 2 * len);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), text);
+  }
+
+  // --------------------------------------------------------------------------
+  void TestDedup() {
+    uint64_t cacheCap = 100;
+    Cache cache(cacheCap);
+    cache.SetDedup(true);
+    EXPECT_TRUE(cache.IsDedup());
+    shared_ptr<IOStream> stream = make_shared<IOStream>(6);
+    stream->write("012345", 6);
+    cache.SetContentKey("file1", "etag1", 6);
+    cache.Write("file1", 0, 6, stream, 0);
+
+    cache.SetContentKey("file2", "etag1", 6);
+    cache.SetContentKey("file3", "etag1", 8);  // size differs
+    EXPECT_EQ(cache.ShareContent("file3", 0, 8, 0), 0u);
+    EXPECT_EQ(cache.ShareContent("file2", 0, 6, 0), 6u);
+    EXPECT_TRUE(cache.HasFileData("file2", 0, 6));
+    EXPECT_EQ(cache.ShareContent("file2", 0, 6, 0), 0u);  // loaded already
+    pair<ContentSliceDeque, ContentRangeDeque> res1 =
+        cache.ReadSlices("file1", 0, 6);
+    pair<ContentSliceDeque, ContentRangeDeque> res2 =
+        cache.ReadSlices("file2", 0, 6);
+    ASSERT_EQ(res1.first.size(), 1u);
+    ASSERT_EQ(res2.first.size(), 1u);
+    EXPECT_TRUE(res1.first[0].m_buffer == res2.first[0].m_buffer);
+
+    // a write to file2 gets its own copy of the page
+    cache.Write("file2", 1, 2, "ab", 0);
+    vector<char> buf(6);
+    EXPECT_EQ(cache.Read("file1", 0, 6, &buf[0]).first, 6u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("012345"));
+    EXPECT_EQ(cache.Read("file2", 0, 6, &buf[0]).first, 6u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("0ab345"));
+
+    // file2 changed locally shares nothing
+    cache.Erase("file1");
+    cache.SetContentKey("file1", "etag1", 6);
+    EXPECT_EQ(cache.ShareContent("file1", 0, 6, 0), 0u);
+
+    // content is shared from the new id of a renamed file
+    cache.Write("file5", 0, 6, stream, 0);
+    cache.SetContentKey("file5", "etag2", 6);
+    cache.Rename("file5", "file6");
+    cache.SetContentKey("file7", "etag2", 6);
+    EXPECT_EQ(cache.ShareContent("file7", 0, 6, 0), 6u);
+    EXPECT_EQ(cache.Read("file7", 0, 6, &buf[0]).first, 6u);
+    EXPECT_EQ(std::string(buf.begin(), buf.end()), std::string("012345"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestDiskCapacity() {
+    uint64_t cacheCap = 6;
+    uint64_t diskCap = 6;
+    Cache cache(cacheCap, 1, 0, 0, diskCap);
+    EXPECT_EQ(cache.GetDiskCapacity(), diskCap);
+    EXPECT_TRUE(cache.HasFreeDiskSpace(diskCap));
+    EXPECT_FALSE(cache.HasFreeDiskSpace(diskCap + 1));
+    cache.Write("file1", 0, 6, "012345", 0);
+    cache.Write("file2", 0, 6, "abcdef", 0);  // file1 is demoted
+    EXPECT_EQ(cache.GetDiskSize(), 6u);
+    EXPECT_FALSE(cache.HasFreeDiskSpace(1));
+
+    // file1 which only has disk content is discarded to demote file2
+    CleanFile(&cache, "file1");
+    cache.Write("file3", 0, 6, "ABCDEF", 0);
+    EXPECT_EQ(cache.GetSize(), 6u);
+    EXPECT_EQ(cache.GetDiskSize(), 6u);
+    EXPECT_FALSE(cache.HasFile("file1"));
+    EXPECT_EQ(cache.GetPolicyStats().m_evictions, 1u);
+    EXPECT_TRUE(cache.HasFileData("file2", 0, 6));
+    EXPECT_TRUE(cache.HasFileData("file3", 0, 6));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestEvictRanges() {
+    uint64_t cacheCap = 8 * QS::Size::MB1;
+    size_t pageSize = QS::Size::MB1;
+    Cache cache(cacheCap, 1, 0, 0, 0);
+    vector<char> buf(pageSize, 'a');
+    for (size_t i = 0; i < 4; ++i) {
+      cache.Write("large", i * pageSize, pageSize, &buf[0], 0);
+    }
+    cache.Read("large", 0, pageSize, &buf[0]);  // the header is hot
+    cache.Write("small1", 0, pageSize, &buf[0], 0);
+    cache.Write("small2", 0, pageSize, &buf[0], 0);
+    EXPECT_EQ(cache.GetSize(), 6 * pageSize);
+    CleanFile(&cache, "large");
+    CleanFile(&cache, "small1");
+    CleanFile(&cache, "small2");
+
+    // only the least recently used range of the large file is evicted
+    EXPECT_TRUE(cache.Free(3 * pageSize, ""));
+    EXPECT_EQ(cache.GetSize(), 5 * pageSize);
+    EXPECT_EQ(cache.GetNumFile(), 3u);
+    EXPECT_EQ(cache.GetFileSize("large"), 3 * pageSize);
+    EXPECT_TRUE(cache.HasFileData("large", 0, pageSize));
+    EXPECT_FALSE(cache.HasFileData("large", pageSize, pageSize));
+
+    // large file is trimmed to its hot header, small files are kept
+    EXPECT_TRUE(cache.Free(5 * pageSize, ""));
+    EXPECT_EQ(cache.GetNumFile(), 3u);
+    EXPECT_EQ(cache.GetFileSize("large"), pageSize);
+    EXPECT_TRUE(cache.HasFileData("large", 0, pageSize));
+    EXPECT_TRUE(cache.HasFileData("small1", 0, pageSize));
+    EXPECT_TRUE(cache.HasFileData("small2", 0, pageSize));
+    EXPECT_EQ(cache.GetPolicyStats().m_evictions, 2u);
+  }
+
+  // --------------------------------------------------------------------------
+  void TestPinOpenFiles() {
+    uint64_t cacheCap = 4;
+    Cache cache(cacheCap, 1, 0, 0, 0);
+    cache.Write("open1", 0, 1, "1", 0, true);
+    cache.Write("open2", 0, 1, "2", 0, true);
+    cache.Write("closed", 0, 1, "c", 0);
+    cache.Write("open3", 0, 1, "3", 0, true);
+    CleanFile(&cache, "open1");
+    CleanFile(&cache, "closed");
+
+    EXPECT_TRUE(cache.Free(1, ""));
+    EXPECT_FALSE(cache.HasFile("closed"));
+    EXPECT_EQ(cache.GetNumFile(), 3u);
+    EXPECT_FALSE(cache.Free(2, ""));  // open files are not freed
+
+    cache.SetFileOpen("open1", false);
+    EXPECT_TRUE(cache.Free(2, ""));
+    EXPECT_FALSE(cache.HasFile("open1"));
+    EXPECT_TRUE(cache.HasFile("open2"));
+    EXPECT_TRUE(cache.HasFile("open3"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestPinById() {
+    uint64_t cacheCap = 4;
+    Cache cache(cacheCap, 1, 0, 0, 0);
+    EXPECT_FALSE(cache.Pin("pinned1", 1));  // no quota
+    cache.SetPinQuota(2);
+    EXPECT_TRUE(cache.Pin("pinned1", 1));  // pinned before cached
+    EXPECT_TRUE(cache.Pin("pinned2", 1));
+    EXPECT_FALSE(cache.Pin("pinned3", 1));
+    EXPECT_EQ(cache.GetPinnedSize(), 2u);
+
+    cache.Write("pinned1", 0, 1, "1", 0);
+    cache.Write("pinned2", 0, 1, "2", 0);
+    cache.Write("file1", 0, 1, "a", 0);
+    cache.Write("file2", 0, 1, "b", 0);
+    CleanFile(&cache, "pinned1");
+    CleanFile(&cache, "pinned2");
+    CleanFile(&cache, "file1");
+    CleanFile(&cache, "file2");
+    EXPECT_TRUE(cache.Free(2, ""));
+    EXPECT_FALSE(cache.HasFile("file1"));
+    EXPECT_FALSE(cache.HasFile("file2"));
+    EXPECT_FALSE(cache.Free(3, ""));  // pinned files are not freed
+
+    // closing a pinned file keeps it pinned
+    cache.SetFileOpen("pinned1", true);
+    cache.SetFileOpen("pinned1", false);
+    EXPECT_FALSE(cache.Free(3, ""));
+
+    cache.Unpin("pinned1");
+    EXPECT_FALSE(cache.IsPinned("pinned1"));
+    EXPECT_EQ(cache.GetPinnedSize(), 1u);
+    EXPECT_TRUE(cache.Free(3, ""));
+    EXPECT_FALSE(cache.HasFile("pinned1"));
+    EXPECT_TRUE(cache.HasFile("pinned2"));
+
+    // the pin stays with the id
+    cache.Rename("pinned2", "file3");
+    EXPECT_TRUE(cache.Free(4, ""));
+    EXPECT_FALSE(cache.HasFile("file3"));
+    EXPECT_TRUE(cache.IsPinned("pinned2"));
+  }
+
+  // --------------------------------------------------------------------------
+  void TestMemoryBudget() {
+    uint64_t cacheCap = 100 * QS::Size::KB1;
+    size_t fileSize = 10 * QS::Size::KB1;
+    MemoryBudget &budget = MemoryBudget::Instance();
+    uint64_t otherUsage = budget.GetUsage();
+    {
+      Cache cache(cacheCap, 1, 0, 0, 0);
+      vector<char> buf(fileSize, 'a');
+      cache.Write("file1", 0, fileSize, &buf[0], 0);
+      // overhead of file and page is counted besides the content
+      EXPECT_GT(cache.GetMemoryUsage(), cache.GetSize());
+      EXPECT_EQ(budget.GetUsage(), otherUsage + cache.GetMemoryUsage());
+      uint64_t fileUsage = cache.GetMemoryUsage();
+
+      // budget only holds two files though cache capacity is not reached,
+      // so the least recently used file is demoted to disk file
+      budget.SetBudget(otherUsage + fileUsage * 5 / 2);
+      cache.Write("file2", 0, fileSize, &buf[0], 0);
+      cache.Write("file3", 0, fileSize, &buf[0], 0);
+      EXPECT_LE(budget.GetUsage(), budget.GetBudget());
+      EXPECT_EQ(cache.GetSize(), 2 * fileSize);
+      EXPECT_EQ(cache.GetDiskSize(), fileSize);
+      EXPECT_TRUE(cache.HasFileData("file1", 0, fileSize));
+      EXPECT_TRUE(cache.HasFileData("file3", 0, fileSize));
+      budget.SetBudget(0);
+
+      cache.Erase("file3");
+      EXPECT_EQ(budget.GetUsage(), otherUsage + cache.GetMemoryUsage());
+    }
+    // memory is released with cache
+    EXPECT_EQ(budget.GetUsage(), otherUsage);
+  }
+
+  // --------------------------------------------------------------------------
+  void TestEvictionPolicy(CachePolicyType::Value policy, bool keepHotFile) {
+    uint64_t cacheCap = 4;
+    Cache cache(cacheCap, 1, 0, 0, 0, policy);
+    EXPECT_EQ(cache.GetPolicy(), policy);
+    cache.Write("hot", 0, 1, "h", 0);
+    char buf[2];
+    for (int i = 0; i < 3; ++i) {
+      EXPECT_EQ(cache.Read("hot", 0, 1, buf).first, 1u);
+    }
+    cache.Read("hot", 0, 2, buf);  // miss, as content is not all cached
+    cache.Write("scan1", 0, 1, "1", 0);
+    cache.Write("scan2", 0, 1, "2", 0);
+    cache.Write("scan3", 0, 1, "3", 0);
+    EXPECT_EQ(cache.GetSize(), cacheCap);
+    CleanFile(&cache, "hot");
+    CleanFile(&cache, "scan1");
+    CleanFile(&cache, "scan2");
+
+    EXPECT_TRUE(cache.Free(1, "scan3"));
+    EXPECT_EQ(cache.GetNumFile(), 3u);
+    EXPECT_EQ(cache.HasFile("hot"), keepHotFile);
+    CachePolicyStats stats = cache.GetPolicyStats();
+    EXPECT_EQ(stats.m_hits, 3u);
+    EXPECT_EQ(stats.m_misses, 1u);
+    EXPECT_EQ(stats.m_evictions, 1u);
+  }
+
+  // --------------------------------------------------------------------------
+  void TestConcurrentAccess() {
+    int numThreads = 8;
+    int numFiles = 50;
+    size_t fileSize = 64;
+    uint64_t cacheCap = numThreads * numFiles * fileSize;
+    Cache cache(cacheCap, 4);
+
+    boost::thread_group threads;
+    for (int i = 0; i < numThreads; ++i) {
+      threads.create_thread(boost::bind(&CacheTest::WriteAndReadFiles, &cache,
+                                        i, numFiles, fileSize));
+    }
+    threads.join_all();
+
+    EXPECT_EQ(cache.GetNumFile(), static_cast<size_t>(numThreads * numFiles));
+    EXPECT_EQ(cache.GetSize(), cacheCap);
+  }
 };
 
 TEST_F(CacheTest, Default) { TestDefault(); }
@@ -477,6 +1017,42 @@ TEST_F(CacheTest, Read) { TestRead(); }
 
 TEST_F(CacheTest, ReadDiskFile) { TestReadDiskFile(); }
 
+TEST_F(CacheTest, Sharded) { TestSharded(); }
+
+TEST_F(CacheTest, BlockStore) { TestBlockStore(); }
+
+TEST_F(CacheTest, MergePages) { TestMergePages(); }
+
+TEST_F(CacheTest, ReadSlices) { TestReadSlices(); }
+
+TEST_F(CacheTest, PersistRestore) { TestPersistRestore(); }
+
+TEST_F(CacheTest, DemotePromote) { TestDemotePromote(); }
+
+TEST_F(CacheTest, Compression) { TestCompression(); }
+
+TEST_F(CacheTest, Dedup) { TestDedup(); }
+
+TEST_F(CacheTest, DiskCapacity) { TestDiskCapacity(); }
+
+TEST_F(CacheTest, EvictRanges) { TestEvictRanges(); }
+
+TEST_F(CacheTest, PinOpenFiles) { TestPinOpenFiles(); }
+
+TEST_F(CacheTest, PinById) { TestPinById(); }
+
+TEST_F(CacheTest, MemoryBudget) { TestMemoryBudget(); }
+
+TEST_F(CacheTest, EvictionPolicyLRU) {
+  TestEvictionPolicy(CachePolicyType::LRU, false);
+}
+
+TEST_F(CacheTest, EvictionPolicyTinyLFU) {
+  TestEvictionPolicy(CachePolicyType::TinyLFU, true);
+}
+
+TEST_F(CacheTest, ConcurrentAccess) { TestConcurrentAccess(); }
+
 }  // namespace Data
 }  // namespace QS
 
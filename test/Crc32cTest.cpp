@@ -0,0 +1,87 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/Crc32c.h"
+
+namespace QS {
+
+namespace Crc32c {
+
+using std::vector;
+
+namespace {
+
+// --------------------------------------------------------------------------
+// Bit by bit implementation to compare with
+uint32_t ValueBitwise(const char *buffer, size_t len) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= static_cast<unsigned char>(buffer[i]);
+    for (int k = 0; k < 8; ++k) {
+      crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+}  // namespace
+
+TEST(Crc32cTest, StandardResults) {
+  // From rfc3720 section B.4
+  vector<char> buf(32, 0);
+  EXPECT_EQ(Value(&buf[0], buf.size()), 0x8a9136aau);
+  buf.assign(32, static_cast<char>(0xff));
+  EXPECT_EQ(Value(&buf[0], buf.size()), 0x62a8ab43u);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = static_cast<char>(i);
+  }
+  EXPECT_EQ(Value(&buf[0], buf.size()), 0x46dd794eu);
+  EXPECT_EQ(Value("123456789", 9), 0xe3069283u);
+  EXPECT_EQ(Value(NULL, 0), 0u);
+}
+
+TEST(Crc32cTest, Extend) {
+  vector<char> buf(100 * 1024 + 7);
+  srand(1);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = static_cast<char>(rand());
+  }
+  uint32_t crc = Value(&buf[0], buf.size());
+  EXPECT_EQ(crc, ValueBitwise(&buf[0], buf.size()));
+  size_t splits[] = {1, 7, 1024, 3 * 1024 + 5, 50 * 1024};
+  for (size_t i = 0; i < sizeof(splits) / sizeof(splits[0]); ++i) {
+    size_t n = splits[i];
+    EXPECT_EQ(Extend(Value(&buf[0], n), &buf[n], buf.size() - n), crc);
+  }
+  // unaligned buffer
+  EXPECT_EQ(Value(&buf[3], 9000), ValueBitwise(&buf[3], 9000));
+}
+
+}  // namespace Crc32c
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,130 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/Logging.h"
+#include "base/Utils.h"
+#include "base/UtilsWithLog.h"
+#include "configure/Options.h"
+#include "data/DiskCacheIndex.h"
+
+namespace QS {
+
+namespace Data {
+
+using QS::UtilsWithLog::RemoveFileIfExists;
+using std::make_pair;
+using std::ofstream;
+using std::pair;
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+// default log dir
+static const char *defaultLogDir = "/tmp/qsfs.test.logs/";
+void InitLog() {
+  QS::Utils::CreateDirectoryIfNotExists(defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(defaultLogDir);
+}
+
+class DiskCacheIndexTest : public Test {
+ protected:
+  static void SetUpTestCase() { InitLog(); }
+
+  void SetUp() {
+    string diskdir = QS::Configure::Options::Instance().GetDiskCacheDirectory();
+    QS::Utils::CreateDirectoryIfNotExists(diskdir);
+    m_indexFile = diskdir + "test_disk_cache_index";
+    RemoveFileIfExists(m_indexFile);
+  }
+
+  void TearDown() { RemoveFileIfExists(m_indexFile); }
+
+  string m_indexFile;
+};
+
+TEST_F(DiskCacheIndexTest, Default) {
+  DiskCacheIndex index;
+  EXPECT_TRUE(index.Empty());
+  EXPECT_FALSE(index.Take("/file1").first);
+  EXPECT_FALSE(index.Load(m_indexFile));  // not exists
+}
+
+TEST_F(DiskCacheIndexTest, SaveLoad) {
+  ContentRangeDeque ranges;
+  ranges.push_back(make_pair(0, 100));
+  ranges.push_back(make_pair(4096, 10));
+  DiskCacheIndex index;
+  index.Add(DiskCacheRecord("/dir/file1", "etag1", 1500000000, 4106, ranges));
+  index.Add(DiskCacheRecord("/file 2", "", 1, 0, ContentRangeDeque()));
+  index.Add(DiskCacheRecord("/bad\tname", "etag3", 1, 1, ranges));
+  EXPECT_EQ(index.Size(), 3u);
+  EXPECT_TRUE(index.Save(m_indexFile));
+
+  DiskCacheIndex index1;
+  EXPECT_TRUE(index1.Load(m_indexFile));
+  EXPECT_EQ(index1.Size(), 2u);  // file name with tab is skipped
+  pair<bool, DiskCacheRecord> res = index1.Take("/dir/file1");
+  ASSERT_TRUE(res.first);
+  EXPECT_EQ(res.second.m_fileId, "/dir/file1");
+  EXPECT_EQ(res.second.m_eTag, "etag1");
+  EXPECT_EQ(res.second.m_mtime, 1500000000);
+  EXPECT_EQ(res.second.m_fileSize, 4106u);
+  EXPECT_EQ(res.second.m_ranges, ranges);
+  EXPECT_FALSE(index1.Take("/dir/file1").first);  // taken out
+
+  vector<DiskCacheRecord> records = index1.GetRecords();
+  ASSERT_EQ(records.size(), 1u);
+  EXPECT_EQ(records[0].m_fileId, "/file 2");
+  EXPECT_TRUE(records[0].m_eTag.empty());
+  EXPECT_TRUE(records[0].m_ranges.empty());
+}
+
+TEST_F(DiskCacheIndexTest, LoadInvalid) {
+  {
+    ofstream file(m_indexFile.c_str());
+    file << "unknown header\n";
+  }
+  DiskCacheIndex index;
+  EXPECT_FALSE(index.Load(m_indexFile));
+
+  {
+    ofstream file(m_indexFile.c_str());
+    file << "qsfs-disk-cache-index 1\n"
+         << "/file1\tetag1\t1\t10\t0:10\n"
+         << "/file2\tetag2\t1\n"             // missing fields
+         << "/file3\tetag3\t1\t10\t0-10\n";  // invalid range
+  }
+  EXPECT_TRUE(index.Load(m_indexFile));
+  EXPECT_EQ(index.Size(), 1u);
+  EXPECT_TRUE(index.Take("/file1").first);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
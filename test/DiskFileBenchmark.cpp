@@ -0,0 +1,207 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+// Benchmark of disk file access versus io size.
+//
+// Compare the positional pread/pwrite with a persistent descriptor of
+// DiskFile, against opening a fstream, seeking and closing it for each
+// operation as disk pages did before. Each round writes and then reads the
+// chunks of a file at shuffled offsets.
+//
+// Then compare the read bandwidth of DiskFile with and without checksum. The
+// file is dropped from the page cache before each round if the platform
+// supports it, so the bytes are read from the storage device as a disk page
+// missing in the page cache is.
+//
+// Usage: DiskFileBenchmark [file size in MB] [max io size in KB]
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base/Crc32c.h"
+#include "base/Logging.h"
+#include "base/Size.h"
+#include "base/Utils.h"
+#include "configure/Options.h"
+#include "data/DiskFile.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::fstream;
+using std::string;
+using std::vector;
+
+static const char *defaultLogDir = "/tmp/qsfs.benchmark.logs/";
+static const int kReadRounds = 8;
+
+class DiskFileBenchmark {
+ public:
+  DiskFileBenchmark(size_t fileSize, size_t ioSize)
+      : m_ioSize(ioSize),
+        m_data(ioSize, 'x'),
+        m_buf(ioSize),
+        m_path(QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+               "benchmark_disk_file") {
+    QS::Utils::CreateDirectoryIfNotExists(
+        QS::Configure::Options::Instance().GetDiskCacheDirectory());
+    for (size_t i = 0; i < fileSize / ioSize; ++i) {
+      m_offsets.push_back(static_cast<off_t>(i * ioSize));
+    }
+    srand(1);
+    std::random_shuffle(m_offsets.begin(), m_offsets.end());
+  }
+
+  ~DiskFileBenchmark() { QS::Utils::RemoveFileIfExists(m_path); }
+
+  // Return operations per second
+  double RunFstream() {
+    QS::Utils::RemoveFileIfExists(m_path);
+    {
+      fstream create(m_path.c_str(),
+                     std::ios_base::binary | std::ios_base::out);
+    }
+    double begin = Now();
+    for (size_t i = 0; i < m_offsets.size(); ++i) {
+      fstream file(m_path.c_str(), std::ios_base::binary | std::ios_base::in |
+                                       std::ios_base::out);
+      file.seekp(m_offsets[i], std::ios_base::beg);
+      file.write(&m_data[0], m_ioSize);
+    }
+    for (size_t i = 0; i < m_offsets.size(); ++i) {
+      fstream file(m_path.c_str(), std::ios_base::binary | std::ios_base::in);
+      file.seekg(m_offsets[i], std::ios_base::beg);
+      file.read(&m_buf[0], m_ioSize);
+    }
+    return OpsPerSecond(Now() - begin);
+  }
+
+  // Return operations per second
+  double RunDiskFile() {
+    QS::Utils::RemoveFileIfExists(m_path);
+    DiskFile file(m_path);
+    double begin = Now();
+    for (size_t i = 0; i < m_offsets.size(); ++i) {
+      file.Allocate(m_offsets[i], m_ioSize);
+      file.Write(m_offsets[i], m_ioSize, &m_data[0]);
+    }
+    for (size_t i = 0; i < m_offsets.size(); ++i) {
+      file.Read(m_offsets[i], m_ioSize, &m_buf[0]);
+    }
+    return OpsPerSecond(Now() - begin);
+  }
+
+  // Return read bandwidth in MB/s
+  double RunRead(bool checksum) {
+    QS::Utils::RemoveFileIfExists(m_path);
+    DiskFile file(m_path, checksum);
+    for (size_t i = 0; i < m_offsets.size(); ++i) {
+      file.Write(m_offsets[i], m_ioSize, &m_data[0]);
+    }
+    file.Sync();
+    double seconds = 0;
+    for (int round = 0; round < kReadRounds; ++round) {
+      DropPageCache();
+      double begin = Now();
+      for (size_t i = 0; i < m_offsets.size(); ++i) {
+        file.Read(m_offsets[i], m_ioSize, &m_buf[0]);
+      }
+      seconds += Now() - begin;
+    }
+    double mb = static_cast<double>(kReadRounds) * m_offsets.size() *
+                m_ioSize / QS::Size::MB1;
+    return seconds > 0 ? mb / seconds : 0;
+  }
+
+ private:
+  void DropPageCache() const {
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(m_path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+#endif
+  }
+
+  static double Now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+  }
+
+  double OpsPerSecond(double seconds) const {
+    double ops = 2.0 * m_offsets.size();
+    return seconds > 0 ? ops / seconds : 0;
+  }
+
+  size_t m_ioSize;
+  vector<char> m_data;
+  vector<char> m_buf;
+  vector<off_t> m_offsets;
+  string m_path;
+};
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  int fileSizeMB = argc > 1 ? atoi(argv[1]) : 64;
+  int maxIOSizeKB = argc > 2 ? atoi(argv[2]) : 1024;
+  if (fileSizeMB <= 0) fileSizeMB = 64;
+  if (maxIOSizeKB <= 0) maxIOSizeKB = 1024;
+
+  QS::Utils::CreateDirectoryIfNotExists(QS::Data::defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(QS::Data::defaultLogDir);
+
+  size_t fileSize = static_cast<size_t>(fileSizeMB) * QS::Size::MB1;
+  std::cout << std::setw(12) << "io size(KB)" << std::setw(20)
+            << "fstream(ops/s)" << std::setw(20) << "pread/pwrite(ops/s)"
+            << std::setw(16) << "read(MB/s)" << std::setw(20)
+            << "verified read(MB/s)" << std::setw(10) << "cost(%)"
+            << std::endl;
+  for (int kb = 4; kb <= maxIOSizeKB; kb *= 4) {
+    size_t ioSize = static_cast<size_t>(kb) * QS::Size::KB1;
+    if (ioSize > fileSize) break;
+    QS::Data::DiskFileBenchmark benchmark(fileSize, ioSize);
+    double fstreamOps = benchmark.RunFstream();
+    double diskFileOps = benchmark.RunDiskFile();
+    double readMBs = benchmark.RunRead(false);
+    double verifiedReadMBs = benchmark.RunRead(true);
+    double cost = readMBs > 0 ? 100 * (1 - verifiedReadMBs / readMBs) : 0;
+    std::cout << std::setw(12) << kb << std::fixed << std::setprecision(0)
+              << std::setw(20) << fstreamOps << std::setw(20) << diskFileOps
+              << std::setw(16) << readMBs << std::setw(20) << verifiedReadMBs
+              << std::setw(10) << std::setprecision(1) << cost << std::endl;
+  }
+  std::cout << "crc32c by SSE4.2: "
+            << (QS::Crc32c::IsHardwareAccelerated() ? "yes" : "no")
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,166 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include <sys/stat.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/Logging.h"
+#include "base/Utils.h"
+#include "base/UtilsWithLog.h"
+#include "configure/Options.h"
+#include "data/DiskFile.h"
+
+namespace QS {
+
+namespace Data {
+
+using QS::UtilsWithLog::RemoveFileIfExists;
+using std::make_pair;
+using std::pair;
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+// default log dir
+static const char *defaultLogDir = "/tmp/qsfs.test.logs/";
+void InitLog() {
+  QS::Utils::CreateDirectoryIfNotExists(defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(defaultLogDir);
+}
+
+class DiskFileTest : public Test {
+ protected:
+  static void SetUpTestCase() { InitLog(); }
+
+  void SetUp() {
+    m_path = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+             "test_disk_file";
+    RemoveFileIfExists(m_path);
+  }
+
+  void TearDown() { RemoveFileIfExists(m_path); }
+
+  string m_path;
+};
+
+TEST_F(DiskFileTest, WriteRead) {
+  DiskFile file(m_path);
+  EXPECT_FALSE(file.IsOpen());
+  EXPECT_TRUE(file.Write(3, 3, "abc"));  // create file at first access
+  EXPECT_TRUE(file.IsOpen());
+  EXPECT_TRUE(file.Write(0, 3, "123"));
+  EXPECT_TRUE(file.Write(4, 4, "wxyz"));  // overwrite and enlarge
+
+  vector<char> buf(10, '-');
+  EXPECT_EQ(file.Read(0, 10, &buf[0]), 8u);  // stop at the end of file
+  EXPECT_EQ(string(buf.begin(), buf.begin() + 8), "123awxyz");
+  EXPECT_EQ(file.Read(8, 2, &buf[0]), 0u);
+
+  file.Close();
+  EXPECT_FALSE(file.IsOpen());
+  EXPECT_EQ(file.Read(2, 3, &buf[0]), 3u);  // open again
+  EXPECT_EQ(string(buf.begin(), buf.begin() + 3), "3aw");
+}
+
+TEST_F(DiskFileTest, AllocateTruncate) {
+  DiskFile file(m_path);
+  EXPECT_TRUE(file.Write(0, 4, "0123"));
+  EXPECT_TRUE(file.Allocate(0, 4096));
+
+  struct stat st;
+  ASSERT_EQ(stat(m_path.c_str(), &st), 0);
+  EXPECT_EQ(st.st_size, 4);  // file size is not changed by preallocation
+
+  EXPECT_TRUE(file.Truncate(2));
+  ASSERT_EQ(stat(m_path.c_str(), &st), 0);
+  EXPECT_EQ(st.st_size, 2);
+}
+
+TEST_F(DiskFileTest, Discard) {
+  DiskFile file(m_path);
+  EXPECT_TRUE(file.Write(0, 8, "01234567"));
+  EXPECT_TRUE(file.Discard(0, 4));
+
+  struct stat st;
+  ASSERT_EQ(stat(m_path.c_str(), &st), 0);
+  EXPECT_EQ(st.st_size, 8);  // file size is not changed by discarding
+  vector<char> buf(4, '-');
+  EXPECT_EQ(file.Read(4, 4, &buf[0]), 4u);
+  EXPECT_EQ(string(buf.begin(), buf.end()), "4567");
+}
+
+TEST_F(DiskFileTest, Checksum) {
+  const size_t chunk = DiskFile::kChecksumChunkSize;
+  DiskFile file(m_path, true);
+  EXPECT_TRUE(file.UseChecksum());
+  vector<char> data(2 * chunk, 'a');
+  EXPECT_TRUE(file.Write(0, data.size(), &data[0]));
+  EXPECT_TRUE(file.Write(10, 3, "xyz"));         // overwrite in place
+  EXPECT_TRUE(file.Write(2 * chunk, 6, "end123"));  // append
+  EXPECT_TRUE(file.Discard(2 * chunk + 3, 3));      // read as zeros
+  vector<char> buf(3);
+  EXPECT_EQ(file.Read(10, 3, &buf[0]), 3u);
+  EXPECT_EQ(string(buf.begin(), buf.end()), "xyz");
+  EXPECT_EQ(file.Read(2 * chunk + 3, 3, &buf[0]), 3u);
+  EXPECT_EQ(buf, vector<char>(3, 0));
+
+  // Corrupt the second chunk with another descriptor
+  EXPECT_TRUE(DiskFile(m_path).Write(chunk + 100, 1, "b"));
+  vector<char> all(2 * chunk + 6);
+  // stop before the corrupt chunk
+  EXPECT_EQ(file.Read(0, all.size(), &all[0]), chunk);
+  EXPECT_EQ(file.Read(chunk + 200, 3, &buf[0]), 0u);
+  EXPECT_EQ(file.Read(2 * chunk, 3, &buf[0]), 3u);
+  EXPECT_TRUE(file.HasCorruptRanges());
+  vector<pair<off_t, size_t> > ranges = file.TakeCorruptRanges();
+  ASSERT_EQ(ranges.size(), 1u);
+  EXPECT_EQ(ranges[0], make_pair(static_cast<off_t>(chunk), chunk));
+  EXPECT_FALSE(file.HasCorruptRanges());
+  EXPECT_EQ(file.Read(chunk + 200, 3, &buf[0]), 3u);  // no checksum any more
+
+  // Bytes not overwritten are verified when writing partially
+  EXPECT_TRUE(DiskFile(m_path).Write(1, 1, "c"));
+  EXPECT_TRUE(file.Write(5, 1, "d"));
+  EXPECT_TRUE(file.HasCorruptRanges());
+  EXPECT_EQ(file.Read(0, 3, &buf[0]), 0u);
+  EXPECT_TRUE(file.Write(0, chunk, &data[0]));  // overwrite the whole chunk
+  EXPECT_FALSE(file.HasCorruptRanges());
+  EXPECT_EQ(file.Read(0, 3, &buf[0]), 3u);
+}
+
+TEST_F(DiskFileTest, Remove) {
+  DiskFile file(m_path);
+  EXPECT_TRUE(file.Write(0, 3, "abc"));
+  EXPECT_TRUE(QS::Utils::FileExists(m_path));
+  EXPECT_TRUE(file.Remove());
+  EXPECT_FALSE(file.IsOpen());
+  EXPECT_FALSE(QS::Utils::FileExists(m_path));
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
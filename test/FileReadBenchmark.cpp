@@ -0,0 +1,132 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+// Benchmark of parallel reads of one file versus thread count.
+//
+// All threads read the same cached file, as many workers reading one model
+// file, so the throughput only scales when the readers of a file do not
+// serialize on its locks. The throughput is reported for reading slices,
+// which share the page buffers, and for reading into a buffer.
+//
+// Usage: FileReadBenchmark [max threads] [read size in KB]
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "base/Logging.h"
+#include "base/Size.h"
+#include "base/Utils.h"
+#include "data/Cache.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::string;
+using std::vector;
+
+static const char *defaultLogDir = "/tmp/qsfs.benchmark.logs/";
+static const char *kFileId = "/model/weights.bin";
+static const size_t kFileSize = 64 * QS::Size::MB1;
+static const size_t kPageSize = QS::Size::MB1;
+static const int kReadsPerThread = 20000;
+
+class FileReadBenchmark {
+ public:
+  static void Worker(Cache *cache, int id, size_t readSize, bool slices) {
+    vector<char> buf(readSize);
+    size_t numReads = kFileSize / readSize;
+    // threads start at different offsets and read through the file
+    size_t n = static_cast<size_t>(id) * 7919;
+    for (int i = 0; i < kReadsPerThread; ++i, ++n) {
+      off_t offset = static_cast<off_t>((n % numReads) * readSize);
+      if (slices) {
+        cache->ReadSlices(kFileId, offset, readSize);
+      } else {
+        cache->Read(kFileId, offset, readSize, &buf[0]);
+      }
+    }
+  }
+
+  // Return reads per second
+  static double Run(Cache *cache, int numThreads, size_t readSize,
+                    bool slices) {
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
+    boost::thread_group threads;
+    for (int i = 0; i < numThreads; ++i) {
+      threads.create_thread(boost::bind(&FileReadBenchmark::Worker, cache, i,
+                                        readSize, slices));
+    }
+    threads.join_all();
+    gettimeofday(&end, NULL);
+
+    double seconds = (end.tv_sec - begin.tv_sec) +
+                     (end.tv_usec - begin.tv_usec) / 1000000.0;
+    double ops = static_cast<double>(numThreads) * kReadsPerThread;
+    return seconds > 0 ? ops / seconds : 0;
+  }
+
+  static void Load(Cache *cache) {
+    vector<char> page(kPageSize);
+    for (size_t off = 0; off < kFileSize; off += kPageSize) {
+      for (size_t i = 0; i < kPageSize; ++i) {
+        page[i] = static_cast<char>((off + i) % 251);
+      }
+      cache->Write(kFileId, static_cast<off_t>(off), kPageSize, &page[0], 0);
+    }
+  }
+};
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  int maxThreads = argc > 1 ? atoi(argv[1]) : 32;
+  int readKB = argc > 2 ? atoi(argv[2]) : 128;
+  if (maxThreads <= 0) maxThreads = 32;
+  if (readKB <= 0) readKB = 128;
+  size_t readSize = static_cast<size_t>(readKB) * QS::Size::KB1;
+
+  QS::Utils::CreateDirectoryIfNotExists(QS::Data::defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(QS::Data::defaultLogDir);
+
+  QS::Data::Cache cache(2 * QS::Data::kFileSize);
+  QS::Data::FileReadBenchmark::Load(&cache);
+
+  std::cout << std::setw(8) << "threads" << std::setw(20) << "slices(ops/s)"
+            << std::setw(20) << "copy(ops/s)" << std::endl;
+  for (int threads = 1; threads <= maxThreads; threads *= 2) {
+    double slices =
+        QS::Data::FileReadBenchmark::Run(&cache, threads, readSize, true);
+    double copy =
+        QS::Data::FileReadBenchmark::Run(&cache, threads, readSize, false);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(0)
+              << std::setw(20) << slices << std::setw(20) << copy
+              << std::endl;
+  }
+  return 0;
+}
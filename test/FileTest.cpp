@@ -20,17 +20,21 @@
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "boost/array.hpp"
+#include "boost/bind.hpp"
 #include "boost/make_shared.hpp"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/thread.hpp"
 #include "boost/tuple/tuple.hpp"
 
 #include "base/Logging.h"
 #include "base/Utils.h"
 #include "configure/Options.h"
+#include "data/DiskFile.h"
 #include "data/File.h"
 #include "data/Page.h"
 
@@ -47,6 +51,7 @@ using std::make_pair;
 using std::pair;
 using std::string;
 using std::stringstream;
+using std::vector;
 using ::testing::Test;
 
 // default log dir
@@ -355,6 +360,518 @@ class FileTest : public Test {
     arr2[2] = 'c';
     EXPECT_EQ(buf3, arr2);
   }
+
+  void TestBlockStore() {
+    string filename = "file1";
+    size_t blockSize = 4;
+    File file1(filename, mtime_, 0, blockSize);
+    EXPECT_TRUE(file1.UseBlockStore());
+
+    file1.Write(0, 3, "012", mtime_);
+    file1.Write(3, 3, "abc", mtime_);
+    EXPECT_EQ(file1.GetSize(), 6u);
+    EXPECT_EQ(file1.GetCachedSize(), 2 * blockSize);
+    EXPECT_EQ(file1.GetNumPages(), 0u);
+    EXPECT_EQ(file1.GetNumBlocks(), 2u);
+    EXPECT_TRUE(file1.HasData(0, 6));
+    EXPECT_FALSE(file1.HasData(0, 7));
+
+    vector<char> buf(8);
+    pair<size_t, ContentRangeDeque> res = file1.Read(0, 8, &buf[0], 0);
+    EXPECT_EQ(res.first, 6u);
+    EXPECT_EQ(string(&buf[0], 6), string("012abc"));
+    ContentRangeDeque unloaded;
+    unloaded.push_back(make_pair(6, 2));
+    EXPECT_EQ(res.second, unloaded);
+
+    file1.ResizeToSmallerSize(4);
+    EXPECT_EQ(file1.GetSize(), 4u);
+    EXPECT_EQ(file1.GetCachedSize(), blockSize);
+    file1.Clear();
+    EXPECT_EQ(file1.GetSize(), 0u);
+    EXPECT_EQ(file1.GetNumBlocks(), 0u);
+  }
+
+  void TestMergePages() {
+    string filename = "file1";
+    size_t maxPageSize = 8;
+    File file1(filename, mtime_, 0, 0, maxPageSize);
+    EXPECT_EQ(file1.GetMaxPageSize(), maxPageSize);
+
+    file1.Write(0, 3, "012", mtime_);
+    file1.Write(3, 3, "abc", mtime_);  // merged into the 1st page
+    EXPECT_EQ(file1.GetNumPages(), 1u);
+    EXPECT_EQ(file1.GetSize(), 6u);
+    EXPECT_EQ(file1.GetCachedSize(), 6u);
+    file1.Write(6, 3, "ABC", mtime_);  // exceed max page size
+    EXPECT_EQ(file1.GetNumPages(), 2u);
+    EXPECT_EQ(file1.Front()->Size(), 6u);
+    EXPECT_EQ(file1.Back()->Size(), 3u);
+    EXPECT_EQ(file1.GetSize(), 9u);
+    EXPECT_EQ(file1.GetCachedSize(), 9u);
+
+    file1.Write(1, 2, "xy", mtime_);  // refresh inside the 1st page
+    EXPECT_EQ(file1.GetNumPages(), 2u);
+    EXPECT_EQ(file1.Front()->Size(), 6u);
+    vector<char> buf(6);
+    file1.Front()->Read(&buf[0]);
+    EXPECT_EQ(string(&buf[0], 6), string("0xyabc"));
+  }
+
+  void TestReadSlices() {
+    string filename = "file1";
+    File file1(filename, mtime_);
+    file1.Write(0, 3, "012", mtime_);
+    file1.Write(6, 3, "ABC", mtime_);
+    pair<ContentSliceDeque, ContentRangeDeque> res = file1.ReadSlices(1, 7);
+    ASSERT_EQ(res.first.size(), 2u);
+    EXPECT_EQ(res.first[0].m_offset, (off_t)1);
+    EXPECT_EQ(string(res.first[0].Data(), res.first[0].m_size), "12");
+    EXPECT_EQ(res.first[1].m_offset, (off_t)6);
+    EXPECT_EQ(string(res.first[1].Data(), res.first[1].m_size), "AB");
+    ContentRangeDeque unloaded;
+    unloaded.push_back(make_pair(3, 3));
+    EXPECT_EQ(res.second, unloaded);
+
+    File file2(filename, mtime_, 0, 4);  // use block store
+    file2.Write(0, 6, "012abc", mtime_);
+    pair<ContentSliceDeque, ContentRangeDeque> res2 = file2.ReadSlices(2, 6);
+    ASSERT_EQ(res2.first.size(), 2u);
+    EXPECT_EQ(string(res2.first[0].Data(), res2.first[0].m_size), "2a");
+    EXPECT_EQ(string(res2.first[1].Data(), res2.first[1].m_size), "bc");
+    ContentRangeDeque unloaded2;
+    unloaded2.push_back(make_pair(6, 2));
+    EXPECT_EQ(res2.second, unloaded2);
+  }
+
+  void TestCompact() {
+    string filename = "file1";
+    File file1(filename, mtime_, 0, 0, 100);
+    file1.Write(0, 3, "012", mtime_);
+    file1.Write(6, 3, "ABC", mtime_);
+    file1.Write(3, 3, "abc", mtime_);  // fill the hole
+    EXPECT_EQ(file1.GetNumPages(), 2u);
+    EXPECT_EQ(file1.Compact(), 1u);
+    EXPECT_EQ(file1.GetNumPages(), 1u);
+    EXPECT_EQ(file1.GetSize(), 9u);
+    EXPECT_EQ(file1.GetCachedSize(), 9u);
+    vector<char> buf(9);
+    file1.Front()->Read(&buf[0]);
+    EXPECT_EQ(string(&buf[0], 9), string("012abcABC"));
+    EXPECT_EQ(file1.Compact(), 0u);
+
+    File file2(filename, mtime_, 0, 0, 100);
+    file2.SetUseDiskFile(true);
+    file2.Write(0, 3, "012", mtime_);
+    file2.Write(6, 3, "ABC", mtime_);
+    file2.Write(3, 3, "abc", mtime_);
+    EXPECT_EQ(file2.Compact(), 1u);
+    EXPECT_EQ(file2.GetNumPages(), 1u);
+    EXPECT_EQ(file2.GetCachedSize(), 0u);
+    vector<char> buf2(9);
+    file2.Front()->Read(&buf2[0]);
+    EXPECT_EQ(string(&buf2[0], 9), string("012abcABC"));
+
+    File file3(filename, mtime_);  // pages are not merged
+    file3.Write(0, 3, "012", mtime_);
+    file3.Write(3, 3, "abc", mtime_);
+    EXPECT_EQ(file3.GetNumPages(), 2u);
+    EXPECT_EQ(file3.Compact(), 0u);
+  }
+
+  void TestPersistRestore() {
+    string filename = "file_persist";
+    string diskFile =
+        QS::Configure::Options::Instance().GetDiskCacheDirectory() + filename;
+    ContentRangeDeque ranges;
+    {
+      File file1(filename, mtime_);
+      file1.Write(0, 3, "012", mtime_);
+      file1.Write(6, 3, "ABC", mtime_);
+      EXPECT_EQ(file1.GetCachedSize(), 6u);
+      pair<bool, size_t> res = file1.Persist();
+      EXPECT_TRUE(res.first);
+      EXPECT_EQ(res.second, 6u);
+      EXPECT_EQ(file1.GetCachedSize(), 0u);
+      EXPECT_TRUE(file1.UseDiskFile());
+      ranges = file1.GetLoadedRanges();
+    }
+    EXPECT_TRUE(QS::Utils::FileExists(diskFile));  // kept after destroyed
+    ContentRangeDeque expected;
+    expected.push_back(make_pair(0, 3));
+    expected.push_back(make_pair(6, 3));
+    EXPECT_EQ(ranges, expected);
+
+    File file2(filename, mtime_);
+    EXPECT_EQ(file2.Restore(ranges), 6u);
+    EXPECT_EQ(file2.GetSize(), 6u);
+    EXPECT_EQ(file2.GetCachedSize(), 0u);
+    EXPECT_TRUE(file2.HasData(6, 3));
+    pair<ContentSliceDeque, ContentRangeDeque> res = file2.ReadSlices(0, 9);
+    vector<char> buf(9);
+    EXPECT_EQ(CopySlices(res.first, 0, 9, &buf[0]), 6u);
+    EXPECT_EQ(string(&buf[0], 3), "012");
+    EXPECT_EQ(string(&buf[6], 3), "ABC");
+    EXPECT_EQ(file2.Restore(ranges), 0u);  // file is not empty
+    file2.Clear();
+    EXPECT_FALSE(QS::Utils::FileExists(diskFile));
+
+    File file3(filename, mtime_, 0, 4);  // use block store
+    file3.Write(0, 6, "012abc", mtime_);
+    pair<bool, size_t> res3 = file3.Persist();
+    EXPECT_TRUE(res3.first);
+    EXPECT_EQ(res3.second, 8u);
+    EXPECT_EQ(file3.GetCachedSize(), 0u);
+    File file4(filename, mtime_, 0, 4);
+    EXPECT_EQ(file4.Restore(file3.GetLoadedRanges()), 6u);
+    vector<char> buf4(6);
+    EXPECT_EQ(file4.Read(0, 6, &buf4[0], 0).first, 6u);
+    EXPECT_EQ(string(&buf4[0], 6), "012abc");
+    file4.Clear();
+  }
+
+  void TestDemotePromote() {
+    string filename = "file_demote";
+    string diskFile =
+        QS::Configure::Options::Instance().GetDiskCacheDirectory() + filename;
+    File file1(filename, mtime_);
+    file1.Write(0, 3, "012", mtime_);
+    file1.Write(6, 3, "ABC", mtime_);
+    file1.Read(6, 3);  // page at 0 is the least recently accessed
+    EXPECT_EQ(file1.Demote(1), 3u);
+    EXPECT_EQ(file1.GetCachedSize(), 3u);
+    EXPECT_EQ(file1.GetDiskSize(), 3u);
+    EXPECT_EQ(file1.GetSize(), 6u);
+    EXPECT_TRUE(QS::Utils::FileExists(diskFile));
+
+    EXPECT_EQ(file1.GetPromotableSize(0, 9), 0u);
+    file1.Read(0, 3);
+    file1.Read(0, 3);
+    EXPECT_EQ(file1.GetPromotableSize(0, 9), 3u);
+    EXPECT_EQ(file1.Promote(0, 9), 3u);
+    EXPECT_EQ(file1.GetCachedSize(), 6u);
+    EXPECT_EQ(file1.GetDiskSize(), 0u);
+    vector<char> buf(3);
+    file1.Front()->Read(&buf[0]);
+    EXPECT_EQ(string(&buf[0], 3), "012");
+
+    EXPECT_EQ(file1.Demote(6), 6u);
+    EXPECT_EQ(file1.GetCachedSize(), 0u);
+    EXPECT_EQ(file1.DropDiskContent(), 6u);
+    EXPECT_EQ(file1.GetSize(), 0u);
+    EXPECT_EQ(file1.GetNumPages(), 0u);
+    EXPECT_FALSE(QS::Utils::FileExists(diskFile));
+
+    File file2(filename, mtime_, 0, 4);  // use block store
+    file2.Write(0, 8, "012abcde", mtime_);
+    EXPECT_EQ(file2.Demote(1), 4u);
+    EXPECT_EQ(file2.GetCachedSize(), 4u);
+    EXPECT_EQ(file2.GetDiskSize(), 4u);
+    vector<char> buf2(8);
+    EXPECT_EQ(file2.Read(0, 8, &buf2[0], 0).first, 8u);
+    EXPECT_EQ(string(&buf2[0], 8), "012abcde");
+    EXPECT_EQ(file2.DropDiskContent(), 4u);
+    EXPECT_EQ(file2.GetDiskSize(), 0u);
+  }
+
+  void TestCompress() {
+    string text;
+    while (text.size() < 8192) {
+      text += "{\"level\":\"info\",\"msg\":\"compressible\"}\n";
+    }
+    size_t len = text.size();
+    File file1("file_compress", mtime_);
+    file1.Write(0, len, text.c_str(), mtime_);
+    file1.Write(len, len, text.c_str(), mtime_);
+    file1.Read(len, len);  // page at 0 is the least recently accessed
+    size_t saved = file1.Compress(1);
+    EXPECT_GT(saved, len / 2);
+    EXPECT_TRUE(file1.Front()->IsCompressed());
+    EXPECT_FALSE(file1.Back()->IsCompressed());
+    EXPECT_EQ(file1.GetCachedSize(), 2 * len - saved);
+    EXPECT_EQ(file1.GetDiskSize(), 0u);
+    EXPECT_EQ(file1.GetSize(), 2 * len);
+
+    pair<ContentSliceDeque, ContentRangeDeque> res = file1.ReadSlices(0, len);
+    ASSERT_EQ(res.first.size(), 1u);
+    EXPECT_EQ(res.first[0].m_tier, ContentTier::Compressed);
+    EXPECT_EQ(string(res.first[0].Data(), len), text);
+    // compressed page read frequently is decompressed
+    file1.Read(0, len);
+    EXPECT_EQ(file1.GetPromotableSize(0, len), saved);
+    EXPECT_EQ(file1.Promote(0, len), saved);
+    EXPECT_FALSE(file1.Front()->IsCompressed());
+    EXPECT_EQ(file1.GetCachedSize(), 2 * len);
+
+    // written page is decompressed, its saving is added back in cache
+    EXPECT_EQ(file1.Compress(2 * len), 2 * saved);
+    tuple<bool, size_t, size_t> res2 = file1.Write(1, 3, "abc", mtime_);
+    EXPECT_TRUE(boost::get<0>(res2));
+    EXPECT_EQ(boost::get<1>(res2), saved);
+    EXPECT_EQ(file1.GetCachedSize(), 2 * len - saved);
+
+    // compressed page is demoted with its compressed size
+    EXPECT_EQ(file1.Demote(2 * len), 2 * len - saved);
+    EXPECT_EQ(file1.GetCachedSize(), 0u);
+    EXPECT_EQ(file1.GetDiskSize(), 2 * len);
+    vector<char> buf(len);
+    file1.Back()->Read(&buf[0]);
+    EXPECT_EQ(string(&buf[0], len), text);
+    file1.DropDiskContent();
+  }
+
+  void TestEvict() {
+    string filename = "file_evict";
+    string diskFile =
+        QS::Configure::Options::Instance().GetDiskCacheDirectory() + filename;
+    File file1(filename, mtime_);
+    file1.Write(0, 3, "012", mtime_);
+    file1.Write(6, 3, "ABC", mtime_);
+    file1.Write(12, 3, "xyz", mtime_);
+    uint64_t snapshot = 0;
+    ContentRangeDeque uploaded = file1.SnapshotDirtyRanges(&snapshot);
+    file1.CleanRanges(uploaded, snapshot);
+    file1.Read(0, 3);  // page at 6 is the least recently accessed
+    EXPECT_EQ(file1.Evict(1, false), 3u);
+    EXPECT_EQ(file1.GetCachedSize(), 6u);
+    EXPECT_EQ(file1.GetSize(), 6u);
+    EXPECT_TRUE(file1.HasData(0, 3));
+    EXPECT_FALSE(file1.HasData(6, 3));
+    EXPECT_TRUE(file1.HasData(12, 3));
+
+    EXPECT_EQ(file1.Demote(6), 6u);
+    EXPECT_EQ(file1.Evict(1, true), 3u);  // page at 12
+    EXPECT_EQ(file1.GetDiskSize(), 3u);
+    EXPECT_EQ(file1.GetSize(), 3u);
+    EXPECT_TRUE(file1.HasData(0, 3));
+    EXPECT_TRUE(QS::Utils::FileExists(diskFile));
+    EXPECT_EQ(file1.Evict(3, true), 3u);
+    EXPECT_EQ(file1.GetNumPages(), 0u);
+    EXPECT_FALSE(QS::Utils::FileExists(diskFile));
+
+    File file2(filename, mtime_, 0, 4);  // use block store
+    file2.Write(0, 8, "012abcde", mtime_);
+    uploaded = file2.SnapshotDirtyRanges(&snapshot);
+    file2.CleanRanges(uploaded, snapshot);
+    vector<char> buf(4);
+    file2.Read(0, 4, &buf[0], 0);  // block 1 is the least recently accessed
+    EXPECT_EQ(file2.Evict(1, false), 4u);
+    EXPECT_EQ(file2.GetCachedSize(), 4u);
+    EXPECT_EQ(file2.GetSize(), 4u);
+    EXPECT_TRUE(file2.HasData(0, 4));
+    EXPECT_FALSE(file2.HasData(4, 4));
+  }
+
+  void TestEvictDirty() {
+    File file1("file_evict_dirty", mtime_);
+    shared_ptr<stringstream> page1 = make_shared<stringstream>("012");
+    shared_ptr<stringstream> page2 = make_shared<stringstream>("xyz");
+    file1.Write(0, 3, page1, mtime_);
+    file1.Write(6, 3, "ABC", mtime_);  // not uploaded
+    file1.Write(12, 3, page2, mtime_);
+    EXPECT_EQ(file1.Evict(9, false), 6u);
+    EXPECT_EQ(file1.GetCachedSize(), 3u);
+    EXPECT_FALSE(file1.HasData(0, 3));
+    EXPECT_FALSE(file1.HasData(12, 3));
+    pair<ContentSliceDeque, ContentRangeDeque> res = file1.ReadSlices(6, 3, 0);
+    vector<char> buf(4);
+    EXPECT_EQ(CopySlices(res.first, 6, 3, &buf[0]), 3u);
+    EXPECT_EQ(string(&buf[0], 3), "ABC");
+    EXPECT_EQ(file1.Evict(3, false), 0u);
+    EXPECT_TRUE(file1.HasData(6, 3));
+
+    File file2("file_evict_dirty", mtime_, 0, 4);  // use block store
+    shared_ptr<stringstream> page3 = make_shared<stringstream>("012abcde");
+    file2.Write(0, 8, page3, mtime_);
+    file2.Write(5, 2, "xy", mtime_);  // block 1 is not uploaded
+    EXPECT_EQ(file2.Evict(8, false), 4u);
+    EXPECT_FALSE(file2.HasData(0, 4));
+    EXPECT_EQ(file2.Read(4, 4, &buf[0], 0).first, 4u);
+    EXPECT_EQ(string(&buf[0], 4), "bxye");
+  }
+
+  void TestWriteUnloaded() {
+    File file1("file_unloaded", mtime_);
+    file1.Write(2, 2, "ab", mtime_);  // written while downloading
+    file1.Write(8, 2, "yz", mtime_);
+    shared_ptr<stringstream> page1 = make_shared<stringstream>("0123456789");
+    tuple<bool, size_t, size_t> res = file1.WriteUnloaded(0, 10, page1, mtime_);
+    EXPECT_TRUE(boost::get<0>(res));
+    EXPECT_EQ(boost::get<2>(res), 6u);
+    EXPECT_EQ(file1.GetSize(), 10u);
+    pair<ContentSliceDeque, ContentRangeDeque> slices =
+        file1.ReadSlices(0, 10, 0);
+    vector<char> buf(10);
+    EXPECT_EQ(CopySlices(slices.first, 0, 10, &buf[0]), 10u);
+    EXPECT_EQ(string(&buf[0], 10), "01ab4567yz");
+    EXPECT_EQ(file1.GetDirtySize(), 4u);
+
+    File file2("file_unloaded", mtime_, 0, 4);  // use block store
+    file2.Write(2, 2, "ab", mtime_);
+    shared_ptr<stringstream> page2 = make_shared<stringstream>("0123456789");
+    res = file2.WriteUnloaded(0, 10, page2, mtime_);
+    EXPECT_TRUE(boost::get<0>(res));
+    EXPECT_EQ(file2.Read(0, 10, &buf[0], 0).first, 10u);
+    EXPECT_EQ(string(&buf[0], 10), "01ab456789");
+    EXPECT_EQ(file2.GetDirtySize(), 2u);
+  }
+
+  void TestCorruptContent() {
+    string filename = "file_corrupt";
+    string diskFile =
+        QS::Configure::Options::Instance().GetDiskCacheDirectory() + filename;
+    File file1(filename, mtime_);
+    file1.SetUseDiskFile(true);
+    // downloaded content is not dirty, so it could be downloaded again
+    shared_ptr<stringstream> page1 = make_shared<stringstream>("012345");
+    file1.Write(0, 6, page1, mtime_);
+    shared_ptr<stringstream> page2 = make_shared<stringstream>("abc");
+    file1.Write(6, 3, page2, mtime_);
+    EXPECT_FALSE(file1.HasCorruptContent());
+    EXPECT_TRUE(DiskFile(diskFile).Write(1, 1, "x"));  // corrupt it
+    array<char, 9> buf;
+    pair<ContentSliceDeque, ContentRangeDeque> res =
+        file1.ReadSlices(0, 9, 0);
+    EXPECT_EQ(CopySlices(res.first, 0, 9, &buf[0]), 0u);
+    EXPECT_TRUE(file1.HasCorruptContent());
+    EXPECT_EQ(file1.DropCorruptContent(), 9u);
+    EXPECT_FALSE(file1.HasCorruptContent());
+    EXPECT_FALSE(file1.HasData(0, 9));
+    res = file1.ReadSlices(0, 9, 0);
+    EXPECT_EQ(res.second, ContentRangeDeque(1, make_pair(0, 9)));
+    EXPECT_FALSE(QS::Utils::FileExists(diskFile));
+
+    // changes not uploaded are kept
+    file1.SetUseDiskFile(true);
+    file1.Write(0, 3, "ABC", mtime_);
+    EXPECT_TRUE(DiskFile(diskFile).Write(1, 1, "x"));
+    file1.ReadSlices(0, 3, 0);
+    EXPECT_TRUE(file1.HasCorruptContent());
+    EXPECT_EQ(file1.DropCorruptContent(), 0u);
+    EXPECT_TRUE(file1.HasData(0, 3));
+    file1.Clear();
+
+    File file2(filename, mtime_, 0, 4);  // use block store
+    file2.SetUseDiskFile(true);
+    shared_ptr<stringstream> page3 = make_shared<stringstream>("012abcde");
+    file2.Write(0, 8, page3, mtime_);
+    uint64_t snapshot = 0;
+    ContentRangeDeque uploaded = file2.SnapshotDirtyRanges(&snapshot);
+    file2.CleanRanges(uploaded, snapshot);
+    EXPECT_TRUE(DiskFile(diskFile).Write(6, 1, "x"));
+    res = file2.ReadSlices(0, 8, 0);
+    EXPECT_EQ(CopySlices(res.first, 0, 8, &buf[0]), 0u);
+    EXPECT_EQ(file2.DropCorruptContent(), 8u);
+    EXPECT_EQ(file2.GetUnloadedRanges(0, 8),
+              ContentRangeDeque(1, make_pair(0, 8)));
+  }
+
+  void TestDirtyRanges() {
+    File file1("file_dirty", mtime_);
+    // downloaded content is not dirty
+    shared_ptr<stringstream> page1 = make_shared<stringstream>("0123456789");
+    file1.Write(0, 10, page1, mtime_);
+    EXPECT_FALSE(file1.IsDirty());
+
+    file1.Write(2, 2, "ab", mtime_);
+    file1.Write(3, 3, "cde", mtime_);
+    file1.Write(8, 2, "wx", mtime_);
+    file1.Write(10, 2, "yz", mtime_);
+    ContentRangeDeque expected;
+    expected.push_back(make_pair(2, 4));
+    expected.push_back(make_pair(8, 4));
+    EXPECT_EQ(file1.GetDirtyRanges(), expected);
+    EXPECT_EQ(file1.GetDirtySize(), 8u);
+
+    file1.ResizeToSmallerSize(9);
+    expected.back().second = 1;
+    EXPECT_EQ(file1.GetDirtyRanges(), expected);
+    EXPECT_EQ(file1.GetDirtySize(), 5u);
+
+    uint64_t snapshot = 0;
+    EXPECT_EQ(file1.SnapshotDirtyRanges(&snapshot), expected);
+    ContentRangeDeque uploaded;
+    uploaded.push_back(make_pair(0, 4));
+    file1.CleanRanges(uploaded, snapshot);
+    expected.front() = make_pair(4, 2);
+    EXPECT_EQ(file1.GetDirtyRanges(), expected);
+    EXPECT_EQ(file1.GetDirtySize(), 3u);
+
+    // overwritten inside a dirty range during the upload
+    file1.Write(4, 2, "fg", mtime_);
+    file1.Write(8, 1, "v", mtime_);
+    EXPECT_EQ(file1.SnapshotDirtyRanges(&snapshot), expected);
+    file1.Write(5, 1, "h", mtime_);
+    file1.CleanRanges(expected, snapshot);
+    EXPECT_EQ(file1.GetDirtyRanges(), ContentRangeDeque(1, make_pair(5, 1)));
+    EXPECT_EQ(file1.GetDirtySize(), 1u);
+
+    // nothing is cleaned by an upload older than the last snapshot
+    uint64_t oldSnapshot = snapshot;
+    file1.SnapshotDirtyRanges(&snapshot);
+    file1.CleanRanges(ContentRangeDeque(1, make_pair(5, 1)), oldSnapshot);
+    EXPECT_TRUE(file1.IsDirty());
+    file1.CleanRanges(ContentRangeDeque(1, make_pair(5, 1)), snapshot);
+    EXPECT_FALSE(file1.IsDirty());
+    file1.Clear();
+    EXPECT_FALSE(file1.IsDirty());
+    EXPECT_EQ(file1.GetDirtySize(), 0u);
+
+    File file2("file_dirty", mtime_, 0, 4);  // use block store
+    file2.Write(1, 6, "abcdef", mtime_);
+    EXPECT_EQ(file2.GetDirtyRanges(), ContentRangeDeque(1, make_pair(1, 6)));
+  }
+
+  // Read slices of the file again and again, each page should be seen
+  // either before or after it is rewritten
+  static void ReadConsistently(File *file, size_t pageSize, size_t numPages,
+                               int times, bool *consistent) {
+    size_t fileSize = pageSize * numPages;
+    for (int n = 0; n < times; ++n) {
+      pair<ContentSliceDeque, ContentRangeDeque> res =
+          file->ReadSlices(0, fileSize);
+      if (res.first.size() != numPages || !res.second.empty()) {
+        *consistent = false;
+        return;
+      }
+      for (size_t i = 0; i < numPages; ++i) {
+        const ContentSlice &slice = res.first[i];
+        if (slice.m_size != pageSize ||
+            string(slice.Data(), slice.m_size) !=
+                string(pageSize, slice.Data()[0])) {
+          *consistent = false;
+          return;
+        }
+      }
+    }
+  }
+
+  void TestParallelRead() {
+    const size_t pageSize = 64;
+    const size_t numPages = 8;
+    File file1("file_parallel", mtime_);
+    for (size_t i = 0; i < numPages; ++i) {
+      file1.Write(i * pageSize, pageSize, string(pageSize, 'a').c_str(),
+                  mtime_);
+    }
+    bool consistent[4] = {true, true, true, true};
+    boost::thread_group readers;
+    for (int i = 0; i < 4; ++i) {
+      readers.create_thread(boost::bind(&FileTest::ReadConsistently, &file1,
+                                        pageSize, numPages, 500,
+                                        &consistent[i]));
+    }
+    for (int n = 0; n < 200; ++n) {
+      string data(pageSize, static_cast<char>('b' + n % 20));
+      file1.Write((n % numPages) * pageSize, pageSize, data.c_str(), mtime_);
+    }
+    readers.join_all();
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_TRUE(consistent[i]);
+    }
+    EXPECT_EQ(file1.GetSize(), pageSize * numPages);
+    EXPECT_EQ(file1.GetNumPages(), numPages);
+  }
 };
 
 TEST_F(FileTest, Default) {
@@ -388,6 +905,32 @@ TEST_F(FileTest, Read) { TestRead(); }
 
 TEST_F(FileTest, ReadDiskFile) { TestReadDiskFile(); }
 
+TEST_F(FileTest, BlockStore) { TestBlockStore(); }
+
+TEST_F(FileTest, MergePages) { TestMergePages(); }
+
+TEST_F(FileTest, ReadSlices) { TestReadSlices(); }
+
+TEST_F(FileTest, Compact) { TestCompact(); }
+
+TEST_F(FileTest, PersistRestore) { TestPersistRestore(); }
+
+TEST_F(FileTest, DemotePromote) { TestDemotePromote(); }
+
+TEST_F(FileTest, Compress) { TestCompress(); }
+
+TEST_F(FileTest, Evict) { TestEvict(); }
+
+TEST_F(FileTest, EvictDirty) { TestEvictDirty(); }
+
+TEST_F(FileTest, WriteUnloaded) { TestWriteUnloaded(); }
+
+TEST_F(FileTest, CorruptContent) { TestCorruptContent(); }
+
+TEST_F(FileTest, DirtyRanges) { TestDirtyRanges(); }
+
+TEST_F(FileTest, ParallelRead) { TestParallelRead(); }
+
 }  // namespace Data
 }  // namespace QS
 
@@ -0,0 +1,107 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <utility>
+
+#include "gtest/gtest.h"
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "data/InFlightRanges.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::make_pair;
+using ::testing::Test;
+
+namespace {
+
+// --------------------------------------------------------------------------
+void WaitAndFlag(InFlightRanges *inFlight, bool *done) {
+  inFlight->Wait("/a", 0, 100);
+  *done = true;
+}
+
+}  // namespace
+
+TEST(InFlightRangesTest, Claim) {
+  InFlightRanges inFlight;
+  ContentRangeDeque claimed = inFlight.Claim("/a", 10, 20);
+  ASSERT_EQ(claimed.size(), 1u);
+  EXPECT_EQ(claimed[0], make_pair(static_cast<off_t>(10), 20ul));
+  EXPECT_TRUE(inFlight.IsInFlight("/a", 0, 11));
+  EXPECT_FALSE(inFlight.IsInFlight("/a", 30, 10));
+  EXPECT_FALSE(inFlight.IsInFlight("/b", 10, 20));
+
+  // only the parts not in flight are claimed
+  EXPECT_TRUE(inFlight.Claim("/a", 15, 10).empty());
+  inFlight.Claim("/a", 50, 10);
+  claimed = inFlight.Claim("/a", 0, 100);
+  ASSERT_EQ(claimed.size(), 3u);
+  EXPECT_EQ(claimed[0], make_pair(static_cast<off_t>(0), 10ul));
+  EXPECT_EQ(claimed[1], make_pair(static_cast<off_t>(30), 20ul));
+  EXPECT_EQ(claimed[2], make_pair(static_cast<off_t>(60), 40ul));
+  EXPECT_TRUE(inFlight.Claim("/a", 0, 100).empty());
+  EXPECT_EQ(inFlight.Claim("/b", 0, 100).size(), 1u);
+  EXPECT_EQ(inFlight.GetNumFiles(), 2u);
+}
+
+TEST(InFlightRangesTest, Release) {
+  InFlightRanges inFlight;
+  inFlight.Claim("/a", 0, 100);
+  // parts of a claimed range are released alone
+  inFlight.Release("/a", 0, 40);
+  EXPECT_FALSE(inFlight.IsInFlight("/a", 0, 40));
+  EXPECT_TRUE(inFlight.IsInFlight("/a", 0, 41));
+  ContentRangeDeque claimed = inFlight.Claim("/a", 20, 40);
+  ASSERT_EQ(claimed.size(), 1u);
+  EXPECT_EQ(claimed[0], make_pair(static_cast<off_t>(20), 20ul));
+
+  inFlight.Release("/a", 20, 20);
+  inFlight.Release("/a", 40, 60);
+  EXPECT_FALSE(inFlight.IsInFlight("/a", 0, 100));
+  EXPECT_EQ(inFlight.GetNumFiles(), 0u);
+  inFlight.Release("/b", 0, 10);  // not claimed
+}
+
+TEST(InFlightRangesTest, Wait) {
+  InFlightRanges inFlight;
+  inFlight.Wait("/a", 0, 100);  // nothing in flight
+
+  inFlight.Claim("/a", 0, 50);
+  inFlight.Claim("/a", 80, 50);
+  bool done = false;
+  boost::thread reader(boost::bind(WaitAndFlag, &inFlight, &done));
+  inFlight.Release("/a", 0, 50);
+  inFlight.Release("/a", 100, 30);  // out of the waited range
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  EXPECT_FALSE(done);
+  inFlight.Release("/a", 80, 20);
+  reader.join();
+  EXPECT_TRUE(done);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
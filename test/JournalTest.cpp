@@ -0,0 +1,194 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <string.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/Logging.h"
+#include "base/Utils.h"
+#include "base/UtilsWithLog.h"
+#include "configure/Options.h"
+#include "data/Journal.h"
+
+namespace QS {
+
+namespace Data {
+
+using QS::UtilsWithLog::RemoveFileIfExists;
+using std::ofstream;
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+// default log dir
+static const char *defaultLogDir = "/tmp/qsfs.test.logs/";
+void InitLog() {
+  QS::Utils::CreateDirectoryIfNotExists(defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(defaultLogDir);
+}
+
+class JournalTest : public Test {
+ protected:
+  static void SetUpTestCase() { InitLog(); }
+
+  void SetUp() {
+    m_dir = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+            "test_journal/";
+    QS::Utils::CreateDirectoryIfNotExists(m_dir);
+    TearDown();
+  }
+
+  void TearDown() {
+    RemoveFileIfExists(m_dir + "journal");
+    RemoveFileIfExists(m_dir + "journal.data");
+  }
+
+  string m_dir;
+};
+
+TEST_F(JournalTest, Default) {
+  Journal journal(m_dir);
+  ASSERT_TRUE(journal.Open());
+  EXPECT_TRUE(journal.Empty());
+  EXPECT_EQ(journal.GetLastSequence(), 0u);
+  EXPECT_TRUE(journal.Sync());
+}
+
+TEST_F(JournalTest, Reload) {
+  {
+    Journal journal(m_dir);
+    ASSERT_TRUE(journal.Open());
+    EXPECT_TRUE(journal.AppendWrite("/file1", 100, 5, "hello"));
+    EXPECT_TRUE(journal.AppendTruncate("/file1", 50));
+    EXPECT_TRUE(journal.AppendWrite("/file 2", 0, 3, "abc"));
+    EXPECT_GT(journal.AppendCreate("/file3", 0644), 0u);
+    EXPECT_TRUE(journal.Sync());
+  }
+
+  Journal journal(m_dir);
+  ASSERT_TRUE(journal.Open());
+  EXPECT_FALSE(journal.Empty());
+  EXPECT_EQ(journal.GetLastSequence(), 4u);
+  vector<JournalOp> intents = journal.GetPendingIntents();
+  ASSERT_EQ(intents.size(), 1u);
+  EXPECT_EQ(intents[0].m_type, JournalOpType::Create);
+  EXPECT_EQ(intents[0].m_path, "/file3");
+  EXPECT_EQ(intents[0].m_mode, static_cast<mode_t>(0644));
+
+  vector<string> files = journal.GetPendingFiles();
+  ASSERT_EQ(files.size(), 2u);
+  vector<JournalOp> ops = journal.GetPendingOps("/file1");
+  ASSERT_EQ(ops.size(), 2u);
+  EXPECT_EQ(ops[0].m_type, JournalOpType::Write);
+  EXPECT_EQ(ops[0].m_offset, 100);
+  EXPECT_EQ(ops[1].m_type, JournalOpType::Truncate);
+  EXPECT_EQ(ops[1].m_size, 50u);
+  char buf[5];
+  ASSERT_TRUE(journal.ReadData(ops[0], buf));
+  EXPECT_EQ(string(buf, 5), "hello");
+  EXPECT_FALSE(journal.ReadData(ops[1], buf));  // not a write
+
+  // new bytes are appended after the loaded ones
+  EXPECT_TRUE(journal.AppendWrite("/file1", 0, 2, "xy"));
+  ops = journal.GetPendingOps("/file1");
+  ASSERT_EQ(ops.size(), 3u);
+  ASSERT_TRUE(journal.ReadData(ops[2], buf));
+  EXPECT_EQ(string(buf, 2), "xy");
+  ops = journal.GetPendingOps("/file 2");
+  ASSERT_EQ(ops.size(), 1u);
+  ASSERT_TRUE(journal.ReadData(ops[0], buf));
+  EXPECT_EQ(string(buf, 3), "abc");
+}
+
+TEST_F(JournalTest, Rename) {
+  Journal journal(m_dir);
+  ASSERT_TRUE(journal.Open());
+  journal.AppendWrite("/a", 0, 1, "a");
+  journal.AppendWrite("/b", 0, 1, "b");
+  journal.Confirm(journal.AppendRename("/a", "/b"));
+  EXPECT_TRUE(journal.GetPendingIntents().empty());
+  EXPECT_TRUE(journal.GetPendingOps("/a").empty());
+  vector<JournalOp> ops = journal.GetPendingOps("/b");
+  ASSERT_EQ(ops.size(), 1u);
+  char c = 0;
+  ASSERT_TRUE(journal.ReadData(ops[0], &c));
+  EXPECT_EQ(c, 'a');
+
+  // the target without changes of its own drops the changes of old target
+  journal.Confirm(journal.AppendRename("/c", "/b"));
+  EXPECT_TRUE(journal.Empty());
+}
+
+TEST_F(JournalTest, Commit) {
+  Journal journal(m_dir);
+  ASSERT_TRUE(journal.Open());
+  journal.AppendWrite("/a", 0, 1, "a");
+  uint64_t seq = journal.GetLastSequence();
+  journal.AppendWrite("/a", 1, 1, "b");  // written during the upload
+  journal.Commit("/a", seq);
+  ASSERT_EQ(journal.GetPendingOps("/a").size(), 1u);
+  EXPECT_EQ(journal.GetPendingOps("/a")[0].m_offset, 1);
+
+  journal.Commit("/a", journal.GetLastSequence());
+  EXPECT_TRUE(journal.Empty());
+  {
+    Journal reloaded(m_dir);
+    ASSERT_TRUE(reloaded.Open());
+    EXPECT_TRUE(reloaded.Empty());
+  }
+
+  journal.AppendWrite("/b", 0, 1, "b");
+  EXPECT_TRUE(journal.AppendRemove("/b"));
+  EXPECT_TRUE(journal.Empty());
+}
+
+TEST_F(JournalTest, TornRecord) {
+  {
+    Journal journal(m_dir);
+    ASSERT_TRUE(journal.Open());
+    journal.AppendWrite("/a", 0, 1, "a");
+  }
+  {
+    // crash in the middle of appending a record
+    ofstream file((m_dir + "journal").c_str(), std::ios::app);
+    file << "W\t2\t/a\t1";
+  }
+
+  Journal journal(m_dir);
+  ASSERT_TRUE(journal.Open());
+  EXPECT_EQ(journal.GetLastSequence(), 1u);
+  EXPECT_EQ(journal.GetPendingOps("/a").size(), 1u);
+  // the torn line is overwritten
+  journal.AppendTruncate("/a", 0);
+  Journal reloaded(m_dir);
+  ASSERT_TRUE(reloaded.Open());
+  ASSERT_EQ(reloaded.GetPendingOps("/a").size(), 2u);
+  EXPECT_EQ(reloaded.GetPendingOps("/a")[1].m_type, JournalOpType::Truncate);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
@@ -0,0 +1,116 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/Lz4.h"
+
+namespace QS {
+
+namespace Lz4 {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// --------------------------------------------------------------------------
+// Compress and decompress, return size of the compressed bytes
+size_t RoundTrip(const vector<char> &data) {
+  vector<char> compressed(CompressBound(data.size()));
+  size_t size = Compress(data.empty() ? NULL : &data[0], data.size(),
+                         &compressed[0], compressed.size());
+  EXPECT_GT(size, 0u);
+  vector<char> decompressed(data.size() + 1);
+  EXPECT_TRUE(Decompress(&compressed[0], size, &decompressed[0], data.size()));
+  decompressed.resize(data.size());
+  EXPECT_TRUE(decompressed == data);
+  return size;
+}
+
+}  // namespace
+
+TEST(Lz4Test, DecompressBlock) {
+  // "abc" followed by a match of 12 bytes at offset 3 and 5 last literals
+  const char block[] = {0x38, 'a', 'b', 'c', 0x03, 0x00,
+                        0x50, 'a', 'b', 'c', 'a', 'b'};
+  char buf[20];
+  EXPECT_TRUE(Decompress(block, sizeof(block), buf, sizeof(buf)));
+  EXPECT_EQ(string(buf, sizeof(buf)), "abcabcabcabcabcabcab");
+  // size not matched
+  EXPECT_FALSE(Decompress(block, sizeof(block), buf, sizeof(buf) - 1));
+  // truncated block
+  EXPECT_FALSE(Decompress(block, 5, buf, sizeof(buf)));
+  // offset beyond the decompressed bytes
+  const char bad[] = {0x18, 'a', 0x03, 0x00, 0x10, 'b'};
+  EXPECT_FALSE(Decompress(bad, sizeof(bad), buf, 14));
+}
+
+TEST(Lz4Test, RoundTrip) {
+  vector<char> data;
+  RoundTrip(data);
+  data.assign(1, 'x');
+  RoundTrip(data);
+  data.assign(13, 'x');
+  RoundTrip(data);
+
+  // text compresses several times
+  string line = "{\"time\":\"2017-10-16T10:12:01Z\",\"level\":\"info\",\"msg\":";
+  data.clear();
+  srand(1);
+  while (data.size() < 256 * 1024) {
+    data.insert(data.end(), line.begin(), line.end());
+    string id = "\"request " + string(1, 'a' + rand() % 26) + "\"}\n";
+    data.insert(data.end(), id.begin(), id.end());
+  }
+  EXPECT_LT(RoundTrip(data) * 4, data.size());
+
+  // long runs and overlapped matches
+  data.assign(100000, 0);
+  EXPECT_LT(RoundTrip(data), 1000u);
+
+  // random bytes grow by a little
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(rand());
+  }
+  EXPECT_LE(RoundTrip(data), CompressBound(data.size()));
+}
+
+TEST(Lz4Test, Capacity) {
+  vector<char> data(64 * 1024);
+  srand(2);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<char>(rand());
+  }
+  // give up on the bytes which do not compress
+  vector<char> compressed(data.size() / 8 * 7);
+  EXPECT_EQ(Compress(&data[0], data.size(), &compressed[0], compressed.size()),
+            0u);
+}
+
+}  // namespace Lz4
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "data/MemoryBudget.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::string;
+using ::testing::Test;
+
+class MemoryBudgetTest : public Test {
+ protected:
+  void TearDown() {
+    MemoryBudget &budget = MemoryBudget::Instance();
+    budget.SetBudget(0);
+    for (int i = 0; i < MemoryUser::NumUsers; ++i) {
+      MemoryUser::Value user = static_cast<MemoryUser::Value>(i);
+      budget.Subtract(user, budget.GetUsage(user));
+    }
+  }
+};
+
+TEST_F(MemoryBudgetTest, Name) {
+  EXPECT_EQ(GetMemoryUserName(MemoryUser::Cache), "cache");
+  EXPECT_EQ(GetMemoryUserName(MemoryUser::TransferBuffer), "transfer buffer");
+}
+
+TEST_F(MemoryBudgetTest, Usage) {
+  MemoryBudget &budget = MemoryBudget::Instance();
+  budget.Add(MemoryUser::Cache, 100);
+  budget.Add(MemoryUser::FileMetaData, 20);
+  budget.Update(MemoryUser::DirectoryTree, 0, 30);
+  budget.Update(MemoryUser::DirectoryTree, 30, 10);
+  budget.Subtract(MemoryUser::Cache, 40);
+  EXPECT_EQ(budget.GetUsage(MemoryUser::Cache), 60u);
+  EXPECT_EQ(budget.GetUsage(MemoryUser::DirectoryTree), 10u);
+  EXPECT_EQ(budget.GetUsage(), 90u);
+
+  std::stringstream ss;
+  ss << budget;
+  EXPECT_NE(ss.str().find("[cache: 60]"), string::npos);
+  EXPECT_NE(ss.str().find("[total: 90]"), string::npos);
+}
+
+TEST_F(MemoryBudgetTest, Budget) {
+  MemoryBudget &budget = MemoryBudget::Instance();
+  budget.Add(MemoryUser::Cache, 100);
+  // zero means no limit
+  EXPECT_TRUE(budget.HasFreeSpace(1000));
+  EXPECT_EQ(budget.GetShortage(1000), 0u);
+
+  budget.SetBudget(150);
+  EXPECT_TRUE(budget.HasFreeSpace(50));
+  EXPECT_FALSE(budget.HasFreeSpace(51));
+  EXPECT_EQ(budget.GetShortage(80), 30u);
+
+  budget.Add(MemoryUser::TransferBuffer, 100);
+  EXPECT_EQ(budget.GetShortage(0), 50u);
+}
+
+TEST_F(MemoryBudgetTest, ContainerSize) {
+  EXPECT_GT(ListNodeSize(8), 8u);
+  EXPECT_GT(TreeNodeSize(8), ListNodeSize(8));
+  EXPECT_EQ(StringSize(string()), 0u);
+  string path(100, 'a');
+  EXPECT_GT(StringSize(path), path.size());
+  EXPECT_GT(SharedCountSize(), 0u);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
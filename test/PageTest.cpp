@@ -15,11 +15,13 @@
 // +-------------------------------------------------------------------------
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -31,6 +33,7 @@
 #include "base/Utils.h"
 #include "base/UtilsWithLog.h"
 #include "configure/Options.h"
+#include "data/DiskFile.h"
 #include "data/Page.h"
 #include "data/StreamUtils.h"
 
@@ -42,9 +45,9 @@ using boost::array;
 using boost::make_shared;
 using boost::shared_ptr;
 using QS::Data::StreamUtils::GetStreamSize;
-using QS::UtilsWithLog::RemoveFileIfExists;
 using std::string;
 using std::stringstream;
+using std::vector;
 using ::testing::Test;
 
 // default log dir
@@ -61,8 +64,9 @@ class PageTest : public Test {
   void TestCtorWithDiskFile() {
     string str("123");
     size_t len = str.size();
-    string file1 = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+    string path1 = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
                    "test_page1";
+    shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
     Page p1(0, len, str.c_str(), file1);
     EXPECT_EQ(p1.Stop(), (off_t)(len - 1));
     EXPECT_EQ(p1.Next(), (off_t)len);
@@ -76,18 +80,19 @@ class PageTest : public Test {
     // assert(body);  // fail when run PageTest exe, but success under debug
     // mode
     EXPECT_TRUE(p1.UseDiskFile());
-    RemoveFileIfExists(file1);
+    file1->Remove();
 
     shared_ptr<stringstream> ss = shared_ptr<stringstream>(new stringstream(str));
-    string file2 = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+    string path2 = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
                    "test_page2";
+    shared_ptr<DiskFile> file2 = make_shared<DiskFile>(path2);
     Page p2(0, len, ss, file2);
     EXPECT_EQ(p2.Stop(), (off_t)(len - 1));
     EXPECT_EQ(p2.Next(), (off_t)len);
     EXPECT_EQ(p2.Size(), len);
     EXPECT_EQ(p2.Offset(), (off_t)0);
     EXPECT_TRUE(p2.UseDiskFile());
-    RemoveFileIfExists(file2);
+    file2->Remove();
   }
 
   void TestResize() {
@@ -107,8 +112,9 @@ class PageTest : public Test {
   void TestResizeDiskFile() {
     const char *str = "123";
     size_t len = 3;
-    string file1 = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
+    string path1 = QS::Configure::Options::Instance().GetDiskCacheDirectory() +
                    "test_page1";
+    shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
     Page p1(0, len, str, file1);
 
     array<char, 2> arrSmaller;
@@ -118,7 +124,7 @@ class PageTest : public Test {
     array<char, 2> buf1;
     p1.Read(&buf1[0]);
     EXPECT_TRUE(buf1 == arrSmaller);
-    RemoveFileIfExists(file1);
+    file1->Remove();
   }
 };
 
@@ -214,15 +220,16 @@ TEST_F(PageTest, ReadDiskFile) {
   arr[0] = '1';
   arr[1] = '2';
   arr[2] = '3';
-  string file1 =
+  string path1 =
       QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
   Page p1(0, len, str, file1);
 
   array<char, 3> buf1;
   p1.Read(0, len, &buf1[0]);
   EXPECT_TRUE(buf1 == arr);
 
-  RemoveFileIfExists(file1);
+  file1->Remove();
 }
 
 // --------------------------------------------------------------------------
@@ -254,8 +261,9 @@ TEST_F(PageTest, Refresh) {
 TEST_F(PageTest, RefreshDiskFile) {
   const char *str = "123";
   size_t len = 3;
-  string file1 =
+  string path1 =
       QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
   Page p1(0, len, str, file1);
 
   array<char, 3> arrNew1;
@@ -276,7 +284,261 @@ TEST_F(PageTest, RefreshDiskFile) {
   p1.Read(0, len, &buf2[0]);
   EXPECT_TRUE(buf2 == arrNew2);
 
-  RemoveFileIfExists(file1);
+  file1->Remove();
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, RefreshToDiskFile) {
+  Page p1(0, 3, "123");
+  string path1 =
+      QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
+  EXPECT_TRUE(p1.Refresh(off_t(2), 3, "abc", file1));  // move to disk file
+  EXPECT_TRUE(p1.UseDiskFile());
+  EXPECT_EQ(p1.Size(), 5u);
+  array<char, 5> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], 5), "12abc");
+
+  EXPECT_TRUE(p1.Refresh(off_t(4), 2, "de"));  // enlarge page in disk file
+  EXPECT_EQ(p1.Size(), 6u);
+  array<char, 6> buf2;
+  p1.Read(&buf2[0]);
+  EXPECT_EQ(string(&buf2[0], 6), "12abde");
+
+  file1->Remove();
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, RefreshPartial) {
+  const char *str = "123456";
+  size_t len = 6;
+  Page p1(0, len, str);
+
+  p1.Refresh(off_t(2), 2, "ab");
+  EXPECT_EQ(p1.Size(), len);
+  array<char, 6> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], len), "12ab56");
+
+  p1.Refresh(off_t(4), 4, "cdef");  // enlarge page
+  EXPECT_EQ(p1.Size(), 8u);
+  array<char, 8> buf2;
+  p1.Read(&buf2[0]);
+  EXPECT_EQ(string(&buf2[0], 8), "12abcdef");
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, Append) {
+  Page p1(2, 3, "123");
+  EXPECT_TRUE(p1.Append(3, "456", 12));
+  EXPECT_EQ(p1.Offset(), (off_t)2);
+  EXPECT_EQ(p1.Size(), 6u);
+  EXPECT_EQ(p1.Next(), (off_t)8);
+  EXPECT_TRUE(p1.Append(3, "789"));  // append in the reserved capacity
+  EXPECT_EQ(p1.Size(), 9u);
+  array<char, 9> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], 9), "123456789");
+
+  shared_ptr<stringstream> stream = make_shared<stringstream>("abc");
+  EXPECT_TRUE(p1.Append(2, stream));
+  EXPECT_EQ(p1.Size(), 11u);
+  array<char, 11> buf2;
+  p1.Read(&buf2[0]);
+  EXPECT_EQ(string(&buf2[0], 11), "123456789ab");
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, AppendDiskFile) {
+  string path1 =
+      QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
+  Page p1(0, 3, "123", file1);
+  EXPECT_TRUE(p1.Append(3, "456"));
+  EXPECT_EQ(p1.Size(), 6u);
+  array<char, 6> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], 6), "123456");
+
+  file1->Remove();
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, Merge) {
+  Page p1(0, 3, "123");
+  Page p2(3, 3, "456");
+  EXPECT_TRUE(p1.Merge(p2));
+  EXPECT_EQ(p1.Size(), 6u);
+  array<char, 6> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], 6), "123456");
+
+  string path1 =
+      QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
+  Page p3(0, 3, "abc", file1);
+  Page p4(3, 3, "def", file1);
+  EXPECT_TRUE(p3.Merge(p4));
+  EXPECT_EQ(p3.Size(), 6u);
+  array<char, 6> buf2;
+  p3.Read(&buf2[0]);
+  EXPECT_EQ(string(&buf2[0], 6), "abcdef");
+
+  file1->Remove();
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, Slice) {
+  Page p1(2, 6, "123456");
+  ContentSlice slice1 = p1.Slice(3, 4);
+  EXPECT_EQ(slice1.m_offset, (off_t)3);
+  EXPECT_EQ(slice1.m_size, 4u);
+  EXPECT_EQ(string(slice1.Data(), slice1.m_size), "2345");
+
+  // slice shares the buffer of page
+  ContentSlice slice2 = p1.Slice(2, 6);
+  EXPECT_TRUE(slice1.m_buffer == slice2.m_buffer);
+  EXPECT_EQ(slice2.m_start, 0u);
+
+  // range is clamped to the page
+  ContentSlice slice4 = p1.Slice(0, 5);
+  EXPECT_EQ(slice4.m_offset, (off_t)2);
+  EXPECT_EQ(string(slice4.Data(), slice4.m_size), "123");
+  EXPECT_EQ(p1.Slice(6, 10).m_size, 2u);
+  EXPECT_EQ(p1.Slice(8, 2).m_size, 0u);
+
+  string path1 =
+      QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
+  Page p2(0, 3, "abc", file1);
+  ContentSlice slice3 = p2.Slice(1, 2);
+  EXPECT_EQ(slice3.m_size, 2u);
+  EXPECT_EQ(string(slice3.Data(), slice3.m_size), "bc");
+  file1->Remove();
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, CopySlices) {
+  Page p1(2, 3, "123");
+  Page p2(7, 2, "ab");
+  ContentSliceDeque slices;
+  slices.push_back(p1.Slice(2, 3));
+  slices.push_back(p2.Slice(7, 2));
+  array<char, 10> buf;
+  buf.fill('x');
+  EXPECT_EQ(CopySlices(slices, 1, 9, &buf[0]), 5u);
+  EXPECT_EQ(string(&buf[0], 9), string("\0" "123" "\0\0" "ab" "\0", 9));
+  EXPECT_EQ(buf[9], 'x');
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, CopyOnWrite) {
+  Buffer buf(new ByteVector(6));
+  memcpy(&(*buf)[0], "123456", 6);
+  Page p1(2, 6, buf);
+  ContentSlice slice1 = p1.Slice(2, 6);
+  EXPECT_TRUE(slice1.m_buffer == buf);  // shared without copying
+
+  // the shared buffer is left untouched
+  EXPECT_TRUE(p1.Refresh(3, 2, "ab"));
+  EXPECT_TRUE(p1.Append(2, "cd", 16));
+  array<char, 8> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], 8), "1ab456cd");
+  EXPECT_EQ(string(&(*buf)[0], 6), "123456");
+  EXPECT_EQ(string(slice1.Data(), slice1.m_size), "123456");
+
+  // written in place once the buffer is not shared
+  Buffer buf2 = p1.Slice(2, 8).m_buffer;
+  EXPECT_FALSE(buf2 == buf);
+  buf2.reset();
+  EXPECT_TRUE(p1.Refresh(2, 1, "x"));
+  ContentSlice slice2 = p1.Slice(2, 8);
+  EXPECT_EQ(string(slice2.Data(), slice2.m_size), "xab456cd");
+  EXPECT_EQ(slice2.m_buffer->capacity(), 16u);
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, MoveBetweenTiers) {
+  string path1 =
+      QS::Configure::Options::Instance().GetDiskCacheDirectory() + "test_page1";
+  shared_ptr<DiskFile> file1 = make_shared<DiskFile>(path1);
+  Page p1(3, 3, "abc");
+  EXPECT_FALSE(p1.UseDiskFile());
+  EXPECT_TRUE(p1.MoveToDiskFile(file1));
+  EXPECT_TRUE(p1.UseDiskFile());
+  array<char, 3> buf1;
+  p1.Read(&buf1[0]);
+  EXPECT_EQ(string(&buf1[0], 3), "abc");
+
+  EXPECT_TRUE(p1.MoveToMemory());
+  EXPECT_FALSE(p1.UseDiskFile());
+  array<char, 3> buf2;
+  p1.Read(&buf2[0]);
+  EXPECT_EQ(string(&buf2[0], 3), "abc");
+  file1->Remove();
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, Compress) {
+  string text;
+  while (text.size() < 8192) {
+    text += "{\"level\":\"info\",\"msg\":\"compressible\"}\n";
+  }
+  Page p1(0, text.size(), text.c_str());
+  EXPECT_TRUE(p1.Compress());
+  EXPECT_TRUE(p1.IsCompressed());
+  EXPECT_LT(p1.GetCompressedSize() * 4, text.size());
+  EXPECT_LT(p1.GetMemoryUsage(), text.size() / 4);
+  ContentSlice slice = p1.Slice(10, 100);
+  EXPECT_EQ(slice.m_tier, ContentTier::Compressed);
+  EXPECT_EQ(string(slice.Data(), slice.m_size), text.substr(10, 100));
+
+  // written page is decompressed
+  EXPECT_TRUE(p1.Refresh(0, 3, "abc"));
+  EXPECT_FALSE(p1.IsCompressed());
+  vector<char> buf(text.size());
+  EXPECT_EQ(p1.Read(&buf[0]), text.size());
+  EXPECT_EQ(string(&buf[0], 3), "abc");
+  EXPECT_EQ(string(&buf[3], buf.size() - 3), text.substr(3));
+  EXPECT_EQ(p1.Slice(0, 3).m_tier, ContentTier::Memory);
+
+  // bytes not compressible are kept
+  vector<char> random(8192);
+  for (size_t i = 0; i < random.size(); ++i) {
+    random[i] = static_cast<char>(rand());
+  }
+  Page p2(0, random.size(), &random[0]);
+  EXPECT_FALSE(p2.Compress());
+  EXPECT_FALSE(p2.IsCompressed());
+  Page p3(0, 3, "abc");  // too small
+  EXPECT_FALSE(p3.Compress());
+}
+
+// --------------------------------------------------------------------------
+TEST_F(PageTest, ContentRange) {
+  ContentRangeDeque ranges;
+  EXPECT_EQ(AddContentRange(&ranges, 10, 5), 5u);
+  EXPECT_EQ(AddContentRange(&ranges, 0, 3), 3u);
+  EXPECT_EQ(AddContentRange(&ranges, 12, 6), 3u);  // overlapped
+  EXPECT_EQ(AddContentRange(&ranges, 3, 2), 2u);   // adjacent
+  ContentRangeDeque expected;
+  expected.push_back(std::make_pair(0, 5));
+  expected.push_back(std::make_pair(10, 8));
+  EXPECT_EQ(ranges, expected);
+
+  EXPECT_TRUE(IntersectContentRanges(ranges, 4, 6));
+  EXPECT_FALSE(IntersectContentRanges(ranges, 5, 5));
+  EXPECT_FALSE(IntersectContentRanges(ranges, 18, 2));
+
+  EXPECT_EQ(RemoveContentRange(&ranges, 12, 2), 2u);
+  EXPECT_EQ(RemoveContentRange(&ranges, 3, 8), 3u);
+  expected.clear();
+  expected.push_back(std::make_pair(0, 3));
+  expected.push_back(std::make_pair(11, 1));
+  expected.push_back(std::make_pair(14, 4));
+  EXPECT_EQ(ranges, expected);
 }
 
 // --------------------------------------------------------------------------
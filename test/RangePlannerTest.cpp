@@ -0,0 +1,113 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "data/RangePlanner.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::make_pair;
+using std::vector;
+using ::testing::Test;
+
+namespace {
+
+const size_t kPartSize = 100;
+const size_t kMaxGap = 10;
+
+// --------------------------------------------------------------------------
+ContentRangeDeque MakeRanges(off_t offset1, size_t size1, off_t offset2,
+                             size_t size2) {
+  ContentRangeDeque ranges;
+  ranges.push_back(make_pair(offset1, size1));
+  ranges.push_back(make_pair(offset2, size2));
+  return ranges;
+}
+
+}  // namespace
+
+TEST(RangePlannerTest, Coalesce) {
+  RangePlanner planner(kPartSize, kMaxGap);
+  vector<RangeRequest> requests = planner.Plan(MakeRanges(0, 30, 35, 20));
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].m_offset, 0);
+  EXPECT_EQ(requests[0].m_size, 55u);  // gap downloaded as well
+  EXPECT_EQ(requests[0].m_ranges, MakeRanges(0, 30, 35, 20));
+
+  // gap is too large
+  requests = planner.Plan(MakeRanges(0, 30, 50, 10));
+  ASSERT_EQ(requests.size(), 2u);
+  EXPECT_EQ(requests[1].m_offset, 50);
+  EXPECT_EQ(requests[1].m_size, 10u);
+
+  // no gap allowed, adjacent ranges are still coalesced
+  RangePlanner noGap(kPartSize, 0);
+  EXPECT_EQ(noGap.Plan(MakeRanges(0, 10, 10, 10)).size(), 1u);
+  EXPECT_EQ(noGap.Plan(MakeRanges(0, 10, 11, 10)).size(), 2u);
+
+  // no limit of request size
+  RangePlanner noLimit(0, kMaxGap);
+  requests = noLimit.Plan(MakeRanges(0, 1000, 1005, 10));
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].m_size, 1015u);
+}
+
+TEST(RangePlannerTest, Align) {
+  RangePlanner planner(kPartSize, kMaxGap);
+  // fit in a request
+  ContentRangeDeque ranges(1, make_pair(static_cast<off_t>(50), kPartSize));
+  vector<RangeRequest> requests = planner.Plan(ranges);
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].m_offset, 50);
+  EXPECT_EQ(requests[0].m_size, kPartSize);
+
+  // split at part boundaries
+  ranges[0].second = 250;
+  requests = planner.Plan(ranges);
+  ASSERT_EQ(requests.size(), 3u);
+  EXPECT_EQ(requests[0].m_size, 50u);
+  EXPECT_EQ(requests[1].m_offset, 100);
+  EXPECT_EQ(requests[1].m_size, kPartSize);
+  EXPECT_EQ(requests[2].m_offset, 200);
+  EXPECT_EQ(requests[2].m_size, kPartSize);
+
+  // the first part of a range is coalesced with the previous range
+  requests = planner.Plan(MakeRanges(0, 30, 35, 200));
+  ASSERT_EQ(requests.size(), 3u);
+  EXPECT_EQ(requests[0].m_offset, 0);
+  EXPECT_EQ(requests[0].m_size, kPartSize);
+  EXPECT_EQ(requests[0].m_ranges, MakeRanges(0, 30, 35, 65));
+  EXPECT_EQ(requests[1].m_offset, 100);
+  EXPECT_EQ(requests[1].m_size, kPartSize);
+  EXPECT_EQ(requests[2].m_offset, 200);
+  EXPECT_EQ(requests[2].m_size, 35u);
+  EXPECT_EQ(requests[2].m_ranges.size(), 1u);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
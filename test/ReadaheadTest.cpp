@@ -0,0 +1,125 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include <utility>
+
+#include "gtest/gtest.h"
+
+#include "data/Readahead.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::pair;
+using ::testing::Test;
+
+namespace {
+
+typedef pair<off_t, size_t> Range;
+
+const size_t kMinWindow = 100;
+const size_t kMaxWindow = 800;
+const uint64_t kFileSize = 100000;
+
+}  // namespace
+
+TEST(ReadaheadTest, Sequential) {
+  Readahead readahead(kMinWindow, kMaxWindow);
+  // first read at the beginning opens the window
+  EXPECT_EQ(readahead.OnRead("/a", 0, 10, kFileSize), Range(10, 100));
+  EXPECT_EQ(readahead.GetWindow("/a"), kMinWindow);
+  // the window grows, the rest of it is read ahead
+  EXPECT_EQ(readahead.OnRead("/a", 10, 10, kFileSize), Range(110, 110));
+  EXPECT_EQ(readahead.GetWindow("/a"), 200u);
+  EXPECT_EQ(readahead.OnRead("/a", 20, 10, kFileSize), Range(220, 210));
+  EXPECT_EQ(readahead.OnRead("/a", 30, 10, kFileSize), Range(430, 410));
+  EXPECT_EQ(readahead.GetWindow("/a"), kMaxWindow);
+  // enough content ahead of the reader, nothing to read ahead
+  EXPECT_EQ(readahead.OnRead("/a", 40, 10, kFileSize).second, 0u);
+  EXPECT_EQ(readahead.GetWindow("/a"), kMaxWindow);  // capped
+  // read ahead again when the content ahead runs short
+  EXPECT_EQ(readahead.OnRead("/a", 50, 400, kFileSize), Range(840, 410));
+
+  // reading ahead stops at the end of file
+  EXPECT_EQ(readahead.OnRead("/b", 0, 10, 300), Range(10, 100));
+  EXPECT_EQ(readahead.OnRead("/b", 10, 10, 300), Range(110, 110));
+  EXPECT_EQ(readahead.OnRead("/b", 20, 10, 300), Range(220, 80));
+  EXPECT_EQ(readahead.OnRead("/b", 30, 10, 300).second, 0u);
+}
+
+TEST(ReadaheadTest, Random) {
+  Readahead readahead(kMinWindow, kMaxWindow);
+  // first read not at the beginning
+  EXPECT_EQ(readahead.OnRead("/a", 5000, 10, kFileSize).second, 0u);
+  EXPECT_EQ(readahead.GetWindow("/a"), 0u);
+  EXPECT_EQ(readahead.OnRead("/a", 100, 10, kFileSize).second, 0u);
+  EXPECT_EQ(readahead.OnRead("/a", 9000, 10, kFileSize).second, 0u);
+
+  // a sequential run opens the window again, random reads shrink it
+  EXPECT_EQ(readahead.OnRead("/a", 9010, 10, kFileSize).second, kMinWindow);
+  readahead.OnRead("/a", 9020, 10, kFileSize);
+  readahead.OnRead("/a", 9030, 10, kFileSize);
+  EXPECT_EQ(readahead.GetWindow("/a"), 400u);
+  EXPECT_EQ(readahead.OnRead("/a", 50, 10, kFileSize).second, 0u);
+  EXPECT_EQ(readahead.GetWindow("/a"), 200u);
+  readahead.OnRead("/a", 70000, 10, kFileSize);
+  readahead.OnRead("/a", 20000, 10, kFileSize);
+  EXPECT_EQ(readahead.GetWindow("/a"), 0u);
+}
+
+TEST(ReadaheadTest, OutOfOrder) {
+  Readahead readahead(kMinWindow, kMaxWindow * 4);
+  readahead.OnRead("/a", 0, 10, kFileSize);
+  readahead.OnRead("/a", 10, 10, kFileSize);
+  // a read served before the previous one is still sequential
+  readahead.OnRead("/a", 30, 10, kFileSize);
+  readahead.OnRead("/a", 20, 10, kFileSize);
+  EXPECT_EQ(readahead.GetWindow("/a"), 800u);
+  readahead.OnRead("/a", 40, 10, kFileSize);
+  EXPECT_EQ(readahead.GetWindow("/a"), 1600u);
+  // but not a read before the run
+  Readahead readahead2(kMinWindow, kMaxWindow);
+  readahead2.OnRead("/a", 100, 10, kFileSize);
+  readahead2.OnRead("/a", 110, 10, kFileSize);
+  EXPECT_EQ(readahead2.GetWindow("/a"), kMinWindow);
+  readahead2.OnRead("/a", 90, 10, kFileSize);
+  EXPECT_EQ(readahead2.GetWindow("/a"), 0u);
+}
+
+TEST(ReadaheadTest, Disabled) {
+  Readahead readahead(kMinWindow, 0);
+  EXPECT_EQ(readahead.OnRead("/a", 0, 10, kFileSize).second, 0u);
+  EXPECT_EQ(readahead.GetNumFiles(), 0u);
+
+  Readahead readahead2(kMinWindow, kMaxWindow);
+  readahead2.OnRead("/a", 0, 10, kFileSize);
+  readahead2.OnRead("/b", 0, 10, kFileSize);
+  EXPECT_EQ(readahead2.GetNumFiles(), 2u);
+  readahead2.Erase("/a");
+  EXPECT_EQ(readahead2.GetNumFiles(), 1u);
+  EXPECT_EQ(readahead2.GetWindow("/a"), 0u);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
@@ -54,11 +54,11 @@ class ResourceManagerTest : public Test {
 
   void TestPutResource() {
     ResourceManager manager;
-    manager.PutResource(Resource(new vector<char>(10)));
-    manager.PutResource(Resource(new vector<char>(10)));
-    manager.PutResource(Resource(new vector<char>(10)));
-    manager.PutResource(Resource(new vector<char>(10)));
-    manager.PutResource(Resource(new vector<char>(10)));
+    manager.PutResource(Resource(new ByteVector(10)));
+    manager.PutResource(Resource(new ByteVector(10)));
+    manager.PutResource(Resource(new ByteVector(10)));
+    manager.PutResource(Resource(new ByteVector(10)));
+    manager.PutResource(Resource(new ByteVector(10)));
     EXPECT_TRUE(manager.ResourcesAvailable());
 
     vector<Resource> resources = manager.ShutdownAndWait(5);
@@ -73,7 +73,7 @@ class ResourceManagerTest : public Test {
 
   void TestAcquireReleaseResource() {
     ResourceManager manager;
-    manager.PutResource(Resource(new vector<char>(10)));
+    manager.PutResource(Resource(new ByteVector(10)));
 
     packaged_task<Resource> task = packaged_task<Resource>(boost::bind(
         boost::type<Resource>(), &ResourceManager::Acquire, &manager));
@@ -87,7 +87,7 @@ class ResourceManagerTest : public Test {
     EXPECT_FALSE(manager.ResourcesAvailable());
 
     Resource resource = f.get();
-    ASSERT_EQ(*(resource), vector<char>(10));
+    ASSERT_EQ(*(resource), ByteVector(10));
 
     manager.Release(resource);
     // resource is released, so resource is available now
@@ -0,0 +1,205 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "data/SlabAllocator.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::vector;
+
+namespace {
+
+// --------------------------------------------------------------------------
+bool IsInSlab(const void *ptr, const void *slab) {
+  uintptr_t base = reinterpret_cast<uintptr_t>(ptr) &
+                   ~(static_cast<uintptr_t>(SlabPool::kSlabSize) - 1);
+  return base == reinterpret_cast<uintptr_t>(slab);
+}
+
+// --------------------------------------------------------------------------
+void Churn(SlabPool *pool, int id, bool *success) {
+  vector<char *> chunks;
+  vector<size_t> sizes;
+  for (int i = 0; i < 2000; ++i) {
+    size_t size = 1 + (i * 7919 + id * 104729) % (64 * 1024);
+    char *chunk = static_cast<char *>(pool->Allocate(size));
+    memset(chunk, id, size);
+    chunks.push_back(chunk);
+    sizes.push_back(size);
+    if (i % 3 == 0) {
+      pool->Deallocate(chunks.front(), sizes.front());
+      chunks.erase(chunks.begin());
+      sizes.erase(sizes.begin());
+    }
+  }
+  *success = true;
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    for (size_t j = 0; j < sizes[i]; ++j) {
+      if (chunks[i][j] != static_cast<char>(id)) {
+        *success = false;
+      }
+    }
+    pool->Deallocate(chunks[i], sizes[i]);
+  }
+}
+
+}  // namespace
+
+TEST(SlabAllocatorTest, SizeClasses) {
+  SlabPool pool;
+  EXPECT_EQ(pool.GetChunkSize(0), 0u);
+  EXPECT_EQ(pool.GetChunkSize(1), 64u);
+  EXPECT_EQ(pool.GetChunkSize(65), 80u);
+  EXPECT_EQ(pool.GetChunkSize(100), 112u);
+  EXPECT_EQ(pool.GetChunkSize(4096), 4096u);
+  EXPECT_EQ(pool.GetChunkSize(4097), 5120u);
+  EXPECT_EQ(pool.GetChunkSize(SlabPool::kMaxChunkSize),
+            SlabPool::kMaxChunkSize);
+  EXPECT_GT(pool.GetChunkSize(SlabPool::kMaxChunkSize + 1),
+            SlabPool::kMaxChunkSize);
+}
+
+TEST(SlabAllocatorTest, AllocateAndFree) {
+  SlabPool pool;
+  EXPECT_TRUE(pool.Allocate(0) == NULL);
+  char *p1 = static_cast<char *>(pool.Allocate(100));
+  char *p2 = static_cast<char *>(pool.Allocate(112));
+  ASSERT_TRUE(p1 != NULL && p2 != NULL);
+  EXPECT_EQ(p2 - p1, 112);  // carved in order from the same slab
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(p1) % 16, 0u);
+  EXPECT_EQ(pool.GetNumSlabs(), 1u);
+  EXPECT_EQ(pool.GetAllocatedSize(), 224u);
+
+  pool.Deallocate(p1, 100);
+  EXPECT_EQ(pool.Allocate(97), p1);  // reuse the freed chunk
+  pool.Deallocate(p1, 97);
+  pool.Deallocate(p2, 112);
+  EXPECT_EQ(pool.GetAllocatedSize(), 0u);
+  // the empty slab is kept as spare
+  EXPECT_EQ(pool.GetNumSlabs(), 1u);
+  EXPECT_EQ(pool.GetMappedSize(), SlabPool::kSlabSize);
+}
+
+TEST(SlabAllocatorTest, ReturnWholeSlabs) {
+  SlabPool pool;
+  size_t size = SlabPool::kMaxChunkSize;
+  size_t perSlab = SlabPool::kSlabSize / size;
+  vector<void *> chunks;
+  for (size_t i = 0; i < 3 * perSlab; ++i) {
+    chunks.push_back(pool.Allocate(size));
+  }
+  EXPECT_EQ(pool.GetNumSlabs(), 3u);
+
+  // free a chunk of the first and the last slab, the next chunk comes from
+  // the slab with the lowest address
+  void *first = chunks.front();
+  void *last = chunks.back();
+  pool.Deallocate(first, size);
+  pool.Deallocate(last, size);
+  void *chunk = pool.Allocate(size);
+  EXPECT_EQ(chunk, first < last ? first : last);
+  pool.Deallocate(chunk, size);
+  chunks.front() = NULL;
+  chunks.back() = NULL;
+
+  // the first empty slab is kept as spare
+  for (size_t i = perSlab; i < 2 * perSlab; ++i) {
+    pool.Deallocate(chunks[i], size);
+    chunks[i] = NULL;
+  }
+  EXPECT_EQ(pool.GetNumSlabs(), 3u);
+
+  // the other slabs are unmapped once empty
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    pool.Deallocate(chunks[i], size);
+  }
+  EXPECT_EQ(pool.GetNumSlabs(), 1u);
+  EXPECT_EQ(pool.GetMappedSize(), SlabPool::kSlabSize);
+  EXPECT_EQ(pool.GetAllocatedSize(), 0u);
+}
+
+TEST(SlabAllocatorTest, Large) {
+  SlabPool pool;
+  size_t size = SlabPool::kMaxChunkSize * 3 + 1;
+  char *p = static_cast<char *>(pool.Allocate(size));
+  ASSERT_TRUE(p != NULL);
+  p[0] = 'a';
+  p[size - 1] = 'z';
+  EXPECT_EQ(pool.GetNumSlabs(), 0u);
+  EXPECT_EQ(pool.GetMappedSize(), pool.GetChunkSize(size));
+  EXPECT_EQ(pool.GetAllocatedSize(), pool.GetChunkSize(size));
+  pool.Deallocate(p, size);
+  EXPECT_EQ(pool.GetMappedSize(), 0u);
+}
+
+TEST(SlabAllocatorTest, HugePages) {
+  SlabPool pool;
+  pool.SetHugePages(true);
+  char *p = static_cast<char *>(pool.Allocate(4096));
+  ASSERT_TRUE(p != NULL);
+  memset(p, 'a', 4096);
+  EXPECT_TRUE(IsInSlab(p + 4095, p));
+  pool.Deallocate(p, 4096);
+}
+
+TEST(SlabAllocatorTest, Concurrent) {
+  SlabPool pool;
+  const int kThreads = 4;
+  bool success[kThreads] = {false};
+  boost::thread_group threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.create_thread(boost::bind(Churn, &pool, i + 1, &success[i]));
+  }
+  threads.join_all();
+  for (int i = 0; i < kThreads; ++i) {
+    EXPECT_TRUE(success[i]);
+  }
+  EXPECT_EQ(pool.GetAllocatedSize(), 0u);
+}
+
+TEST(SlabAllocatorTest, Vector) {
+  uint64_t allocated = SlabPool::Instance().GetAllocatedSize();
+  {
+    vector<char, SlabAllocator<char> > bytes(1000, 'a');
+    EXPECT_EQ(SlabPool::Instance().GetAllocatedSize(), allocated + 1024);
+    bytes.resize(3000, 'b');
+    EXPECT_EQ(bytes[999], 'a');
+    EXPECT_EQ(bytes[1000], 'b');
+  }
+  EXPECT_EQ(SlabPool::Instance().GetAllocatedSize(), allocated);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
@@ -39,7 +39,6 @@ using QS::Data::IOStream;
 using QS::Data::StreamBuf;
 using std::string;
 using std::stringstream;
-using std::vector;
 using ::testing::Test;
 
 // default log dir
@@ -52,7 +51,7 @@ void InitLog() {
 void InitStreamWithNullBuffer() { StreamBuf streamBuf(Buffer(), 1); }
 
 void InitStreamWithOverflowLength() {
-  Buffer buf(new vector<char>(1));
+  Buffer buf(new ByteVector(1));
   StreamBuf streamBuf(buf, 2);
 }
 
@@ -61,12 +60,12 @@ class StreamBufTest : public Test {
   static void SetUpTestCase() { InitLog(); }
 
   void TestPrivateFun() {
-    vector<char> buf;
+    ByteVector buf;
     buf.reserve(3);
     buf.push_back('0');
     buf.push_back('1');
     buf.push_back('2');
-    Buffer buf_(new vector<char>(buf));
+    Buffer buf_(new ByteVector(buf));
     StreamBuf streamBuf(buf_, buf.size() - 1);
     EXPECT_TRUE(*(streamBuf.GetBuffer()) == buf);
     EXPECT_EQ(*(streamBuf.begin()), '0');
@@ -83,13 +82,13 @@ TEST_F(StreamBufTest, DeathTestInitOverflow) {
 }
 
 TEST_F(StreamBufTest, Ctor) {
-  vector<char> buf;
+  ByteVector buf;
   buf.reserve(3);
   buf.push_back('0');
   buf.push_back('1');
   buf.push_back('2');
 
-  Buffer buf_(new vector<char>(buf));
+  Buffer buf_(new ByteVector(buf));
   const StreamBuf streamBuf(buf_, buf.size());
   EXPECT_TRUE(*(streamBuf.GetBuffer()) == buf);
 }
@@ -101,25 +100,25 @@ TEST(IOStreamTest, Ctor1) {
   iostream.seekg(0, std::ios_base::beg);
   StreamBuf * buf = dynamic_cast<StreamBuf *>(iostream.rdbuf());
   EXPECT_EQ(const_cast<const StreamBuf *>(buf)->GetBuffer()->size(), 10u);
-  vector<char> buf1 = vector<char>(10);
+  ByteVector buf1 = ByteVector(10);
   EXPECT_TRUE(*(const_cast<const StreamBuf *>(buf)->GetBuffer()) == buf1);
 }
 
 
 TEST(IOStreamTest, Ctor2) {
-  vector<char> buf0;
+  ByteVector buf0;
   buf0.reserve(3);
   buf0.push_back('0');
   buf0.push_back('1');
   buf0.push_back('2');
-  Buffer buf(new vector<char>(buf0));
+  Buffer buf(new ByteVector(buf0));
 
   IOStream iostream(buf, buf->size());
   iostream.seekg(0, std::ios_base::beg);
   StreamBuf *streambuf = dynamic_cast<StreamBuf *>(iostream.rdbuf());
   EXPECT_TRUE(*(const_cast<const StreamBuf *>(streambuf)->GetBuffer()) == buf0);
 
-  Buffer buf1(new vector<char>(buf0));
+  Buffer buf1(new ByteVector(buf0));
 
   IOStream iostream1(buf1, 2);
   iostream1.seekg(0, std::ios_base::beg);
@@ -129,12 +128,12 @@ TEST(IOStreamTest, Ctor2) {
 }
 
 TEST(IOStreamTest, Read1) {
-  vector<char> buf0;
+  ByteVector buf0;
   buf0.reserve(3);
   buf0.push_back('0');
   buf0.push_back('1');
   buf0.push_back('2');
-  Buffer buf(new vector<char>(buf0));
+  Buffer buf(new ByteVector(buf0));
 
   IOStream stream(buf, 3);
   stringstream ss;
@@ -150,12 +149,12 @@ TEST(IOStreamTest, Read1) {
 }
 
 TEST(IOStreamTest, Read2) {
-  vector<char> buf0;
+  ByteVector buf0;
   buf0.reserve(3);
   buf0.push_back('0');
   buf0.push_back('1');
   buf0.push_back('2');
-  Buffer buf(new vector<char>(buf0));
+  Buffer buf(new ByteVector(buf0));
 
   IOStream stream(buf, 3);
   stream.seekg(1, std::ios_base::beg);
@@ -165,26 +164,26 @@ TEST(IOStreamTest, Read2) {
 }
 
 TEST(IOStreamTest, Write1) {
-  Buffer buf(new vector<char>(3));
+  Buffer buf(new ByteVector(3));
   IOStream stream(buf, 3);
   stringstream ss("012");
   stream << ss.rdbuf();
   stream.seekg(0, std::ios_base::beg);
   StreamBuf *streambuf = dynamic_cast<StreamBuf *>(stream.rdbuf());
-  vector<char> buf0;
+  ByteVector buf0;
   buf0.reserve(3);
   buf0.push_back('0');
   buf0.push_back('1');
   buf0.push_back('2');
   EXPECT_TRUE(*(const_cast<const StreamBuf *>(streambuf)->GetBuffer()) == buf0);
 
-  Buffer buf1(new vector<char>(2));
+  Buffer buf1(new ByteVector(2));
   IOStream stream1(buf1, 2);
   stringstream ss1("012");
   stream1 << ss1.rdbuf();
   stream1.seekg(0, std::ios_base::beg);
   StreamBuf *streambuf1 = dynamic_cast<StreamBuf *>(stream1.rdbuf());
-  vector<char> buf0_;
+  ByteVector buf0_;
   buf0_.reserve(2);
   buf0_.push_back('0');
   buf0_.push_back('1');
@@ -193,14 +192,14 @@ TEST(IOStreamTest, Write1) {
 }
 
 TEST(IOStreamTest, Write2) {
-  Buffer buf(new vector<char>(3));
+  Buffer buf(new ByteVector(3));
   IOStream stream(buf, 3);
   stringstream ss("012");
   stream.seekp(1, std::ios_base::beg);
   stream << ss.rdbuf();
   stream.seekg(0, std::ios_base::beg);
   StreamBuf *streambuf = dynamic_cast<StreamBuf *>(stream.rdbuf());
-  vector<char> buf0;
+  ByteVector buf0;
   buf0.reserve(3);
   buf0.push_back(static_cast<char>(0));
   buf0.push_back('0');
@@ -209,12 +208,12 @@ TEST(IOStreamTest, Write2) {
 }
 
 TEST(StreamUtilsTest, Default) {
-  vector<char> buf0;
+  ByteVector buf0;
   buf0.reserve(3);
   buf0.push_back('0');
   buf0.push_back('1');
   buf0.push_back('2');
-  Buffer buf(new vector<char>(buf0));
+  Buffer buf(new ByteVector(buf0));
 
   boost::shared_ptr<IOStream> stream =
       boost::make_shared<IOStream>(buf, 2);
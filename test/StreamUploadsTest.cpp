@@ -0,0 +1,151 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <string>
+#include <utility>
+
+#include "gtest/gtest.h"
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "data/StreamUploads.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::pair;
+using std::string;
+using ::testing::Test;
+
+namespace {
+
+typedef pair<off_t, size_t> Range;
+
+const size_t kPartSize = 100;
+
+// --------------------------------------------------------------------------
+void TakeAndFlag(StreamUploads *uploads, StreamedUpload *upload, bool *done) {
+  uploads->Take("/a", upload);
+  *done = true;
+}
+
+}  // namespace
+
+TEST(StreamUploadsTest, Sequential) {
+  StreamUploads uploads(kPartSize);
+  EXPECT_FALSE(uploads.OnWrite("/a", 10, 10, 0));  // not from the beginning
+  EXPECT_FALSE(uploads.OnWrite("/b", 0, 10, 20));  // not empty
+  EXPECT_EQ(uploads.GetNumFiles(), 0u);
+
+  EXPECT_FALSE(uploads.OnWrite("/a", 0, 60, 0));
+  EXPECT_TRUE(uploads.HasFile("/a"));
+  // written out of order
+  EXPECT_FALSE(uploads.OnWrite("/a", 120, 100, 60));
+  EXPECT_TRUE(uploads.OnWrite("/a", 60, 60, 220));
+  EXPECT_FALSE(uploads.OnWrite("/a", 220, 10, 220));  // uploader started
+
+  Range range;
+  string uploadId = "x";
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 1u);
+  EXPECT_EQ(range, Range(0, kPartSize));
+  EXPECT_TRUE(uploadId.empty());
+  uploads.SetUploadId("/a", "id");
+  uploads.FinishPart("/a", true);
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 2u);
+  EXPECT_EQ(range, Range(100, kPartSize));
+  EXPECT_EQ(uploadId, "id");
+  uploads.FinishPart("/a", true);
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 0u);  // uploader exits
+
+  EXPECT_TRUE(uploads.OnWrite("/a", 230, 100, 230));
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 3u);
+  uploads.FinishPart("/a", true);
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 0u);
+  StreamedUpload upload;
+  EXPECT_TRUE(uploads.Take("/a", &upload));
+  EXPECT_TRUE(upload.m_valid);
+  EXPECT_EQ(upload.m_uploadId, "id");
+  EXPECT_EQ(upload.m_size, 3 * kPartSize);
+  EXPECT_FALSE(uploads.HasFile("/a"));
+  EXPECT_FALSE(uploads.Take("/a", &upload));
+}
+
+TEST(StreamUploadsTest, Invalidate) {
+  StreamUploads uploads(kPartSize);
+  EXPECT_TRUE(uploads.OnWrite("/a", 0, 250, 0));
+  Range range;
+  string uploadId;
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 1u);
+  // rewrite the part in flight
+  EXPECT_FALSE(uploads.OnWrite("/a", 50, 10, 250));
+  uploads.FinishPart("/a", true);
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 0u);
+  StreamedUpload upload;
+  EXPECT_TRUE(uploads.Take("/a", &upload));
+  EXPECT_FALSE(upload.m_valid);
+
+  // truncate into the uploaded part
+  EXPECT_TRUE(uploads.OnWrite("/b", 0, 150, 0));
+  EXPECT_EQ(uploads.PopPart("/b", &range, &uploadId), 1u);
+  uploads.FinishPart("/b", true);
+  EXPECT_EQ(uploads.PopPart("/b", &range, &uploadId), 0u);
+  uploads.OnTruncate("/b", 120);
+  EXPECT_FALSE(uploads.OnWrite("/b", 150, 100, 120));  // a hole
+  uploads.OnTruncate("/b", 50);
+  EXPECT_TRUE(uploads.Take("/b", &upload));
+  EXPECT_FALSE(upload.m_valid);
+
+  // failed part
+  EXPECT_TRUE(uploads.OnWrite("/c", 0, 150, 0));
+  EXPECT_EQ(uploads.PopPart("/c", &range, &uploadId), 1u);
+  uploads.FinishPart("/c", false);
+  EXPECT_EQ(uploads.PopPart("/c", &range, &uploadId), 0u);
+  EXPECT_TRUE(uploads.Take("/c", &upload));
+  EXPECT_FALSE(upload.m_valid);
+  EXPECT_EQ(upload.m_size, 0u);
+}
+
+TEST(StreamUploadsTest, Take) {
+  StreamUploads uploads(kPartSize);
+  EXPECT_TRUE(uploads.OnWrite("/a", 0, 300, 0));
+  Range range;
+  string uploadId;
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 1u);
+
+  StreamedUpload upload;
+  bool done = false;
+  boost::thread closer(boost::bind(TakeAndFlag, &uploads, &upload, &done));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  EXPECT_FALSE(done);  // wait for the part in flight
+  uploads.FinishPart("/a", true);
+  // no more part is popped once the file is being taken
+  EXPECT_EQ(uploads.PopPart("/a", &range, &uploadId), 0u);
+  closer.join();
+  EXPECT_TRUE(done);
+  EXPECT_TRUE(upload.m_valid);
+  EXPECT_EQ(upload.m_size, kPartSize);
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
@@ -0,0 +1,117 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "base/Logging.h"
+#include "base/Utils.h"
+#include "base/UtilsWithLog.h"
+#include "configure/Options.h"
+#include "data/WarmUpManifest.h"
+
+namespace QS {
+
+namespace Data {
+
+using QS::UtilsWithLog::RemoveFileIfExists;
+using std::ofstream;
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+// default log dir
+static const char *defaultLogDir = "/tmp/qsfs.test.logs/";
+void InitLog() {
+  QS::Utils::CreateDirectoryIfNotExists(defaultLogDir);
+  QS::Logging::Log::Instance().Initialize(defaultLogDir);
+}
+
+class WarmUpManifestTest : public Test {
+ protected:
+  static void SetUpTestCase() { InitLog(); }
+
+  void SetUp() {
+    string diskdir = QS::Configure::Options::Instance().GetDiskCacheDirectory();
+    QS::Utils::CreateDirectoryIfNotExists(diskdir);
+    m_manifestFile = diskdir + "test_warm_up_manifest";
+    RemoveFileIfExists(m_manifestFile);
+  }
+
+  void TearDown() { RemoveFileIfExists(m_manifestFile); }
+
+  string m_manifestFile;
+};
+
+TEST_F(WarmUpManifestTest, ParseLine) {
+  WarmUpEntry entry;
+  EXPECT_TRUE(WarmUpManifest::ParseLine("/file1", &entry));
+  EXPECT_EQ(entry.m_path, "/file1");
+  EXPECT_EQ(entry.m_priority, 0);
+  EXPECT_FALSE(entry.m_pin);
+  EXPECT_FALSE(entry.IsPrefix());
+
+  EXPECT_TRUE(WarmUpManifest::ParseLine("  pin\t-3  /dir 1/ \r", &entry));
+  EXPECT_EQ(entry.m_path, "/dir 1/");
+  EXPECT_EQ(entry.m_priority, -3);
+  EXPECT_TRUE(entry.m_pin);
+  EXPECT_TRUE(entry.IsPrefix());
+
+  EXPECT_TRUE(WarmUpManifest::ParseLine("10 pin /file2", &entry));
+  EXPECT_EQ(entry.m_priority, 10);
+  EXPECT_TRUE(entry.m_pin);
+
+  EXPECT_FALSE(WarmUpManifest::ParseLine("", &entry));
+  EXPECT_FALSE(WarmUpManifest::ParseLine("  # comment", &entry));
+  EXPECT_FALSE(WarmUpManifest::ParseLine("pin 10", &entry));  // no path
+  EXPECT_FALSE(WarmUpManifest::ParseLine("file3", &entry));   // relative
+  EXPECT_FALSE(WarmUpManifest::ParseLine("1 2 /file4", &entry));
+  EXPECT_FALSE(WarmUpManifest::ParseLine("keep /file5", &entry));
+}
+
+TEST_F(WarmUpManifestTest, Load) {
+  WarmUpManifest manifest;
+  EXPECT_FALSE(manifest.Load(m_manifestFile));  // not exists
+  {
+    ofstream file(m_manifestFile.c_str());
+    file << "# warm up\n"
+         << "/low\n"
+         << "pin 10 /models/\n"
+         << "invalid line\n"
+         << "\n"
+         << "5 /data/\n"
+         << "pin 10 /config\n";
+  }
+  ASSERT_TRUE(manifest.Load(m_manifestFile));
+  const vector<WarmUpEntry> &entries = manifest.GetEntries();
+  ASSERT_EQ(manifest.Size(), 4u);
+  EXPECT_EQ(entries[0].m_path, "/models/");
+  EXPECT_EQ(entries[1].m_path, "/config");
+  EXPECT_EQ(entries[2].m_path, "/data/");
+  EXPECT_EQ(entries[3].m_path, "/low");
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}
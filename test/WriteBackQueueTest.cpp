@@ -0,0 +1,171 @@
+// +-------------------------------------------------------------------------
+// | Copyright (C) 2017 Yunify, Inc.
+// +-------------------------------------------------------------------------
+// | Licensed under the Apache License, Version 2.0 (the "License");
+// | You may not use this work except in compliance with the License.
+// | You may obtain a copy of the License in the LICENSE file, or at:
+// |
+// | http://www.apache.org/licenses/LICENSE-2.0
+// |
+// | Unless required by applicable law or agreed to in writing, software
+// | distributed under the License is distributed on an "AS IS" BASIS,
+// | WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// | See the License for the specific language governing permissions and
+// | limitations under the License.
+// +-------------------------------------------------------------------------
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "boost/bind.hpp"
+#include "boost/thread/thread.hpp"
+
+#include "data/WriteBackQueue.h"
+
+namespace QS {
+
+namespace Data {
+
+using std::string;
+using std::vector;
+using ::testing::Test;
+
+namespace {
+
+const time_t kExpire = 30;
+
+// --------------------------------------------------------------------------
+void WaitAndFlag(WriteBackQueue *queue, bool *done) {
+  queue->WaitForSpace();
+  *done = true;
+}
+
+// --------------------------------------------------------------------------
+void HoldAndFlag(WriteBackQueue *queue, bool *done) {
+  queue->Hold("/a");
+  *done = true;
+}
+
+}  // namespace
+
+TEST(WriteBackQueueTest, MarkDirty) {
+  WriteBackQueue queue(0, 0, 0, kExpire);
+  queue.MarkDirty("/a", 10, 0);
+  queue.MarkDirty("/b", 0, 0);  // truncated
+  queue.MarkDirty("/a", 20, 5);
+  EXPECT_TRUE(queue.HasFile("/a"));
+  EXPECT_TRUE(queue.HasFile("/b"));
+  EXPECT_EQ(queue.GetNumFiles(), 2u);
+  EXPECT_EQ(queue.GetDirtySize(), 20u);
+
+  queue.Rename("/a", "/c");
+  EXPECT_FALSE(queue.HasFile("/a"));
+  EXPECT_TRUE(queue.HasFile("/c"));
+  queue.Erase("/c");
+  EXPECT_EQ(queue.GetDirtySize(), 0u);
+  EXPECT_EQ(queue.GetNumFiles(), 1u);
+}
+
+TEST(WriteBackQueueTest, Expire) {
+  WriteBackQueue queue(0, 0, 0, kExpire);
+  queue.MarkDirty("/a", 10, 10);
+  queue.MarkDirty("/b", 10, 0);
+  EXPECT_TRUE(queue.PopFilesToFlush(kExpire - 1).empty());
+
+  vector<string> files = queue.PopFilesToFlush(kExpire + 10);
+  ASSERT_EQ(files.size(), 2u);
+  EXPECT_EQ(files[0], "/b");  // oldest first
+  EXPECT_EQ(files[1], "/a");
+  // files in flushing are not popped again
+  EXPECT_TRUE(queue.PopFilesToFlush(kExpire * 10).empty());
+
+  EXPECT_TRUE(queue.FinishFlush("/b", 0, kExpire + 20));
+  EXPECT_FALSE(queue.HasFile("/b"));
+  // written during the upload
+  queue.MarkDirty("/a", 10, kExpire + 20);
+  EXPECT_FALSE(queue.FinishFlush("/a", 0, kExpire + 20));
+  EXPECT_TRUE(queue.PopFilesToFlush(kExpire + 30).empty());
+
+  queue.Expedite("/a");
+  EXPECT_EQ(queue.PopFilesToFlush(kExpire + 30), vector<string>(1, "/a"));
+}
+
+TEST(WriteBackQueueTest, Watermarks) {
+  WriteBackQueue queue(10, 30, 60, kExpire);
+  queue.MarkDirty("/a", 10, 1);
+  queue.MarkDirty("/b", 10, 2);
+  queue.MarkDirty("/c", 5, 3);
+  EXPECT_TRUE(queue.PopFilesToFlush(4).empty());
+
+  queue.MarkDirty("/d", 5, 4);
+  // pop the oldest until the rest are under the low watermark
+  vector<string> files = queue.PopFilesToFlush(4);
+  ASSERT_EQ(files.size(), 2u);
+  EXPECT_EQ(files[0], "/a");
+  EXPECT_EQ(files[1], "/b");
+  // in flushing bytes are not counted
+  EXPECT_TRUE(queue.PopFilesToFlush(4).empty());
+
+  EXPECT_FALSE(queue.FinishFlush("/a", 10, 5));  // upload failed
+  EXPECT_TRUE(queue.FinishFlush("/b", 0, 5));
+  EXPECT_EQ(queue.GetDirtySize(), 20u);
+  vector<string> rest = queue.PopAllFiles();
+  EXPECT_EQ(rest.size(), 3u);
+}
+
+TEST(WriteBackQueueTest, HardLimit) {
+  WriteBackQueue queue(10, 20, 40, kExpire);
+  queue.MarkDirty("/a", 40, 0);
+  bool done = false;
+  boost::thread writer(boost::bind(WaitAndFlag, &queue, &done));
+  EXPECT_TRUE(queue.WaitForFlush(1000));
+  EXPECT_EQ(queue.PopFilesToFlush(0), vector<string>(1, "/a"));
+  queue.FinishFlush("/a", 0, 1);
+  writer.join();
+  EXPECT_TRUE(done);
+
+  queue.MarkDirty("/b", 40, 0);
+  queue.Stop();
+  EXPECT_FALSE(queue.WaitForSpace());
+  EXPECT_FALSE(queue.WaitForFlush(1000));
+}
+
+TEST(WriteBackQueueTest, Hold) {
+  WriteBackQueue queue(0, 0, 0, kExpire);
+  queue.MarkDirty("/a", 10, 0);
+  EXPECT_EQ(queue.PopFilesToFlush(kExpire), vector<string>(1, "/a"));
+
+  // wait for the upload in flight
+  bool done = false;
+  boost::thread renamer(boost::bind(HoldAndFlag, &queue, &done));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  EXPECT_FALSE(done);
+  EXPECT_FALSE(queue.FinishFlush("/a", 10, kExpire));  // upload failed
+  renamer.join();
+  EXPECT_TRUE(done);
+
+  // held files are not flushed
+  queue.Expedite("/a");
+  EXPECT_TRUE(queue.PopFilesToFlush(kExpire * 10).empty());
+  EXPECT_TRUE(queue.PopAllFiles().empty());
+  queue.Unhold("/a");
+  EXPECT_EQ(queue.PopAllFiles(), vector<string>(1, "/a"));
+  queue.FinishFlush("/a", 10, kExpire);
+
+  // released by rename
+  queue.Hold("/a");
+  queue.Rename("/a", "/b");
+  EXPECT_EQ(queue.GetFilePaths(), vector<string>(1, "/b"));
+  EXPECT_EQ(queue.PopAllFiles(), vector<string>(1, "/b"));
+}
+
+}  // namespace Data
+}  // namespace QS
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  int code = RUN_ALL_TESTS();
+  return code;
+}